@@ -15,6 +15,7 @@
 #include "DisplayWindow.h"
 #include "../Helper/Helper.h"
 #include "../Helper/ShellHelper.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/WindowHelper.h"
 #include "../Helper/Macros.h"
 
@@ -131,24 +132,25 @@ void CDisplayWindow::DrawThumbnail(HDC hdcMem)
 	}
 }
 
-DWORD WINAPI Thread_ExtractThumbnailImage(LPVOID lpParameter)
+void ExtractThumbnailImageJob(LPVOID pParam,const CCancellationToken *pToken)
 {
-	CDisplayWindow *pdw = NULL;
+	UNREFERENCED_PARAMETER(pToken);
 
-	pdw = (CDisplayWindow *)((ThumbnailEntry_t *)lpParameter)->pdw;
+	CDisplayWindow *pdw = NULL;
 
-	CoInitializeEx(0,COINIT_APARTMENTTHREADED);
+	pdw = (CDisplayWindow *)((ThumbnailEntry_t *)pParam)->pdw;
 
-	SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_BELOW_NORMAL);
+	/* Reading the image waits for anything
+	more urgent on the same disk. */
+	if(!CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE))
+	{
+		return;
+	}
 
-	pdw->ExtractThumbnailImageInternal((ThumbnailEntry_t *)lpParameter);
+	pdw->ExtractThumbnailImageInternal((ThumbnailEntry_t *)pParam);
 
 	/* TODO: Erase the item. */
 	//g_ThumbnailEntries.erase();
-
-	CoUninitialize();
-
-	return 0;
 }
 
 void CDisplayWindow::ExtractThumbnailImage(void)
@@ -159,9 +161,8 @@ void CDisplayWindow::ExtractThumbnailImage(void)
 	te.bCancelled	= FALSE;
 	g_ThumbnailEntries.push_back(te);
 
-	HANDLE hThread = CreateThread(NULL,0,Thread_ExtractThumbnailImage,
-		(LPVOID)&g_ThumbnailEntries.back(),0,NULL);
-	CloseHandle(hThread);
+	CThreadPool::GetInstance().QueueJob(ExtractThumbnailImageJob,
+		(LPVOID)&g_ThumbnailEntries.back(),THREAD_POOL_PRIORITY_LOW,m_ImageFile);
 }
 
 void CDisplayWindow::ExtractThumbnailImageInternal(ThumbnailEntry_t *pte)
@@ -32,12 +32,9 @@ m_hContainer(hwnd)
 
 	/* Initial state. */
 	m_nSelected						= 0;
-	m_nSelectedOnInvert				= 0;
 	m_iObjectIndex					= 0;
 	m_iMaxArrangeMenuItem			= 0;
-	m_bCountingUp					= FALSE;
 	m_bCountingDown					= FALSE;
-	m_bInverted						= FALSE;
 	m_bSelectionFromNowhere			= FALSE;
 	m_bSelectingTreeViewDirectory	= FALSE;
 	m_bTreeViewRightClick			= FALSE;
@@ -199,6 +196,19 @@ void Explorerplusplus::SetDefaultValues(void)
 	m_bCheckBoxSelection			= FALSE;
 	m_bForceSize					= FALSE;
 	m_SizeDisplayFormat				= SIZE_FORMAT_BYTES;
+	m_FolderSizeMode				= FOLDER_SIZE_MODE_LOGICAL;
+
+	for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+	{
+		int nMaxJobsPerDevice;
+		ULONGLONG ulMaxBytesPerSecond;
+		CThreadPool::GetDefaultDeviceClassLimits(static_cast<DeviceClass_t>(i),
+			&nMaxJobsPerDevice,&ulMaxBytesPerSecond);
+
+		m_dwMaxJobsPerDevice[i] = nMaxJobsPerDevice;
+		m_dwBackgroundBandwidth[i] = static_cast<DWORD>(ulMaxBytesPerSecond / 1024);
+	}
+
 	m_bSynchronizeTreeview			= TRUE;
 	m_bTVAutoExpandSelected			= FALSE;
 	m_bCloseMainWindowOnTabClose	= TRUE;
@@ -19,6 +19,9 @@
 #include "../Helper/Bookmark.h"
 #include "../Helper/DropHandler.h"
 #include "../Helper/CustomMenu.h"
+#include "../Helper/ColorRuleSet.h"
+#include "../Helper/FolderSize.h"
+#include "../Helper/ThreadPool.h"
 #import <msxml3.dll> raw_interfaces_only
 
 #define MENU_BOOKMARK_STARTID		10000
@@ -46,6 +49,7 @@ class Explorerplusplus : public IExplorerplusplus, public IFileContextMenuExtern
 	friend LRESULT CALLBACK WndProcStub(HWND hwnd,UINT Msg,WPARAM wParam,LPARAM lParam);
 
 	friend void FolderSizeCallbackStub(int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,LPVOID pData);
+	friend void FolderSizeProgressStub(int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,LPVOID pData);
 
 public:
 
@@ -203,6 +207,10 @@ private:
 		ULARGE_INTEGER	liFolderSize;
 		int				uId;
 		int				iTabId;
+
+		/* FALSE for the running totals sent while
+		the folder is still being walked. */
+		BOOL			bComplete;
 	};
 
 	struct DWFolderSize_t
@@ -210,6 +218,10 @@ private:
 		int	uId;
 		int	iTabId;
 		BOOL bValid;
+
+		/* Shared with the thread doing the calculation.
+		Cancelled once the result is no longer needed. */
+		CCancellationToken *pToken;
 	};
 
 	struct FolderSizeExtraInfo_t
@@ -393,6 +405,7 @@ private:
 	void					OnNdwRClick(POINT *pt);
 	void					OnNdwIconRClick(POINT *pt);
 	LRESULT					OnCustomDraw(LPARAM lParam);
+	void					UpdateColorRuleSet(void);
 	void					OnSortBy(UINT uSortMode);
 	void					OnGroupBy(UINT uSortMode);
 	void					OnSelectTab(int iTab);
@@ -778,6 +791,7 @@ private:
 	void					InitializeMenus(void);
 	void					SetGoMenuName(HMENU hMenu,UINT uMenuID,UINT csidl);
 	int						CreateDriveFreeSpaceString(const TCHAR *szPath, TCHAR *szBuffer, int nBuffer);
+	void					CreateFolderSizeString(ULARGE_INTEGER liFolderSize, BOOL bComplete, TCHAR *szBuffer, int nBuffer);
 	BOOL					AnyItemsSelected(void);
 	void					ShowMainRebarBand(HWND hwnd,BOOL bShow);
 	BOOL					OnMouseWheel(MousewheelSource_t MousewheelSource,WPARAM wParam,LPARAM lParam);
@@ -788,7 +802,7 @@ private:
 	CStatusBar				*GetStatusBar();
 	UINT					GetDefaultSortMode(LPCITEMIDLIST pidlDirectory);
 	unsigned int			DetermineColumnSortMode(UINT uColumnId);
-	void					FolderSizeCallback(FolderSizeExtraInfo_t *pfsei,int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize);
+	void					FolderSizeCallback(FolderSizeExtraInfo_t *pfsei,int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,BOOL bComplete);
 
 
 
@@ -818,7 +832,6 @@ private:
 	CStatusBar *			m_pStatusBar;
 	HANDLE					m_hIconThread;
 	HANDLE					m_hTreeViewIconThread;
-	HANDLE					m_hFolderSizeThread;
 
 	HMODULE					m_hLanguageModule;
 
@@ -914,6 +927,12 @@ private:
 	BOOL					m_bLargeToolbarIcons;
 	BOOL					m_bPlayNavigationSound;
 	SizeDisplayFormat_t		m_SizeDisplayFormat;
+	FolderSizeMode_t		m_FolderSizeMode;
+
+	/* Thread pool limits (user options), indexed
+	by DeviceClass_t. Bandwidth is in KB/s. */
+	DWORD					m_dwMaxJobsPerDevice[NUM_DEVICE_CLASSES];
+	DWORD					m_dwBackgroundBandwidth[NUM_DEVICE_CLASSES];
 	StartupMode_t			m_StartupMode;
 	NDefaultFileManager::ReplaceExplorerModes_t	m_ReplaceExplorerMode;
 
@@ -954,6 +973,7 @@ private:
 
 	/* Customize colors. */
 	std::vector<NColorRuleHelper::ColorRule_t>	m_ColorRules;
+	CColorRuleSet			m_ColorRuleSet;
 
 	/* Undo support. */
 	CFileActionHandler		m_FileActionHandler;
@@ -989,12 +1009,9 @@ private:
 	std::list<Column_t>		m_MyNetworkPlacesColumnList;
 
 	/* ListView selection. */
-	BOOL					m_bCountingUp;
 	BOOL					m_bCountingDown;
-	BOOL					m_bInverted;
 	BOOL					m_bSelectionFromNowhere;
 	int						m_nSelected;
-	int						m_nSelectedOnInvert;
 	int						m_ListViewMButtonItem;
 
 	/* Copy/cut. */
@@ -19,6 +19,17 @@ namespace NExplorerplusplus
 
 	const TCHAR LOG_FILENAME[]		= _T("Explorer++.log");
 
+	/* The names the thread pool's limits are saved under,
+	indexed by DeviceClass_t. Bandwidth is in KB/s, with 0
+	leaving background jobs unthrottled. */
+	const TCHAR * const MAX_JOBS_PER_DEVICE_SETTINGS[] =
+	{_T("MaxJobsPerSolidStateDevice"),_T("MaxJobsPerRotationalDevice"),
+	_T("MaxJobsPerRemovableDevice"),_T("MaxJobsPerNetworkDevice")};
+
+	const TCHAR * const BACKGROUND_BANDWIDTH_SETTINGS[] =
+	{_T("BackgroundBandwidthSolidState"),_T("BackgroundBandwidthRotational"),
+	_T("BackgroundBandwidthRemovable"),_T("BackgroundBandwidthNetwork")};
+
 	/* Command line arguments supplied to the program
 	for each jump list task. */
 	const TCHAR JUMPLIST_TASK_NEWTAB_ARGUMENT[]	= _T("-open_new_tab");
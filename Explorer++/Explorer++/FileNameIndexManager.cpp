@@ -0,0 +1,304 @@
+/******************************************************************
+ *
+ * Project: Explorer++
+ * File: FileNameIndexManager.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Loads, builds and maintains the file name index
+ * for each volume that's searched.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "FileNameIndexManager.h"
+#include "../Helper/ThreadPool.h"
+#include "../Helper/Macros.h"
+
+
+namespace
+{
+	/* Passed to the directory monitor, which
+	takes ownership of (and frees) it. */
+	struct IndexChange_t
+	{
+		CFileNameIndex	*pIndex;
+		volatile LONG	*plUnsaved;
+	};
+
+	void FileNameIndexChanged(const TCHAR *szFileName,DWORD dwAction,void *pData)
+	{
+		IndexChange_t *pIndexChange = reinterpret_cast<IndexChange_t *>(pData);
+
+		pIndexChange->pIndex->ApplyChange(szFileName,dwAction);
+		InterlockedExchange(pIndexChange->plUnsaved,1);
+	}
+}
+
+const TCHAR CFileNameIndexManager::INDEX_DIRECTORY[] = _T("Explorer++\\Index");
+
+CFileNameIndexManager::CFileNameIndexManager() :
+m_lStop(0)
+{
+	InitializeCriticalSection(&m_cs);
+	CreateDirectoryMonitor(&m_pDirMon);
+
+	/* Indices are built on the pool, so it has to
+	outlive this object. Statics are destroyed in the
+	reverse order to which they're constructed, so
+	it's constructed first. */
+	CThreadPool::GetInstance();
+}
+
+CFileNameIndexManager::~CFileNameIndexManager()
+{
+	InterlockedExchange(&m_lStop,1);
+
+	for(auto itr = m_Indices.begin();itr != m_Indices.end();itr++)
+	{
+		(*itr)->pToken->Cancel();
+		WaitForSingleObject((*itr)->hDone,INFINITE);
+		CloseHandle((*itr)->hDone);
+		(*itr)->pToken->Release();
+
+		if((*itr)->iDirMonitorId != -1)
+		{
+			m_pDirMon->StopDirectoryMonitor((*itr)->iDirMonitorId);
+		}
+	}
+
+	/* The monitor waits for its worker thread to
+	exit, so no further changes will be reported
+	once it's been released. */
+	m_pDirMon->Release();
+
+	for(auto itr = m_Indices.begin();itr != m_Indices.end();itr++)
+	{
+		/* Any changes made since the index was loaded
+		or built are kept for next time. */
+		if((*itr)->lReady != 0 && (*itr)->lUnsaved != 0 &&
+			!(*itr)->strIndexFile.empty())
+		{
+			(*itr)->pIndex->Save((*itr)->strIndexFile.c_str());
+		}
+
+		delete (*itr)->pIndex;
+		delete *itr;
+	}
+
+	DeleteCriticalSection(&m_cs);
+}
+
+CFileNameIndexManager &CFileNameIndexManager::GetInstance()
+{
+	static CFileNameIndexManager fnim;
+	return fnim;
+}
+
+CFileNameIndex *CFileNameIndexManager::GetIndex(const TCHAR *szDirectory)
+{
+	TCHAR szRoot[MAX_PATH];
+	BOOL bRet = GetVolumePathName(szDirectory,szRoot,SIZEOF_ARRAY(szRoot));
+
+	/* Walking a network or removable drive would
+	take too long (and the index would quickly
+	go out of date), so only fixed volumes are
+	indexed. */
+	if(!bRet || GetDriveType(szRoot) != DRIVE_FIXED)
+	{
+		return NULL;
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	for(auto itr = m_Indices.begin();itr != m_Indices.end();itr++)
+	{
+		if(lstrcmpi((*itr)->strRoot.c_str(),szRoot) == 0)
+		{
+			CFileNameIndex *pIndex = ((*itr)->lReady != 0) ? (*itr)->pIndex : NULL;
+
+			LeaveCriticalSection(&m_cs);
+
+			return pIndex;
+		}
+	}
+
+	IndexInfo_t *pIndexInfo = new IndexInfo_t;
+	pIndexInfo->pManager = this;
+	pIndexInfo->pIndex = new CFileNameIndex;
+	pIndexInfo->strRoot = szRoot;
+	pIndexInfo->iDirMonitorId = -1;
+	pIndexInfo->pToken = new CCancellationToken;
+	pIndexInfo->hDone = CreateEvent(NULL,TRUE,FALSE,NULL);
+	pIndexInfo->lReady = 0;
+	pIndexInfo->lUnsaved = 0;
+
+	/* The index is loaded and built in the background,
+	behind anything the user is waiting on. */
+	if(pIndexInfo->hDone == NULL ||
+		!CThreadPool::GetInstance().QueueJob(FileNameIndexJob,reinterpret_cast<LPVOID>(pIndexInfo),
+		THREAD_POOL_PRIORITY_LOW,szRoot,pIndexInfo->pToken))
+	{
+		if(pIndexInfo->hDone != NULL)
+		{
+			CloseHandle(pIndexInfo->hDone);
+		}
+
+		pIndexInfo->pToken->Release();
+		delete pIndexInfo->pIndex;
+		delete pIndexInfo;
+	}
+	else
+	{
+		m_Indices.push_back(pIndexInfo);
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return NULL;
+}
+
+void FileNameIndexJob(LPVOID pParam,const CCancellationToken *pToken)
+{
+	assert(pParam != NULL);
+
+	CFileNameIndexManager::IndexInfo_t *pIndexInfo =
+		reinterpret_cast<CFileNameIndexManager::IndexInfo_t *>(pParam);
+
+	if(!pToken->IsCancelled())
+	{
+		pIndexInfo->pManager->LoadAndBuildIndex(pIndexInfo);
+	}
+
+	SetEvent(pIndexInfo->hDone);
+}
+
+void CFileNameIndexManager::LoadAndBuildIndex(IndexInfo_t *pIndexInfo)
+{
+	std::wstring strIndexFile;
+
+	if(GetIndexFileName(pIndexInfo->strRoot.c_str(),strIndexFile))
+	{
+		pIndexInfo->strIndexFile = strIndexFile;
+	}
+
+	BOOL bSaveIndex = !pIndexInfo->strIndexFile.empty();
+
+	/* A saved index may be out of date, but it can
+	still be searched while the index is rebuilt. */
+	BOOL bLoaded = bSaveIndex && pIndexInfo->pIndex->Load(strIndexFile.c_str()) &&
+		pIndexInfo->pIndex->IsDirectoryCovered(pIndexInfo->strRoot.c_str());
+
+	if(bLoaded)
+	{
+		InterlockedExchange(&pIndexInfo->lReady,1);
+	}
+
+	/* Changes are watched for before the build
+	starts, so that nothing is missed. Changes
+	reported during the build are applied once
+	it's finished. */
+	IndexChange_t *pIndexChange = reinterpret_cast<IndexChange_t *>(malloc(sizeof(IndexChange_t)));
+
+	if(pIndexChange != NULL)
+	{
+		pIndexChange->pIndex = pIndexInfo->pIndex;
+		pIndexChange->plUnsaved = &pIndexInfo->lUnsaved;
+
+		pIndexInfo->iDirMonitorId = m_pDirMon->WatchDirectory(pIndexInfo->strRoot.c_str(),
+			FILE_NOTIFY_CHANGE_FILE_NAME|FILE_NOTIFY_CHANGE_DIR_NAME|FILE_NOTIFY_CHANGE_ATTRIBUTES|
+			FILE_NOTIFY_CHANGE_SIZE|FILE_NOTIFY_CHANGE_LAST_WRITE,FileNameIndexChanged,
+			TRUE,reinterpret_cast<void *>(pIndexChange));
+	}
+
+	/* A recently saved index only misses whatever
+	changed while it wasn't being watched, so it's
+	used as it is. */
+	if(bLoaded && !IsIndexFileStale(strIndexFile))
+	{
+		return;
+	}
+
+	if(pIndexInfo->pIndex->Build(pIndexInfo->strRoot.c_str(),&m_lStop))
+	{
+		InterlockedExchange(&pIndexInfo->lReady,1);
+
+		if(bSaveIndex)
+		{
+			/* Cleared first, so that a change made
+			while saving is saved again later. */
+			InterlockedExchange(&pIndexInfo->lUnsaved,0);
+			pIndexInfo->pIndex->Save(strIndexFile.c_str());
+		}
+	}
+}
+
+BOOL CFileNameIndexManager::IsIndexFileStale(const std::wstring &strIndexFile)
+{
+	WIN32_FILE_ATTRIBUTE_DATA wfad;
+
+	if(!GetFileAttributesEx(strIndexFile.c_str(),GetFileExInfoStandard,&wfad))
+	{
+		return TRUE;
+	}
+
+	FILETIME ftNow;
+	GetSystemTimeAsFileTime(&ftNow);
+
+	ULARGE_INTEGER uliNow;
+	uliNow.LowPart = ftNow.dwLowDateTime;
+	uliNow.HighPart = ftNow.dwHighDateTime;
+
+	ULARGE_INTEGER uliSaved;
+	uliSaved.LowPart = wfad.ftLastWriteTime.dwLowDateTime;
+	uliSaved.HighPart = wfad.ftLastWriteTime.dwHighDateTime;
+
+	/* File times are in 100 nanosecond intervals. */
+	const ULONGLONG ulIntervalsPerMinute = 60ULL * 10000000ULL;
+
+	return uliNow.QuadPart < uliSaved.QuadPart ||
+		(uliNow.QuadPart - uliSaved.QuadPart) / ulIntervalsPerMinute >= MAX_INDEX_AGE;
+}
+
+/* Indices are saved under the local application data
+folder, and named after the serial number of the
+volume they cover. */
+BOOL CFileNameIndexManager::GetIndexFileName(const TCHAR *szRoot,std::wstring &strIndexFile)
+{
+	DWORD dwSerialNumber;
+	BOOL bRet = GetVolumeInformation(szRoot,NULL,0,&dwSerialNumber,NULL,NULL,NULL,0);
+
+	if(!bRet)
+	{
+		return FALSE;
+	}
+
+	TCHAR szIndexDirectory[MAX_PATH];
+	HRESULT hr = SHGetFolderPath(NULL,CSIDL_LOCAL_APPDATA,NULL,SHGFP_TYPE_CURRENT,szIndexDirectory);
+
+	if(FAILED(hr) || !PathAppend(szIndexDirectory,INDEX_DIRECTORY))
+	{
+		return FALSE;
+	}
+
+	int iRet = SHCreateDirectoryEx(NULL,szIndexDirectory,NULL);
+
+	if(iRet != ERROR_SUCCESS && iRet != ERROR_ALREADY_EXISTS)
+	{
+		return FALSE;
+	}
+
+	TCHAR szFileName[32];
+	StringCchPrintf(szFileName,SIZEOF_ARRAY(szFileName),_T("%08X.idx"),dwSerialNumber);
+
+	if(!PathAppend(szIndexDirectory,szFileName))
+	{
+		return FALSE;
+	}
+
+	strIndexFile = szIndexDirectory;
+
+	return TRUE;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include "../Helper/FileNameIndex.h"
+#include "../Helper/CancellationToken.h"
+#include "../Helper/iDirectoryMonitor.h"
+#include "../Helper/Macros.h"
+
+/* Keeps a file name index for each fixed volume that's
+been searched with indexing enabled.
+
+The first time an index is asked for, the previously
+saved copy (if any) is loaded, so that it can be used
+straight away. If the saved copy is missing or stale, the
+index is then rebuilt as a background job on the thread
+pool, and saved again once that's finished. From then on,
+it's kept up to date by watching the volume for changes,
+and saved on shutdown if anything has changed. */
+class CFileNameIndexManager
+{
+	friend void	FileNameIndexJob(LPVOID pParam,const CCancellationToken *pToken);
+
+public:
+
+	~CFileNameIndexManager();
+
+	/* The instance is created during startup, on the
+	main thread, as the XP toolsets don't initialize
+	local statics in a thread-safe way. After that,
+	it can be used from any thread. */
+	static CFileNameIndexManager &GetInstance();
+
+	/* Returns the index for the volume containing
+	szDirectory, if it's ready to be searched. If it
+	isn't, NULL is returned (and the index is loaded
+	or built in the background, if that hasn't been
+	started already). */
+	CFileNameIndex		*GetIndex(const TCHAR *szDirectory);
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CFileNameIndexManager);
+
+	static const TCHAR	INDEX_DIRECTORY[];
+
+	/* A saved index that's older than this (in
+	minutes) is rebuilt once it's been loaded. */
+	static const int	MAX_INDEX_AGE = 24 * 60;
+
+	struct IndexInfo_t
+	{
+		CFileNameIndexManager	*pManager;
+		CFileNameIndex			*pIndex;
+		std::wstring			strRoot;
+		int						iDirMonitorId;
+
+		/* Empty if the index can't be saved. */
+		std::wstring			strIndexFile;
+
+		/* Shared with the job. hDone is set once
+		the job has finished. */
+		CCancellationToken		*pToken;
+		HANDLE					hDone;
+
+		/* Set once the index can be searched. */
+		volatile LONG			lReady;
+
+		/* Set when the index has changed
+		since it was last saved. */
+		volatile LONG			lUnsaved;
+	};
+
+	CFileNameIndexManager();
+
+	void				LoadAndBuildIndex(IndexInfo_t *pIndexInfo);
+	static BOOL			IsIndexFileStale(const std::wstring &strIndexFile);
+	BOOL				GetIndexFileName(const TCHAR *szRoot,std::wstring &strIndexFile);
+
+	CRITICAL_SECTION	m_cs;
+	std::list<IndexInfo_t *>	m_Indices;
+
+	IDirectoryMonitor	*m_pDirMon;
+
+	/* Set on shutdown, to abandon any
+	builds still in progress. */
+	volatile LONG		m_lStop;
+};
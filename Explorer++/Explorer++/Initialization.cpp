@@ -18,10 +18,12 @@
 #include "MainImages.h"
 #include "CustomizeColorsDialog.h"
 #include "BookmarkHelper.h"
+#include "FileNameIndexManager.h"
 #include "../DisplayWindow/DisplayWindow.h"
 #include "../Helper/FileOperations.h"
 #include "../Helper/Helper.h"
 #include "../Helper/Controls.h"
+#include "../Helper/FolderSizeCache.h"
 #include "../Helper/Macros.h"
 #include "MainResource.h"
 
@@ -93,7 +95,21 @@ void Explorerplusplus::OnCreate(void)
 
 	m_hIconThread = CreateWorkerThread();
 	m_hTreeViewIconThread = CreateWorkerThread();
-	m_hFolderSizeThread = CreateWorkerThread();
+
+	/* The folder size cache is shared between threads,
+	so it's created here, before any of them can use it. */
+	CFolderSizeCache::GetInstance().SetSizeMode(m_FolderSizeMode);
+
+	/* Likewise for the thread pool. */
+	for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+	{
+		CThreadPool::GetInstance().SetDeviceClassLimits(static_cast<DeviceClass_t>(i),
+			static_cast<int>(m_dwMaxJobsPerDevice[i]),static_cast<ULONGLONG>(m_dwBackgroundBandwidth[i]) * 1024);
+	}
+
+	/* And for the file name indices, which are
+	looked up from searches running on the pool. */
+	CFileNameIndexManager::GetInstance();
 
 	/* These need to occur after the language module
 	has been initialized, but before the tabs are
@@ -526,8 +526,7 @@ LRESULT Explorerplusplus::OnListViewKeyDown(LPARAM lParam)
 				!IsKeyDown(VK_SHIFT) &&
 				!IsKeyDown(VK_MENU))
 			{
-				m_bCountingUp = TRUE;
-				NListView::ListView_SelectAllItems(m_hActiveListView,TRUE);
+				m_pActiveShellBrowser->SelectAllItems(TRUE);
 				SetFocus(m_hActiveListView);
 			}
 			break;
@@ -546,9 +545,7 @@ LRESULT Explorerplusplus::OnListViewKeyDown(LPARAM lParam)
 				!IsKeyDown(VK_SHIFT) &&
 				!IsKeyDown(VK_MENU))
 			{
-				m_bInverted = TRUE;
-				m_nSelectedOnInvert = m_nSelected;
-				NListView::ListView_InvertSelection(m_hActiveListView);
+				m_pActiveShellBrowser->InvertSelection();
 				SetFocus(m_hActiveListView);
 			}
 			break;
@@ -633,7 +630,8 @@ void Explorerplusplus::OnListViewItemChanged(LPARAM lParam)
 	/* The selection for this tab has changed, so invalidate any
 	folder size calculations that are occurring for this tab
 	(applies only to folder sizes that will be shown in the display
-	window). */
+	window). There's no point continuing with them, so they're
+	cancelled as well. */
 	std::list<DWFolderSize_t>::iterator itr;
 
 	for(itr = m_DWFolderSizes.begin();itr != m_DWFolderSizes.end();itr++)
@@ -641,6 +639,7 @@ void Explorerplusplus::OnListViewItemChanged(LPARAM lParam)
 		if(itr->iTabId == iObjectIndex)
 		{
 			itr->bValid = FALSE;
+			itr->pToken->Cancel();
 		}
 	}
 
@@ -652,9 +651,6 @@ void Explorerplusplus::OnListViewItemChanged(LPARAM lParam)
 		if(Selected)
 		{
 			m_nSelected++;
-
-			if(m_nSelected == ListView_GetItemCount(m_hActiveListView))
-				m_bCountingUp = FALSE;
 		}
 		else
 		{
@@ -668,10 +664,10 @@ void Explorerplusplus::OnListViewItemChanged(LPARAM lParam)
 	m_pShellBrowser[iObjectIndex]->UpdateFileSelectionInfo(
 	(int)ItemChanged->lParam,Selected);
 
-	if((ListView_GetItemCount(m_hActiveListView) - m_nSelected) == m_nSelectedOnInvert)
-		m_bInverted = FALSE;
-
-	if(m_bCountingUp || m_bCountingDown || m_bInverted)
+	/* Bulk selection changes are reported once,
+	when the whole batch has been applied. */
+	if(m_bCountingDown ||
+		m_pShellBrowser[iObjectIndex]->IsSelectionBatchInProgress())
 		return;
 
 	UpdateDisplayWindow();
@@ -124,6 +124,8 @@ void Explorerplusplus::OnCustomizeColors()
 	CCustomizeColorsDialog CustomizeColorsDialog(m_hLanguageModule, IDD_CUSTOMIZECOLORS, m_hContainer, &m_ColorRules);
 	CustomizeColorsDialog.ShowModalDialog();
 
+	UpdateColorRuleSet();
+
 	/* Causes the active listview to redraw (therefore
 	applying any updated color schemes). */
 	InvalidateRect(m_hActiveListView, NULL, FALSE);
@@ -112,6 +112,15 @@ LRESULT CALLBACK Explorerplusplus::WindowProcedure(HWND hwnd,UINT Msg,WPARAM wPa
 		UpdateWindowStates();
 		break;
 
+	case WM_USER_SELECTIONCHANGED:
+		if((int)wParam == m_iObjectIndex)
+		{
+			UpdateDisplayWindow();
+			UpdateStatusBarText();
+			UpdateMainToolbar();
+		}
+		break;
+
 	case WM_USER_FILESADDED:
 		/* Runs in the context of the main thread. Either
 		occurs after the specified tab index has been
@@ -181,8 +190,8 @@ LRESULT CALLBACK Explorerplusplus::WindowProcedure(HWND hwnd,UINT Msg,WPARAM wPa
 	case WM_APP_FOLDERSIZECOMPLETED:
 		{
 			DWFolderSizeCompletion_t *pDWFolderSizeCompletion = NULL;
-			TCHAR szFolderSize[32];
-			TCHAR szSizeString[64];
+			TCHAR szFolderSize[64];
+			TCHAR szSizeString[128];
 			TCHAR szTotalSize[64];
 			BOOL bValid = FALSE;
 
@@ -203,7 +212,13 @@ LRESULT CALLBACK Explorerplusplus::WindowProcedure(HWND hwnd,UINT Msg,WPARAM wPa
 						bValid = itr->bValid;
 					}
 
-					m_DWFolderSizes.erase(itr);
+					/* Partial results are always followed
+					by the final one. */
+					if(pDWFolderSizeCompletion->bComplete)
+					{
+						itr->pToken->Release();
+						m_DWFolderSizes.erase(itr);
+					}
 
 					break;
 				}
@@ -211,8 +226,8 @@ LRESULT CALLBACK Explorerplusplus::WindowProcedure(HWND hwnd,UINT Msg,WPARAM wPa
 
 			if(bValid)
 			{
-				FormatSizeString(pDWFolderSizeCompletion->liFolderSize,szFolderSize,
-					SIZEOF_ARRAY(szFolderSize),m_bForceSize,m_SizeDisplayFormat);
+				CreateFolderSizeString(pDWFolderSizeCompletion->liFolderSize,
+					pDWFolderSizeCompletion->bComplete,szFolderSize,SIZEOF_ARRAY(szFolderSize));
 
 				LoadString(m_hLanguageModule,IDS_GENERAL_TOTALSIZE,
 					szTotalSize,SIZEOF_ARRAY(szTotalSize));
@@ -222,6 +237,14 @@ LRESULT CALLBACK Explorerplusplus::WindowProcedure(HWND hwnd,UINT Msg,WPARAM wPa
 
 				/* TODO: The line index should be stored in some other (variable) way. */
 				DisplayWindow_SetLine(m_hDisplayWindow,FOLDER_SIZE_LINE_INDEX,szSizeString);
+
+				/* The folder is the only item selected, so its
+				size is shown in the status bar as well. */
+				if(m_pActiveShellBrowser->QueryNumSelectedFolders() == 1 &&
+					m_pActiveShellBrowser->QueryNumSelectedFiles() == 0)
+				{
+					SendMessage(m_hStatusBar,SB_SETTEXT,(WPARAM)1|0,(LPARAM)szFolderSize);
+				}
 			}
 
 			free(pDWFolderSizeCompletion);
@@ -492,15 +515,12 @@ LRESULT CALLBACK Explorerplusplus::CommandHandler(HWND hwnd,WPARAM wParam)
 			break;
 
 		case IDM_EDIT_SELECTALL:
-			m_bCountingUp = TRUE;
-			NListView::ListView_SelectAllItems(m_hActiveListView,TRUE);
+			m_pActiveShellBrowser->SelectAllItems(TRUE);
 			SetFocus(m_hActiveListView);
 			break;
 
 		case IDM_EDIT_INVERTSELECTION:
-			m_bInverted = TRUE;
-			m_nSelectedOnInvert = m_nSelected;
-			NListView::ListView_InvertSelection(m_hActiveListView);
+			m_pActiveShellBrowser->InvertSelection();
 			SetFocus(m_hActiveListView);
 			break;
 
@@ -510,8 +530,7 @@ LRESULT CALLBACK Explorerplusplus::CommandHandler(HWND hwnd,WPARAM wParam)
 			break;
 
 		case IDM_EDIT_SELECTNONE:
-			m_bCountingDown = TRUE;
-			NListView::ListView_SelectAllItems(m_hActiveListView,FALSE);
+			m_pActiveShellBrowser->SelectAllItems(FALSE);
 			SetFocus(m_hActiveListView);
 			break;
 
@@ -17,8 +17,10 @@
 #include "MergeFilesDialog.h"
 #include "MainResource.h"
 #include "../Helper/Helper.h"
+#include "../Helper/BlockCopier.h"
 #include "../Helper/ListViewHelper.h"
 #include "../Helper/FileOperations.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
@@ -29,7 +31,7 @@ namespace NMergeFilesDialog
 	const int WM_APP_MERGINGFINISHED		= WM_APP + 3;
 	const int WM_APP_OUTPUTFILEINVALID		= WM_APP + 4;
 
-	DWORD WINAPI	MergeFilesThread(LPVOID pParam);
+	void			MergeFilesJob(LPVOID pParam,const CCancellationToken *pToken);
 }
 
 const TCHAR CMergeFilesDialogPersistentSettings::SETTINGS_KEY[] = _T("MergeFiles");
@@ -399,10 +401,25 @@ void CMergeFilesDialog::OnOk()
 
 		m_bMergingFiles = true;
 
-		HANDLE hThread = CreateThread(NULL,0,NMergeFilesDialog::MergeFilesThread,
-			reinterpret_cast<LPVOID>(m_pMergeFiles),0,NULL);
-		SetThreadPriority(hThread,THREAD_PRIORITY_LOWEST);
-		CloseHandle(hThread);
+		/* The job holds its own reference, as the dialog
+		may be closed before the job has run. */
+		m_pMergeFiles->AddRef();
+
+		if(!CThreadPool::GetInstance().QueueJob(NMergeFilesDialog::MergeFilesJob,
+			reinterpret_cast<LPVOID>(m_pMergeFiles),THREAD_POOL_PRIORITY_NORMAL,
+			szOutputFileName))
+		{
+			/* The pool is shutting down, so the merge will
+			never run. Both the job's reference and the
+			dialog's are released. */
+			m_pMergeFiles->Release();
+			m_pMergeFiles->Release();
+			m_pMergeFiles = NULL;
+
+			m_bMergingFiles = false;
+
+			SetDlgItemText(m_hDlg,IDOK,m_szOk);
+		}
 	}
 	else
 	{
@@ -495,14 +512,18 @@ void CMergeFilesDialog::OnFinished()
 	SetDlgItemText(m_hDlg,IDOK,m_szOk);
 }
 
-DWORD WINAPI NMergeFilesDialog::MergeFilesThread(LPVOID pParam)
+void NMergeFilesDialog::MergeFilesJob(LPVOID pParam,const CCancellationToken *pToken)
 {
 	assert(pParam != NULL);
 
 	CMergeFiles *pMergeFiles = reinterpret_cast<CMergeFiles *>(pParam);
-	pMergeFiles->StartMerging();
 
-	return 0;
+	if(!pToken->IsCancelled())
+	{
+		pMergeFiles->StartMerging();
+	}
+
+	pMergeFiles->Release();
 }
 
 CMergeFiles::CMergeFiles(HWND hDlg,std::wstring strOutputFilename,std::list<std::wstring> FullFilenameList)
@@ -511,21 +532,18 @@ CMergeFiles::CMergeFiles(HWND hDlg,std::wstring strOutputFilename,std::list<std:
 	m_strOutputFilename	= strOutputFilename;
 	m_FullFilenameList	= FullFilenameList;
 
-	m_bstopMerging		= false;
-
-	InitializeCriticalSection(&m_csStop);
+	m_pStopToken		= new CCancellationToken();
 }
 
 CMergeFiles::~CMergeFiles()
 {
-	DeleteCriticalSection(&m_csStop);
+	m_pStopToken->Release();
 }
 
 void CMergeFiles::StartMerging()
 {
 	LARGE_INTEGER lMergeFileSize;
 	int nFilesMerged = 1;
-	bool bStop = false;
 
 	HANDLE hOutputFile = CreateFile(m_strOutputFilename.c_str(),GENERIC_WRITE,
 		0,NULL,CREATE_NEW,FILE_ATTRIBUTE_NORMAL,NULL);
@@ -539,50 +557,47 @@ void CMergeFiles::StartMerging()
 	PostMessage(m_hDlg,NMergeFilesDialog::WM_APP_SETTOTALMERGECOUNT,
 		static_cast<WPARAM>(m_FullFilenameList.size()),0);
 
+	/* The copier isn't flushed between files, so the next
+	file is read while the last of the previous file is being
+	written. */
+	CBlockCopier BlockCopier;
+
 	for each(auto strFullFilename in m_FullFilenameList)
 	{
-		if(bStop)
+		if(m_pStopToken->IsCancelled())
 		{
 			break;
 		}
 
+		/* Files are read from start to finish, which lets
+		the system read further ahead of the copy. */
 		HANDLE hInputFile = CreateFile(strFullFilename.c_str(),GENERIC_READ,FILE_SHARE_READ,
-			NULL,OPEN_EXISTING,0,NULL);
+			NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
 
 		if(hInputFile != INVALID_HANDLE_VALUE)
 		{
 			GetFileSizeEx(hInputFile,&lMergeFileSize);
 
-			if(lMergeFileSize.QuadPart != 0)
-			{
-				char *pBuffer = new char[lMergeFileSize.LowPart];
+			/* The copy is throttled, and checked for
+			cancellation, one buffer at a time. */
+			BOOL bSuccess = BlockCopier.Copy(hInputFile,hOutputFile,
+				static_cast<ULONGLONG>(lMergeFileSize.QuadPart),NULL,m_pStopToken);
 
-				DWORD dwNumberOfBytesRead;
-				ReadFile(hInputFile,reinterpret_cast<LPVOID>(pBuffer),static_cast<DWORD>(lMergeFileSize.LowPart),
-					&dwNumberOfBytesRead,NULL);
-
-				DWORD dwNumberOfBytesWritten;
-				WriteFile(hOutputFile,reinterpret_cast<LPCVOID>(pBuffer),dwNumberOfBytesRead,
-					&dwNumberOfBytesWritten,NULL);
+			CloseHandle(hInputFile);
 
-				delete[] pBuffer;
+			if(!bSuccess)
+			{
+				break;
 			}
 
-			CloseHandle(hInputFile);
-
 			PostMessage(m_hDlg,NMergeFilesDialog::WM_APP_SETCURRENTMERGECOUNT,nFilesMerged,0);
 
 			nFilesMerged++;
-
-			EnterCriticalSection(&m_csStop);
-			if(m_bstopMerging)
-			{
-				bStop = true;
-			}
-			LeaveCriticalSection(&m_csStop);
 		}
 	}
 
+	BlockCopier.Flush();
+
 	CloseHandle(hOutputFile);
 
 	SendMessage(m_hDlg,NMergeFilesDialog::WM_APP_MERGINGFINISHED,0,0);
@@ -590,9 +605,7 @@ void CMergeFiles::StartMerging()
 
 void CMergeFiles::StopMerging()
 {
-	EnterCriticalSection(&m_csStop);
-	m_bstopMerging = true;
-	LeaveCriticalSection(&m_csStop);
+	m_pStopToken->Cancel();
 }
 
 CMergeFilesDialogPersistentSettings::CMergeFilesDialogPersistentSettings() :
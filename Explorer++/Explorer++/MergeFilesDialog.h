@@ -2,6 +2,7 @@
 
 #include "../Helper/BaseDialog.h"
 #include "../Helper/ResizableDialog.h"
+#include "../Helper/CancellationToken.h"
 #include "../Helper/DialogSettings.h"
 #include "../Helper/ReferenceCount.h"
 
@@ -27,6 +28,10 @@ private:
 	CMergeFilesDialogPersistentSettings & operator=(const CMergeFilesDialogPersistentSettings &);
 };
 
+/* Joins a set of files together, in order. Each file is
+streamed through a fixed amount of memory (see CBlockCopier),
+and the next file is read while the end of the previous one
+is still being written. */
 class CMergeFiles : public CReferenceCount
 {
 public:
@@ -44,8 +49,7 @@ private:
 	std::wstring			m_strOutputFilename;
 	std::list<std::wstring>	m_FullFilenameList;
 
-	CRITICAL_SECTION		m_csStop;
-	bool					m_bstopMerging;
+	CCancellationToken		*m_pStopToken;
 };
 
 class CMergeFilesDialog : public CBaseDialog
@@ -27,6 +27,8 @@
 #include "../Helper/ShellHelper.h"
 #include "../Helper/ListViewHelper.h"
 #include "../Helper/FolderSize.h"
+#include "../Helper/FolderSizeCache.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/ProcessHelper.h"
 #include "../Helper/WindowHelper.h"
 #include "../Helper/Macros.h"
@@ -616,8 +618,28 @@ HRESULT Explorerplusplus::UpdateStatusBarText(void)
 		{
 			if(nFilesSelected == 0)
 			{
-				/* Only folders selected. Don't show any size in the status bar. */
+				/* Only folders selected. Don't show any size in the status bar,
+				unless there's a single folder whose size is already known. (The
+				size is also shown as it's calculated, from the display window's
+				folder size request.) */
 				StringCchCopy(lpszSizeBuffer,SIZEOF_ARRAY(lpszSizeBuffer),EMPTY_STRING);
+
+				int iSelected = ListView_GetNextItem(m_hActiveListView,-1,LVNI_SELECTED);
+
+				if(nFoldersSelected == 1 && m_bShowFolderSizes && iSelected != -1)
+				{
+					TCHAR szFullItemName[MAX_PATH];
+					FolderSizeTotals_t Totals;
+
+					m_pActiveShellBrowser->QueryFullItemName(iSelected,szFullItemName,SIZEOF_ARRAY(szFullItemName));
+
+					if(CFolderSizeCache::GetInstance().Lookup(szFullItemName,Totals,NULL))
+					{
+						ULARGE_INTEGER liFolderSize;
+						liFolderSize.QuadPart = Totals.ulSize;
+						CreateFolderSizeString(liFolderSize,TRUE,lpszSizeBuffer,SIZEOF_ARRAY(lpszSizeBuffer));
+					}
+				}
 			}
 			else
 			{
@@ -694,6 +716,12 @@ void *pData)
 
 		pContainer->m_pShellBrowser[pDirectoryAltered->iIndex]->FilesModified(dwAction,
 			szFileName,pDirectoryAltered->iIndex,pDirectoryAltered->iFolderIndex);
+
+		/* Any cached folder sizes that include
+		this item are now out of date. */
+		TCHAR szFullFileName[MAX_PATH];
+		PathCombine(szFullFileName,szDirectory,szFileName);
+		CFolderSizeCache::GetInstance().Invalidate(szFullFileName);
 	}
 
 	LeaveCriticalSection(&g_csDirMonCallback);
@@ -800,6 +828,7 @@ void Explorerplusplus::UpdateDisplayWindowOne(void)
 
 		if(!m_pActiveShellBrowser->InVirtualFolder())
 		{
+			FolderSizeTotals_t	CachedTotals;
 			DWORD dwAttributes;
 
 			m_pActiveShellBrowser->QueryFullItemName(iSelected,szFullItemName,SIZEOF_ARRAY(szFullItemName));
@@ -809,6 +838,26 @@ void Explorerplusplus::UpdateDisplayWindowOne(void)
 			dwAttributes = GetFileAttributes(szFullItemName);
 
 			if(((dwAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
+				FILE_ATTRIBUTE_DIRECTORY) && m_bShowFolderSizes &&
+				CFolderSizeCache::GetInstance().Lookup(szFullItemName,CachedTotals,NULL))
+			{
+				/* The size is already known, so there's
+				no need to start another calculation. */
+				ULARGE_INTEGER	liFolderSize;
+				TCHAR			szFolderSize[32];
+				TCHAR			szDisplayText[256];
+				TCHAR			szTotalSize[64];
+
+				liFolderSize.QuadPart = CachedTotals.ulSize;
+				CreateFolderSizeString(liFolderSize,TRUE,szFolderSize,SIZEOF_ARRAY(szFolderSize));
+
+				LoadString(m_hLanguageModule,IDS_GENERAL_TOTALSIZE,
+					szTotalSize,SIZEOF_ARRAY(szTotalSize));
+				StringCchPrintf(szDisplayText,SIZEOF_ARRAY(szDisplayText),
+					_T("%s: %s"),szTotalSize,szFolderSize);
+				DisplayWindow_BufferText(m_hDisplayWindow,szDisplayText);
+			}
+			else if(((dwAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
 				FILE_ATTRIBUTE_DIRECTORY) && m_bShowFolderSizes)
 			{
 				FolderSize_t	*pfs = NULL;
@@ -817,7 +866,6 @@ void Explorerplusplus::UpdateDisplayWindowOne(void)
 				TCHAR			szDisplayText[256];
 				TCHAR			szTotalSize[64];
 				TCHAR			szCalculating[64];
-				DWORD			ThreadId;
 
 				pfs = (FolderSize_t *)malloc(sizeof(FolderSize_t));
 
@@ -832,6 +880,12 @@ void Explorerplusplus::UpdateDisplayWindowOne(void)
 						pfs->pData			= (LPVOID)pfsei;
 
 						pfs->pfnCallback	= FolderSizeCallbackStub;
+						pfs->pfnProgress	= FolderSizeProgressStub;
+
+						/* One reference is held by the list below, and
+						the other by the thread. */
+						pfs->pToken			= new CCancellationToken();
+						pfs->pToken->AddRef();
 
 						StringCchCopy(pfs->szPath, SIZEOF_ARRAY(pfs->szPath), szFullItemName);
 
@@ -847,10 +901,19 @@ void Explorerplusplus::UpdateDisplayWindowOne(void)
 						DWFolderSize.uId	= m_iDWFolderSizeUniqueId;
 						DWFolderSize.iTabId	= m_iObjectIndex;
 						DWFolderSize.bValid	= TRUE;
+						DWFolderSize.pToken	= pfs->pToken;
 						m_DWFolderSizes.push_back(DWFolderSize);
 
-						HANDLE hThread = CreateThread(NULL,0,Thread_CalculateFolderSize,(LPVOID)pfs,0,&ThreadId);
-						CloseHandle(hThread);
+						/* The selection may change again before the
+						job starts, in which case the token will already
+						have been cancelled. */
+						if(!CThreadPool::GetInstance().QueueJob(CalculateFolderSizeJob,(LPVOID)pfs,
+							THREAD_POOL_PRIORITY_HIGH,pfs->szPath,pfs->pToken))
+						{
+							pfs->pToken->Release();
+							free(pfsei);
+							free(pfs);
+						}
 
 						m_iDWFolderSizeUniqueId++;
 					}
@@ -1078,12 +1141,18 @@ void Explorerplusplus::UpdateDisplayWindowMore(void)
 void FolderSizeCallbackStub(int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,LPVOID pData)
 {
 	Explorerplusplus::FolderSizeExtraInfo_t *pfsei = reinterpret_cast<Explorerplusplus::FolderSizeExtraInfo_t *>(pData);
-	reinterpret_cast<Explorerplusplus *>(pfsei->pContainer)->FolderSizeCallback(pfsei,nFolders,nFiles,lTotalFolderSize);
+	reinterpret_cast<Explorerplusplus *>(pfsei->pContainer)->FolderSizeCallback(pfsei,nFolders,nFiles,lTotalFolderSize,TRUE);
 	free(pfsei);
 }
 
+void FolderSizeProgressStub(int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,LPVOID pData)
+{
+	Explorerplusplus::FolderSizeExtraInfo_t *pfsei = reinterpret_cast<Explorerplusplus::FolderSizeExtraInfo_t *>(pData);
+	reinterpret_cast<Explorerplusplus *>(pfsei->pContainer)->FolderSizeCallback(pfsei,nFolders,nFiles,lTotalFolderSize,FALSE);
+}
+
 void Explorerplusplus::FolderSizeCallback(FolderSizeExtraInfo_t *pfsei,
-int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize)
+int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize,BOOL bComplete)
 {
 	UNREFERENCED_PARAMETER(nFolders);
 	UNREFERENCED_PARAMETER(nFiles);
@@ -1094,6 +1163,7 @@ int nFolders,int nFiles,PULARGE_INTEGER lTotalFolderSize)
 
 	pDWFolderSizeCompletion->liFolderSize = *lTotalFolderSize;
 	pDWFolderSizeCompletion->uId = pfsei->uId;
+	pDWFolderSizeCompletion->bComplete = bComplete;
 
 	/* Queue the result back to the main thread, so that
 	the folder size can be displayed. It is up to the main
@@ -1115,6 +1185,28 @@ void Explorerplusplus::CreateViewsMenu(POINT *ptOrigin)
 		0,m_hContainer,NULL);
 }
 
+/* Sizes that are still being calculated are
+marked as such. */
+void Explorerplusplus::CreateFolderSizeString(ULARGE_INTEGER liFolderSize, BOOL bComplete, TCHAR *szBuffer, int nBuffer)
+{
+	TCHAR szFolderSize[32];
+	FormatSizeString(liFolderSize,szFolderSize,SIZEOF_ARRAY(szFolderSize),
+		m_bForceSize,m_SizeDisplayFormat);
+
+	if(bComplete)
+	{
+		StringCchCopy(szBuffer,nBuffer,szFolderSize);
+	}
+	else
+	{
+		TCHAR szCalculating[64];
+		LoadString(m_hLanguageModule,IDS_GENERAL_CALCULATING,
+			szCalculating,SIZEOF_ARRAY(szCalculating));
+
+		StringCchPrintf(szBuffer,nBuffer,_T("%s (%s)"),szFolderSize,szCalculating);
+	}
+}
+
 int Explorerplusplus::CreateDriveFreeSpaceString(const TCHAR *szPath, TCHAR *szBuffer, int nBuffer)
 {
 	ULARGE_INTEGER	TotalNumberOfBytes;
@@ -12,6 +12,7 @@
  *****************************************************************/
 
 #include "stdafx.h"
+#include <pantheios\inserters\integer.hpp>
 #include "Explorer++.h"
 #include "Explorer++_internal.h"
 #include "MainResource.h"
@@ -20,6 +21,7 @@
 #include "../Helper/RegistrySettings.h"
 #include "../Helper/ProcessHelper.h"
 #include "../Helper/WindowHelper.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
@@ -52,6 +54,7 @@ static const int TAB_TOOLBAR_WIDTH = 20;
 static const int TAB_TOOLBAR_HEIGHT = 20;
 
 void CALLBACK UninitializeCOMAPC(ULONG_PTR dwParam);
+void LogThreadPoolDeviceStats(void);
 
 void CALLBACK UninitializeCOMAPC(ULONG_PTR dwParam)
 {
@@ -60,6 +63,37 @@ void CALLBACK UninitializeCOMAPC(ULONG_PTR dwParam)
 	CoUninitialize();
 }
 
+/* Writes out how long jobs waited on each device,
+so that the per-device limits can be tuned. Nothing
+is written unless logging is enabled. */
+void LogThreadPoolDeviceStats(void)
+{
+	/* Indexed by DeviceClass_t. */
+	static const TCHAR * const DEVICE_CLASS_NAMES[] =
+	{_T("solid state"),_T("rotational"),_T("removable"),_T("network")};
+
+	std::vector<DeviceStats_t> DeviceStats;
+	CThreadPool::GetInstance().GetDeviceStats(DeviceStats);
+
+	for(auto itr = DeviceStats.begin();itr != DeviceStats.end();itr++)
+	{
+		ULONGLONG ulAverageQueueWait = 0;
+
+		if(itr->nJobsStarted > 0)
+		{
+			ulAverageQueueWait = itr->ulTotalQueueWait / itr->nJobsStarted;
+		}
+
+		pantheios::log(pantheios::informational,_T("Thread pool - \""),itr->strDevice.c_str(),
+			_T("\" ("),DEVICE_CLASS_NAMES[itr->DeviceClass],_T("): Jobs started = "),
+			pantheios::integer(itr->nJobsStarted),_T(", Average queue wait = "),
+			pantheios::integer(ulAverageQueueWait),_T("ms, Maximum queue wait = "),
+			pantheios::integer(itr->dwMaxQueueWait),_T("ms, Bytes = "),
+			pantheios::integer(itr->ulBytes),_T(", Throttled for = "),
+			pantheios::integer(itr->ulThrottledTime),_T("ms"));
+	}
+}
+
 void Explorerplusplus::TestConfigFile(void)
 {
 	m_bLoadSettingsFromXML = TestConfigFileInternal();
@@ -126,6 +160,8 @@ void Explorerplusplus::LoadAllSettings(ILoadSave **pLoadSave)
 	(*pLoadSave)->LoadDialogStates();
 
 	ValidateLoadedSettings();
+
+	UpdateColorRuleSet();
 }
 
 void Explorerplusplus::OpenItem(const TCHAR *szItem,BOOL bOpenInNewTab,BOOL bOpenInNewWindow)
@@ -553,6 +589,9 @@ int Explorerplusplus::OnDestroy(void)
 	delete m_pStatusBar;
 
 	ChangeClipboardChain(m_hContainer,m_hNextClipboardViewer);
+
+	LogThreadPoolDeviceStats();
+
 	PostQuitMessage(0);
 
 	return 0;
@@ -1551,49 +1590,15 @@ LRESULT Explorerplusplus::OnCustomDraw(LPARAM lParam)
 
 		case CDDS_ITEMPREPAINT:
 			{
-				DWORD dwAttributes = m_pActiveShellBrowser->QueryFileAttributes(static_cast<int>(pnmcd->dwItemSpec));
-
-				TCHAR szFileName[MAX_PATH];
-				m_pActiveShellBrowser->QueryFullItemName(static_cast<int>(pnmcd->dwItemSpec),szFileName,SIZEOF_ARRAY(szFileName));
-				PathStripPath(szFileName);
+				/* The colour rule each item matches is determined
+				when the item is added (or changes), so there's
+				no matching to do here. */
+				COLORREF rgbColour;
 
-				/* Loop through each filter. Decide whether to change the font of the
-				current item based on its filename and/or attributes. */
-				for each(auto ColorRule in m_ColorRules)
+				if(m_pActiveShellBrowser->QueryItemColor(static_cast<int>(pnmcd->dwItemSpec),&rgbColour))
 				{
-					BOOL bMatchFileName = FALSE;
-					BOOL bMatchAttributes = FALSE;
-
-					/* Only match against the filename if it's not empty. */
-					if(ColorRule.strFilterPattern.size() > 0)
-					{
-						if(CheckWildcardMatch(ColorRule.strFilterPattern.c_str(),szFileName,!ColorRule.caseInsensitive) == 1)
-						{
-							bMatchFileName = TRUE;
-						}
-					}
-					else
-					{
-						bMatchFileName = TRUE;
-					}
-
-					if(ColorRule.dwFilterAttributes != 0)
-					{
-						if(ColorRule.dwFilterAttributes & dwAttributes)
-						{
-							bMatchAttributes = TRUE;
-						}
-					}
-					else
-					{
-						bMatchAttributes = TRUE;
-					}
-
-					if(bMatchFileName && bMatchAttributes)
-					{
-						pnmlvcd->clrText = ColorRule.rgbColour;
-						return CDRF_NEWFONT;
-					}
+					pnmlvcd->clrText = rgbColour;
+					return CDRF_NEWFONT;
 				}
 			}
 			break;
@@ -1605,6 +1610,31 @@ LRESULT Explorerplusplus::OnCustomDraw(LPARAM lParam)
 	return 0;
 }
 
+/* Compiles the current set of colour rules, and
+pushes them out to each tab. Should be called
+whenever the rules change. */
+void Explorerplusplus::UpdateColorRuleSet(void)
+{
+	m_ColorRuleSet = CColorRuleSet();
+
+	for each(auto ColorRule in m_ColorRules)
+	{
+		m_ColorRuleSet.AddRule(ColorRule.strFilterPattern.c_str(),ColorRule.caseInsensitive,
+			ColorRule.dwFilterAttributes,ColorRule.rgbColour);
+	}
+
+	int nTabs = TabCtrl_GetItemCount(m_hTabCtrl);
+
+	for(int i = 0;i < nTabs;i++)
+	{
+		TCITEM tcItem;
+		tcItem.mask	= TCIF_PARAM;
+		TabCtrl_GetItem(m_hTabCtrl,i,&tcItem);
+
+		m_pShellBrowser[(int)tcItem.lParam]->SetColorRuleSet(&m_ColorRuleSet);
+	}
+}
+
 int Explorerplusplus::GetViewModeMenuId(UINT uViewMode)
 {
 	switch(uViewMode)
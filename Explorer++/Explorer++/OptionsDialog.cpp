@@ -28,6 +28,7 @@
 #include "../Helper/ListViewHelper.h"
 #include "../Helper/ProcessHelper.h"
 #include "../Helper/WindowHelper.h"
+#include "../Helper/FolderSizeCache.h"
 #include "../Helper/Macros.h"
 
 
@@ -57,6 +58,17 @@ static const FileSize_t FILE_SIZES[] =
 {SIZE_FORMAT_TBYTES, IDS_OPTIONS_DIALOG_FILE_SIZE_TB},
 {SIZE_FORMAT_PBYTES, IDS_OPTIONS_DIALOG_FILE_SIZE_PB}};
 
+struct FolderSizeModeString_t
+{
+	FolderSizeMode_t Mode;
+	UINT StringID;
+};
+
+static const FolderSizeModeString_t FOLDER_SIZE_MODES[] =
+{{FOLDER_SIZE_MODE_LOGICAL, IDS_OPTIONS_DIALOG_FOLDER_SIZE_LOGICAL},
+{FOLDER_SIZE_MODE_ALLOCATED, IDS_OPTIONS_DIALOG_FOLDER_SIZE_ALLOCATED},
+{FOLDER_SIZE_MODE_UNIQUE, IDS_OPTIONS_DIALOG_FOLDER_SIZE_UNIQUE}};
+
 static HWND g_hOptionsPropertyDialog	= NULL;
 
 HICON g_hNewTabDirIcon;
@@ -558,6 +570,21 @@ INT_PTR CALLBACK Explorerplusplus::FilesFoldersProc(HWND hDlg,UINT uMsg,WPARAM w
 
 				EnableWindow(hCBSize,m_bForceSize);
 
+				HWND hCBFolderSizeMode = GetDlgItem(hDlg,IDC_COMBO_FOLDERSIZEMODE);
+
+				for(int i = 0;i < SIZEOF_ARRAY(FOLDER_SIZE_MODES);i++)
+				{
+					TCHAR szTemp[64];
+					LoadString(m_hLanguageModule,FOLDER_SIZE_MODES[i].StringID,szTemp,SIZEOF_ARRAY(szTemp));
+					SendMessage(hCBFolderSizeMode,CB_ADDSTRING,0,reinterpret_cast<LPARAM>(szTemp));
+					SendMessage(hCBFolderSizeMode,CB_SETITEMDATA,i,FOLDER_SIZE_MODES[i].Mode);
+
+					if(FOLDER_SIZE_MODES[i].Mode == m_FolderSizeMode)
+					{
+						SendMessage(hCBFolderSizeMode,CB_SETCURSEL,i,0);
+					}
+				}
+
 				SetInfoTipWindowStates(hDlg);
 				SetFolderSizeWindowState(hDlg);
 			}
@@ -686,6 +713,22 @@ INT_PTR CALLBACK Explorerplusplus::FilesFoldersProc(HWND hDlg,UINT uMsg,WPARAM w
 						iSel = (int)SendMessage(hCBSize,CB_GETCURSEL,0,0);
 						m_SizeDisplayFormat = (SizeDisplayFormat_t)SendMessage(hCBSize,CB_GETITEMDATA,iSel,0);
 
+						HWND hCBFolderSizeMode = GetDlgItem(hDlg,IDC_COMBO_FOLDERSIZEMODE);
+
+						/* A language module that predates the
+						folder size modes won't have the combo box,
+						in which case the current mode is kept. */
+						if(hCBFolderSizeMode != NULL)
+						{
+							iSel = (int)SendMessage(hCBFolderSizeMode,CB_GETCURSEL,0,0);
+							m_FolderSizeMode = (FolderSizeMode_t)SendMessage(hCBFolderSizeMode,CB_GETITEMDATA,iSel,0);
+
+							/* Sizes calculated in the previous mode are
+							dropped, so the tabs below will recalculate
+							them when they're refreshed. */
+							CFolderSizeCache::GetInstance().SetSizeMode(m_FolderSizeMode);
+						}
+
 						nTabs = TabCtrl_GetItemCount(m_hTabCtrl);
 
 						/* Now, push each of the required settings to the
@@ -1440,4 +1483,6 @@ void Explorerplusplus::SetFolderSizeWindowState(HWND hDlg)
 		== BST_CHECKED);
 
 	EnableWindow(hFolderSizesNeworkRemovable,bEnable);
+	EnableWindow(GetDlgItem(hDlg,IDC_LABEL_FOLDERSIZEMODE),bEnable);
+	EnableWindow(GetDlgItem(hDlg,IDC_COMBO_FOLDERSIZEMODE),bEnable);
 }
\ No newline at end of file
@@ -139,6 +139,14 @@ LONG Explorerplusplus::SaveSettings(void)
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("CheckBoxSelection"),m_bCheckBoxSelection);
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("ForceSize"),m_bForceSize);
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("SizeDisplayFormat"),m_SizeDisplayFormat);
+		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("FolderSizeMode"),m_FolderSizeMode);
+
+		for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+		{
+			NRegistrySettings::SaveDwordToRegistry(hSettingsKey,NExplorerplusplus::MAX_JOBS_PER_DEVICE_SETTINGS[i],m_dwMaxJobsPerDevice[i]);
+			NRegistrySettings::SaveDwordToRegistry(hSettingsKey,NExplorerplusplus::BACKGROUND_BANDWIDTH_SETTINGS[i],m_dwBackgroundBandwidth[i]);
+		}
+
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("CloseMainWindowOnTabClose"),m_bCloseMainWindowOnTabClose);
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("ShowTabBarAtBottom"),m_bShowTabBarAtBottom);
 		NRegistrySettings::SaveDwordToRegistry(hSettingsKey,_T("OverwriteExistingFilesConfirmation"),m_bOverwriteExistingFilesConfirmation);
@@ -258,6 +266,14 @@ LONG Explorerplusplus::LoadSettings()
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("CheckBoxSelection"),(LPDWORD)&m_bCheckBoxSelection);
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("ForceSize"),(LPDWORD)&m_bForceSize);
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("SizeDisplayFormat"),(LPDWORD)&m_SizeDisplayFormat);
+		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("FolderSizeMode"),(LPDWORD)&m_FolderSizeMode);
+
+		for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+		{
+			NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,NExplorerplusplus::MAX_JOBS_PER_DEVICE_SETTINGS[i],&m_dwMaxJobsPerDevice[i]);
+			NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,NExplorerplusplus::BACKGROUND_BANDWIDTH_SETTINGS[i],&m_dwBackgroundBandwidth[i]);
+		}
+
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("CloseMainWindowOnTabClose"),(LPDWORD)&m_bCloseMainWindowOnTabClose);
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("ShowTabBarAtBottom"),(LPDWORD)&m_bShowTabBarAtBottom);
 		NRegistrySettings::ReadDwordFromRegistry(hSettingsKey,_T("ShowTaskbarThumbnails"),(LPDWORD)&m_bShowTaskbarThumbnails);
@@ -12,10 +12,10 @@
  *****************************************************************/
 
 #include "stdafx.h"
-#include <regex>
 #include "Explorer++_internal.h"
 #include "MainImages.h"
 #include "SearchDialog.h"
+#include "FileNameIndexManager.h"
 #include "DialogHelper.h"
 #include "MainResource.h"
 #include "../Helper/Helper.h"
@@ -27,22 +27,24 @@
 #include "../Helper/ComboBox.h"
 #include "../Helper/WindowHelper.h"
 #include "../Helper/Controls.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
 namespace NSearchDialog
 {
-	const int		WM_APP_SEARCHITEMFOUND = WM_APP + 1;
+	const int		WM_APP_SEARCHRESULTS = WM_APP + 1;
 	const int		WM_APP_SEARCHFINISHED = WM_APP + 2;
 	const int		WM_APP_SEARCHCHANGEDDIRECTORY = WM_APP + 3;
 	const int		WM_APP_REGULAREXPRESSIONINVALID = WM_APP + 4;
+	const int		WM_APP_QUERYINVALID = WM_APP + 5;
 
-	int CALLBACK	SortResultsStub(LPARAM lParam1,LPARAM lParam2,LPARAM lParamSort);
-
-	DWORD WINAPI	SearchThread(LPVOID pParam);
+	void			SearchJob(LPVOID pParam,const CCancellationToken *pToken);
 	int CALLBACK	BrowseCallbackProc(HWND hwnd,UINT uMsg,LPARAM lParam,LPARAM lpData);
 }
 
+void	SearchWorkerProc(int iWorker,LPVOID pData);
+
 const TCHAR CSearchDialogPersistentSettings::SETTINGS_KEY[] = _T("Search");
 
 const TCHAR CSearchDialogPersistentSettings::SETTING_COLUMN_WIDTH_1[] = _T("ColumnWidth1");
@@ -50,6 +52,7 @@ const TCHAR CSearchDialogPersistentSettings::SETTING_COLUMN_WIDTH_2[] = _T("Colu
 const TCHAR CSearchDialogPersistentSettings::SETTING_SEARCH_DIRECTORY_TEXT[] = _T("SearchDirectoryText");
 const TCHAR CSearchDialogPersistentSettings::SETTING_SEARCH_SUB_FOLDERS[] = _T("SearchSubFolders");
 const TCHAR CSearchDialogPersistentSettings::SETTING_USE_REGULAR_EXPRESSIONS[] = _T("UseRegularExpressions");
+const TCHAR CSearchDialogPersistentSettings::SETTING_USE_INDEX[] = _T("UseIndex");
 const TCHAR CSearchDialogPersistentSettings::SETTING_CASE_INSENSITIVE[] = _T("CaseInsensitive");
 const TCHAR CSearchDialogPersistentSettings::SETTING_ARCHIVE[] = _T("Archive");
 const TCHAR CSearchDialogPersistentSettings::SETTING_HIDDEN[] = _T("Hidden");
@@ -71,9 +74,8 @@ CBaseDialog(hInstance,iResource,hParent,true)
 
 	m_bSearching		= FALSE;
 	m_bStopSearching	= FALSE;
-	m_bSetSearchTimer	= TRUE;
-	m_iInternalIndex	= 0;
 	m_iPreviousSelectedColumn	= -1;
+	m_bResultsSorted			= FALSE;
 	m_pSearch			= NULL;
 
 	m_sdps = &CSearchDialogPersistentSettings::GetInstance();
@@ -89,6 +91,8 @@ CSearchDialog::~CSearchDialog()
 		m_pSearch->StopSearching();
 		m_pSearch->Release();
 	}
+
+	ClearSearchResults();
 }
 
 INT_PTR CSearchDialog::OnInitDialog()
@@ -149,6 +153,7 @@ INT_PTR CSearchDialog::OnInitDialog()
 	lCheckDlgButton(m_hDlg,IDC_CHECK_SEARCHSUBFOLDERS,m_sdps->m_bSearchSubFolders);
 	lCheckDlgButton(m_hDlg,IDC_CHECK_CASEINSENSITIVE,m_sdps->m_bCaseInsensitive);
 	lCheckDlgButton(m_hDlg,IDC_CHECK_USEREGULAREXPRESSIONS,m_sdps->m_bUseRegularExpressions);
+	lCheckDlgButton(m_hDlg,IDC_CHECK_USEINDEX,m_sdps->m_bUseIndex);
 
 	for each(auto strDirectory in *m_sdps->m_pSearchDirectories)
 	{
@@ -203,6 +208,16 @@ void CSearchDialog::GetResizableControlInformation(CBaseDialog::DialogSizeConstr
 	Control.Constraint = CResizableDialog::CONSTRAINT_X;
 	ControlList.push_back(Control);
 
+	Control.iID = IDC_EDIT_CONTAININGTEXT;
+	Control.Type = CResizableDialog::TYPE_RESIZE;
+	Control.Constraint = CResizableDialog::CONSTRAINT_X;
+	ControlList.push_back(Control);
+
+	Control.iID = IDC_EDIT_QUERY;
+	Control.Type = CResizableDialog::TYPE_RESIZE;
+	Control.Constraint = CResizableDialog::CONSTRAINT_X;
+	ControlList.push_back(Control);
+
 	Control.iID = IDC_BUTTON_DIRECTORY;
 	Control.Type = CResizableDialog::TYPE_MOVE;
 	Control.Constraint = CResizableDialog::CONSTRAINT_X;
@@ -248,6 +263,21 @@ void CSearchDialog::GetResizableControlInformation(CBaseDialog::DialogSizeConstr
 	Control.Constraint = CResizableDialog::CONSTRAINT_X;
 	ControlList.push_back(Control);
 
+	Control.iID = IDC_BUTTON_REFINE;
+	Control.Type = CResizableDialog::TYPE_MOVE;
+	Control.Constraint = CResizableDialog::CONSTRAINT_Y;
+	ControlList.push_back(Control);
+
+	Control.iID = IDC_BUTTON_UNDOREFINE;
+	Control.Type = CResizableDialog::TYPE_MOVE;
+	Control.Constraint = CResizableDialog::CONSTRAINT_Y;
+	ControlList.push_back(Control);
+
+	Control.iID = IDC_BUTTON_EXPORT;
+	Control.Type = CResizableDialog::TYPE_MOVE;
+	Control.Constraint = CResizableDialog::CONSTRAINT_NONE;
+	ControlList.push_back(Control);
+
 	Control.iID = IDSEARCH;
 	Control.Type = CResizableDialog::TYPE_MOVE;
 	Control.Constraint = CResizableDialog::CONSTRAINT_NONE;
@@ -274,6 +304,18 @@ INT_PTR CSearchDialog::OnCommand(WPARAM wParam,LPARAM lParam)
 		OnSearch();
 		break;
 
+	case IDC_BUTTON_EXPORT:
+		OnExport();
+		break;
+
+	case IDC_BUTTON_REFINE:
+		OnRefine();
+		break;
+
+	case IDC_BUTTON_UNDOREFINE:
+		OnUndoRefine();
+		break;
+
 	case IDC_BUTTON_DIRECTORY:
 		{
 			BROWSEINFO bi;
@@ -339,7 +381,7 @@ void CSearchDialog::OnSearch()
 {
 	if(!m_bSearching)
 	{
-		StartSearching();
+		StartSearching(NULL);
 	}
 	else
 	{
@@ -347,15 +389,95 @@ void CSearchDialog::OnSearch()
 	}
 }
 
-void CSearchDialog::StartSearching()
+/* Runs the search straight into a file. Nothing
+is added to the listview. */
+void CSearchDialog::OnExport()
+{
+	if(m_bSearching)
+	{
+		return;
+	}
+
+	/* String resources can't contain embedded NULs, so
+	the parts of the filter are separated by '|' instead.
+	The string ends with a separator, so that the filter
+	is double NUL terminated once they're replaced. */
+	TCHAR Filter[256];
+	LoadString(GetInstance(),IDS_SEARCH_EXPORT_FILTER,Filter,SIZEOF_ARRAY(Filter));
+	std::replace(Filter,Filter + lstrlen(Filter),_T('|'),_T('\0'));
+
+	TCHAR FullFileName[MAX_PATH] = EMPTY_STRING;
+
+	OPENFILENAME ofn;
+	ofn.lStructSize			= sizeof(ofn);
+	ofn.hwndOwner			= m_hDlg;
+	ofn.lpstrFilter			= Filter;
+	ofn.lpstrCustomFilter	= NULL;
+	ofn.nMaxCustFilter		= 0;
+	ofn.nFilterIndex		= 1;
+	ofn.lpstrFile			= FullFileName;
+	ofn.nMaxFile			= SIZEOF_ARRAY(FullFileName);
+	ofn.lpstrFileTitle		= NULL;
+	ofn.nMaxFileTitle		= 0;
+	ofn.lpstrInitialDir		= NULL;
+	ofn.lpstrTitle			= NULL;
+	ofn.Flags				= OFN_ENABLESIZING|OFN_OVERWRITEPROMPT|OFN_EXPLORER;
+	ofn.lpstrDefExt			= _T("csv");
+	ofn.lCustData			= NULL;
+	ofn.lpfnHook			= NULL;
+	ofn.pvReserved			= NULL;
+	ofn.dwReserved			= NULL;
+	ofn.FlagsEx				= NULL;
+
+	BOOL bRet = GetSaveFileName(&ofn);
+
+	if(!bRet)
+	{
+		return;
+	}
+
+	/* The filter index is 1-based, and
+	follows the order of the filter. */
+	CResultExporter::Format_t Format;
+
+	switch(ofn.nFilterIndex)
+	{
+	case 2:
+		Format = CResultExporter::FORMAT_TSV;
+		break;
+
+	case 3:
+		Format = CResultExporter::FORMAT_JSON_LINES;
+		break;
+
+	default:
+		Format = CResultExporter::FORMAT_CSV;
+		break;
+	}
+
+	CResultExporter *pExporter = new CResultExporter(Format);
+
+	if(!pExporter->Open(FullFileName))
+	{
+		delete pExporter;
+
+		TCHAR szTemp[128];
+		LoadString(GetInstance(),IDS_SEARCH_EXPORT_FAILED,
+			szTemp,SIZEOF_ARRAY(szTemp));
+		SetDlgItemText(m_hDlg,IDC_STATIC_STATUS,szTemp);
+		return;
+	}
+
+	StartSearching(pExporter);
+}
+
+void CSearchDialog::StartSearching(CResultExporter *pExporter)
 {
 	ShowWindow(GetDlgItem(m_hDlg, IDC_LINK_STATUS), SW_HIDE);
 	ShowWindow(GetDlgItem(m_hDlg, IDC_STATIC_STATUS), SW_SHOW);
 
-	m_AwaitingSearchItems.clear();
-	m_SearchItemsMapInternal.clear();
-
-	ListView_DeleteAllItems(GetDlgItem(m_hDlg, IDC_LISTVIEW_SEARCHRESULTS));
+	ClearSearchResults();
+	ListView_SetItemCount(GetDlgItem(m_hDlg, IDC_LISTVIEW_SEARCHRESULTS), 0);
 
 	TCHAR szBaseDirectory[MAX_PATH];
 	TCHAR szSearchPattern[MAX_PATH];
@@ -370,6 +492,8 @@ void CSearchDialog::StartSearching()
 		SIZEOF_ARRAY(szSearchPattern));
 	PathRemoveBlanks(szSearchPattern);
 
+	m_ResultTable.SetBaseDirectory(szBaseDirectory);
+
 	BOOL bSearchSubFolders = IsDlgButtonChecked(m_hDlg, IDC_CHECK_SEARCHSUBFOLDERS) ==
 		BST_CHECKED;
 
@@ -413,6 +537,21 @@ void CSearchDialog::StartSearching()
 		dwAttributes, bUseRegularExpressions, bCaseInsensitive, bSearchSubFolders);
 	m_pSearch->AddRef();
 
+	m_pSearch->SetUseIndex(IsDlgButtonChecked(m_hDlg, IDC_CHECK_USEINDEX) == BST_CHECKED);
+	m_pSearch->SetTraversalOrder(TRAVERSAL_ORDER_AUTOMATIC);
+
+	TCHAR szContainingText[MAX_PATH];
+	GetDlgItemText(m_hDlg, IDC_EDIT_CONTAININGTEXT, szContainingText,
+		SIZEOF_ARRAY(szContainingText));
+	m_pSearch->SetContainingText(szContainingText);
+
+	TCHAR szQuery[MAX_PATH];
+	GetDlgItemText(m_hDlg, IDC_EDIT_QUERY, szQuery,
+		SIZEOF_ARRAY(szQuery));
+	m_pSearch->SetQuery(szQuery);
+
+	m_pSearch->SetExporter(pExporter);
+
 	/* Save the search directory and search pattern (only if they are not
 	the same as the most recent entry). */
 	BOOL bSaveEntry = FALSE;
@@ -447,13 +586,32 @@ void CSearchDialog::StartSearching()
 
 	LoadString(GetInstance(), IDS_STOP, szTemp, SIZEOF_ARRAY(szTemp));
 	SetDlgItemText(m_hDlg, IDSEARCH, szTemp);
+	EnableWindow(GetDlgItem(m_hDlg, IDC_BUTTON_EXPORT), FALSE);
 
 	m_bSearching = TRUE;
+	UpdateRefineButtons();
+
+	/* The search itself runs on a pool thread (the
+	directories are still walked by the search's own
+	worker threads). */
+	if(!CThreadPool::GetInstance().QueueJob(NSearchDialog::SearchJob,
+		reinterpret_cast<LPVOID>(m_pSearch), THREAD_POOL_PRIORITY_NORMAL, szBaseDirectory))
+	{
+		/* The pool is shutting down, so the search will never
+		run. Both the job's reference and the dialog's are
+		released, and the dialog is put back as it was. */
+		m_pSearch->Release();
+		m_pSearch->Release();
+		m_pSearch = NULL;
+
+		LoadString(GetInstance(), IDS_SEARCH_CANCELLED_MESSAGE, szTemp, SIZEOF_ARRAY(szTemp));
+		SetDlgItemText(m_hDlg, IDC_STATIC_STATUS, szTemp);
 
-	/* Create a background thread, and search using it... */
-	HANDLE hThread = CreateThread(NULL, 0, NSearchDialog::SearchThread,
-		reinterpret_cast<LPVOID>(m_pSearch), 0, NULL);
-	CloseHandle(hThread);
+		m_bSearching = FALSE;
+		SetDlgItemText(m_hDlg, IDSEARCH, m_szSearchButton);
+		EnableWindow(GetDlgItem(m_hDlg, IDC_BUTTON_EXPORT), TRUE);
+		UpdateRefineButtons();
+	}
 }
 
 void CSearchDialog::SaveEntry(int comboBoxId, boost::circular_buffer<std::wstring> &buffer)
@@ -562,27 +720,36 @@ void CSearchDialog::UpdateListViewHeader()
 	m_iPreviousSelectedColumn = iColumn;
 }
 
-int CALLBACK NSearchDialog::SortResultsStub(LPARAM lParam1,LPARAM lParam2,LPARAM lParamSort)
+/* Results are sorted in place. Since the listview only
+refers to results by position, the selection is cleared
+first (it would otherwise stay with the old positions). */
+void CSearchDialog::SortSearchResults()
 {
-	assert(lParamSort != NULL);
+	HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
 
-	CSearchDialog *psd = reinterpret_cast<CSearchDialog *>(lParamSort);
+	ListView_SetItemState(hListView,-1,0,LVIS_SELECTED|LVIS_FOCUSED);
+
+	std::stable_sort(m_SearchResults.begin(),m_SearchResults.end(),
+		[this] (const SearchResult_t &Result1,const SearchResult_t &Result2)
+	{
+		return SortResults(Result1,Result2) < 0;
+	});
 
-	return psd->SortResults(lParam1,lParam2);
+	InvalidateRect(hListView,NULL,TRUE);
 }
 
-int CALLBACK CSearchDialog::SortResults(LPARAM lParam1,LPARAM lParam2)
+int CSearchDialog::SortResults(const SearchResult_t &Result1,const SearchResult_t &Result2) const
 {
 	int iRes = 0;
 
 	switch(m_sdps->m_SortMode)
 	{
 	case CSearchDialogPersistentSettings::SORT_NAME:
-		iRes = SortResultsByName(lParam1,lParam2);
+		iRes = SortResultsByName(Result1,Result2);
 		break;
 
 	case CSearchDialogPersistentSettings::SORT_PATH:
-		iRes = SortResultsByPath(lParam1,lParam2);
+		iRes = SortResultsByPath(Result1,Result2);
 		break;
 	}
 
@@ -594,33 +761,18 @@ int CALLBACK CSearchDialog::SortResults(LPARAM lParam1,LPARAM lParam2)
 	return iRes;
 }
 
-int CALLBACK CSearchDialog::SortResultsByName(LPARAM lParam1,LPARAM lParam2)
+int CSearchDialog::SortResultsByName(const SearchResult_t &Result1,const SearchResult_t &Result2) const
 {
-	auto itr1 = m_SearchItemsMapInternal.find(static_cast<int>(lParam1));
-	auto itr2 = m_SearchItemsMapInternal.find(static_cast<int>(lParam2));
-
-	TCHAR szFilename1[MAX_PATH];
-	TCHAR szFilename2[MAX_PATH];
-
-	StringCchCopy(szFilename1,SIZEOF_ARRAY(szFilename1),itr1->second.c_str());
-	StringCchCopy(szFilename2,SIZEOF_ARRAY(szFilename2),itr2->second.c_str());
-
-	PathStripPath(szFilename1);
-	PathStripPath(szFilename2);
-
-	return StrCmpLogicalW(szFilename1,szFilename2);
+	return StrCmpLogicalW(Result1.pszFileName,Result2.pszFileName);
 }
 
-int CALLBACK CSearchDialog::SortResultsByPath(LPARAM lParam1,LPARAM lParam2)
+int CSearchDialog::SortResultsByPath(const SearchResult_t &Result1,const SearchResult_t &Result2) const
 {
-	auto itr1 = m_SearchItemsMapInternal.find(static_cast<int>(lParam1));
-	auto itr2 = m_SearchItemsMapInternal.find(static_cast<int>(lParam2));
-
 	TCHAR szPath1[MAX_PATH];
 	TCHAR szPath2[MAX_PATH];
 
-	StringCchCopy(szPath1,SIZEOF_ARRAY(szPath1),itr1->second.c_str());
-	StringCchCopy(szPath2,SIZEOF_ARRAY(szPath2),itr2->second.c_str());
+	StringCchCopy(szPath1,SIZEOF_ARRAY(szPath1),Result1.pszFullFileName);
+	StringCchCopy(szPath2,SIZEOF_ARRAY(szPath2),Result2.pszFullFileName);
 
 	PathRemoveFileSpec(szPath1);
 	PathRemoveFileSpec(szPath2);
@@ -706,36 +858,19 @@ INT_PTR CSearchDialog::OnNotify(NMHDR *pnmhdr)
 	case NM_DBLCLK:
 		if(pnmhdr->hwndFrom == GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS))
 		{
-			HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
-			int iSelected = ListView_GetNextItem(hListView,-1,LVNI_ALL|LVNI_SELECTED);
+			int iSelected = GetSelectedSearchResult();
 
 			if(iSelected != -1)
 			{
-				LVITEM lvItem;
+				LPITEMIDLIST pidlFull = NULL;
 
-				lvItem.mask		= LVIF_PARAM;
-				lvItem.iItem	= iSelected;
-				lvItem.iSubItem	= 0;
+				HRESULT hr = GetIdlFromParsingName(m_SearchResults[iSelected].pszFullFileName,&pidlFull);
 
-				BOOL bRet = ListView_GetItem(hListView,&lvItem);
-
-				if(bRet)
+				if(hr == S_OK)
 				{
-					auto itr = m_SearchItemsMapInternal.find(static_cast<int>(lvItem.lParam));
-
-					/* Item should always exist. */
-					assert(itr != m_SearchItemsMapInternal.end());
+					m_pexpp->OpenItem(pidlFull,FALSE,FALSE);
 
-					LPITEMIDLIST pidlFull = NULL;
-
-					HRESULT hr = GetIdlFromParsingName(itr->second.c_str(),&pidlFull);
-
-					if(hr == S_OK)
-					{
-						m_pexpp->OpenItem(pidlFull,FALSE,FALSE);
-
-						CoTaskMemFree(pidlFull);
-					}
+					CoTaskMemFree(pidlFull);
 				}
 			}
 		}
@@ -757,55 +892,49 @@ INT_PTR CSearchDialog::OnNotify(NMHDR *pnmhdr)
 		{
 			if(pnmhdr->hwndFrom == GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS))
 			{
-				HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
-				int iSelected = ListView_GetNextItem(hListView,-1,LVNI_ALL|LVNI_SELECTED);
+				int iSelected = GetSelectedSearchResult();
 
 				if(iSelected != -1)
 				{
-					LVITEM lvItem;
-					lvItem.mask		= LVIF_PARAM;
-					lvItem.iItem	= iSelected;
-					lvItem.iSubItem	= 0;
-					BOOL bRet = ListView_GetItem(hListView,&lvItem);
-
-					if(bRet)
-					{
-						auto itr = m_SearchItemsMapInternal.find(static_cast<int>(lvItem.lParam));
-						assert(itr != m_SearchItemsMapInternal.end());
-
-						LPITEMIDLIST pidlFull = NULL;
+					LPITEMIDLIST pidlFull = NULL;
 
-						HRESULT hr = GetIdlFromParsingName(itr->second.c_str(),&pidlFull);
+					HRESULT hr = GetIdlFromParsingName(m_SearchResults[iSelected].pszFullFileName,&pidlFull);
 
-						if(hr == S_OK)
-						{
-							std::list<LPITEMIDLIST> pidlList;
-							pidlList.push_back(ILFindLastID(pidlFull));
+					if(hr == S_OK)
+					{
+						std::list<LPITEMIDLIST> pidlList;
+						pidlList.push_back(ILFindLastID(pidlFull));
 
-							LPITEMIDLIST pidlDirectory = ILClone(pidlFull);
-							ILRemoveLastID(pidlDirectory);
+						LPITEMIDLIST pidlDirectory = ILClone(pidlFull);
+						ILRemoveLastID(pidlDirectory);
 
-							CFileContextMenuManager fcmm(m_hDlg,pidlDirectory,
-								pidlList);
+						CFileContextMenuManager fcmm(m_hDlg,pidlDirectory,
+							pidlList);
 
-							DWORD dwCursorPos = GetMessagePos();
+						DWORD dwCursorPos = GetMessagePos();
 
-							POINT ptCursor;
-							ptCursor.x = GET_X_LPARAM(dwCursorPos);
-							ptCursor.y = GET_Y_LPARAM(dwCursorPos);
+						POINT ptCursor;
+						ptCursor.x = GET_X_LPARAM(dwCursorPos);
+						ptCursor.y = GET_Y_LPARAM(dwCursorPos);
 
-							fcmm.ShowMenu(this,MIN_SHELL_MENU_ID,MAX_SHELL_MENU_ID,&ptCursor,m_pexpp->GetStatusBar(),
-								NULL,FALSE,IsKeyDown(VK_SHIFT));
+						fcmm.ShowMenu(this,MIN_SHELL_MENU_ID,MAX_SHELL_MENU_ID,&ptCursor,m_pexpp->GetStatusBar(),
+							NULL,FALSE,IsKeyDown(VK_SHIFT));
 
-							CoTaskMemFree(pidlDirectory);
-							CoTaskMemFree(pidlFull);
-						}
+						CoTaskMemFree(pidlDirectory);
+						CoTaskMemFree(pidlFull);
 					}
 				}
 			}
 		}
 		break;
 
+	case LVN_GETDISPINFO:
+		if(pnmhdr->hwndFrom == GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS))
+		{
+			OnGetDispInfo(reinterpret_cast<NMLVDISPINFO *>(pnmhdr));
+		}
+		break;
+
 	case LVN_COLUMNCLICK:
 		{
 			/* A listview header has been clicked,
@@ -824,8 +953,8 @@ INT_PTR CSearchDialog::OnNotify(NMHDR *pnmhdr)
 				m_sdps->m_bSortAscending = m_sdps->m_Columns[pnmlv->iSubItem].bSortAscending;
 			}
 
-			ListView_SortItems(GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS),
-				NSearchDialog::SortResultsStub,reinterpret_cast<LPARAM>(this));
+			SortSearchResults();
+			m_bResultsSorted = TRUE;
 
 			UpdateListViewHeader();
 		}
@@ -839,29 +968,28 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 {
 	switch(uMsg)
 	{
-		/* We won't actually process the item here. Instead, we'll
-		add it onto the list of current items, which will be processed
-		in batch. This is done to stop this message from blocking the
-		main GUI (also see http://www.flounder.com/iocompletion.htm). */
-		case NSearchDialog::WM_APP_SEARCHITEMFOUND:
-			{
-				m_AwaitingSearchItems.push_back(reinterpret_cast<LPITEMIDLIST>(wParam));
-
-				if(m_bSetSearchTimer)
-				{
-					SetTimer(m_hDlg,SEARCH_PROCESSITEMS_TIMER_ID,
-						SEARCH_PROCESSITEMS_TIMER_ELAPSED,NULL);
-
-					m_bSetSearchTimer = FALSE;
-				}
-			}
+		/* Results arrive in chunks, rather than one message
+		per item. This stops large searches from flooding the
+		message queue and blocking the main GUI (also see
+		http://www.flounder.com/iocompletion.htm). */
+		case NSearchDialog::WM_APP_SEARCHRESULTS:
+			OnSearchResults(reinterpret_cast<CSearchResultChunk *>(wParam));
 			break;
 
 		case NSearchDialog::WM_APP_SEARCHFINISHED:
 			{
 				TCHAR szStatus[512];
 
-				if(!m_bStopSearching)
+				if(wParam)
+				{
+					/* The exporter stops the search
+					itself if a write fails. */
+					TCHAR szTemp[128];
+					LoadString(GetInstance(),IDS_SEARCH_EXPORT_FAILED,
+						szTemp,SIZEOF_ARRAY(szTemp));
+					SetDlgItemText(m_hDlg,IDC_STATIC_STATUS,szTemp);
+				}
+				else if(!m_bStopSearching)
 				{
 					int iFoldersFound = LOWORD(lParam);
 					int iFilesFound = HIWORD(lParam);
@@ -889,6 +1017,8 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 				m_bSearching = FALSE;
 				m_bStopSearching = FALSE;
 				SetDlgItemText(m_hDlg,IDSEARCH,m_szSearchButton);
+				EnableWindow(GetDlgItem(m_hDlg,IDC_BUTTON_EXPORT),TRUE);
+				UpdateRefineButtons();
 			}
 			break;
 
@@ -909,6 +1039,7 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 			break;
 
 		case NSearchDialog::WM_APP_REGULAREXPRESSIONINVALID:
+		case NSearchDialog::WM_APP_QUERYINVALID:
 			{
 				/* The link/status controls are in the same position, and
 				have the same size. If one of the controls is showing text,
@@ -916,10 +1047,13 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 				ShowWindow(GetDlgItem(m_hDlg,IDC_LINK_STATUS),SW_SHOW);
 				ShowWindow(GetDlgItem(m_hDlg,IDC_STATIC_STATUS),SW_HIDE);
 
-				/* The regular expression passed to the search
+				/* The regular expression or query passed to the search
 				thread was invalid. Show the user an error message. */
+				UINT uStringID = (uMsg == NSearchDialog::WM_APP_QUERYINVALID) ?
+					IDS_SEARCH_QUERY_INVALID : IDS_SEARCH_REGULAR_EXPRESSION_INVALID;
+
 				TCHAR szTemp[128];
-				LoadString(GetInstance(),IDS_SEARCH_REGULAR_EXPRESSION_INVALID,
+				LoadString(GetInstance(),uStringID,
 					szTemp,SIZEOF_ARRAY(szTemp));
 				SetDlgItemText(m_hDlg,IDC_LINK_STATUS,szTemp);
 
@@ -931,6 +1065,8 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 				m_bSearching = FALSE;
 				m_bStopSearching = FALSE;
 				SetDlgItemText(m_hDlg,IDSEARCH,m_szSearchButton);
+				EnableWindow(GetDlgItem(m_hDlg,IDC_BUTTON_EXPORT),TRUE);
+				UpdateRefineButtons();
 			}
 			break;
 	}
@@ -938,64 +1074,214 @@ INT_PTR CSearchDialog::OnPrivateMessage(UINT uMsg,WPARAM wParam,LPARAM lParam)
 	return 0;
 }
 
-INT_PTR CSearchDialog::OnTimer(int iTimerID)
+/* The dialog takes ownership of the chunk. The results
+are copied into the result table (so that they can be
+refined later), and the chunk is then freed. Only the
+listview count is updated here; the text and icon for
+each item are only retrieved once the item is shown. */
+void CSearchDialog::OnSearchResults(CSearchResultChunk *pChunk)
 {
-	if(iTimerID != SEARCH_PROCESSITEMS_TIMER_ID)
+	int nResults = pChunk->GetResultCount();
+
+	for(int i = 0;i < nResults;i++)
 	{
-		return 1;
+		SearchResult_t SearchResult;
+		SearchResult.iRow				= m_ResultTable.AddRow(pChunk->GetResult(i),
+			pChunk->GetResultInfo(i));
+		SearchResult.pszFullFileName	= m_ResultTable.GetFullFileName(SearchResult.iRow);
+		SearchResult.pszFileName		= m_ResultTable.GetFileName(SearchResult.iRow);
+		SearchResult.iIcon				= -1;
+		m_SearchResults.push_back(SearchResult);
 	}
 
-	HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
-	int nListViewItems = ListView_GetItemCount(hListView);
+	delete pChunk;
 
-	int nItems = min(static_cast<int>(m_AwaitingSearchItems.size()),
-		SEARCH_MAX_ITEMS_BATCH_PROCESS);
-	int i = 0;
+	ListView_SetItemCountEx(GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS),
+		static_cast<int>(m_SearchResults.size()),LVSICF_NOINVALIDATEALL|LVSICF_NOSCROLL);
+}
+
+void CSearchDialog::OnGetDispInfo(NMLVDISPINFO *pnmlvdi)
+{
+	if(pnmlvdi->item.iItem < 0 ||
+		pnmlvdi->item.iItem >= static_cast<int>(m_SearchResults.size()))
+	{
+		return;
+	}
 
-	auto itr = m_AwaitingSearchItems.begin();
+	SearchResult_t &SearchResult = m_SearchResults[pnmlvdi->item.iItem];
 
-	while(i < nItems)
+	if((pnmlvdi->item.mask & LVIF_TEXT) == LVIF_TEXT)
 	{
-		TCHAR szFullFileName[MAX_PATH];
-		TCHAR szDirectory[MAX_PATH];
-		TCHAR szFileName[MAX_PATH];
-		LVITEM lvItem;
-		SHFILEINFO shfi;
-		int iIndex;
+		switch(pnmlvdi->item.iSubItem)
+		{
+		case 0:
+			StringCchCopy(pnmlvdi->item.pszText,pnmlvdi->item.cchTextMax,
+				SearchResult.pszFileName);
+			break;
 
-		LPITEMIDLIST pidl = *itr;
+		case 1:
+			{
+				TCHAR szDirectory[MAX_PATH];
+				StringCchCopy(szDirectory,SIZEOF_ARRAY(szDirectory),
+					SearchResult.pszFullFileName);
+				PathRemoveFileSpec(szDirectory);
 
-		GetDisplayName(pidl,szDirectory,SIZEOF_ARRAY(szDirectory),SHGDN_FORPARSING);
-		PathRemoveFileSpec(szDirectory);
+				StringCchCopy(pnmlvdi->item.pszText,pnmlvdi->item.cchTextMax,
+					szDirectory);
+			}
+			break;
+		}
+	}
 
-		GetDisplayName(pidl,szFullFileName,SIZEOF_ARRAY(szFullFileName),SHGDN_FORPARSING);
-		GetDisplayName(pidl,szFileName,SIZEOF_ARRAY(szFileName),SHGDN_INFOLDER|SHGDN_FORPARSING);
+	if((pnmlvdi->item.mask & LVIF_IMAGE) == LVIF_IMAGE)
+	{
+		if(SearchResult.iIcon == -1)
+		{
+			SHFILEINFO shfi;
+			DWORD_PTR dwRet = SHGetFileInfo(SearchResult.pszFullFileName,0,&shfi,
+				sizeof(shfi),SHGFI_SYSICONINDEX);
+
+			SearchResult.iIcon = (dwRet != 0) ? shfi.iIcon : 0;
+		}
 
-		SHGetFileInfo((LPCWSTR)pidl,0,&shfi,sizeof(shfi),SHGFI_PIDL|SHGFI_SYSICONINDEX);
+		pnmlvdi->item.iImage = SearchResult.iIcon;
+	}
+}
+
+void CSearchDialog::ClearSearchResults()
+{
+	m_SearchResults.clear();
+	m_ResultTable.Clear();
+	m_bResultsSorted = FALSE;
 
-		m_SearchItemsMapInternal.insert(std::unordered_map<int,std::wstring>::value_type(m_iInternalIndex,
-			szFullFileName));
+	UpdateRefineButtons();
+}
 
-		lvItem.mask		= LVIF_IMAGE|LVIF_TEXT|LVIF_PARAM;
-		lvItem.pszText	= szFileName;
-		lvItem.iItem	= nListViewItems + i;
-		lvItem.iSubItem	= 0;
-		lvItem.iImage	= shfi.iIcon;
-		lvItem.lParam	= m_iInternalIndex++;
-		iIndex = ListView_InsertItem(hListView,&lvItem);
+/* Narrows the current results down to those that
+match the query, without searching again. */
+void CSearchDialog::OnRefine()
+{
+	if(m_bSearching)
+	{
+		return;
+	}
 
-		ListView_SetItemText(hListView,iIndex,1,szDirectory);
+	TCHAR szQuery[MAX_PATH];
+	GetDlgItemText(m_hDlg,IDC_EDIT_QUERY,szQuery,
+		SIZEOF_ARRAY(szQuery));
 
-		CoTaskMemFree(pidl);
+	CSearchQuery Query;
 
-		itr = m_AwaitingSearchItems.erase(itr);
+	if(!Query.Parse(szQuery))
+	{
+		ShowWindow(GetDlgItem(m_hDlg,IDC_LINK_STATUS),SW_SHOW);
+		ShowWindow(GetDlgItem(m_hDlg,IDC_STATIC_STATUS),SW_HIDE);
 
-		i++;
+		TCHAR szTemp[128];
+		LoadString(GetInstance(),IDS_SEARCH_QUERY_INVALID,
+			szTemp,SIZEOF_ARRAY(szTemp));
+		SetDlgItemText(m_hDlg,IDC_LINK_STATUS,szTemp);
+		return;
+	}
+
+	/* An empty query would keep
+	every row anyway. */
+	if(Query.IsEmpty())
+	{
+		return;
 	}
 
-	m_bSetSearchTimer = TRUE;
+	m_ResultTable.Refine(Query,0);
 
-	return 0;
+	ShowCurrentResults();
+}
+
+void CSearchDialog::OnUndoRefine()
+{
+	if(m_bSearching || !m_ResultTable.Undo())
+	{
+		return;
+	}
+
+	ShowCurrentResults();
+}
+
+/* Rebuilds the results list from the rows left after
+the current refinements. Icons that have already been
+looked up are kept. */
+void CSearchDialog::ShowCurrentResults()
+{
+	std::vector<int> Icons(m_ResultTable.GetRowCount(),-1);
+
+	for(auto itr = m_SearchResults.begin();itr != m_SearchResults.end();itr++)
+	{
+		Icons[itr->iRow] = itr->iIcon;
+	}
+
+	m_SearchResults.clear();
+
+	int nRows = m_ResultTable.GetCurrentRowCount();
+	m_SearchResults.reserve(nRows);
+
+	for(int i = 0;i < nRows;i++)
+	{
+		SearchResult_t SearchResult;
+		SearchResult.iRow				= m_ResultTable.GetCurrentRow(i);
+		SearchResult.pszFullFileName	= m_ResultTable.GetFullFileName(SearchResult.iRow);
+		SearchResult.pszFileName		= m_ResultTable.GetFileName(SearchResult.iRow);
+		SearchResult.iIcon				= Icons[SearchResult.iRow];
+		m_SearchResults.push_back(SearchResult);
+	}
+
+	HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
+
+	ListView_SetItemState(hListView,-1,0,LVIS_SELECTED|LVIS_FOCUSED);
+	ListView_SetItemCount(hListView,nRows);
+
+	/* The table holds the rows in the order they were
+	found, so any sort needs to be applied again. */
+	if(m_bResultsSorted)
+	{
+		SortSearchResults();
+	}
+	else
+	{
+		InvalidateRect(hListView,NULL,TRUE);
+	}
+
+	ShowWindow(GetDlgItem(m_hDlg,IDC_LINK_STATUS),SW_HIDE);
+	ShowWindow(GetDlgItem(m_hDlg,IDC_STATIC_STATUS),SW_SHOW);
+
+	TCHAR szTemp[128];
+	TCHAR szStatus[512];
+	LoadString(GetInstance(),IDS_SEARCH_REFINED_MESSAGE,
+		szTemp,SIZEOF_ARRAY(szTemp));
+	StringCchPrintf(szStatus,SIZEOF_ARRAY(szStatus),szTemp,
+		nRows,m_ResultTable.GetRowCount());
+	SetDlgItemText(m_hDlg,IDC_STATIC_STATUS,szStatus);
+
+	UpdateRefineButtons();
+}
+
+void CSearchDialog::UpdateRefineButtons()
+{
+	EnableWindow(GetDlgItem(m_hDlg,IDC_BUTTON_REFINE),
+		!m_bSearching && m_ResultTable.GetCurrentRowCount() > 0);
+	EnableWindow(GetDlgItem(m_hDlg,IDC_BUTTON_UNDOREFINE),
+		!m_bSearching && m_ResultTable.GetRefinementCount() > 0);
+}
+
+int CSearchDialog::GetSelectedSearchResult()
+{
+	HWND hListView = GetDlgItem(m_hDlg,IDC_LISTVIEW_SEARCHRESULTS);
+	int iSelected = ListView_GetNextItem(hListView,-1,LVNI_ALL|LVNI_SELECTED);
+
+	if(iSelected < 0 || iSelected >= static_cast<int>(m_SearchResults.size()))
+	{
+		return -1;
+	}
+
+	return iSelected;
 }
 
 INT_PTR CSearchDialog::OnClose()
@@ -1012,14 +1298,48 @@ INT_PTR CSearchDialog::OnNcDestroy()
 	return 0;
 }
 
-DWORD WINAPI NSearchDialog::SearchThread(LPVOID pParam)
+void NSearchDialog::SearchJob(LPVOID pParam,const CCancellationToken *pToken)
 {
+	UNREFERENCED_PARAMETER(pToken);
+
 	assert(pParam != NULL);
 
+	/* The search is started even if the pool is
+	shutting down, as it releases itself once it's
+	finished. */
 	CSearch *pSearch = reinterpret_cast<CSearch *>(pParam);
 	pSearch->StartSearching();
+}
 
-	return 0;
+void CSearchResultChunk::AddResult(const TCHAR *szFullFileName,
+	const CResultTable::ItemInfo_t &Info)
+{
+	m_Offsets.push_back(m_Buffer.size());
+	m_Buffer.insert(m_Buffer.end(),szFullFileName,
+		szFullFileName + lstrlen(szFullFileName) + 1);
+	m_Info.push_back(Info);
+}
+
+BOOL CSearchResultChunk::IsFull() const
+{
+	return m_Buffer.size() >= CHUNK_SIZE;
+}
+
+int CSearchResultChunk::GetResultCount() const
+{
+	return static_cast<int>(m_Offsets.size());
+}
+
+/* The returned pointer remains valid until the
+chunk is either freed or added to. */
+const TCHAR *CSearchResultChunk::GetResult(int iIndex) const
+{
+	return &m_Buffer[m_Offsets[iIndex]];
+}
+
+const CResultTable::ItemInfo_t &CSearchResultChunk::GetResultInfo(int iIndex) const
+{
+	return m_Info[iIndex];
 }
 
 CSearch::CSearch(HWND hDlg,TCHAR *szBaseDirectory,
@@ -1037,35 +1357,86 @@ CSearch::CSearch(HWND hDlg,TCHAR *szBaseDirectory,
 	StringCchCopy(m_szSearchPattern,SIZEOF_ARRAY(m_szSearchPattern),
 		szPattern);
 
-	InitializeCriticalSection(&m_csStop);
-	m_bStopSearching = FALSE;
+	m_nThreads = 0;
+	m_bDeterministicOrder = FALSE;
+	m_bUseIndex = FALSE;
+	m_TraversalOrder = TRAVERSAL_ORDER_DEFAULT;
+	m_bLocalityOrder = FALSE;
+	m_pWalker = NULL;
+	m_pPrefetcher = NULL;
+	m_pExporter = NULL;
+
+	InitializeCriticalSection(&m_csResults);
+	m_lStopSearching = 0;
 }
 
 CSearch::~CSearch()
 {
-	DeleteCriticalSection(&m_csStop);
+	delete m_pExporter;
+
+	DeleteCriticalSection(&m_csResults);
+}
+
+void CSearch::SetThreadCount(int nThreads)
+{
+	m_nThreads = nThreads;
+}
+
+void CSearch::SetDeterministicOrder(BOOL bDeterministicOrder)
+{
+	m_bDeterministicOrder = bDeterministicOrder;
+}
+
+void CSearch::SetUseIndex(BOOL bUseIndex)
+{
+	m_bUseIndex = bUseIndex;
+}
+
+void CSearch::SetTraversalOrder(TraversalOrder_t TraversalOrder)
+{
+	m_TraversalOrder = TraversalOrder;
+}
+
+void CSearch::SetContainingText(const TCHAR *szContainingText)
+{
+	m_strContainingText = szContainingText;
+}
+
+void CSearch::SetQuery(const TCHAR *szQuery)
+{
+	m_strQuery = szQuery;
+}
+
+void CSearch::SetExporter(CResultExporter *pExporter)
+{
+	m_pExporter = pExporter;
 }
 
 void CSearch::StartSearching()
 {
-	m_iFoldersFound = 0;
-	m_iFilesFound = 0;
+	m_lFoldersFound = 0;
+	m_lFilesFound = 0;
 
 	if(lstrcmp(m_szSearchPattern,EMPTY_STRING) != 0 &&
 		m_bUseRegularExpressions)
 	{
-		try
+		if(!m_RegexMatcher.Compile(m_szSearchPattern,m_bCaseInsensitive))
 		{
-			if(m_bCaseInsensitive)
-			{
-				m_rxPattern.assign(m_szSearchPattern,std::regex_constants::icase);
-			}
-			else
-			{
-				m_rxPattern.assign(m_szSearchPattern);
-			}
+			SendMessage(m_hDlg,NSearchDialog::WM_APP_REGULAREXPRESSIONINVALID,
+				0,0);
+
+			return;
 		}
-		catch(std::exception)
+	}
+	else if(!m_bUseRegularExpressions)
+	{
+		m_WildcardMatcher = CWildcardMatcher(m_szSearchPattern,!m_bCaseInsensitive);
+	}
+
+	if(!m_strContainingText.empty())
+	{
+		if(!m_ContentMatcher.Compile(m_strContainingText.c_str(),m_bUseRegularExpressions,
+			m_bCaseInsensitive))
 		{
 			SendMessage(m_hDlg,NSearchDialog::WM_APP_REGULAREXPRESSIONINVALID,
 				0,0);
@@ -1074,159 +1445,654 @@ void CSearch::StartSearching()
 		}
 	}
 
-	SearchDirectory(m_szBaseDirectory);
+	if(!m_Query.Parse(m_strQuery.c_str()))
+	{
+		SendMessage(m_hDlg,NSearchDialog::WM_APP_QUERYINVALID,
+			0,0);
+
+		return;
+	}
+
+	/* The index holds everything a query can check, but
+	not file contents, so content searches always go to the
+	disk (where the files are also spread across the
+	workers). */
+	if(!m_bUseIndex || !m_strContainingText.empty() || !SearchIndex())
+	{
+		SearchDisk();
+	}
+
+	BOOL bExportFailed = FALSE;
+
+	if(m_pExporter != NULL)
+	{
+		bExportFailed = !m_pExporter->Close();
+	}
 
-	SendMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHFINISHED,0,
-		MAKELPARAM(m_iFoldersFound,m_iFilesFound));
+	/* Posted (rather than sent), so that it arrives
+	after any results that are still queued. */
+	PostMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHFINISHED,bExportFailed,
+		MAKELPARAM(m_lFoldersFound,m_lFilesFound));
 
 	Release();
 }
 
-void CSearch::SearchDirectory(const TCHAR *szDirectory)
+/* Returns FALSE if the index can't be used (e.g. because
+it's still being built), in which case the disk needs to
+be searched instead. */
+BOOL CSearch::SearchIndex()
 {
-	SendMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHCHANGEDDIRECTORY,
-		reinterpret_cast<WPARAM>(szDirectory),0);
+	CFileNameIndex *pIndex = CFileNameIndexManager::GetInstance().GetIndex(m_szBaseDirectory);
+
+	if(pIndex == NULL)
+	{
+		return FALSE;
+	}
+
+	std::vector<CFileNameIndex::QueryResult_t> Results;
+	BOOL bRet = pIndex->Query(m_szBaseDirectory,m_bSearchSubFolders,m_szSearchPattern,
+		m_bUseRegularExpressions ? CFileNameIndex::QUERY_REGEX : CFileNameIndex::QUERY_WILDCARD,
+		m_bCaseInsensitive,m_dwAttributes,Results);
 
-	std::list<std::wstring> SubFolderList;
+	if(!bRet)
+	{
+		return FALSE;
+	}
 
-	SearchDirectoryInternal(szDirectory,&SubFolderList);
+	PendingResults_t Pending;
+	Pending.pChunk = NULL;
+	Pending.dwChunkStarted = 0;
 
-	bool bStop = false;
+	IndexContexts_t Contexts;
 
-	EnterCriticalSection(&m_csStop);
-	if(m_bStopSearching)
+	for(auto itr = Results.begin();itr != Results.end() && !IsStopRequested();itr++)
 	{
-		bStop = true;
+		/* The index doesn't hold the creation or last
+		access times, so they're left empty (which is
+		how the exporter writes missing values). */
+		WIN32_FIND_DATA wfd = {0};
+		ULARGE_INTEGER uliSize;
+		uliSize.QuadPart = itr->ulSize;
+
+		wfd.dwFileAttributes = itr->dwAttributes;
+		wfd.ftLastWriteTime = itr->ftLastWriteTime;
+		wfd.nFileSizeLow = uliSize.LowPart;
+		wfd.nFileSizeHigh = uliSize.HighPart;
+		StringCchCopy(wfd.cFileName,SIZEOF_ARRAY(wfd.cFileName),
+			PathFindFileName(itr->strFullFileName.c_str()));
+
+		if(!m_Query.IsEmpty())
+		{
+			std::wstring strDirectory = itr->strFullFileName.substr(0,
+				itr->strFullFileName.size() - lstrlen(wfd.cFileName));
+
+			if(!m_Query.Evaluate(&wfd,GetIndexContext(strDirectory,Contexts)))
+			{
+				continue;
+			}
+		}
+
+		if((itr->dwAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
+			FILE_ATTRIBUTE_DIRECTORY)
+			InterlockedIncrement(&m_lFoldersFound);
+		else
+			InterlockedIncrement(&m_lFilesFound);
+
+		if(m_pExporter != NULL)
+		{
+			if(!m_pExporter->AddResult(itr->strFullFileName.c_str(),&wfd))
+			{
+				StopSearching();
+			}
+		}
+		else
+		{
+			CResultTable::ItemInfo_t Info;
+			CResultTable::GetItemInfo(&wfd,Info);
+			AddPendingResult(Pending,itr->strFullFileName.c_str(),Info);
+		}
 	}
-	LeaveCriticalSection(&m_csStop);
 
-	if(bStop)
+	FlushPendingResults(Pending,TRUE);
+
+	return TRUE;
+}
+
+/* strDirectory ends with a backslash. Anything no longer
+than the base directory is the base directory itself. The
+context for any other directory is built from its parent's,
+in the same way as when walking the disk. */
+const CSearchQuery::DirectoryContext_t &CSearch::GetIndexContext(const std::wstring &strDirectory,
+	IndexContexts_t &Contexts) const
+{
+	auto itr = Contexts.find(strDirectory);
+
+	if(itr != Contexts.end())
 	{
-		return;
+		return itr->second;
 	}
 
-	if(m_bSearchSubFolders)
+	CSearchQuery::DirectoryContext_t &Context = Contexts[strDirectory];
+	size_t nBaseLength = lstrlen(m_szBaseDirectory);
+
+	if(strDirectory.size() <= nBaseLength + 1)
 	{
-		for each(auto strSubFolder in SubFolderList)
-		{
-			SearchDirectory(strSubFolder.c_str());
-		}
+		m_Query.GetBaseContext(Context);
+		return Context;
+	}
+
+	/* Skips the trailing backslash. */
+	size_t nNameStart = strDirectory.rfind('\\',strDirectory.size() - 2) + 1;
+	std::wstring strName = strDirectory.substr(nNameStart,strDirectory.size() - nNameStart - 1);
+
+	/* References to map elements stay valid as
+	other elements are added. */
+	const CSearchQuery::DirectoryContext_t &Parent =
+		GetIndexContext(strDirectory.substr(0,nNameStart),Contexts);
+	m_Query.GetChildContext(Parent,strName.c_str(),Context);
+
+	return Context;
+}
+
+void CSearch::SearchDisk()
+{
+	int nThreads = m_nThreads;
+
+	if(nThreads <= 0)
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		nThreads = static_cast<int>(si.dwNumberOfProcessors);
+	}
+
+	/* When run as a pool job, the walk is kept
+	within its device's limit. */
+	int nDeviceLimit = CThreadPool::GetJobDeviceLimit();
+
+	if(nDeviceLimit > 0)
+	{
+		nThreads = min(nThreads,nDeviceLimit);
+	}
+
+	/* Without sub folders, there is only ever
+	a single directory to search. */
+	if(!m_bSearchSubFolders)
+	{
+		nThreads = 1;
+	}
+
+	/* Without sub folders, there's nothing to order. */
+	m_bLocalityOrder = m_bSearchSubFolders &&
+		ShouldUseLocalityOrder(m_TraversalOrder,m_szBaseDirectory);
+
+	if(m_bLocalityOrder)
+	{
+		nThreads = min(nThreads,GetLocalityOrderThreadLimit(m_szBaseDirectory));
+	}
+
+	nThreads = max(1,min(nThreads,MAX_SEARCH_THREADS));
+
+	CParallelWalker<SearchNode_t *> Walker(nThreads);
+	m_pWalker = &Walker;
+
+	PendingResults_t EmptyResults;
+	EmptyResults.pChunk = NULL;
+	EmptyResults.dwChunkStarted = 0;
+
+	m_WorkerResults.assign(nThreads,EmptyResults);
+	m_OrderedResults = EmptyResults;
+
+	if(m_bLocalityOrder)
+	{
+		m_pPrefetcher = new CDirectoryPrefetcher(PREFETCH_DEPTH);
+		Walker.SetLocalityOrder(GetNodeLocation,PrefetchNode,
+			reinterpret_cast<LPVOID>(m_pPrefetcher),PREFETCH_DEPTH);
+	}
+
+	SearchNode_t *pRootNode = new SearchNode_t;
+	pRootNode->strDirectory = m_szBaseDirectory;
+	m_Query.GetBaseContext(pRootNode->QueryContext);
+	pRootNode->pResults = NULL;
+	pRootNode->nNextChild = 0;
+	pRootNode->bComplete = FALSE;
+	pRootNode->bResultsReported = FALSE;
+	pRootNode->ulLocation = 0;
+	pRootNode->bPrefetched = FALSE;
+
+	if(m_bLocalityOrder)
+	{
+		GetFileLocation(pRootNode->strDirectory,pRootNode->ulLocation);
+	}
+
+	m_ReportStack.clear();
+
+	if(m_bDeterministicOrder)
+	{
+		m_ReportStack.push_back(pRootNode);
 	}
+
+	m_lLastDirectoryReport = static_cast<LONG>(GetTickCount() - DIRECTORY_REPORT_INTERVAL);
+
+	std::vector<SearchNode_t *> RootNodes;
+	RootNodes.push_back(pRootNode);
+	Walker.Push(0,RootNodes);
+
+	Walker.Run(SearchWorkerProc,reinterpret_cast<LPVOID>(this));
+
+	/* Every directory has been searched (or discarded),
+	so every node has been reported and freed. */
+	assert(m_ReportStack.empty());
+
+	FlushPendingResults(m_OrderedResults,TRUE);
+	m_WorkerResults.clear();
+
+	m_pWalker = NULL;
+
+	delete m_pPrefetcher;
+	m_pPrefetcher = NULL;
+}
+
+void SearchWorkerProc(int iWorker,LPVOID pData)
+{
+	assert(pData != NULL);
+
+	CSearch *pSearch = reinterpret_cast<CSearch *>(pData);
+	pSearch->SearchWorker(iWorker);
 }
 
-/* Can't recurse, as it would overflow the stack. */
-void CSearch::SearchDirectoryInternal(const TCHAR *szSearchDirectory,
-	std::list<std::wstring> *pSubFolderList)
+void CSearch::SearchWorker(int iWorker)
 {
-	assert(szSearchDirectory != NULL);
-	assert(pSubFolderList != NULL);
+	SearchNode_t *pNode;
+
+	while(TRUE)
+	{
+		if(!m_pWalker->TryPop(iWorker,pNode))
+		{
+			/* There's nothing to add to the current
+			chunk for now, so hand it over before
+			waiting for more work. */
+			FlushPendingResults(m_WorkerResults[iWorker],TRUE);
+
+			if(!m_pWalker->Pop(iWorker,pNode))
+			{
+				break;
+			}
+		}
 
-	WIN32_FIND_DATA wfd;
-	TCHAR szSearchTerm[MAX_PATH];
+		SearchDirectory(iWorker,pNode);
+		m_pWalker->Finish();
 
-	PathCombine(szSearchTerm,szSearchDirectory,_T("*"));
+		FlushPendingResults(m_WorkerResults[iWorker],FALSE);
+	}
+}
 
-	HANDLE hFindFile = FindFirstFile(szSearchTerm,&wfd);
+/* Once a stop has been requested, directories are still
+taken from the queues (so that they can be freed), but
+are no longer searched. Directories in which the query
+can't match anything (e.g. because they're too deep)
+aren't searched either, so nothing below them is
+queued. */
+void CSearch::SearchDirectory(int iWorker,SearchNode_t *pNode)
+{
+	std::vector<SearchNode_t *> SubFolders;
 
-	if(hFindFile != INVALID_HANDLE_VALUE)
+	/* Searches are interactive, so this never waits; the
+	I/O is only counted against the disk. */
+	if(!IsStopRequested() && m_Query.CanMatchWithin(pNode->QueryContext) &&
+		CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE))
 	{
-		bool bStop = false;
+		ReportDirectory(pNode->strDirectory.c_str());
+
+		WIN32_FIND_DATA wfd;
 
-		while(FindNextFile(hFindFile,&wfd) != 0 && !bStop)
+		if(m_bLocalityOrder)
 		{
-			if(lstrcmpi(wfd.cFileName,_T(".")) != 0 &&
-				lstrcmpi(wfd.cFileName,_T("..")) != 0)
+			CDirectoryReader DirectoryReader;
+
+			if(DirectoryReader.Open(pNode->strDirectory))
 			{
-				BOOL bMatchFileName = FALSE;
-				BOOL bMatchAttributes = FALSE;
+				ULONGLONG ulLocation;
 
-				/* Only match against the filename if it's not empty. */
-				if(lstrcmp(m_szSearchPattern,EMPTY_STRING) != 0)
-				{
-					if(m_bUseRegularExpressions)
-					{
-						if(std::tr1::regex_match(wfd.cFileName,m_rxPattern))
-						{
-							bMatchFileName = TRUE;
-						}
-					}
-					else
-					{
-						if(CheckWildcardMatch(m_szSearchPattern,wfd.cFileName,!m_bCaseInsensitive))
-						{
-							bMatchFileName = TRUE;
-						}
-					}
-				}
-				else
+				while(!IsStopRequested() && DirectoryReader.Read(wfd,ulLocation))
 				{
-					/* No filename constraint, so all filenames match. */
-					bMatchFileName = TRUE;
+					SearchItem(iWorker,pNode,&wfd,ulLocation,SubFolders);
 				}
+			}
+		}
+		else
+		{
+			TCHAR szSearchTerm[MAX_PATH];
+
+			PathCombine(szSearchTerm,pNode->strDirectory.c_str(),_T("*"));
 
-				if(m_dwAttributes != 0)
+			HANDLE hFindFile = FindFirstFile(szSearchTerm,&wfd);
+
+			if(hFindFile != INVALID_HANDLE_VALUE)
+			{
+				do
 				{
-					if((wfd.dwFileAttributes & m_dwAttributes) == m_dwAttributes)
+					if(lstrcmpi(wfd.cFileName,_T(".")) == 0 ||
+						lstrcmpi(wfd.cFileName,_T("..")) == 0)
 					{
-						bMatchAttributes = TRUE;
+						continue;
 					}
-				}
-				else
-				{
-					bMatchAttributes = TRUE;
-				}
 
-				BOOL bItemMatch = bMatchFileName && bMatchAttributes;
+					SearchItem(iWorker,pNode,&wfd,0,SubFolders);
+				} while(!IsStopRequested() && FindNextFile(hFindFile,&wfd) != 0);
 
-				if(bItemMatch)
-				{
-					if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
-						FILE_ATTRIBUTE_DIRECTORY)
-						m_iFoldersFound++;
-					else
-						m_iFilesFound++;
+				FindClose(hFindFile);
+			}
+		}
+	}
+
+	if(m_bDeterministicOrder)
+	{
+		pNode->Children = SubFolders;
+	}
+
+	m_pWalker->Push(iWorker,SubFolders);
 
-					LPITEMIDLIST pidl = NULL;
-					TCHAR szFullFileName[MAX_PATH];
+	if(m_bDeterministicOrder)
+	{
+		CompleteNode(pNode);
+	}
+	else
+	{
+		delete pNode;
+	}
+}
 
-					PathCombine(szFullFileName,szSearchDirectory,wfd.cFileName);
-					GetIdlFromParsingName(szFullFileName,&pidl);
+void CSearch::SearchItem(int iWorker,SearchNode_t *pNode,const WIN32_FIND_DATA *pwfd,
+	ULONGLONG ulLocation,std::vector<SearchNode_t *> &SubFolders)
+{
+	TCHAR szFullFileName[MAX_PATH];
+	PathCombine(szFullFileName,pNode->strDirectory.c_str(),pwfd->cFileName);
 
-					PostMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHITEMFOUND,
-						reinterpret_cast<WPARAM>(ILClone(pidl)),0);
+	if(MatchItem(pwfd) && m_Query.Evaluate(pwfd,pNode->QueryContext) &&
+		MatchContents(pwfd,szFullFileName))
+	{
+		if((pwfd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
+			FILE_ATTRIBUTE_DIRECTORY)
+			InterlockedIncrement(&m_lFoldersFound);
+		else
+			InterlockedIncrement(&m_lFilesFound);
 
-					CoTaskMemFree(pidl);
-				}
+		ReportItem(iWorker,pNode,szFullFileName,pwfd);
+	}
 
-				if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
-					FILE_ATTRIBUTE_DIRECTORY)
-				{
-					TCHAR szSubFolder[MAX_PATH];
+	if(m_bSearchSubFolders &&
+		(pwfd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
+		FILE_ATTRIBUTE_DIRECTORY)
+	{
+		SearchNode_t *pChildNode = new SearchNode_t;
+		pChildNode->strDirectory = szFullFileName;
+		m_Query.GetChildContext(pNode->QueryContext,pwfd->cFileName,
+			pChildNode->QueryContext);
+		pChildNode->pResults = NULL;
+		pChildNode->nNextChild = 0;
+		pChildNode->bComplete = FALSE;
+		pChildNode->bResultsReported = FALSE;
+		pChildNode->ulLocation = ulLocation;
+		pChildNode->bPrefetched = FALSE;
+
+		SubFolders.push_back(pChildNode);
+	}
+}
 
-					PathCombine(szSubFolder,szSearchDirectory,
-						wfd.cFileName);
+BOOL CSearch::MatchItem(const WIN32_FIND_DATA *pwfd) const
+{
+	BOOL bMatchFileName = FALSE;
+	BOOL bMatchAttributes = FALSE;
 
-					pSubFolderList->push_back(szSubFolder);
-				}
+	/* Only match against the filename if it's not empty. */
+	if(lstrcmp(m_szSearchPattern,EMPTY_STRING) != 0)
+	{
+		if(m_bUseRegularExpressions)
+		{
+			if(m_RegexMatcher.Match(pwfd->cFileName))
+			{
+				bMatchFileName = TRUE;
+			}
+		}
+		else
+		{
+			if(m_WildcardMatcher.Match(pwfd->cFileName))
+			{
+				bMatchFileName = TRUE;
 			}
+		}
+	}
+	else
+	{
+		/* No filename constraint, so all filenames match. */
+		bMatchFileName = TRUE;
+	}
+
+	if(m_dwAttributes != 0)
+	{
+		if((pwfd->dwFileAttributes & m_dwAttributes) == m_dwAttributes)
+		{
+			bMatchAttributes = TRUE;
+		}
+	}
+	else
+	{
+		bMatchAttributes = TRUE;
+	}
+
+	return bMatchFileName && bMatchAttributes;
+}
+
+/* Only called once an item has matched on its name
+and attributes, since reading the file is by far the
+most expensive check. */
+BOOL CSearch::MatchContents(const WIN32_FIND_DATA *pwfd,const TCHAR *szFullFileName) const
+{
+	if(m_strContainingText.empty())
+	{
+		return TRUE;
+	}
+
+	if((pwfd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ==
+		FILE_ATTRIBUTE_DIRECTORY)
+	{
+		return FALSE;
+	}
+
+	return m_ContentMatcher.MatchFile(szFullFileName,&m_lStopSearching) ==
+		CContentMatcher::MATCH_FOUND;
+}
 
-			EnterCriticalSection(&m_csStop);
-			if(m_bStopSearching)
+void CSearch::ReportItem(int iWorker,SearchNode_t *pNode,const TCHAR *szFullFileName,
+	const WIN32_FIND_DATA *pwfd)
+{
+	if(m_pExporter != NULL)
+	{
+		/* Results are written in the order they're found.
+		There's no point continuing once the file can no
+		longer be written to. */
+		if(!m_pExporter->AddResult(szFullFileName,pwfd))
+		{
+			StopSearching();
+		}
+	}
+	else if(m_bDeterministicOrder)
+	{
+		CResultTable::ItemInfo_t Info;
+		CResultTable::GetItemInfo(pwfd,Info);
+
+		/* Only this worker can access the node
+		until it has been marked as complete. */
+		if(pNode->pResults == NULL)
+		{
+			pNode->pResults = new CSearchResultChunk;
+		}
+
+		pNode->pResults->AddResult(szFullFileName,Info);
+	}
+	else
+	{
+		CResultTable::ItemInfo_t Info;
+		CResultTable::GetItemInfo(pwfd,Info);
+
+		AddPendingResult(m_WorkerResults[iWorker],szFullFileName,Info);
+	}
+}
+
+void CSearch::AddPendingResult(PendingResults_t &Pending,const TCHAR *szFullFileName,
+	const CResultTable::ItemInfo_t &Info)
+{
+	if(Pending.pChunk == NULL)
+	{
+		Pending.pChunk = new CSearchResultChunk;
+		Pending.dwChunkStarted = GetTickCount();
+	}
+
+	Pending.pChunk->AddResult(szFullFileName,Info);
+
+	if(Pending.pChunk->IsFull())
+	{
+		FlushPendingResults(Pending,TRUE);
+	}
+}
+
+/* Hands the current chunk over to the dialog, if it's
+either been forced, or the chunk has been held for long
+enough. Once the dialog has the chunk, it's responsible
+for freeing it. */
+void CSearch::FlushPendingResults(PendingResults_t &Pending,BOOL bForce)
+{
+	if(Pending.pChunk == NULL)
+	{
+		return;
+	}
+
+	if(!bForce &&
+		(GetTickCount() - Pending.dwChunkStarted) < RESULT_FLUSH_INTERVAL)
+	{
+		return;
+	}
+
+	BOOL bPosted = FALSE;
+
+	if(!IsStopRequested())
+	{
+		bPosted = PostMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHRESULTS,
+			reinterpret_cast<WPARAM>(Pending.pChunk),0);
+	}
+
+	if(!bPosted)
+	{
+		delete Pending.pChunk;
+	}
+
+	Pending.pChunk = NULL;
+}
+
+/* With several workers running, the directory being
+searched changes far more often than the status text
+can usefully show. Only one worker reports within
+each interval. */
+void CSearch::ReportDirectory(const TCHAR *szDirectory)
+{
+	LONG lNow = static_cast<LONG>(GetTickCount());
+	LONG lLastReport = m_lLastDirectoryReport;
+
+	if(static_cast<DWORD>(lNow - lLastReport) < DIRECTORY_REPORT_INTERVAL)
+	{
+		return;
+	}
+
+	if(InterlockedCompareExchange(&m_lLastDirectoryReport,lNow,lLastReport) != lLastReport)
+	{
+		return;
+	}
+
+	SendMessage(m_hDlg,NSearchDialog::WM_APP_SEARCHCHANGEDDIRECTORY,
+		reinterpret_cast<WPARAM>(szDirectory),0);
+}
+
+ULONGLONG CSearch::GetNodeLocation(SearchNode_t * const &pNode)
+{
+	return pNode->ulLocation;
+}
+
+void CSearch::PrefetchNode(SearchNode_t *&pNode,LPVOID pData)
+{
+	CDirectoryPrefetcher *pPrefetcher = reinterpret_cast<CDirectoryPrefetcher *>(pData);
+
+	if(!pNode->bPrefetched)
+	{
+		pPrefetcher->Prefetch(pNode->strDirectory);
+		pNode->bPrefetched = TRUE;
+	}
+}
+
+void CSearch::CompleteNode(SearchNode_t *pNode)
+{
+	EnterCriticalSection(&m_csResults);
+	pNode->bComplete = TRUE;
+	ReportCompletedNodes();
+	LeaveCriticalSection(&m_csResults);
+}
+
+/* Walks the tree in depth-first order, reporting the
+results of each node, until a node that hasn't yet been
+searched is reached. Nodes are freed once they (and all
+their children) have been reported. Must be called with
+m_csResults held. */
+void CSearch::ReportCompletedNodes()
+{
+	while(!m_ReportStack.empty())
+	{
+		SearchNode_t *pNode = m_ReportStack.back();
+
+		if(!pNode->bComplete)
+		{
+			break;
+		}
+
+		if(!pNode->bResultsReported)
+		{
+			if(pNode->pResults != NULL)
 			{
-				bStop = true;
+				int nResults = pNode->pResults->GetResultCount();
+
+				for(int i = 0;i < nResults;i++)
+				{
+					AddPendingResult(m_OrderedResults,pNode->pResults->GetResult(i),
+						pNode->pResults->GetResultInfo(i));
+				}
+
+				delete pNode->pResults;
+				pNode->pResults = NULL;
 			}
-			LeaveCriticalSection(&m_csStop);
+
+			pNode->bResultsReported = TRUE;
 		}
 
-		FindClose(hFindFile);
+		if(pNode->nNextChild < pNode->Children.size())
+		{
+			m_ReportStack.push_back(pNode->Children[pNode->nNextChild++]);
+		}
+		else
+		{
+			m_ReportStack.pop_back();
+			delete pNode;
+		}
 	}
+
+	FlushPendingResults(m_OrderedResults,FALSE);
+}
+
+BOOL CSearch::IsStopRequested() const
+{
+	return m_lStopSearching != 0;
 }
 
 void CSearch::StopSearching()
 {
-	EnterCriticalSection(&m_csStop);
-	m_bStopSearching = TRUE;
-	LeaveCriticalSection(&m_csStop);
+	InterlockedExchange(&m_lStopSearching,1);
 }
 
 void CSearchDialog::SaveState()
@@ -1241,6 +2107,9 @@ void CSearchDialog::SaveState()
 	m_sdps->m_bUseRegularExpressions = IsDlgButtonChecked(m_hDlg,
 		IDC_CHECK_USEREGULAREXPRESSIONS) == BST_CHECKED;
 
+	m_sdps->m_bUseIndex = IsDlgButtonChecked(m_hDlg,
+		IDC_CHECK_USEINDEX) == BST_CHECKED;
+
 	m_sdps->m_bSearchSubFolders = IsDlgButtonChecked(m_hDlg,
 		IDC_CHECK_SEARCHSUBFOLDERS) == BST_CHECKED;
 
@@ -1272,6 +2141,7 @@ CDialogSettings(SETTINGS_KEY)
 {
 	m_bSearchSubFolders			= TRUE;
 	m_bUseRegularExpressions	= FALSE;
+	m_bUseIndex					= FALSE;
 	m_bCaseInsensitive			= FALSE;
 	m_bArchive					= FALSE;
 	m_bHidden					= FALSE;
@@ -1319,6 +2189,7 @@ void CSearchDialogPersistentSettings::SaveExtraRegistrySettings(HKEY hKey)
 	NRegistrySettings::SaveStringToRegistry(hKey, SETTING_SEARCH_DIRECTORY_TEXT, m_szSearchPattern);
 	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_SEARCH_SUB_FOLDERS, m_bSearchSubFolders);
 	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_USE_REGULAR_EXPRESSIONS, m_bUseRegularExpressions);
+	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_USE_INDEX, m_bUseIndex);
 	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_CASE_INSENSITIVE, m_bCaseInsensitive);
 	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_ARCHIVE, m_bArchive);
 	NRegistrySettings::SaveDwordToRegistry(hKey, SETTING_HIDDEN, m_bHidden);
@@ -1343,6 +2214,7 @@ void CSearchDialogPersistentSettings::LoadExtraRegistrySettings(HKEY hKey)
 	NRegistrySettings::ReadStringFromRegistry(hKey, SETTING_SEARCH_DIRECTORY_TEXT, m_szSearchPattern, SIZEOF_ARRAY(m_szSearchPattern));
 	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_SEARCH_SUB_FOLDERS, reinterpret_cast<LPDWORD>(&m_bSearchSubFolders));
 	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_USE_REGULAR_EXPRESSIONS, reinterpret_cast<LPDWORD>(&m_bUseRegularExpressions));
+	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_USE_INDEX, reinterpret_cast<LPDWORD>(&m_bUseIndex));
 	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_CASE_INSENSITIVE, reinterpret_cast<LPDWORD>(&m_bCaseInsensitive));
 	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_ARCHIVE, reinterpret_cast<LPDWORD>(&m_bArchive));
 	NRegistrySettings::ReadDwordFromRegistry(hKey, SETTING_HIDDEN, reinterpret_cast<LPDWORD>(&m_bHidden));
@@ -1368,6 +2240,7 @@ void CSearchDialogPersistentSettings::SaveExtraXMLSettings(
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_SEARCH_DIRECTORY_TEXT, m_szSearchPattern);
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_SEARCH_SUB_FOLDERS, NXMLSettings::EncodeBoolValue(m_bSearchSubFolders));
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_USE_REGULAR_EXPRESSIONS, NXMLSettings::EncodeBoolValue(m_bUseRegularExpressions));
+	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_USE_INDEX, NXMLSettings::EncodeBoolValue(m_bUseIndex));
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_CASE_INSENSITIVE, NXMLSettings::EncodeBoolValue(m_bCaseInsensitive));
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_ARCHIVE, NXMLSettings::EncodeBoolValue(m_bArchive));
 	NXMLSettings::AddAttributeToNode(pXMLDom, pParentNode, SETTING_HIDDEN, NXMLSettings::EncodeBoolValue(m_bHidden));
@@ -1407,6 +2280,10 @@ void CSearchDialogPersistentSettings::LoadExtraXMLSettings(BSTR bstrName,BSTR bs
 	{
 		m_bUseRegularExpressions = NXMLSettings::DecodeBoolValue(bstrValue);
 	}
+	else if(lstrcmpi(bstrName, SETTING_USE_INDEX) == 0)
+	{
+		m_bUseIndex = NXMLSettings::DecodeBoolValue(bstrValue);
+	}
 	else if(lstrcmpi(bstrName, SETTING_CASE_INSENSITIVE) == 0)
 	{
 		m_bCaseInsensitive = NXMLSettings::DecodeBoolValue(bstrValue);
@@ -3,13 +3,21 @@
 #include <list>
 #include <vector>
 #include <string>
-#include <regex>
 #include <unordered_map>
 #include <boost/circular_buffer.hpp>
 #include "../Helper/BaseDialog.h"
 #include "../Helper/DialogSettings.h"
 #include "../Helper/ReferenceCount.h"
 #include "../Helper/FileContextMenuManager.h"
+#include "../Helper/LocalityOrder.h"
+#include "../Helper/ParallelWalker.h"
+#include "../Helper/RegexMatcher.h"
+#include "../Helper/ContentMatcher.h"
+#include "../Helper/SearchQuery.h"
+#include "../Helper/ResultExporter.h"
+#include "../Helper/ResultTable.h"
+#include "../Helper/WildcardMatcher.h"
+#include "../Helper/Macros.h"
 
 #import <msxml3.dll> raw_interfaces_only
 
@@ -35,6 +43,7 @@ private:
 	static const TCHAR SETTING_SEARCH_DIRECTORY_TEXT[];
 	static const TCHAR SETTING_SEARCH_SUB_FOLDERS[];
 	static const TCHAR SETTING_USE_REGULAR_EXPRESSIONS[];
+	static const TCHAR SETTING_USE_INDEX[];
 	static const TCHAR SETTING_CASE_INSENSITIVE[];
 	static const TCHAR SETTING_ARCHIVE[];
 	static const TCHAR SETTING_HIDDEN[];
@@ -81,6 +90,7 @@ private:
 	boost::circular_buffer<std::wstring>	*m_pSearchDirectories;
 	BOOL						m_bSearchSubFolders;
 	BOOL						m_bUseRegularExpressions;
+	BOOL						m_bUseIndex;
 	BOOL						m_bCaseInsensitive;
 	BOOL						m_bArchive;
 	BOOL						m_bHidden;
@@ -95,20 +105,156 @@ private:
 	int							m_iColumnWidth2;
 };
 
+/* A block of search results. Paths are stored back to
+back in a single buffer, so that a whole block can be
+handed from the search thread to the dialog (and later
+freed) as one unit. */
+class CSearchResultChunk
+{
+public:
+
+	/* The number of characters after which a
+	chunk is full and should be handed over. */
+	static const size_t	CHUNK_SIZE = 32768;
+
+	CSearchResultChunk() {}
+
+	void			AddResult(const TCHAR *szFullFileName,const CResultTable::ItemInfo_t &Info);
+	BOOL			IsFull() const;
+	int				GetResultCount() const;
+	const TCHAR		*GetResult(int iIndex) const;
+	const CResultTable::ItemInfo_t	&GetResultInfo(int iIndex) const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CSearchResultChunk);
+
+	std::vector<TCHAR>	m_Buffer;
+	std::vector<size_t>	m_Offsets;
+	std::vector<CResultTable::ItemInfo_t>	m_Info;
+};
+
+/* Performs the actual search. Directories are walked
+in parallel by a set of worker threads (see
+CParallelWalker). */
 class CSearch : public CReferenceCount
 {
+	friend void	SearchWorkerProc(int iWorker,LPVOID pData);
+
 public:
 	
 	CSearch(HWND hDlg,TCHAR *szBaseDirectory,TCHAR *szPattern,DWORD dwAttributes,BOOL bUseRegularExpressions,BOOL bCaseInsensitive,BOOL bSearchSubFolders);
 	~CSearch();
 
+	/* A thread count of 0 uses one thread per processor.
+	Within a pool job, the count is also limited to what
+	the job's device allows. */
+	void				SetThreadCount(int nThreads);
+
+	/* If set, results are reported in the same order a
+	single-threaded depth-first walk would produce. Results
+	for a directory are then held back until every directory
+	that precedes it has been searched. */
+	void				SetDeterministicOrder(BOOL bDeterministicOrder);
+
+	/* If set, the search is answered from the file name
+	index, provided the index for the base directory's
+	volume is ready. Otherwise, the disk is searched (as
+	it always is when searching file contents). */
+	void				SetUseIndex(BOOL bUseIndex);
+
+	/* TRAVERSAL_ORDER_DEFAULT by default. In locality
+	order, directories are searched in order of where
+	they are on disk, and are listed ahead of the
+	workers. This has no effect on the order results
+	are reported in, if that's deterministic. */
+	void				SetTraversalOrder(TraversalOrder_t TraversalOrder);
+
+	/* If set, only files whose contents contain the
+	text are matched (folders are never matched). The
+	text is treated as a regular expression if the
+	search pattern is. */
+	void				SetContainingText(const TCHAR *szContainingText);
+
+	/* Items must also match the query (see
+	CSearchQuery for the syntax). */
+	void				SetQuery(const TCHAR *szQuery);
+
+	/* If set, results are written to the exporter
+	rather than being sent to the dialog. The exporter
+	should already be open. The search takes ownership
+	of it, and closes it once the search finishes. */
+	void				SetExporter(CResultExporter *pExporter);
+
 	void				StartSearching();
 	void				StopSearching();
 
 private:
 
-	void				SearchDirectory(const TCHAR *szDirectory);
-	void				SearchDirectoryInternal(const TCHAR *szSearchDirectory,std::list<std::wstring> *pSubFolderList);
+	static const int	MAX_SEARCH_THREADS = 16;
+	static const DWORD	DIRECTORY_REPORT_INTERVAL = 100;
+
+	/* How many directories are listed ahead of
+	the workers, in locality order. */
+	static const size_t	PREFETCH_DEPTH = 16;
+
+	/* The longest a partially filled chunk of
+	results is held before being handed over. */
+	static const DWORD	RESULT_FLUSH_INTERVAL = 100;
+
+	struct SearchNode_t
+	{
+		std::wstring				strDirectory;
+		CSearchQuery::DirectoryContext_t	QueryContext;
+
+		/* Only used when results are being
+		reported in a deterministic order. */
+		CSearchResultChunk			*pResults;
+		std::vector<SearchNode_t *>	Children;
+		size_t						nNextChild;
+		BOOL						bComplete;
+		BOOL						bResultsReported;
+
+		/* Only used in locality order. */
+		ULONGLONG					ulLocation;
+		BOOL						bPrefetched;
+	};
+
+	/* Results that have been found, but not
+	yet handed over to the dialog. */
+	struct PendingResults_t
+	{
+		CSearchResultChunk	*pChunk;
+		DWORD				dwChunkStarted;
+	};
+
+	/* Query contexts for the directories results from
+	the index are in, keyed by their full path. */
+	typedef std::unordered_map<std::wstring,CSearchQuery::DirectoryContext_t>	IndexContexts_t;
+
+	BOOL				SearchIndex();
+	const CSearchQuery::DirectoryContext_t	&GetIndexContext(const std::wstring &strDirectory,
+							IndexContexts_t &Contexts) const;
+	void				SearchDisk();
+	void				SearchWorker(int iWorker);
+	void				SearchDirectory(int iWorker,SearchNode_t *pNode);
+	void				SearchItem(int iWorker,SearchNode_t *pNode,const WIN32_FIND_DATA *pwfd,
+							ULONGLONG ulLocation,std::vector<SearchNode_t *> &SubFolders);
+	BOOL				MatchItem(const WIN32_FIND_DATA *pwfd) const;
+	BOOL				MatchContents(const WIN32_FIND_DATA *pwfd,const TCHAR *szFullFileName) const;
+	void				ReportItem(int iWorker,SearchNode_t *pNode,const TCHAR *szFullFileName,const WIN32_FIND_DATA *pwfd);
+	void				AddPendingResult(PendingResults_t &Pending,const TCHAR *szFullFileName,
+							const CResultTable::ItemInfo_t &Info);
+	void				FlushPendingResults(PendingResults_t &Pending,BOOL bForce);
+	void				ReportDirectory(const TCHAR *szDirectory);
+
+	static ULONGLONG	GetNodeLocation(SearchNode_t * const &pNode);
+	static void			PrefetchNode(SearchNode_t *&pNode,LPVOID pData);
+
+	void				CompleteNode(SearchNode_t *pNode);
+	void				ReportCompletedNodes();
+
+	BOOL				IsStopRequested() const;
 
 	HWND				m_hDlg;
 
@@ -119,13 +265,47 @@ private:
 	BOOL				m_bCaseInsensitive;
 	BOOL				m_bSearchSubFolders;
 
-	std::wregex			m_rxPattern;
+	CRegexMatcher		m_RegexMatcher;
+	CWildcardMatcher	m_WildcardMatcher;
+
+	std::wstring		m_strContainingText;
+	CContentMatcher		m_ContentMatcher;
+
+	std::wstring		m_strQuery;
+	CSearchQuery		m_Query;
+
+	CResultExporter		*m_pExporter;
+
+	int					m_nThreads;
+	BOOL				m_bDeterministicOrder;
+	BOOL				m_bUseIndex;
+	TraversalOrder_t	m_TraversalOrder;
+
+	/* Set once a stop has been requested. Read
+	by the workers without taking any lock. */
+	volatile LONG		m_lStopSearching;
+
+	/* Only valid while the disk is being searched. */
+	CParallelWalker<SearchNode_t *>	*m_pWalker;
+
+	BOOL				m_bLocalityOrder;
+	CDirectoryPrefetcher	*m_pPrefetcher;
+
+	/* One per worker. Each entry is only ever
+	accessed by its own worker. */
+	std::vector<PendingResults_t>	m_WorkerResults;
 
-	CRITICAL_SECTION	m_csStop;
-	BOOL				m_bStopSearching;
+	volatile LONG		m_lLastDirectoryReport;
 
-	int					m_iFoldersFound;
-	int					m_iFilesFound;
+	/* Used when reporting results in order. The stack
+	holds the path from the root to the next node
+	whose results are due. */
+	CRITICAL_SECTION	m_csResults;
+	std::vector<SearchNode_t *>	m_ReportStack;
+	PendingResults_t	m_OrderedResults;
+
+	volatile LONG		m_lFoldersFound;
+	volatile LONG		m_lFilesFound;
 };
 
 class CSearchDialog : public CBaseDialog, public IFileContextMenuExternal
@@ -140,15 +320,9 @@ public:
 	BOOL			HandleShellMenuItem(LPCITEMIDLIST pidlParent,const std::list<LPITEMIDLIST> &pidlItemList,DWORD_PTR dwData,const TCHAR *szCmd);
 	void			HandleCustomMenuItem(LPCITEMIDLIST pidlParent,const std::list<LPITEMIDLIST> &pidlItemList,int iCmd);
 
-	/* Sorting methods. */
-	int CALLBACK	SortResults(LPARAM lParam1,LPARAM lParam2);
-	int CALLBACK	SortResultsByName(LPARAM lParam1,LPARAM lParam2);
-	int CALLBACK	SortResultsByPath(LPARAM lParam1,LPARAM lParam2);
-
 protected:
 
 	INT_PTR	OnInitDialog();
-	INT_PTR	OnTimer(int iTimerID);
 	INT_PTR	OnCommand(WPARAM wParam,LPARAM lParam);
 	INT_PTR	OnNotify(NMHDR *pnmhdr);
 	INT_PTR	OnClose();
@@ -158,9 +332,18 @@ protected:
 
 private:
 
-	static const int SEARCH_PROCESSITEMS_TIMER_ID = 0;
-	static const int SEARCH_PROCESSITEMS_TIMER_ELAPSED = 50;
-	static const int SEARCH_MAX_ITEMS_BATCH_PROCESS = 100;
+	/* The results list is virtual. Each entry refers
+	to a row in the result table. */
+	struct SearchResult_t
+	{
+		int			iRow;
+		const TCHAR	*pszFullFileName;
+		const TCHAR	*pszFileName;
+
+		/* Looked up the first time the
+		item is shown. */
+		int			iIcon;
+	};
 
 	static const int MIN_SHELL_MENU_ID = 1;
 	static const int MAX_SHELL_MENU_ID = 1000;
@@ -171,11 +354,27 @@ private:
 	void						SaveState();
 
 	void						OnSearch();
-	void						StartSearching();
+	void						OnExport();
+	void						StartSearching(CResultExporter *pExporter);
 	void						StopSearching();
+	void						OnRefine();
+	void						OnUndoRefine();
+	void						ShowCurrentResults();
+	void						UpdateRefineButtons();
 	void						SaveEntry(int comboBoxId, boost::circular_buffer<std::wstring> &buffer);
 	void						UpdateListViewHeader();
 
+	void						OnSearchResults(CSearchResultChunk *pChunk);
+	void						OnGetDispInfo(NMLVDISPINFO *pnmlvdi);
+	void						ClearSearchResults();
+	int							GetSelectedSearchResult();
+
+	/* Sorting methods. */
+	void						SortSearchResults();
+	int							SortResults(const SearchResult_t &Result1,const SearchResult_t &Result2) const;
+	int							SortResultsByName(const SearchResult_t &Result1,const SearchResult_t &Result2) const;
+	int							SortResultsByPath(const SearchResult_t &Result1,const SearchResult_t &Result2) const;
+
 	TCHAR						m_szSearchDirectory[MAX_PATH];
 	HICON						m_hDialogIcon;
 	HICON						m_hDirectoryIcon;
@@ -186,13 +385,11 @@ private:
 	CSearch						*m_pSearch;
 
 	/* Listview item information. */
-	std::list<LPITEMIDLIST>		m_AwaitingSearchItems;
-	std::unordered_map<int,std::wstring>	m_SearchItemsMapInternal;
-	int							m_iInternalIndex;
+	CResultTable				m_ResultTable;
+	std::vector<SearchResult_t>	m_SearchResults;
+	BOOL						m_bResultsSorted;
 	int							m_iPreviousSelectedColumn;
 
-	BOOL						m_bSetSearchTimer;
-
 	IExplorerplusplus			*m_pexpp;
 
 	CSearchDialogPersistentSettings	*m_sdps;
@@ -18,9 +18,11 @@
 #include "SplitFileDialog.h"
 #include "MainResource.h"
 #include "../Helper/Helper.h"
+#include "../Helper/BlockCopier.h"
 #include "../Helper/RegistrySettings.h"
 #include "../Helper/XMLSettings.h"
 #include "../Helper/FileOperations.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/WindowHelper.h"
 #include "../Helper/Macros.h"
 
@@ -34,7 +36,7 @@ namespace NSplitFileDialog
 
 	const TCHAR		COUNTER_PATTERN[] = _T("/N");
 
-	DWORD WINAPI	SplitFileThreadProcStub(LPVOID pParam);
+	void			SplitFileJob(LPVOID pParam,const CCancellationToken *pToken);
 }
 
 const TCHAR CSplitFileDialogPersistentSettings::SETTINGS_KEY[] = _T("SplitFile");
@@ -383,7 +385,7 @@ void CSplitFileDialog::OnOk()
 		BOOL bTranslated;
 		UINT uSplitSize = GetDlgItemInt(m_hDlg,IDC_SPLIT_EDIT_SIZE,&bTranslated,FALSE);
 
-		if(!bTranslated)
+		if(!bTranslated || uSplitSize == 0)
 		{
 			TCHAR szTemp[128];
 
@@ -403,6 +405,10 @@ void CSplitFileDialog::OnOk()
 
 		auto itr = m_SizeMap.find(iCurSel);
 
+		/* Done in 64 bits, so that pieces
+		of 4GB or more don't overflow. */
+		ULONGLONG ulSplitSize = uSplitSize;
+
 		if(itr != m_SizeMap.end())
 		{
 			switch(itr->second)
@@ -413,21 +419,21 @@ void CSplitFileDialog::OnOk()
 				break;
 
 			case SIZE_TYPE_KB:
-				uSplitSize *= KB;
+				ulSplitSize *= KB;
 				break;
 
 			case SIZE_TYPE_MB:
-				uSplitSize *= MB;
+				ulSplitSize *= MB;
 				break;
 
 			case SIZE_TYPE_GB:
-				uSplitSize *= GB;
+				ulSplitSize *= GB;
 				break;
 			}
 		}
 
 		m_pSplitFile = new CSplitFile(m_hDlg,m_strFullFilename,strOutputFilename,
-			strOutputDirectory,uSplitSize);
+			strOutputDirectory,ulSplitSize,SPLIT_BUFFER_SIZE);
 
 		GetDlgItemText(m_hDlg,IDOK,m_szOk,SIZEOF_ARRAY(m_szOk));
 
@@ -444,10 +450,31 @@ void CSplitFileDialog::OnOk()
 			szTemp,SIZEOF_ARRAY(szTemp));
 		SetDlgItemText(m_hDlg,IDC_SPLIT_STATIC_MESSAGE,szTemp);
 
-		HANDLE hThread = CreateThread(NULL,0,NSplitFileDialog::SplitFileThreadProcStub,
-			reinterpret_cast<LPVOID>(m_pSplitFile),0,NULL);
-		SetThreadPriority(hThread,THREAD_PRIORITY_LOWEST);
-		CloseHandle(hThread);
+		/* The job holds its own reference, as the dialog
+		may be closed before the job has run. */
+		m_pSplitFile->AddRef();
+
+		if(!CThreadPool::GetInstance().QueueJob(NSplitFileDialog::SplitFileJob,
+			reinterpret_cast<LPVOID>(m_pSplitFile),THREAD_POOL_PRIORITY_NORMAL,
+			m_strFullFilename.c_str()))
+		{
+			/* The pool is shutting down, so the split will
+			never run. Both the job's reference and the
+			dialog's are released. */
+			m_pSplitFile->Release();
+			m_pSplitFile->Release();
+			m_pSplitFile = NULL;
+
+			m_bSplittingFile = false;
+
+			KillTimer(m_hDlg,ELPASED_TIMER_ID);
+
+			LoadString(GetInstance(),IDS_SPLITFILEDIALOG_CANCELLED,
+				szTemp,SIZEOF_ARRAY(szTemp));
+			SetDlgItemText(m_hDlg,IDC_SPLIT_STATIC_MESSAGE,szTemp);
+
+			SetDlgItemText(m_hDlg,IDOK,m_szOk);
+		}
 	}
 	else
 	{
@@ -520,34 +547,37 @@ void CSplitFileDialog::OnSplitFinished()
 	SetDlgItemText(m_hDlg,IDOK,m_szOk);
 }
 
-DWORD WINAPI NSplitFileDialog::SplitFileThreadProcStub(LPVOID pParam)
+void NSplitFileDialog::SplitFileJob(LPVOID pParam,const CCancellationToken *pToken)
 {
 	assert(pParam != NULL);
 
 	CSplitFile *pSplitFile = reinterpret_cast<CSplitFile *>(pParam);
-	pSplitFile->SplitFile();
 
-	return 0;
+	if(!pToken->IsCancelled())
+	{
+		pSplitFile->SplitFile();
+	}
+
+	pSplitFile->Release();
 }
 
 CSplitFile::CSplitFile(HWND hDlg,std::wstring strFullFilename,
 	std::wstring strOutputFilename,std::wstring strOutputDirectory,
-	UINT uSplitSize)
+	ULONGLONG ulSplitSize,DWORD dwBufferSize)
 {
 	m_hDlg					= hDlg;
 	m_strFullFilename		= strFullFilename;
 	m_strOutputFilename		= strOutputFilename;
 	m_strOutputDirectory	= strOutputDirectory;
-	m_uSplitSize			= uSplitSize;
+	m_ulSplitSize			= ulSplitSize;
+	m_dwBufferSize			= dwBufferSize;
 
-	m_bStopSplitting		= false;
-
-	InitializeCriticalSection(&m_csStop);
+	m_pStopToken			= new CCancellationToken();
 }
 
 CSplitFile::~CSplitFile()
 {
-	DeleteCriticalSection(&m_csStop);
+	m_pStopToken->Release();
 }
 
 void CSplitFile::SplitFile()
@@ -564,9 +594,9 @@ void CSplitFile::SplitFile()
 	LARGE_INTEGER lFileSize;
 	GetFileSizeEx(hInputFile,&lFileSize);
 
-	LONGLONG nSplits = lFileSize.QuadPart / m_uSplitSize;
+	LONGLONG nSplits = lFileSize.QuadPart / m_ulSplitSize;
 
-	if((lFileSize.QuadPart % m_uSplitSize) != 0)
+	if((lFileSize.QuadPart % m_ulSplitSize) != 0)
 		nSplits++;
 
 	PostMessage(m_hDlg,NSplitFileDialog::WM_APP_SETTOTALSPLITCOUNT,
@@ -581,49 +611,60 @@ void CSplitFile::SplitFile()
 
 void CSplitFile::SplitFileInternal(HANDLE hInputFile,const LARGE_INTEGER &lFileSize)
 {
-	LARGE_INTEGER lRunningSplitSize = {0};
+	/* Each piece is streamed through the copier's
+	buffers, rather than being read in one go. */
+	CBlockCopier BlockCopier(m_dwBufferSize);
 
-	char *pBuffer = new char[m_uSplitSize];
-	bool bStop = false;
+	ULONGLONG ulRunningSplitSize = 0;
 	int nSplitsMade = 1;
 
-	while(lRunningSplitSize.QuadPart < lFileSize.QuadPart &&
-		!bStop)
+	while(ulRunningSplitSize < static_cast<ULONGLONG>(lFileSize.QuadPart) &&
+		!m_pStopToken->IsCancelled())
 	{
-		DWORD dwNumberOfBytesRead;
-		ReadFile(hInputFile,reinterpret_cast<LPVOID>(pBuffer),m_uSplitSize,&dwNumberOfBytesRead,NULL);
-
 		std::wstring strOutputFullFilename;
 		ProcessFilename(nSplitsMade,strOutputFullFilename);
 
 		HANDLE hOutputFile = CreateFile(strOutputFullFilename.c_str(),GENERIC_WRITE,0,NULL,CREATE_NEW,
 			FILE_ATTRIBUTE_NORMAL,NULL);
 
+		ULONGLONG ulBytesRead;
+		BOOL bSuccess;
+
 		if(hOutputFile != INVALID_HANDLE_VALUE)
 		{
-			DWORD dwNumberOfBytesWritten;
-			WriteFile(hOutputFile,reinterpret_cast<LPCVOID>(pBuffer),dwNumberOfBytesRead,
-				&dwNumberOfBytesWritten,NULL);
+			bSuccess = BlockCopier.Copy(hInputFile,hOutputFile,m_ulSplitSize,
+				&ulBytesRead,m_pStopToken);
+
+			/* The piece can only be closed once
+			it's been completely written. */
+			bSuccess = BlockCopier.Flush() && bSuccess;
 
 			CloseHandle(hOutputFile);
 		}
+		else
+		{
+			/* The piece is skipped, so that the
+			numbering of later pieces is unchanged. */
+			LARGE_INTEGER lDistance;
+			lDistance.QuadPart = static_cast<LONGLONG>(min(m_ulSplitSize,
+				lFileSize.QuadPart - ulRunningSplitSize));
+
+			bSuccess = SetFilePointerEx(hInputFile,lDistance,NULL,FILE_CURRENT);
+			ulBytesRead = lDistance.QuadPart;
+		}
 
 		/* TODO: Wait for a set period of time before sending message
 		(so as not to block the GUI). */
 		PostMessage(m_hDlg,NSplitFileDialog::WM_APP_SETCURRENTSPLITCOUNT,nSplitsMade,0);
 
-		lRunningSplitSize.QuadPart += dwNumberOfBytesRead;
-		nSplitsMade++;
-
-		EnterCriticalSection(&m_csStop);
-		if(m_bStopSplitting)
+		if(!bSuccess || ulBytesRead == 0)
 		{
-			bStop = true;
+			break;
 		}
-		LeaveCriticalSection(&m_csStop);
-	}
 
-	delete[] pBuffer;
+		ulRunningSplitSize += ulBytesRead;
+		nSplitsMade++;
+	}
 }
 
 void CSplitFile::ProcessFilename(int nSplitsMade,std::wstring &strOutputFullFilename)
@@ -639,9 +680,7 @@ void CSplitFile::ProcessFilename(int nSplitsMade,std::wstring &strOutputFullFile
 
 void CSplitFile::StopSplitting()
 {
-	EnterCriticalSection(&m_csStop);
-	m_bStopSplitting = true;
-	LeaveCriticalSection(&m_csStop);
+	m_pStopToken->Cancel();
 }
 
 CSplitFileDialogPersistentSettings::CSplitFileDialogPersistentSettings() :
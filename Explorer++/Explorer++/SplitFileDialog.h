@@ -3,6 +3,7 @@
 #include <list>
 #include <string>
 #include "../Helper/BaseDialog.h"
+#include "../Helper/CancellationToken.h"
 #include "../Helper/DialogSettings.h"
 #include "../Helper/ReferenceCount.h"
 
@@ -40,11 +41,16 @@ private:
 	std::wstring	m_strSplitGroup;
 };
 
+/* Splits a file into pieces of a fixed size. The file is
+streamed through a fixed amount of memory (see CBlockCopier),
+so the size of each piece doesn't affect how much memory is
+used. */
 class CSplitFile : public CReferenceCount
 {
 public:
 	
-	CSplitFile(HWND hDlg,std::wstring strFullFilename,std::wstring strOutputFilename,std::wstring strOutputDirectory,UINT uSplitSize);
+	CSplitFile(HWND hDlg,std::wstring strFullFilename,std::wstring strOutputFilename,std::wstring strOutputDirectory,
+		ULONGLONG ulSplitSize,DWORD dwBufferSize);
 	~CSplitFile();
 
 	void	SplitFile();
@@ -60,10 +66,10 @@ private:
 	std::wstring		m_strFullFilename;
 	std::wstring		m_strOutputFilename;
 	std::wstring		m_strOutputDirectory;
-	UINT				m_uSplitSize;
+	ULONGLONG			m_ulSplitSize;
+	DWORD				m_dwBufferSize;
 
-	CRITICAL_SECTION	m_csStop;
-	bool				m_bStopSplitting;
+	CCancellationToken	*m_pStopToken;
 };
 
 class CSplitFileDialog : public CBaseDialog
@@ -111,6 +117,10 @@ private:
 	static const int MB = (1024 * 1024);
 	static const int GB = (1024 * 1024 * 1024);
 
+	/* The amount of memory each of the split
+	buffers uses (there are two). */
+	static const DWORD SPLIT_BUFFER_SIZE = 4 * 1024 * 1024;
+
 	static const UINT_PTR ELPASED_TIMER_ID = 1;
 	static const UINT_PTR ELPASED_TIMER_TIMEOUT = 1000;
 
@@ -26,6 +26,7 @@
 #include "../Helper/ListViewHelper.h"
 #include "../Helper/MenuHelper.h"
 #include "../Helper/TabHelper.h"
+#include "../Helper/FolderSizeCache.h"
 #include "../Helper/Macros.h"
 
 
@@ -472,7 +473,7 @@ int *pTabObjectIndex)
 	pSettings->sdf			= m_SizeDisplayFormat;
 
 	m_pShellBrowser[iTabId] = CShellBrowser::CreateNew(m_hContainer,m_hListView[iTabId],pSettings,
-		m_hIconThread,m_hFolderSizeThread);
+		m_hIconThread);
 
 	if(pSettings->bApplyFilter)
 		NListView::ListView_SetBackgroundImage(m_hListView[iTabId],IDB_FILTERINGAPPLIED);
@@ -493,6 +494,7 @@ int *pTabObjectIndex)
 	m_pShellBrowser[iTabId]->SetShowFolderSizes(m_bShowFolderSizes);
 	m_pShellBrowser[iTabId]->SetShowFriendlyDates(m_bShowFriendlyDatesGlobal);
 	m_pShellBrowser[iTabId]->SetInsertSorted(m_bInsertSorted);
+	m_pShellBrowser[iTabId]->SetColorRuleSet(&m_ColorRuleSet);
 
 	/* Browse folder sends a message back to the main window, which
 	attempts to contact the new tab (needs to be created before browsing
@@ -968,6 +970,13 @@ void Explorerplusplus::RefreshTab(int iTabId)
 
 	pidlDirectory = m_pShellBrowser[iTabId]->QueryCurrentDirectoryIdl();
 
+	/* Only the current folder is monitored, so cached sizes
+	may not reflect changes further down. Refreshing the tab
+	recalculates them. */
+	TCHAR szDirectory[MAX_PATH];
+	m_pShellBrowser[iTabId]->QueryCurrentDirectory(SIZEOF_ARRAY(szDirectory),szDirectory);
+	CFolderSizeCache::GetInstance().Invalidate(szDirectory);
+
 	hr = m_pShellBrowser[iTabId]->BrowseFolder(pidlDirectory,
 		SBSP_SAMEBROWSER|SBSP_ABSOLUTE|SBSP_WRITENOHISTORY);
 
@@ -20,7 +20,6 @@
 #include "../Helper/Helper.h"
 #include "../Helper/RegistrySettings.h"
 #include "../Helper/XMLSettings.h"
-#include "../Helper/ListViewHelper.h"
 #include "../Helper/Macros.h"
 
 
@@ -156,20 +155,7 @@ void CWildcardSelectDialog::OnOk()
 
 void CWildcardSelectDialog::SelectItems(TCHAR *szPattern)
 {
-	HWND hListView = m_pexpp->GetActiveListView();
-
-	int nItems = ListView_GetItemCount(hListView);
-
-	for(int i = 0;i < nItems;i++)
-	{
-		TCHAR szFilename[MAX_PATH];
-		m_pexpp->GetActiveShellBrowser()->QueryDisplayName(i,SIZEOF_ARRAY(szFilename),szFilename);
-
-		if(CheckWildcardMatch(szPattern,szFilename,FALSE) == 1)
-		{
-			NListView::ListView_SelectItem(hListView,i,m_bSelect);
-		}
-	}
+	m_pexpp->GetActiveShellBrowser()->SelectItemsMatching(szPattern,FALSE,m_bSelect);
 }
 
 void CWildcardSelectDialog::OnCancel()
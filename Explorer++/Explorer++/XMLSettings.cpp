@@ -107,6 +107,7 @@ will need to be changed correspondingly. */
 #define HASH_OVERWRITEEXISTINGFILESCONFIRMATION	1625342835
 #define HASH_LARGETOOLBARICONS		10895007
 #define HASH_PLAYNAVIGATIONSOUND	1987363412
+#define HASH_FOLDERSIZEMODE			813873121
 
 struct ColumnXMLSaveData
 {
@@ -481,6 +482,17 @@ MSXML2::IXMLDOMElement *pRoot)
 	NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),_T("DoubleClickTabClose"),NXMLSettings::EncodeBoolValue(m_bDoubleClickTabClose));
 	NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
 	NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),_T("ExtendTabControl"),NXMLSettings::EncodeBoolValue(m_bExtendTabControl));
+	NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
+	NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),_T("FolderSizeMode"),NXMLSettings::EncodeIntValue(m_FolderSizeMode));
+
+	for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+	{
+		NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
+		NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),NExplorerplusplus::MAX_JOBS_PER_DEVICE_SETTINGS[i],NXMLSettings::EncodeIntValue(m_dwMaxJobsPerDevice[i]));
+		NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
+		NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),NExplorerplusplus::BACKGROUND_BANDWIDTH_SETTINGS[i],NXMLSettings::EncodeIntValue(m_dwBackgroundBandwidth[i]));
+	}
+
 	NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
 	NXMLSettings::WriteStandardSetting(pXMLDom,pe,_T("Setting"),_T("ForceSameTabWidth"),NXMLSettings::EncodeBoolValue(m_bForceSameTabWidth));
 	NXMLSettings::AddWhiteSpaceToNode(pXMLDom,bstr_wsntt,pe);
@@ -1587,6 +1599,10 @@ WCHAR *wszName,WCHAR *wszValue)
 		m_bExtendTabControl = NXMLSettings::DecodeBoolValue(wszValue);
 		break;
 
+	case HASH_FOLDERSIZEMODE:
+		m_FolderSizeMode = static_cast<FolderSizeMode_t>(NXMLSettings::DecodeIntValue(wszValue));
+		break;
+
 	case HASH_FORCESAMETABWIDTH:
 		m_bForceSameTabWidth = NXMLSettings::DecodeBoolValue(wszValue);
 		break;
@@ -1907,6 +1923,18 @@ WCHAR *wszName,WCHAR *wszValue)
 	case HASH_INFOTIPTYPE:
 		m_InfoTipType = static_cast<InfoTipType_t>(NXMLSettings::DecodeIntValue(wszValue));
 		break;
+
+	default:
+		/* The thread pool's limits are saved under one
+		name per device class. */
+		for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+		{
+			if(lstrcmp(wszName,NExplorerplusplus::MAX_JOBS_PER_DEVICE_SETTINGS[i]) == 0)
+				m_dwMaxJobsPerDevice[i] = NXMLSettings::DecodeIntValue(wszValue);
+			else if(lstrcmp(wszName,NExplorerplusplus::BACKGROUND_BANDWIDTH_SETTINGS[i]) == 0)
+				m_dwBackgroundBandwidth[i] = NXMLSettings::DecodeIntValue(wszValue);
+		}
+		break;
 	}
 }
 
@@ -0,0 +1,261 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: BlockCopier.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Copies data between files through a fixed pair of
+ * buffers, overlapping reads with writes.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "BlockCopier.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+
+DWORD WINAPI	BlockCopierWriteThread(LPVOID pParam);
+
+CBlockCopier::CBlockCopier(DWORD dwBufferSize) :
+m_dwBufferSize(dwBufferSize > 0 ? dwBufferSize : DEFAULT_BUFFER_SIZE),
+m_iReadIndex(0),
+m_iWriteIndex(0),
+m_nFilled(0),
+m_bWriteFailed(FALSE),
+m_bStopping(FALSE)
+{
+	for(int i = 0;i < NUM_BUFFERS;i++)
+	{
+		m_Blocks[i].Buffer.resize(m_dwBufferSize);
+		m_Blocks[i].hOutput = NULL;
+		m_Blocks[i].dwSize = 0;
+	}
+
+	InitializeCriticalSection(&m_cs);
+	m_hBlockFilled = CreateEvent(NULL,FALSE,FALSE,NULL);
+	m_hBlockWritten = CreateEvent(NULL,FALSE,FALSE,NULL);
+
+	m_hThread = CreateThread(NULL,0,BlockCopierWriteThread,
+		reinterpret_cast<LPVOID>(this),0,NULL);
+}
+
+CBlockCopier::~CBlockCopier()
+{
+	if(m_hThread != NULL)
+	{
+		Flush();
+
+		EnterCriticalSection(&m_cs);
+		m_bStopping = TRUE;
+		LeaveCriticalSection(&m_cs);
+
+		SetEvent(m_hBlockFilled);
+		WaitForSingleObject(m_hThread,INFINITE);
+		CloseHandle(m_hThread);
+	}
+
+	CloseHandle(m_hBlockWritten);
+	CloseHandle(m_hBlockFilled);
+	DeleteCriticalSection(&m_cs);
+}
+
+BOOL CBlockCopier::Copy(HANDLE hInput,HANDLE hOutput,ULONGLONG ulBytes,
+	ULONGLONG *pulBytesRead,const CCancellationToken *pToken)
+{
+	ULONGLONG ulTotalRead = 0;
+	BOOL bSuccess = TRUE;
+
+	while(ulTotalRead < ulBytes)
+	{
+		if(pToken != NULL && pToken->IsCancelled())
+		{
+			bSuccess = FALSE;
+			break;
+		}
+
+		if(!WaitForFreeBlock())
+		{
+			bSuccess = FALSE;
+			break;
+		}
+
+		DWORD dwToRead = static_cast<DWORD>(min(static_cast<ULONGLONG>(m_dwBufferSize),
+			ulBytes - ulTotalRead));
+
+		/* Waits while anything more urgent
+		is using the same disk. */
+		if(!CThreadPool::ThrottleIo(dwToRead))
+		{
+			bSuccess = FALSE;
+			break;
+		}
+
+		/* The writer never touches a block
+		until it's been filled. */
+		Block_t &Block = m_Blocks[m_iReadIndex];
+
+		DWORD dwRead;
+		BOOL bRes = ReadFile(hInput,reinterpret_cast<LPVOID>(&Block.Buffer[0]),
+			dwToRead,&dwRead,NULL);
+
+		if(!bRes)
+		{
+			bSuccess = FALSE;
+			break;
+		}
+
+		if(dwRead == 0)
+		{
+			/* The end of the input. */
+			break;
+		}
+
+		Block.hOutput = hOutput;
+		Block.dwSize = dwRead;
+		ulTotalRead += dwRead;
+
+		if(m_hThread == NULL)
+		{
+			if(!WriteBlock(Block))
+			{
+				m_bWriteFailed = TRUE;
+				bSuccess = FALSE;
+				break;
+			}
+
+			continue;
+		}
+
+		EnterCriticalSection(&m_cs);
+		m_iReadIndex = (m_iReadIndex + 1) % NUM_BUFFERS;
+		m_nFilled++;
+		LeaveCriticalSection(&m_cs);
+
+		SetEvent(m_hBlockFilled);
+	}
+
+	if(pulBytesRead != NULL)
+	{
+		*pulBytesRead = ulTotalRead;
+	}
+
+	return bSuccess;
+}
+
+BOOL CBlockCopier::WaitForFreeBlock()
+{
+	if(m_hThread == NULL)
+	{
+		return !m_bWriteFailed;
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	while(m_nFilled == NUM_BUFFERS)
+	{
+		LeaveCriticalSection(&m_cs);
+		WaitForSingleObject(m_hBlockWritten,INFINITE);
+		EnterCriticalSection(&m_cs);
+	}
+
+	BOOL bWriteFailed = m_bWriteFailed;
+
+	LeaveCriticalSection(&m_cs);
+
+	return !bWriteFailed;
+}
+
+BOOL CBlockCopier::Flush()
+{
+	if(m_hThread == NULL)
+	{
+		return !m_bWriteFailed;
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	while(m_nFilled > 0)
+	{
+		LeaveCriticalSection(&m_cs);
+		WaitForSingleObject(m_hBlockWritten,INFINITE);
+		EnterCriticalSection(&m_cs);
+	}
+
+	BOOL bWriteFailed = m_bWriteFailed;
+
+	LeaveCriticalSection(&m_cs);
+
+	return !bWriteFailed;
+}
+
+DWORD CBlockCopier::GetBufferSize() const
+{
+	return m_dwBufferSize;
+}
+
+BOOL CBlockCopier::WriteBlock(const Block_t &Block)
+{
+	DWORD dwWritten;
+	BOOL bRes = WriteFile(Block.hOutput,reinterpret_cast<LPCVOID>(&Block.Buffer[0]),
+		Block.dwSize,&dwWritten,NULL);
+
+	return bRes && dwWritten == Block.dwSize;
+}
+
+DWORD WINAPI BlockCopierWriteThread(LPVOID pParam)
+{
+	assert(pParam != NULL);
+
+	CBlockCopier *pBlockCopier = reinterpret_cast<CBlockCopier *>(pParam);
+	pBlockCopier->WriteThread();
+
+	return 0;
+}
+
+void CBlockCopier::WriteThread()
+{
+	while(TRUE)
+	{
+		EnterCriticalSection(&m_cs);
+
+		BOOL bStopping = m_bStopping;
+		BOOL bFound = (m_nFilled > 0);
+		BOOL bWriteFailed = m_bWriteFailed;
+		int iIndex = m_iWriteIndex;
+
+		LeaveCriticalSection(&m_cs);
+
+		if(!bFound)
+		{
+			if(bStopping)
+			{
+				break;
+			}
+
+			WaitForSingleObject(m_hBlockFilled,INFINITE);
+			continue;
+		}
+
+		/* Once a write has failed, the output is incomplete
+		anyway, so anything else that's queued is dropped. */
+		BOOL bWritten = bWriteFailed || WriteBlock(m_Blocks[iIndex]);
+
+		EnterCriticalSection(&m_cs);
+
+		if(!bWritten)
+		{
+			m_bWriteFailed = TRUE;
+		}
+
+		m_iWriteIndex = (m_iWriteIndex + 1) % NUM_BUFFERS;
+		m_nFilled--;
+
+		LeaveCriticalSection(&m_cs);
+
+		SetEvent(m_hBlockWritten);
+	}
+}
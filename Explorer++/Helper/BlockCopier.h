@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include "CancellationToken.h"
+#include "Macros.h"
+
+/* Copies data between files through a fixed amount of
+memory, however much is being copied. Data is read on the
+calling thread, and written on a thread of its own, through
+a pair of buffers. While one buffer is being written out, the
+next is being read into the other, so that reads and writes
+proceed at the same time.
+
+Writes are made in the order the data was read. Each block
+is written to whichever output it was read for, so the
+output can change between calls to Copy (see Flush). */
+class CBlockCopier
+{
+	friend DWORD WINAPI	BlockCopierWriteThread(LPVOID pParam);
+
+public:
+
+	static const DWORD	DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+	CBlockCopier(DWORD dwBufferSize = DEFAULT_BUFFER_SIZE);
+
+	/* Waits for any outstanding writes to finish. */
+	~CBlockCopier();
+
+	/* Reads up to ulBytes from the input (starting at its
+	current position), and queues them to be written to the
+	output (at its current position). Returns once everything
+	has been read; the last blocks may still be being written.
+	Reading stops early if the end of the input is reached.
+
+	pToken can be NULL. Returns FALSE if a read or write
+	fails, or if the copy is cancelled (either through the
+	token, or through CThreadPool::ThrottleIo). Once a write
+	has failed, every later copy fails as well. */
+	BOOL		Copy(HANDLE hInput,HANDLE hOutput,ULONGLONG ulBytes,
+		ULONGLONG *pulBytesRead,const CCancellationToken *pToken);
+
+	/* Waits until every queued block has been written. Should
+	be called before closing an output. Returns FALSE if any
+	write has failed. */
+	BOOL		Flush();
+
+	DWORD		GetBufferSize() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CBlockCopier);
+
+	static const int	NUM_BUFFERS = 2;
+
+	struct Block_t
+	{
+		std::vector<char>	Buffer;
+		HANDLE				hOutput;
+		DWORD				dwSize;
+	};
+
+	void		WriteThread();
+	BOOL		WriteBlock(const Block_t &Block);
+
+	/* Returns FALSE if a write has failed. */
+	BOOL		WaitForFreeBlock();
+
+	DWORD				m_dwBufferSize;
+
+	CRITICAL_SECTION	m_cs;
+	Block_t				m_Blocks[NUM_BUFFERS];
+
+	/* Blocks are filled and written in turn. m_iReadIndex
+	is the next block to fill, and m_iWriteIndex the next
+	block to write. */
+	int					m_iReadIndex;
+	int					m_iWriteIndex;
+	int					m_nFilled;
+
+	BOOL				m_bWriteFailed;
+	BOOL				m_bStopping;
+
+	/* Auto-reset. Set when a block has been filled,
+	or the thread needs to stop. */
+	HANDLE				m_hBlockFilled;
+
+	/* Auto-reset. Set when a block has been written. */
+	HANDLE				m_hBlockWritten;
+
+	/* If the thread can't be created, blocks are written
+	on the calling thread instead. */
+	HANDLE				m_hThread;
+};
@@ -0,0 +1,33 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: CancellationToken.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Allows background work to be stopped from
+ * another thread.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "CancellationToken.h"
+
+
+CCancellationToken::CCancellationToken() :
+m_lCancelled(0)
+{
+
+}
+
+void CCancellationToken::Cancel()
+{
+	InterlockedExchange(&m_lCancelled,1);
+}
+
+BOOL CCancellationToken::IsCancelled() const
+{
+	return m_lCancelled != 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ReferenceCount.h"
+#include "Macros.h"
+
+/* Stops any background work (such as a folder size
+calculation, or a job queued on the thread pool) that's
+been given the token. A token can be shared between
+threads, so it's reference counted; whoever releases it
+last frees it. */
+class CCancellationToken : public CReferenceCount
+{
+public:
+
+	CCancellationToken();
+
+	void	Cancel();
+	BOOL	IsCancelled() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CCancellationToken);
+
+	volatile LONG	m_lCancelled;
+};
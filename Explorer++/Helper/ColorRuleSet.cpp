@@ -0,0 +1,75 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: ColorRuleSet.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Matches items against a compiled set of
+ * colour rules.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <cassert>
+#include "ColorRuleSet.h"
+#include "Macros.h"
+
+
+void CColorRuleSet::AddRule(const TCHAR *szFilterPattern,BOOL bCaseInsensitive,
+	DWORD dwFilterAttributes,COLORREF rgbColour)
+{
+	CompiledRule_t CompiledRule;
+	CompiledRule.bMatchFileName		= (lstrlen(szFilterPattern) > 0);
+	CompiledRule.dwFilterAttributes	= dwFilterAttributes;
+	CompiledRule.rgbColour			= rgbColour;
+
+	if(CompiledRule.bMatchFileName)
+	{
+		CompiledRule.FileNameMatcher = CWildcardMatcher(szFilterPattern,!bCaseInsensitive);
+	}
+
+	m_Rules.push_back(CompiledRule);
+}
+
+int CColorRuleSet::FindMatchingRule(const TCHAR *szFileName,DWORD dwAttributes) const
+{
+	int iRule = 0;
+
+	for(auto itr = m_Rules.begin();itr != m_Rules.end();itr++)
+	{
+		/* Attributes are cheaper to check, so they're
+		tested first. */
+		if(itr->dwFilterAttributes != 0 &&
+			(itr->dwFilterAttributes & dwAttributes) == 0)
+		{
+			iRule++;
+			continue;
+		}
+
+		if(itr->bMatchFileName &&
+			!itr->FileNameMatcher.Match(szFileName))
+		{
+			iRule++;
+			continue;
+		}
+
+		return iRule;
+	}
+
+	return NO_MATCH;
+}
+
+COLORREF CColorRuleSet::GetRuleColor(int iRule) const
+{
+	assert(iRule >= 0 && iRule < static_cast<int>(m_Rules.size()));
+
+	return m_Rules[iRule].rgbColour;
+}
+
+BOOL CColorRuleSet::IsEmpty() const
+{
+	return m_Rules.empty();
+}
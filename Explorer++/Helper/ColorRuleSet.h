@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "WildcardMatcher.h"
+
+/* A compiled set of colour rules. Each rule matches
+items by filename pattern and/or attributes. Rules are
+checked in order, and the first one that matches
+determines the item's colour. */
+class CColorRuleSet
+{
+public:
+
+	static const int NO_MATCH = -1;
+
+	void		AddRule(const TCHAR *szFilterPattern,BOOL bCaseInsensitive,DWORD dwFilterAttributes,COLORREF rgbColour);
+
+	/* Returns the index of the first matching rule, or
+	NO_MATCH. */
+	int			FindMatchingRule(const TCHAR *szFileName,DWORD dwAttributes) const;
+	COLORREF	GetRuleColor(int iRule) const;
+
+	BOOL		IsEmpty() const;
+
+private:
+
+	struct CompiledRule_t
+	{
+		/* An empty pattern matches every filename. */
+		BOOL				bMatchFileName;
+		CWildcardMatcher	FileNameMatcher;
+
+		/* Zero matches any attributes. */
+		DWORD				dwFilterAttributes;
+
+		COLORREF			rgbColour;
+	};
+
+	std::vector<CompiledRule_t>	m_Rules;
+};
@@ -0,0 +1,681 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: ContentMatcher.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Searches the contents of files for text or
+ * regular expressions.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "ContentMatcher.h"
+#include "Macros.h"
+
+
+CContentMatcher::CContentMatcher() :
+m_bCompiled(FALSE),
+m_bUseRegularExpressions(FALSE),
+m_bCaseInsensitive(FALSE),
+m_bLiteralOnly(FALSE),
+m_bUseNeedle(FALSE),
+m_ulMaxFileSize(DEFAULT_MAX_FILE_SIZE)
+{
+	for(int i = 0;i < SIZEOF_ARRAY(m_Fold);i++)
+	{
+		m_Fold[i] = static_cast<BYTE>(i);
+	}
+}
+
+BOOL CContentMatcher::Compile(const TCHAR *szText,BOOL bUseRegularExpressions,BOOL bCaseInsensitive)
+{
+	m_bCompiled = FALSE;
+	m_bUseRegularExpressions = bUseRegularExpressions;
+	m_bCaseInsensitive = bCaseInsensitive;
+
+	if(lstrlen(szText) == 0)
+	{
+		return FALSE;
+	}
+
+	std::wstring strNeedle;
+
+	if(bUseRegularExpressions)
+	{
+		/* The pattern is checked on its own first, since
+		wrapping an invalid pattern can make it valid
+		(e.g. "a)|(b"). */
+		if(!m_RegexMatcher.Compile(szText,bCaseInsensitive))
+		{
+			return FALSE;
+		}
+
+		/* Each line is matched as a whole, so allow
+		the pattern to appear anywhere within it. */
+		std::wstring strPattern = std::wstring(_T(".*(?:")) + szText + _T(").*");
+
+		if(!m_RegexMatcher.Compile(strPattern.c_str(),bCaseInsensitive))
+		{
+			return FALSE;
+		}
+
+		/* Any literal text the pattern requires is
+		already case folded, if necessary. */
+		strNeedle = m_RegexMatcher.GetRequiredLiteral();
+		m_bLiteralOnly = FALSE;
+	}
+	else
+	{
+		strNeedle = szText;
+		m_bLiteralOnly = TRUE;
+	}
+
+	BOOL bAscii = TRUE;
+
+	for(auto itr = strNeedle.begin();itr != strNeedle.end();itr++)
+	{
+		if(*itr >= 0x80)
+		{
+			bAscii = FALSE;
+			break;
+		}
+	}
+
+	/* Bytes can only be compared directly if they don't
+	need to be case folded, or only ASCII letters need
+	to be folded. Otherwise, the text is decoded and
+	folded before being checked. */
+	m_bUseNeedle = !strNeedle.empty() && (!bCaseInsensitive || bAscii);
+
+	if(!m_bUseNeedle)
+	{
+		m_bLiteralOnly = FALSE;
+	}
+
+	for(int i = 0;i < SIZEOF_ARRAY(m_Fold);i++)
+	{
+		m_Fold[i] = static_cast<BYTE>(i);
+
+		if(bCaseInsensitive && i >= 'A' && i <= 'Z')
+		{
+			m_Fold[i] = static_cast<BYTE>(i - 'A' + 'a');
+		}
+	}
+
+	m_strText = szText;
+
+	if(bCaseInsensitive)
+	{
+		LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,szText,static_cast<int>(m_strText.size()),
+			&m_strText[0],static_cast<int>(m_strText.size()));
+	}
+
+	if(m_bUseNeedle)
+	{
+		for(int i = 0;i < ENCODING_BINARY;i++)
+		{
+			BuildNeedle(strNeedle,static_cast<Encoding_t>(i),m_Needles[i]);
+		}
+	}
+
+	m_bCompiled = TRUE;
+
+	return TRUE;
+}
+
+void CContentMatcher::SetMaxFileSize(ULONGLONG ulMaxFileSize)
+{
+	m_ulMaxFileSize = ulMaxFileSize;
+}
+
+void CContentMatcher::BuildNeedle(const std::wstring &strText,Encoding_t Encoding,Needle_t &Needle)
+{
+	Needle.bValid = TRUE;
+	Needle.Bytes.clear();
+
+	switch(Encoding)
+	{
+	case ENCODING_ANSI:
+		{
+			BOOL bUsedDefaultChar = FALSE;
+			int nBytes = WideCharToMultiByte(CP_ACP,0,strText.c_str(),static_cast<int>(strText.size()),
+				NULL,0,NULL,NULL);
+
+			if(nBytes > 0)
+			{
+				Needle.Bytes.resize(nBytes);
+				WideCharToMultiByte(CP_ACP,0,strText.c_str(),static_cast<int>(strText.size()),
+					reinterpret_cast<LPSTR>(&Needle.Bytes[0]),nBytes,NULL,&bUsedDefaultChar);
+			}
+
+			/* The text contains characters that can't
+			appear in an ANSI file. */
+			if(bUsedDefaultChar)
+			{
+				Needle.bValid = FALSE;
+			}
+		}
+		break;
+
+	case ENCODING_UTF8:
+		{
+			int nBytes = WideCharToMultiByte(CP_UTF8,0,strText.c_str(),static_cast<int>(strText.size()),
+				NULL,0,NULL,NULL);
+
+			if(nBytes > 0)
+			{
+				Needle.Bytes.resize(nBytes);
+				WideCharToMultiByte(CP_UTF8,0,strText.c_str(),static_cast<int>(strText.size()),
+					reinterpret_cast<LPSTR>(&Needle.Bytes[0]),nBytes,NULL,NULL);
+			}
+		}
+		break;
+
+	case ENCODING_UTF16LE:
+		for(auto itr = strText.begin();itr != strText.end();itr++)
+		{
+			Needle.Bytes.push_back(LOBYTE(*itr));
+			Needle.Bytes.push_back(HIBYTE(*itr));
+		}
+		break;
+
+	case ENCODING_UTF16BE:
+		for(auto itr = strText.begin();itr != strText.end();itr++)
+		{
+			Needle.Bytes.push_back(HIBYTE(*itr));
+			Needle.Bytes.push_back(LOBYTE(*itr));
+		}
+		break;
+	}
+
+	if(Needle.Bytes.empty())
+	{
+		Needle.bValid = FALSE;
+		return;
+	}
+
+	for(auto itr = Needle.Bytes.begin();itr != Needle.Bytes.end();itr++)
+	{
+		*itr = m_Fold[*itr];
+	}
+
+	/* The distance the needle can be moved along, based
+	on the (folded) byte under its last position. */
+	size_t nLength = Needle.Bytes.size();
+
+	for(int i = 0;i < SIZEOF_ARRAY(Needle.Skip);i++)
+	{
+		Needle.Skip[i] = nLength;
+	}
+
+	for(size_t i = 0;i < nLength - 1;i++)
+	{
+		Needle.Skip[Needle.Bytes[i]] = nLength - 1 - i;
+	}
+}
+
+CContentMatcher::MatchResult_t CContentMatcher::MatchFile(const TCHAR *szFileName,const volatile LONG *plStop) const
+{
+	if(!m_bCompiled)
+	{
+		return MATCH_FAILED;
+	}
+
+	HANDLE hFile = CreateFile(szFileName,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+		NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return MATCH_FAILED;
+	}
+
+	LARGE_INTEGER liFileSize;
+
+	if(!GetFileSizeEx(hFile,&liFileSize))
+	{
+		CloseHandle(hFile);
+		return MATCH_FAILED;
+	}
+
+	ULONGLONG ulFileSize = static_cast<ULONGLONG>(liFileSize.QuadPart);
+
+	if(ulFileSize > m_ulMaxFileSize)
+	{
+		CloseHandle(hFile);
+		return MATCH_SKIPPED_TOO_LARGE;
+	}
+
+	/* Empty files can't be mapped. */
+	if(ulFileSize == 0)
+	{
+		CloseHandle(hFile);
+		return MATCH_NOT_FOUND;
+	}
+
+	HANDLE hMapping = CreateFileMapping(hFile,NULL,PAGE_READONLY,0,0,NULL);
+
+	if(hMapping == NULL)
+	{
+		CloseHandle(hFile);
+		return MATCH_FAILED;
+	}
+
+	MatchResult_t Result = MATCH_NOT_FOUND;
+	Encoding_t Encoding = ENCODING_BINARY;
+	ULONGLONG ulOffset = 0;
+
+	while(TRUE)
+	{
+		size_t nViewSize = static_cast<size_t>(min(static_cast<ULONGLONG>(VIEW_SIZE),ulFileSize - ulOffset));
+
+		ULARGE_INTEGER uliOffset;
+		uliOffset.QuadPart = ulOffset;
+
+		const BYTE *pView = reinterpret_cast<const BYTE *>(MapViewOfFile(hMapping,FILE_MAP_READ,
+			uliOffset.HighPart,uliOffset.LowPart,nViewSize));
+
+		if(pView == NULL)
+		{
+			Result = MATCH_FAILED;
+			break;
+		}
+
+		size_t nHeaderSize = 0;
+
+		if(ulOffset == 0)
+		{
+			size_t nDetectionSize = min(nViewSize,DETECTION_SIZE);
+			Encoding = DetectEncoding(pView,nDetectionSize,nDetectionSize == ulFileSize,nHeaderSize);
+		}
+
+		BOOL bFinished = TRUE;
+
+		if(Encoding == ENCODING_BINARY)
+		{
+			Result = MATCH_SKIPPED_BINARY;
+		}
+		else if(m_bUseNeedle && !m_Needles[Encoding].bValid)
+		{
+			/* The text can't appear anywhere
+			in the file. */
+			Result = MATCH_NOT_FOUND;
+		}
+		else if(MatchView(pView + nHeaderSize,nViewSize - nHeaderSize,Encoding,plStop))
+		{
+			Result = MATCH_FOUND;
+		}
+		else
+		{
+			bFinished = (ulOffset + nViewSize >= ulFileSize) ||
+				(plStop != NULL && *plStop != 0);
+		}
+
+		UnmapViewOfFile(pView);
+
+		if(bFinished)
+		{
+			break;
+		}
+
+		ulOffset += VIEW_SIZE - VIEW_OVERLAP;
+	}
+
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+
+	return Result;
+}
+
+/* Text starting with a byte order mark is decoded
+accordingly. Otherwise, the pattern of null bytes
+is used to spot UTF-16 text (in which every other
+byte of ASCII text is null). Any other text with a
+null byte is assumed to be binary. */
+CContentMatcher::Encoding_t CContentMatcher::DetectEncoding(const BYTE *pData,size_t nSize,
+	BOOL bComplete,size_t &nHeaderSize)
+{
+	nHeaderSize = 0;
+
+	if(nSize >= 3 && pData[0] == 0xEF && pData[1] == 0xBB && pData[2] == 0xBF)
+	{
+		nHeaderSize = 3;
+		return ENCODING_UTF8;
+	}
+
+	if(nSize >= 2 && pData[0] == 0xFF && pData[1] == 0xFE)
+	{
+		nHeaderSize = 2;
+		return ENCODING_UTF16LE;
+	}
+
+	if(nSize >= 2 && pData[0] == 0xFE && pData[1] == 0xFF)
+	{
+		nHeaderSize = 2;
+		return ENCODING_UTF16BE;
+	}
+
+	size_t nEvenNulls = 0;
+	size_t nOddNulls = 0;
+
+	for(size_t i = 0;i < nSize;i++)
+	{
+		if(pData[i] == 0)
+		{
+			if(i % 2 == 0)
+			{
+				nEvenNulls++;
+			}
+			else
+			{
+				nOddNulls++;
+			}
+		}
+	}
+
+	if(nEvenNulls == 0 && nOddNulls == 0)
+	{
+		return IsValidUtf8(pData,nSize,bComplete) ? ENCODING_UTF8 : ENCODING_ANSI;
+	}
+
+	size_t nUnits = nSize / 2;
+
+	if(nEvenNulls == 0 && nOddNulls >= nUnits / 4)
+	{
+		return ENCODING_UTF16LE;
+	}
+
+	if(nOddNulls == 0 && nEvenNulls >= nUnits / 4)
+	{
+		return ENCODING_UTF16BE;
+	}
+
+	return ENCODING_BINARY;
+}
+
+/* If only the start of a file is being checked, a
+sequence that has been cut off at the end of the
+data is allowed. */
+BOOL CContentMatcher::IsValidUtf8(const BYTE *pData,size_t nSize,BOOL bComplete)
+{
+	size_t i = 0;
+
+	while(i < nSize)
+	{
+		BYTE ch = pData[i];
+		size_t nTrailBytes;
+
+		if(ch < 0x80)
+		{
+			nTrailBytes = 0;
+		}
+		else if(ch >= 0xC2 && ch <= 0xDF)
+		{
+			nTrailBytes = 1;
+		}
+		else if(ch >= 0xE0 && ch <= 0xEF)
+		{
+			nTrailBytes = 2;
+		}
+		else if(ch >= 0xF0 && ch <= 0xF4)
+		{
+			nTrailBytes = 3;
+		}
+		else
+		{
+			return FALSE;
+		}
+
+		if(bComplete && i + nTrailBytes >= nSize)
+		{
+			return FALSE;
+		}
+
+		for(size_t j = 1;j <= nTrailBytes && i + j < nSize;j++)
+		{
+			if((pData[i + j] & 0xC0) != 0x80)
+			{
+				return FALSE;
+			}
+		}
+
+		i += nTrailBytes + 1;
+	}
+
+	return TRUE;
+}
+
+BOOL CContentMatcher::MatchView(const BYTE *pData,size_t nSize,Encoding_t Encoding,
+	const volatile LONG *plStop) const
+{
+	size_t nUnitSize = (Encoding == ENCODING_UTF16LE || Encoding == ENCODING_UTF16BE) ? 2 : 1;
+
+	/* Ignore any partial character at the end. */
+	const BYTE *pEnd = pData + (nSize - nSize % nUnitSize);
+
+	const Needle_t &Needle = m_Needles[Encoding];
+
+	if(m_bLiteralOnly)
+	{
+		return FindNeedle(Needle,pData,pEnd,pData,nUnitSize) != NULL;
+	}
+
+	if(!m_bUseRegularExpressions)
+	{
+		return MatchFoldedText(pData,pEnd,Encoding);
+	}
+
+	std::wstring strLine;
+	const BYTE *pPosition = pData;
+
+	while(pPosition < pEnd)
+	{
+		if(plStop != NULL && *plStop != 0)
+		{
+			return FALSE;
+		}
+
+		const BYTE *pLineStart = pPosition;
+
+		/* Skip straight to the next line that
+		contains the required text. */
+		if(m_bUseNeedle)
+		{
+			const BYTE *pFound = FindNeedle(Needle,pPosition,pEnd,pData,nUnitSize);
+
+			if(pFound == NULL)
+			{
+				return FALSE;
+			}
+
+			pLineStart = FindLineStart(pPosition,pFound,Encoding);
+		}
+
+		const BYTE *pLineEnd = FindLineEnd(pLineStart,pEnd,Encoding);
+
+		DecodeText(pLineStart,pLineEnd,Encoding,strLine);
+
+		if(!strLine.empty() && strLine[strLine.size() - 1] == '\r')
+		{
+			strLine.erase(strLine.size() - 1);
+		}
+
+		if(m_RegexMatcher.Match(strLine.c_str()))
+		{
+			return TRUE;
+		}
+
+		if(pLineEnd == pEnd)
+		{
+			break;
+		}
+
+		pPosition = pLineEnd + nUnitSize;
+	}
+
+	return FALSE;
+}
+
+/* Boyer-Moore-Horspool. For UTF-16, a match only
+counts if it starts on a character boundary (relative
+to pBase). */
+const BYTE *CContentMatcher::FindNeedle(const Needle_t &Needle,const BYTE *pStart,const BYTE *pEnd,
+	const BYTE *pBase,size_t nUnitSize) const
+{
+	size_t nLength = Needle.Bytes.size();
+	const BYTE *pNeedle = &Needle.Bytes[0];
+	BYTE chLast = pNeedle[nLength - 1];
+
+	const BYTE *pPosition = pStart;
+
+	while(static_cast<size_t>(pEnd - pPosition) >= nLength)
+	{
+		BYTE ch = m_Fold[pPosition[nLength - 1]];
+
+		if(ch == chLast && (pPosition - pBase) % nUnitSize == 0)
+		{
+			size_t i = 0;
+
+			while(i < nLength - 1 && m_Fold[pPosition[i]] == pNeedle[i])
+			{
+				i++;
+			}
+
+			if(i == nLength - 1)
+			{
+				return pPosition;
+			}
+		}
+
+		pPosition += Needle.Skip[ch];
+	}
+
+	return NULL;
+}
+
+/* Searches back from pPosition (which must be on a
+character boundary) to the start of its line, without
+going past pData. */
+const BYTE *CContentMatcher::FindLineStart(const BYTE *pData,const BYTE *pPosition,Encoding_t Encoding) const
+{
+	switch(Encoding)
+	{
+	case ENCODING_UTF16LE:
+		while(pPosition - pData >= 2 && !(pPosition[-2] == '\n' && pPosition[-1] == 0))
+		{
+			pPosition -= 2;
+		}
+		break;
+
+	case ENCODING_UTF16BE:
+		while(pPosition - pData >= 2 && !(pPosition[-2] == 0 && pPosition[-1] == '\n'))
+		{
+			pPosition -= 2;
+		}
+		break;
+
+	default:
+		while(pPosition > pData && pPosition[-1] != '\n')
+		{
+			pPosition--;
+		}
+		break;
+	}
+
+	return pPosition;
+}
+
+/* Returns the position of the newline that ends the
+line, or pEnd if the line isn't terminated. */
+const BYTE *CContentMatcher::FindLineEnd(const BYTE *pPosition,const BYTE *pEnd,Encoding_t Encoding) const
+{
+	switch(Encoding)
+	{
+	case ENCODING_UTF16LE:
+		while(pPosition < pEnd && !(pPosition[0] == '\n' && pPosition[1] == 0))
+		{
+			pPosition += 2;
+		}
+		return pPosition;
+
+	case ENCODING_UTF16BE:
+		while(pPosition < pEnd && !(pPosition[0] == 0 && pPosition[1] == '\n'))
+		{
+			pPosition += 2;
+		}
+		return pPosition;
+	}
+
+	const BYTE *pNewline = reinterpret_cast<const BYTE *>(memchr(pPosition,'\n',pEnd - pPosition));
+
+	return (pNewline != NULL) ? pNewline : pEnd;
+}
+
+/* Literal text that can't be found by comparing bytes
+is found by decoding and folding the whole view. */
+BOOL CContentMatcher::MatchFoldedText(const BYTE *pData,const BYTE *pEnd,Encoding_t Encoding) const
+{
+	std::wstring strText;
+	DecodeText(pData,pEnd,Encoding,strText);
+
+	if(strText.empty())
+	{
+		return FALSE;
+	}
+
+	LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,strText.c_str(),static_cast<int>(strText.size()),
+		&strText[0],static_cast<int>(strText.size()));
+
+	return strText.find(m_strText) != std::wstring::npos;
+}
+
+void CContentMatcher::DecodeText(const BYTE *pStart,const BYTE *pEnd,Encoding_t Encoding,
+	std::wstring &strText)
+{
+	strText.clear();
+
+	switch(Encoding)
+	{
+	case ENCODING_ANSI:
+	case ENCODING_UTF8:
+		{
+			int nBytes = static_cast<int>(pEnd - pStart);
+
+			if(nBytes == 0)
+			{
+				break;
+			}
+
+			UINT uCodePage = (Encoding == ENCODING_UTF8) ? CP_UTF8 : CP_ACP;
+			int nChars = MultiByteToWideChar(uCodePage,0,reinterpret_cast<LPCSTR>(pStart),nBytes,NULL,0);
+
+			if(nChars > 0)
+			{
+				strText.resize(nChars);
+				MultiByteToWideChar(uCodePage,0,reinterpret_cast<LPCSTR>(pStart),nBytes,&strText[0],nChars);
+			}
+		}
+		break;
+
+	case ENCODING_UTF16LE:
+		strText.reserve((pEnd - pStart) / 2);
+
+		for(const BYTE *p = pStart;p < pEnd;p += 2)
+		{
+			strText += static_cast<WCHAR>(MAKEWORD(p[0],p[1]));
+		}
+		break;
+
+	case ENCODING_UTF16BE:
+		strText.reserve((pEnd - pStart) / 2);
+
+		for(const BYTE *p = pStart;p < pEnd;p += 2)
+		{
+			strText += static_cast<WCHAR>(MAKEWORD(p[1],p[0]));
+		}
+		break;
+	}
+}
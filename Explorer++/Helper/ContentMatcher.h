@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "RegexMatcher.h"
+#include "Macros.h"
+
+/* Checks whether the contents of a file contain a piece
+of text, or a line matching a regular expression.
+
+Files are memory mapped. Small files are mapped in a
+single view, while larger files are mapped in a series of
+overlapping views, so that only part of the file needs to
+be mapped at any one time.
+
+The encoding of each file (UTF-8, UTF-16 or the ANSI code
+page) is worked out from its first few bytes. The text
+being searched for is converted to the same encoding, so
+that literal text can be found by scanning the raw bytes
+(using Boyer-Moore-Horspool), without decoding the file.
+Regular expressions are matched line by line. Where a
+pattern contains literal text, only the lines containing
+that text are decoded and checked. Text that has to be
+case folded beyond ASCII is decoded before being checked.
+
+Files that appear to be binary, and files above a
+maximum size, are skipped.
+
+Once compiled, a matcher may be used from several
+threads at once. */
+class CContentMatcher
+{
+public:
+
+	enum MatchResult_t
+	{
+		MATCH_FOUND,
+		MATCH_NOT_FOUND,
+		MATCH_SKIPPED_TOO_LARGE,
+		MATCH_SKIPPED_BINARY,
+		MATCH_FAILED
+	};
+
+	enum Encoding_t
+	{
+		ENCODING_ANSI,
+		ENCODING_UTF8,
+		ENCODING_UTF16LE,
+		ENCODING_UTF16BE,
+		ENCODING_BINARY
+	};
+
+	static const ULONGLONG	DEFAULT_MAX_FILE_SIZE = 64 * 1024 * 1024;
+
+	CContentMatcher();
+
+	/* Returns FALSE if the text is empty, or is
+	an invalid regular expression. */
+	BOOL			Compile(const TCHAR *szText,BOOL bUseRegularExpressions,BOOL bCaseInsensitive);
+
+	void			SetMaxFileSize(ULONGLONG ulMaxFileSize);
+
+	/* If the value pointed to by plStop becomes non-zero,
+	the file is abandoned and MATCH_NOT_FOUND is returned. */
+	MatchResult_t	MatchFile(const TCHAR *szFileName,const volatile LONG *plStop) const;
+
+	/* Works out how the text at the start of a file is
+	encoded. bComplete indicates whether pData holds the
+	whole file. nHeaderSize receives the size of any byte
+	order mark. */
+	static Encoding_t	DetectEncoding(const BYTE *pData,size_t nSize,BOOL bComplete,size_t &nHeaderSize);
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CContentMatcher);
+
+	/* The number of bytes used to work out
+	the encoding of a file. */
+	static const size_t	DETECTION_SIZE = 4096;
+
+	/* Files larger than this are mapped in several views.
+	Each view overlaps the previous one, so that text
+	crossing the boundary between two views is still
+	found. Both sizes are multiples of the allocation
+	granularity (64KB), as view offsets must be. */
+	static const size_t	VIEW_SIZE = 16 * 1024 * 1024;
+	static const size_t	VIEW_OVERLAP = 64 * 1024;
+
+	/* Literal text, converted to the bytes
+	used by a particular encoding. */
+	struct Needle_t
+	{
+		/* FALSE if the text can't be represented
+		in the encoding. */
+		BOOL				bValid;
+
+		std::vector<BYTE>	Bytes;
+		size_t				Skip[256];
+	};
+
+	static BOOL	IsValidUtf8(const BYTE *pData,size_t nSize,BOOL bComplete);
+	static void	DecodeText(const BYTE *pStart,const BYTE *pEnd,Encoding_t Encoding,std::wstring &strText);
+
+	void		BuildNeedle(const std::wstring &strText,Encoding_t Encoding,Needle_t &Needle);
+	BOOL		MatchView(const BYTE *pData,size_t nSize,Encoding_t Encoding,
+		const volatile LONG *plStop) const;
+	const BYTE	*FindNeedle(const Needle_t &Needle,const BYTE *pStart,const BYTE *pEnd,
+		const BYTE *pBase,size_t nUnitSize) const;
+	const BYTE	*FindLineStart(const BYTE *pData,const BYTE *pPosition,Encoding_t Encoding) const;
+	const BYTE	*FindLineEnd(const BYTE *pPosition,const BYTE *pEnd,Encoding_t Encoding) const;
+	BOOL		MatchFoldedText(const BYTE *pData,const BYTE *pEnd,Encoding_t Encoding) const;
+
+	BOOL			m_bCompiled;
+	BOOL			m_bUseRegularExpressions;
+	BOOL			m_bCaseInsensitive;
+
+	/* Set if the whole match can be done by
+	finding the needle. */
+	BOOL			m_bLiteralOnly;
+
+	/* Set if lines can be skipped unless they
+	contain the needle. */
+	BOOL			m_bUseNeedle;
+
+	/* Lowercased if matching is case insensitive. Only
+	used when the needle can't be (i.e. when literal text
+	has to be folded as well as decoded). */
+	std::wstring	m_strText;
+	CRegexMatcher	m_RegexMatcher;
+
+	/* One for each encoding (other than binary). */
+	Needle_t		m_Needles[ENCODING_BINARY];
+
+	/* Maps each byte to the value it's compared
+	as. Folds ASCII letters when matching is
+	case insensitive. */
+	BYTE			m_Fold[256];
+
+	ULONGLONG		m_ulMaxFileSize;
+};
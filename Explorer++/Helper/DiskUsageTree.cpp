@@ -0,0 +1,669 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: DiskUsageTree.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Records the space used by every file and folder
+ * beneath a directory.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include "DiskUsageTree.h"
+#include "Macros.h"
+
+
+namespace
+{
+	typedef std::pair<ULONGLONG,DWORD> SizedNode_t;
+
+	/* The listing of every folder that's been walked,
+	by path. Folders are listed on several threads at
+	once, so the critical section guards the map. */
+	struct Listings_t
+	{
+		CRITICAL_SECTION	cs;
+		std::unordered_map<std::wstring,std::vector<FolderSizeItem_t>>	Folders;
+	};
+
+	void DiskUsageListingProc(const std::wstring &strFolder,
+		const std::vector<FolderSizeItem_t> &Items,LPVOID pData)
+	{
+		Listings_t *pListings = reinterpret_cast<Listings_t *>(pData);
+
+		EnterCriticalSection(&pListings->cs);
+		pListings->Folders[strFolder] = Items;
+		LeaveCriticalSection(&pListings->cs);
+	}
+
+	BOOL IsWalkedFolder(DWORD dwAttributes)
+	{
+		/* Reparse points (e.g. junctions) aren't
+		followed, as they can lead back into the
+		tree being walked. */
+		return (dwAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY &&
+			(dwAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != FILE_ATTRIBUTE_REPARSE_POINT;
+	}
+
+	/* Largest first. Items of the same size are
+	kept in the order they're stored in. */
+	bool CompareSizedNodes(const SizedNode_t &Node1,const SizedNode_t &Node2)
+	{
+		if(Node1.first != Node2.first)
+		{
+			return Node1.first > Node2.first;
+		}
+
+		return Node1.second < Node2.second;
+	}
+
+	bool CompareExtensionTotals(const CDiskUsageTree::ExtensionTotal_t &Total1,
+		const CDiskUsageTree::ExtensionTotal_t &Total2)
+	{
+		if(Total1.ulSize != Total2.ulSize)
+		{
+			return Total1.ulSize > Total2.ulSize;
+		}
+
+		return Total1.strExtension < Total2.strExtension;
+	}
+
+	template <typename T> BOOL WriteColumn(HANDLE hFile,const std::vector<T> &Column)
+	{
+		if(Column.empty())
+		{
+			return TRUE;
+		}
+
+		DWORD dwSize = static_cast<DWORD>(Column.size() * sizeof(T));
+		DWORD nBytesWritten;
+		BOOL bRet = WriteFile(hFile,&Column[0],dwSize,&nBytesWritten,NULL);
+
+		return bRet && nBytesWritten == dwSize;
+	}
+
+	template <typename T> void ReadColumn(const BYTE *&pData,size_t nItems,std::vector<T> &Column)
+	{
+		Column.resize(nItems);
+
+		if(nItems > 0)
+		{
+			memcpy(&Column[0],pData,nItems * sizeof(T));
+		}
+
+		pData += nItems * sizeof(T);
+	}
+}
+
+CDiskUsageTree::CDiskUsageTree()
+{
+	ZeroMemory(&m_ftBuilt,sizeof(m_ftBuilt));
+	ClearData(m_Data);
+}
+
+BOOL CDiskUsageTree::Build(const TCHAR *szRoot,int nThreads,const CCancellationToken *pToken,
+	FolderSizeMode_t SizeMode)
+{
+	std::vector<TCHAR> RootBuffer(szRoot,szRoot + lstrlen(szRoot) + 1);
+	PathRemoveBackslash(&RootBuffer[0]);
+	std::wstring strRoot(&RootBuffer[0]);
+
+	FILETIME ftBuilt;
+	GetSystemTimeAsFileTime(&ftBuilt);
+
+	Listings_t Listings;
+	InitializeCriticalSection(&Listings.cs);
+
+	CFolderSizeCalculator FolderSizeCalculator;
+	FolderSizeCalculator.SetThreadCount(nThreads);
+	FolderSizeCalculator.SetSizeMode(SizeMode);
+	FolderSizeCalculator.SetListingCallback(DiskUsageListingProc,&Listings);
+	FolderSizeCalculator.AddRoot(strRoot.c_str());
+
+	BOOL bCompleted = FolderSizeCalculator.Calculate(pToken);
+
+	DeleteCriticalSection(&Listings.cs);
+
+	if(!bCompleted)
+	{
+		return FALSE;
+	}
+
+	TreeData_t Data;
+	ClearData(Data);
+	DWORD dwRoot = AddNode(Data,strRoot.c_str(),NO_NODE,FILE_ATTRIBUTE_DIRECTORY,0);
+
+	/* Each listing is freed as soon as it's been added,
+	so that the whole tree is never held twice. */
+	std::vector<std::pair<std::wstring,DWORD>> Folders;
+	Folders.push_back(std::make_pair(strRoot,dwRoot));
+
+	while(!Folders.empty())
+	{
+		std::pair<std::wstring,DWORD> Folder = Folders.back();
+		Folders.pop_back();
+
+		auto itr = Listings.Folders.find(Folder.first);
+
+		if(itr == Listings.Folders.end())
+		{
+			continue;
+		}
+
+		/* A folder's items are all added at
+		once, so they're stored together. */
+		Data.FirstChildren[Folder.second] = static_cast<DWORD>(Data.Parents.size());
+
+		for(auto itrItem = itr->second.begin();itrItem != itr->second.end();itrItem++)
+		{
+			DWORD dwChild = AddNode(Data,itrItem->strName.c_str(),Folder.second,
+				itrItem->dwAttributes,itrItem->ulSize);
+			Data.ChildCounts[Folder.second]++;
+
+			if(IsWalkedFolder(itrItem->dwAttributes))
+			{
+				Folders.push_back(std::make_pair(CFolderSizeCalculator::CombinePath(Folder.first,
+					itrItem->strName.c_str()),dwChild));
+			}
+		}
+
+		Listings.Folders.erase(itr);
+	}
+
+	TotalFolderSizes(Data);
+
+	m_strRoot = strRoot;
+	m_ftBuilt = ftBuilt;
+	std::swap(m_Data,Data);
+
+	return TRUE;
+}
+
+DWORD CDiskUsageTree::AddNode(TreeData_t &Data,const TCHAR *szName,DWORD dwParent,
+	DWORD dwAttributes,ULONGLONG ulSize)
+{
+	Data.NameOffsets.push_back(static_cast<DWORD>(Data.Names.size()));
+	Data.Names.insert(Data.Names.end(),szName,szName + lstrlen(szName) + 1);
+
+	Data.Parents.push_back(dwParent);
+	Data.FirstChildren.push_back(0);
+	Data.ChildCounts.push_back(0);
+	Data.Attributes.push_back(dwAttributes);
+
+	/* Folder sizes are totalled once
+	everything has been added. */
+	Data.Sizes.push_back((dwAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 0 : ulSize);
+
+	return static_cast<DWORD>(Data.Parents.size()) - 1;
+}
+
+void CDiskUsageTree::TotalFolderSizes(TreeData_t &Data)
+{
+	/* Items always come after the folder they're in,
+	so by the time a folder is reached, everything
+	beneath it has already been added to its size. */
+	for(size_t i = Data.Parents.size() - 1;i > 0;i--)
+	{
+		Data.Sizes[Data.Parents[i]] += Data.Sizes[i];
+	}
+}
+
+void CDiskUsageTree::ClearData(TreeData_t &Data)
+{
+	Data.Names.clear();
+	Data.NameOffsets.clear();
+	Data.Parents.clear();
+	Data.FirstChildren.clear();
+	Data.ChildCounts.clear();
+	Data.Attributes.clear();
+	Data.Sizes.clear();
+}
+
+BOOL CDiskUsageTree::Save(const TCHAR *szFileName) const
+{
+	TreeFileHeader_t Header;
+	ZeroMemory(&Header,sizeof(Header));
+	Header.dwSignature = TREE_FILE_SIGNATURE;
+	Header.dwVersion = TREE_FILE_VERSION;
+	Header.nNodes = static_cast<DWORD>(m_Data.Parents.size());
+	Header.nNameCharacters = static_cast<DWORD>(m_Data.Names.size());
+	Header.ftBuilt = m_ftBuilt;
+	StringCchCopy(Header.szRoot,SIZEOF_ARRAY(Header.szRoot),m_strRoot.c_str());
+
+	/* The tree is written to a temporary file first,
+	so that an existing file is only replaced once
+	the new one is complete. */
+	std::wstring strTempFileName = std::wstring(szFileName) + _T(".tmp");
+
+	HANDLE hFile = CreateFile(strTempFileName.c_str(),GENERIC_WRITE,0,NULL,
+		CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	DWORD nBytesWritten;
+	BOOL bSuccess = WriteFile(hFile,&Header,sizeof(Header),&nBytesWritten,NULL) &&
+		nBytesWritten == sizeof(Header) &&
+		WriteColumn(hFile,m_Data.NameOffsets) &&
+		WriteColumn(hFile,m_Data.Parents) &&
+		WriteColumn(hFile,m_Data.FirstChildren) &&
+		WriteColumn(hFile,m_Data.ChildCounts) &&
+		WriteColumn(hFile,m_Data.Attributes) &&
+		WriteColumn(hFile,m_Data.Sizes) &&
+		WriteColumn(hFile,m_Data.Names);
+
+	CloseHandle(hFile);
+
+	if(bSuccess)
+	{
+		bSuccess = MoveFileEx(strTempFileName.c_str(),szFileName,MOVEFILE_REPLACE_EXISTING);
+	}
+
+	if(!bSuccess)
+	{
+		DeleteFile(strTempFileName.c_str());
+	}
+
+	return bSuccess;
+}
+
+BOOL CDiskUsageTree::Load(const TCHAR *szFileName)
+{
+	HANDLE hFile = CreateFile(szFileName,GENERIC_READ,FILE_SHARE_READ,NULL,
+		OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	LARGE_INTEGER liFileSize;
+
+	if(!GetFileSizeEx(hFile,&liFileSize) ||
+		liFileSize.QuadPart < static_cast<LONGLONG>(sizeof(TreeFileHeader_t)))
+	{
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	HANDLE hMapping = CreateFileMapping(hFile,NULL,PAGE_READONLY,0,0,NULL);
+
+	if(hMapping == NULL)
+	{
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	const BYTE *pView = reinterpret_cast<const BYTE *>(MapViewOfFile(hMapping,FILE_MAP_READ,0,0,0));
+
+	if(pView == NULL)
+	{
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	TreeFileHeader_t Header;
+	memcpy(&Header,pView,sizeof(Header));
+
+	ULONGLONG ulExpectedSize = sizeof(Header) +
+		static_cast<ULONGLONG>(Header.nNodes) * (5 * sizeof(DWORD) + sizeof(ULONGLONG)) +
+		static_cast<ULONGLONG>(Header.nNameCharacters) * sizeof(TCHAR);
+
+	size_t nRootLength;
+
+	BOOL bSuccess = Header.dwSignature == TREE_FILE_SIGNATURE &&
+		Header.dwVersion == TREE_FILE_VERSION &&
+		Header.nNodes > 0 &&
+		ulExpectedSize == static_cast<ULONGLONG>(liFileSize.QuadPart) &&
+		SUCCEEDED(StringCchLength(Header.szRoot,SIZEOF_ARRAY(Header.szRoot),&nRootLength)) &&
+		nRootLength > 0;
+
+	TreeData_t Data;
+	ClearData(Data);
+
+	if(bSuccess)
+	{
+		const BYTE *pData = pView + sizeof(Header);
+
+		ReadColumn(pData,Header.nNodes,Data.NameOffsets);
+		ReadColumn(pData,Header.nNodes,Data.Parents);
+		ReadColumn(pData,Header.nNodes,Data.FirstChildren);
+		ReadColumn(pData,Header.nNodes,Data.ChildCounts);
+		ReadColumn(pData,Header.nNodes,Data.Attributes);
+		ReadColumn(pData,Header.nNodes,Data.Sizes);
+		ReadColumn(pData,Header.nNameCharacters,Data.Names);
+	}
+
+	UnmapViewOfFile(pView);
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+
+	if(!bSuccess)
+	{
+		return FALSE;
+	}
+
+	/* The file may have been truncated or altered, so
+	check that every node has a valid name, and that
+	the child ranges account for every node exactly
+	once before using it. */
+	if(Data.Names.empty() || Data.Names.back() != '\0' ||
+		Data.Parents[ROOT_NODE] != NO_NODE)
+	{
+		return FALSE;
+	}
+
+	ULONGLONG ulTotalChildren = 0;
+
+	for(DWORD i = 0;i < Header.nNodes;i++)
+	{
+		if(Data.NameOffsets[i] >= Header.nNameCharacters)
+		{
+			return FALSE;
+		}
+
+		if(Data.ChildCounts[i] > 0 &&
+			(Data.FirstChildren[i] <= i ||
+			static_cast<ULONGLONG>(Data.FirstChildren[i]) + Data.ChildCounts[i] > Header.nNodes))
+		{
+			return FALSE;
+		}
+
+		ulTotalChildren += Data.ChildCounts[i];
+
+		if(i == ROOT_NODE)
+		{
+			continue;
+		}
+
+		DWORD dwParent = Data.Parents[i];
+
+		if(dwParent >= i || i < Data.FirstChildren[dwParent] ||
+			i - Data.FirstChildren[dwParent] >= Data.ChildCounts[dwParent])
+		{
+			return FALSE;
+		}
+	}
+
+	if(ulTotalChildren != Header.nNodes - 1)
+	{
+		return FALSE;
+	}
+
+	/* The root's name is its full path, which (unlike
+	the copy in the header) is never truncated. */
+	m_strRoot = &Data.Names[Data.NameOffsets[ROOT_NODE]];
+	m_ftBuilt = Header.ftBuilt;
+	std::swap(m_Data,Data);
+
+	return TRUE;
+}
+
+std::wstring CDiskUsageTree::GetRoot() const
+{
+	return m_strRoot;
+}
+
+FILETIME CDiskUsageTree::GetBuildTime() const
+{
+	return m_ftBuilt;
+}
+
+DWORD CDiskUsageTree::GetNodeCount() const
+{
+	return static_cast<DWORD>(m_Data.Parents.size());
+}
+
+const TCHAR *CDiskUsageTree::GetName(DWORD dwNode) const
+{
+	assert(dwNode < GetNodeCount());
+
+	return &m_Data.Names[m_Data.NameOffsets[dwNode]];
+}
+
+std::wstring CDiskUsageTree::GetFullPath(DWORD dwNode) const
+{
+	assert(dwNode < GetNodeCount());
+
+	std::vector<DWORD> Nodes;
+
+	for(DWORD dwCurrent = dwNode;dwCurrent != NO_NODE;dwCurrent = m_Data.Parents[dwCurrent])
+	{
+		Nodes.push_back(dwCurrent);
+	}
+
+	std::wstring strPath = GetName(Nodes.back());
+
+	for(auto itr = Nodes.rbegin() + 1;itr != Nodes.rend();itr++)
+	{
+		strPath = CFolderSizeCalculator::CombinePath(strPath,GetName(*itr));
+	}
+
+	return strPath;
+}
+
+DWORD CDiskUsageTree::GetParent(DWORD dwNode) const
+{
+	assert(dwNode < GetNodeCount());
+
+	return m_Data.Parents[dwNode];
+}
+
+BOOL CDiskUsageTree::IsFolder(DWORD dwNode) const
+{
+	assert(dwNode < GetNodeCount());
+
+	return (m_Data.Attributes[dwNode] & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY;
+}
+
+ULONGLONG CDiskUsageTree::GetSize(DWORD dwNode) const
+{
+	assert(dwNode < GetNodeCount());
+
+	return m_Data.Sizes[dwNode];
+}
+
+void CDiskUsageTree::GetChildren(DWORD dwNode,std::vector<DWORD> &Children) const
+{
+	assert(dwNode < GetNodeCount());
+
+	std::vector<SizedNode_t> SizedNodes;
+	DWORD dwFirstChild = m_Data.FirstChildren[dwNode];
+
+	for(DWORD i = 0;i < m_Data.ChildCounts[dwNode];i++)
+	{
+		SizedNodes.push_back(std::make_pair(m_Data.Sizes[dwFirstChild + i],dwFirstChild + i));
+	}
+
+	std::sort(SizedNodes.begin(),SizedNodes.end(),CompareSizedNodes);
+
+	Children.clear();
+
+	for(auto itr = SizedNodes.begin();itr != SizedNodes.end();itr++)
+	{
+		Children.push_back(itr->second);
+	}
+}
+
+void CDiskUsageTree::GetLargestFiles(DWORD dwNode,size_t nCount,std::vector<DWORD> &Nodes) const
+{
+	GetLargest(dwNode,FALSE,nCount,Nodes);
+}
+
+void CDiskUsageTree::GetLargestFolders(DWORD dwNode,size_t nCount,std::vector<DWORD> &Nodes) const
+{
+	GetLargest(dwNode,TRUE,nCount,Nodes);
+}
+
+void CDiskUsageTree::GetLargest(DWORD dwNode,BOOL bFolders,size_t nCount,std::vector<DWORD> &Nodes) const
+{
+	std::vector<DWORD> Subtree;
+	GetSubtree(dwNode,Subtree);
+
+	/* Only the largest nCount items seen so far are
+	kept, with the smallest of them at the top. */
+	std::priority_queue<SizedNode_t,std::vector<SizedNode_t>,
+		bool (*)(const SizedNode_t &,const SizedNode_t &)> Largest(CompareSizedNodes);
+
+	for(auto itr = Subtree.begin();itr != Subtree.end();itr++)
+	{
+		if(*itr == dwNode || IsFolder(*itr) != bFolders)
+		{
+			continue;
+		}
+
+		SizedNode_t SizedNode = std::make_pair(m_Data.Sizes[*itr],*itr);
+
+		if(Largest.size() < nCount)
+		{
+			Largest.push(SizedNode);
+		}
+		else if(nCount > 0 && CompareSizedNodes(SizedNode,Largest.top()))
+		{
+			Largest.pop();
+			Largest.push(SizedNode);
+		}
+	}
+
+	Nodes.resize(Largest.size());
+
+	for(size_t i = Nodes.size();i > 0;i--)
+	{
+		Nodes[i - 1] = Largest.top().second;
+		Largest.pop();
+	}
+}
+
+void CDiskUsageTree::GetExtensionTotals(DWORD dwNode,std::vector<ExtensionTotal_t> &Totals) const
+{
+	std::vector<DWORD> Subtree;
+	GetSubtree(dwNode,Subtree);
+
+	std::map<std::wstring,ExtensionTotal_t> TotalMap;
+
+	for(auto itr = Subtree.begin();itr != Subtree.end();itr++)
+	{
+		if(IsFolder(*itr))
+		{
+			continue;
+		}
+
+		std::wstring strExtension = PathFindExtension(GetName(*itr));
+
+		if(!strExtension.empty())
+		{
+			std::vector<TCHAR> Lowercase(strExtension.size());
+			LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,strExtension.c_str(),static_cast<int>(strExtension.size()),
+				&Lowercase[0],static_cast<int>(Lowercase.size()));
+			strExtension.assign(Lowercase.begin(),Lowercase.end());
+		}
+
+		auto itrTotal = TotalMap.find(strExtension);
+
+		if(itrTotal == TotalMap.end())
+		{
+			ExtensionTotal_t Total;
+			Total.strExtension = strExtension;
+			Total.ulSize = 0;
+			Total.nFiles = 0;
+			itrTotal = TotalMap.insert(std::make_pair(strExtension,Total)).first;
+		}
+
+		itrTotal->second.ulSize += m_Data.Sizes[*itr];
+		itrTotal->second.nFiles++;
+	}
+
+	Totals.clear();
+
+	for(auto itr = TotalMap.begin();itr != TotalMap.end();itr++)
+	{
+		Totals.push_back(itr->second);
+	}
+
+	std::sort(Totals.begin(),Totals.end(),CompareExtensionTotals);
+}
+
+BOOL CDiskUsageTree::FindNode(const TCHAR *szPath,DWORD &dwNode) const
+{
+	if(m_Data.Parents.empty())
+	{
+		return FALSE;
+	}
+
+	std::wstring strPath(szPath);
+	DWORD dwCurrent = ROOT_NODE;
+	size_t nStart = 0;
+
+	while(nStart < strPath.size())
+	{
+		size_t nEnd = strPath.find('\\',nStart);
+
+		if(nEnd == std::wstring::npos)
+		{
+			nEnd = strPath.size();
+		}
+
+		std::wstring strName = strPath.substr(nStart,nEnd - nStart);
+		nStart = nEnd + 1;
+
+		if(strName.empty())
+		{
+			continue;
+		}
+
+		DWORD dwFirstChild = m_Data.FirstChildren[dwCurrent];
+		DWORD dwChildCount = m_Data.ChildCounts[dwCurrent];
+		DWORD i;
+
+		for(i = 0;i < dwChildCount;i++)
+		{
+			if(lstrcmpi(GetName(dwFirstChild + i),strName.c_str()) == 0)
+			{
+				break;
+			}
+		}
+
+		if(i == dwChildCount)
+		{
+			return FALSE;
+		}
+
+		dwCurrent = dwFirstChild + i;
+	}
+
+	dwNode = dwCurrent;
+
+	return TRUE;
+}
+
+void CDiskUsageTree::GetSubtree(DWORD dwNode,std::vector<DWORD> &Nodes) const
+{
+	assert(dwNode < GetNodeCount());
+
+	Nodes.clear();
+	Nodes.push_back(dwNode);
+
+	/* Nodes is used as the queue of folders still
+	to be expanded, since each folder's items are
+	stored as a single range. */
+	for(size_t i = 0;i < Nodes.size();i++)
+	{
+		DWORD dwFirstChild = m_Data.FirstChildren[Nodes[i]];
+
+		for(DWORD j = 0;j < m_Data.ChildCounts[Nodes[i]];j++)
+		{
+			Nodes.push_back(dwFirstChild + j);
+		}
+	}
+}
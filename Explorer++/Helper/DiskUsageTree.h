@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "FolderSize.h"
+#include "Macros.h"
+
+/* A snapshot of the space used beneath a root directory,
+built with a single walk. Once built, the largest files
+and folders (and the space used by each file extension)
+can be found anywhere within the tree, without touching
+the disk again.
+
+Each item is stored as a row in a set of columns, in the
+same way as the file name index. The children of a
+folder are always stored next to each other, and after
+the folder itself. Names are kept back to back in a
+single buffer, so full paths are never stored. Each item
+takes up 28 bytes, plus its name.
+
+The tree can be saved, and loaded back later (e.g. to
+see how the space used has changed). Build and Load
+replace the contents of the tree, and shouldn't be
+called while another thread is reading from it. */
+class CDiskUsageTree
+{
+public:
+
+	/* Returned for the parent of the root. */
+	static const DWORD	NO_NODE = 0xFFFFFFFF;
+
+	/* The root is always node 0. */
+	static const DWORD	ROOT_NODE = 0;
+
+	struct ExtensionTotal_t
+	{
+		/* Lowercase, and including the period.
+		Empty for files without an extension. */
+		std::wstring	strExtension;
+		ULONGLONG		ulSize;
+		int				nFiles;
+	};
+
+	CDiskUsageTree();
+
+	/* Walks the root directory and replaces the contents of
+	the tree. The walk is done by CFolderSizeCalculator, with
+	nThreads threads (see SetThreadCount), and file sizes are
+	counted in the given size mode. If the token is cancelled
+	first, the tree is left as it was and FALSE is returned.
+	The token can be NULL. */
+	BOOL		Build(const TCHAR *szRoot,int nThreads,const CCancellationToken *pToken,
+		FolderSizeMode_t SizeMode = FOLDER_SIZE_MODE_LOGICAL);
+
+	BOOL		Save(const TCHAR *szFileName) const;
+	BOOL		Load(const TCHAR *szFileName);
+
+	std::wstring	GetRoot() const;
+
+	/* The time the tree was built. */
+	FILETIME	GetBuildTime() const;
+
+	DWORD		GetNodeCount() const;
+
+	/* The root's name is its full path. */
+	const TCHAR	*GetName(DWORD dwNode) const;
+	std::wstring	GetFullPath(DWORD dwNode) const;
+	DWORD		GetParent(DWORD dwNode) const;
+	BOOL		IsFolder(DWORD dwNode) const;
+
+	/* For a folder, this is the size of everything
+	beneath it. */
+	ULONGLONG	GetSize(DWORD dwNode) const;
+
+	/* The items directly within the folder,
+	largest first. */
+	void		GetChildren(DWORD dwNode,std::vector<DWORD> &Children) const;
+
+	/* The largest files or folders anywhere beneath
+	dwNode, largest first. */
+	void		GetLargestFiles(DWORD dwNode,size_t nCount,std::vector<DWORD> &Nodes) const;
+	void		GetLargestFolders(DWORD dwNode,size_t nCount,std::vector<DWORD> &Nodes) const;
+
+	/* The space used by each file extension beneath
+	dwNode, largest first. */
+	void		GetExtensionTotals(DWORD dwNode,std::vector<ExtensionTotal_t> &Totals) const;
+
+	/* szPath is relative to the root (an empty path
+	refers to the root itself). Names are compared
+	without regard to case. */
+	BOOL		FindNode(const TCHAR *szPath,DWORD &dwNode) const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CDiskUsageTree);
+
+	static const DWORD	TREE_FILE_SIGNATURE = 0x52545544;
+	static const DWORD	TREE_FILE_VERSION = 1;
+
+	struct TreeData_t
+	{
+		std::vector<TCHAR>		Names;
+		std::vector<DWORD>		NameOffsets;
+		std::vector<DWORD>		Parents;
+		std::vector<DWORD>		FirstChildren;
+		std::vector<DWORD>		ChildCounts;
+		std::vector<DWORD>		Attributes;
+		std::vector<ULONGLONG>	Sizes;
+	};
+
+	struct TreeFileHeader_t
+	{
+		DWORD		dwSignature;
+		DWORD		dwVersion;
+		DWORD		nNodes;
+		DWORD		nNameCharacters;
+		FILETIME	ftBuilt;
+		WCHAR		szRoot[MAX_PATH];
+	};
+
+	static DWORD	AddNode(TreeData_t &Data,const TCHAR *szName,DWORD dwParent,
+		DWORD dwAttributes,ULONGLONG ulSize);
+	static void	TotalFolderSizes(TreeData_t &Data);
+	static void	ClearData(TreeData_t &Data);
+
+	void		GetLargest(DWORD dwNode,BOOL bFolders,size_t nCount,std::vector<DWORD> &Nodes) const;
+	void		GetSubtree(DWORD dwNode,std::vector<DWORD> &Nodes) const;
+
+	std::wstring	m_strRoot;
+	FILETIME		m_ftBuilt;
+	TreeData_t		m_Data;
+};
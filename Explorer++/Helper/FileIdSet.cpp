@@ -0,0 +1,187 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: FileIdSet.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Records which files have already been seen, by
+ * their file ID.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "FileIdSet.h"
+#include "Macros.h"
+
+
+namespace
+{
+	const ULONGLONG EMPTY_SLOT = 0;
+}
+
+CFileIdSet::CFileIdSet()
+{
+	InitializeCriticalSection(&m_cs);
+}
+
+CFileIdSet::~CFileIdSet()
+{
+	for(auto itr = m_Volumes.begin();itr != m_Volumes.end();itr++)
+	{
+		for(int i = 0;i < NUM_SHARDS;i++)
+		{
+			DeleteCriticalSection(&(*itr)->Shards[i].cs);
+		}
+
+		delete *itr;
+	}
+
+	DeleteCriticalSection(&m_cs);
+}
+
+BOOL CFileIdSet::Insert(DWORD dwVolumeSerialNumber,ULONGLONG ulFileIndex)
+{
+	Volume_t *pVolume = GetVolume(dwVolumeSerialNumber);
+
+	/* The top bits pick the shard, and the
+	bottom bits the slot within it. */
+	ULONGLONG ulHash = Hash(ulFileIndex);
+	Shard_t &Shard = pVolume->Shards[ulHash >> 58];
+
+	EnterCriticalSection(&Shard.cs);
+	BOOL bInserted = InsertIntoShard(Shard,ulFileIndex,ulHash);
+	LeaveCriticalSection(&Shard.cs);
+
+	return bInserted;
+}
+
+size_t CFileIdSet::GetCount() const
+{
+	size_t nItems = 0;
+
+	EnterCriticalSection(&m_cs);
+
+	for(auto itr = m_Volumes.begin();itr != m_Volumes.end();itr++)
+	{
+		for(int i = 0;i < NUM_SHARDS;i++)
+		{
+			Shard_t &Shard = (*itr)->Shards[i];
+
+			EnterCriticalSection(&Shard.cs);
+			nItems += Shard.nItems + (Shard.bContainsZero ? 1 : 0);
+			LeaveCriticalSection(&Shard.cs);
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return nItems;
+}
+
+CFileIdSet::Volume_t *CFileIdSet::GetVolume(DWORD dwVolumeSerialNumber)
+{
+	Volume_t *pVolume = NULL;
+
+	EnterCriticalSection(&m_cs);
+
+	/* There's usually only one volume,
+	so a linear search is enough. */
+	for(auto itr = m_Volumes.begin();itr != m_Volumes.end();itr++)
+	{
+		if((*itr)->dwSerialNumber == dwVolumeSerialNumber)
+		{
+			pVolume = *itr;
+			break;
+		}
+	}
+
+	if(pVolume == NULL)
+	{
+		pVolume = new Volume_t;
+		pVolume->dwSerialNumber = dwVolumeSerialNumber;
+
+		for(int i = 0;i < NUM_SHARDS;i++)
+		{
+			InitializeCriticalSection(&pVolume->Shards[i].cs);
+			pVolume->Shards[i].nItems = 0;
+			pVolume->Shards[i].bContainsZero = FALSE;
+		}
+
+		m_Volumes.push_back(pVolume);
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return pVolume;
+}
+
+ULONGLONG CFileIdSet::Hash(ULONGLONG ulFileIndex)
+{
+	/* File indexes are largely sequential, so the
+	bits are mixed before they're used (this is the
+	finalizer from MurmurHash3). */
+	ULONGLONG ulHash = ulFileIndex;
+	ulHash ^= ulHash >> 33;
+	ulHash *= 0xFF51AFD7ED558CCDULL;
+	ulHash ^= ulHash >> 33;
+	ulHash *= 0xC4CEB9FE1A85EC53ULL;
+	ulHash ^= ulHash >> 33;
+
+	return ulHash;
+}
+
+BOOL CFileIdSet::InsertIntoShard(Shard_t &Shard,ULONGLONG ulFileIndex,ULONGLONG ulHash)
+{
+	if(ulFileIndex == EMPTY_SLOT)
+	{
+		BOOL bInserted = !Shard.bContainsZero;
+		Shard.bContainsZero = TRUE;
+
+		return bInserted;
+	}
+
+	/* Tables are kept at most three
+	quarters full. */
+	if((Shard.nItems + 1) * 4 > Shard.Slots.size() * 3)
+	{
+		Grow(Shard);
+	}
+
+	size_t nMask = Shard.Slots.size() - 1;
+	size_t nSlot = static_cast<size_t>(ulHash) & nMask;
+
+	while(Shard.Slots[nSlot] != EMPTY_SLOT)
+	{
+		if(Shard.Slots[nSlot] == ulFileIndex)
+		{
+			return FALSE;
+		}
+
+		nSlot = (nSlot + 1) & nMask;
+	}
+
+	Shard.Slots[nSlot] = ulFileIndex;
+	Shard.nItems++;
+
+	return TRUE;
+}
+
+void CFileIdSet::Grow(Shard_t &Shard)
+{
+	std::vector<ULONGLONG> OldSlots;
+	OldSlots.swap(Shard.Slots);
+
+	Shard.Slots.resize(OldSlots.empty() ? INITIAL_CAPACITY : OldSlots.size() * 2,EMPTY_SLOT);
+	Shard.nItems = 0;
+
+	for(auto itr = OldSlots.begin();itr != OldSlots.end();itr++)
+	{
+		if(*itr != EMPTY_SLOT)
+		{
+			InsertIntoShard(Shard,*itr,Hash(*itr));
+		}
+	}
+}
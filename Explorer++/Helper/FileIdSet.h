@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "Macros.h"
+
+/* A set of file IDs (the volume serial number, together
+with the file index returned by GetFileInformationByHandle),
+used to count hard linked files only once.
+
+Items can be added from several threads at once. The set
+is split into a fixed number of shards, each with its own
+lock and its own open addressed table, so threads rarely
+wait on each other. Each table slot holds only the file
+index (8 bytes); volumes are kept apart by giving each one
+its own set of shards. */
+class CFileIdSet
+{
+public:
+
+	CFileIdSet();
+	~CFileIdSet();
+
+	/* Returns TRUE if the ID wasn't already
+	in the set. */
+	BOOL		Insert(DWORD dwVolumeSerialNumber,ULONGLONG ulFileIndex);
+
+	size_t		GetCount() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CFileIdSet);
+
+	static const int	NUM_SHARDS = 64;
+	static const size_t	INITIAL_CAPACITY = 64;
+
+	struct Shard_t
+	{
+		CRITICAL_SECTION		cs;
+		std::vector<ULONGLONG>	Slots;
+		size_t					nItems;
+
+		/* 0 marks an empty slot, so a file index
+		of 0 is recorded separately. */
+		BOOL					bContainsZero;
+	};
+
+	struct Volume_t
+	{
+		DWORD		dwSerialNumber;
+		Shard_t		Shards[NUM_SHARDS];
+	};
+
+	Volume_t	*GetVolume(DWORD dwVolumeSerialNumber);
+
+	static ULONGLONG	Hash(ULONGLONG ulFileIndex);
+	static BOOL	InsertIntoShard(Shard_t &Shard,ULONGLONG ulFileIndex,ULONGLONG ulHash);
+	static void	Grow(Shard_t &Shard);
+
+	/* Guards the list of volumes (but not
+	the shards within them). */
+	mutable CRITICAL_SECTION	m_cs;
+	std::vector<Volume_t *>		m_Volumes;
+};
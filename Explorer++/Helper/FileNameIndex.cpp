@@ -0,0 +1,1157 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: FileNameIndex.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Maintains an index of the files and folders beneath
+ * a directory, which can be searched by name.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <algorithm>
+#include <iterator>
+#include "FileNameIndex.h"
+#include "WildcardMatcher.h"
+#include "RegexMatcher.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+
+namespace
+{
+	std::wstring CombinePath(const std::wstring &strDirectory,const TCHAR *szName)
+	{
+		std::wstring strPath(strDirectory);
+
+		if(strPath.empty() || strPath[strPath.length() - 1] != '\\')
+		{
+			strPath += '\\';
+		}
+
+		strPath += szName;
+
+		return strPath;
+	}
+
+	ULONGLONG CombineParts(DWORD dwLow,DWORD dwHigh)
+	{
+		ULARGE_INTEGER ul;
+		ul.LowPart = dwLow;
+		ul.HighPart = dwHigh;
+
+		return ul.QuadPart;
+	}
+
+	template <typename T> BOOL WriteColumn(HANDLE hFile,const std::vector<T> &Column)
+	{
+		if(Column.empty())
+		{
+			return TRUE;
+		}
+
+		DWORD dwSize = static_cast<DWORD>(Column.size() * sizeof(T));
+		DWORD nBytesWritten;
+		BOOL bRet = WriteFile(hFile,&Column[0],dwSize,&nBytesWritten,NULL);
+
+		return bRet && nBytesWritten == dwSize;
+	}
+
+	template <typename T> void ReadColumn(const BYTE *&pData,size_t nItems,std::vector<T> &Column)
+	{
+		Column.resize(nItems);
+
+		if(nItems > 0)
+		{
+			memcpy(&Column[0],pData,nItems * sizeof(T));
+		}
+
+		pData += nItems * sizeof(T);
+	}
+}
+
+CFileNameIndex::CFileNameIndex() :
+m_bBuilding(FALSE)
+{
+	InitializeCriticalSection(&m_cs);
+	ClearData(m_Data);
+}
+
+CFileNameIndex::~CFileNameIndex()
+{
+	DeleteCriticalSection(&m_cs);
+}
+
+BOOL CFileNameIndex::Build(const TCHAR *szRoot,const volatile LONG *plStop)
+{
+	TCHAR szRootCopy[MAX_PATH];
+	StringCchCopy(szRootCopy,SIZEOF_ARRAY(szRootCopy),szRoot);
+	PathRemoveBackslash(szRootCopy);
+
+	EnterCriticalSection(&m_cs);
+	m_bBuilding = TRUE;
+	LeaveCriticalSection(&m_cs);
+
+	IndexData_t Data;
+	ClearData(Data);
+
+	BOOL bSuccess = WalkDirectory(szRootCopy,-1,Data,plStop);
+
+	CTrigramIndex Trigrams;
+
+	if(bSuccess)
+	{
+		SortItems(Data);
+		IndexNames(Data,Trigrams);
+	}
+
+	std::vector<Change_t> QueuedChanges;
+
+	EnterCriticalSection(&m_cs);
+
+	if(bSuccess)
+	{
+		m_strRoot = szRootCopy;
+		std::swap(m_Data,Data);
+		m_Trigrams.Swap(Trigrams);
+		m_strPendingRename.clear();
+	}
+
+	QueuedChanges.swap(m_QueuedChanges);
+	m_bBuilding = FALSE;
+
+	LeaveCriticalSection(&m_cs);
+
+	/* These changes happened while the directory
+	was being walked, so some of them may already
+	be reflected in the index. Changes are applied
+	in a way that allows for this. */
+	for(auto itr = QueuedChanges.begin();itr != QueuedChanges.end();itr++)
+	{
+		ApplyChangeInternal(itr->strFileName,itr->dwAction);
+	}
+
+	return bSuccess;
+}
+
+BOOL CFileNameIndex::WalkDirectory(const std::wstring &strDirectory,int iParent,
+	IndexData_t &Data,const volatile LONG *plStop)
+{
+	std::vector<std::pair<std::wstring,int>> Directories;
+	Directories.push_back(std::make_pair(strDirectory,iParent));
+
+	while(!Directories.empty())
+	{
+		if(plStop != NULL && *plStop != 0)
+		{
+			return FALSE;
+		}
+
+		/* When built in the background, the walk gives
+		way to anything more urgent on the same disk. */
+		if(!CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE))
+		{
+			return FALSE;
+		}
+
+		std::pair<std::wstring,int> Directory = Directories.back();
+		Directories.pop_back();
+
+		WIN32_FIND_DATA wfd;
+		HANDLE hFindFile = FindFirstFile(CombinePath(Directory.first,_T("*")).c_str(),&wfd);
+
+		if(hFindFile == INVALID_HANDLE_VALUE)
+		{
+			continue;
+		}
+
+		do
+		{
+			if(lstrcmp(wfd.cFileName,_T(".")) == 0 ||
+				lstrcmp(wfd.cFileName,_T("..")) == 0)
+			{
+				continue;
+			}
+
+			int iItem = AddItem(Data,wfd.cFileName,Directory.second,wfd.dwFileAttributes,
+				CombineParts(wfd.nFileSizeLow,wfd.nFileSizeHigh),
+				CombineParts(wfd.ftLastWriteTime.dwLowDateTime,wfd.ftLastWriteTime.dwHighDateTime));
+
+			/* Reparse points (e.g. junctions) aren't
+			followed, as they can lead back into the
+			tree being walked. */
+			if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY &&
+				(wfd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != FILE_ATTRIBUTE_REPARSE_POINT)
+			{
+				Directories.push_back(std::make_pair(CombinePath(Directory.first,wfd.cFileName),iItem));
+			}
+		} while(FindNextFile(hFindFile,&wfd) != 0);
+
+		FindClose(hFindFile);
+	}
+
+	return TRUE;
+}
+
+int CFileNameIndex::AddItem(IndexData_t &Data,const TCHAR *szName,int iParent,
+	DWORD dwAttributes,ULONGLONG ulSize,ULONGLONG ulLastWriteTime)
+{
+	Data.NameOffsets.push_back(static_cast<DWORD>(Data.Names.size()));
+	Data.Names.insert(Data.Names.end(),szName,szName + lstrlen(szName) + 1);
+
+	Data.Parents.push_back(iParent);
+	Data.Attributes.push_back(dwAttributes);
+	Data.Sizes.push_back(ulSize);
+	Data.LastWriteTimes.push_back(ulLastWriteTime);
+
+	return static_cast<int>(Data.Parents.size()) - 1;
+}
+
+void CFileNameIndex::SortItems(IndexData_t &Data)
+{
+	Data.SortedItems.clear();
+	Data.UnsortedItems.clear();
+
+	int nItems = static_cast<int>(Data.Parents.size());
+
+	for(int i = 0;i < nItems;i++)
+	{
+		if(Data.Attributes[i] != REMOVED_ITEM)
+		{
+			Data.SortedItems.push_back(i);
+		}
+	}
+
+	std::sort(Data.SortedItems.begin(),Data.SortedItems.end(),CNameComparison(Data));
+}
+
+void CFileNameIndex::IndexNames(const IndexData_t &Data,CTrigramIndex &Trigrams)
+{
+	Trigrams.Clear();
+
+	int nItems = static_cast<int>(Data.Parents.size());
+
+	for(int i = 0;i < nItems;i++)
+	{
+		if(Data.Attributes[i] != REMOVED_ITEM)
+		{
+			Trigrams.AddName(i,&Data.Names[Data.NameOffsets[i]]);
+		}
+	}
+}
+
+void CFileNameIndex::ClearData(IndexData_t &Data)
+{
+	Data.Names.clear();
+	Data.NameOffsets.clear();
+	Data.Parents.clear();
+	Data.Attributes.clear();
+	Data.Sizes.clear();
+	Data.LastWriteTimes.clear();
+	Data.SortedItems.clear();
+	Data.UnsortedItems.clear();
+	Data.nRemovedItems = 0;
+}
+
+BOOL CFileNameIndex::Save(const TCHAR *szFileName)
+{
+	/* The data is copied, so that the index doesn't
+	stay locked while the file is written. */
+	EnterCriticalSection(&m_cs);
+	Compact();
+	IndexData_t Data = m_Data;
+	std::wstring strRoot = m_strRoot;
+	LeaveCriticalSection(&m_cs);
+
+	IndexFileHeader_t Header;
+	ZeroMemory(&Header,sizeof(Header));
+	Header.dwSignature = INDEX_FILE_SIGNATURE;
+	Header.dwVersion = INDEX_FILE_VERSION;
+	Header.nItems = static_cast<DWORD>(Data.Parents.size());
+	Header.nNameCharacters = static_cast<DWORD>(Data.Names.size());
+	StringCchCopy(Header.szRoot,SIZEOF_ARRAY(Header.szRoot),strRoot.c_str());
+
+	/* The index is written to a temporary file first,
+	so that an existing index file is only replaced
+	once the new one is complete. */
+	std::wstring strTempFileName = std::wstring(szFileName) + _T(".tmp");
+
+	HANDLE hFile = CreateFile(strTempFileName.c_str(),GENERIC_WRITE,0,NULL,
+		CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	DWORD nBytesWritten;
+	BOOL bSuccess = WriteFile(hFile,&Header,sizeof(Header),&nBytesWritten,NULL) &&
+		nBytesWritten == sizeof(Header) &&
+		WriteColumn(hFile,Data.NameOffsets) &&
+		WriteColumn(hFile,Data.Parents) &&
+		WriteColumn(hFile,Data.Attributes) &&
+		WriteColumn(hFile,Data.Sizes) &&
+		WriteColumn(hFile,Data.LastWriteTimes) &&
+		WriteColumn(hFile,Data.SortedItems) &&
+		WriteColumn(hFile,Data.Names);
+
+	CloseHandle(hFile);
+
+	if(bSuccess)
+	{
+		bSuccess = MoveFileEx(strTempFileName.c_str(),szFileName,MOVEFILE_REPLACE_EXISTING);
+	}
+
+	if(!bSuccess)
+	{
+		DeleteFile(strTempFileName.c_str());
+	}
+
+	return bSuccess;
+}
+
+BOOL CFileNameIndex::Load(const TCHAR *szFileName)
+{
+	HANDLE hFile = CreateFile(szFileName,GENERIC_READ,FILE_SHARE_READ,NULL,
+		OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	LARGE_INTEGER liFileSize;
+
+	if(!GetFileSizeEx(hFile,&liFileSize) ||
+		liFileSize.QuadPart < static_cast<LONGLONG>(sizeof(IndexFileHeader_t)))
+	{
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	HANDLE hMapping = CreateFileMapping(hFile,NULL,PAGE_READONLY,0,0,NULL);
+
+	if(hMapping == NULL)
+	{
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	const BYTE *pView = reinterpret_cast<const BYTE *>(MapViewOfFile(hMapping,FILE_MAP_READ,0,0,0));
+
+	if(pView == NULL)
+	{
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return FALSE;
+	}
+
+	IndexFileHeader_t Header;
+	memcpy(&Header,pView,sizeof(Header));
+
+	ULONGLONG ulExpectedSize = sizeof(Header) +
+		static_cast<ULONGLONG>(Header.nItems) * (sizeof(DWORD) + sizeof(int) + sizeof(DWORD) +
+		sizeof(ULONGLONG) + sizeof(ULONGLONG) + sizeof(int)) +
+		static_cast<ULONGLONG>(Header.nNameCharacters) * sizeof(TCHAR);
+
+	size_t nRootLength;
+
+	BOOL bSuccess = Header.dwSignature == INDEX_FILE_SIGNATURE &&
+		Header.dwVersion == INDEX_FILE_VERSION &&
+		ulExpectedSize == static_cast<ULONGLONG>(liFileSize.QuadPart) &&
+		SUCCEEDED(StringCchLength(Header.szRoot,SIZEOF_ARRAY(Header.szRoot),&nRootLength)) &&
+		nRootLength > 0;
+
+	IndexData_t Data;
+	ClearData(Data);
+
+	if(bSuccess)
+	{
+		const BYTE *pData = pView + sizeof(Header);
+
+		ReadColumn(pData,Header.nItems,Data.NameOffsets);
+		ReadColumn(pData,Header.nItems,Data.Parents);
+		ReadColumn(pData,Header.nItems,Data.Attributes);
+		ReadColumn(pData,Header.nItems,Data.Sizes);
+		ReadColumn(pData,Header.nItems,Data.LastWriteTimes);
+		ReadColumn(pData,Header.nItems,Data.SortedItems);
+		ReadColumn(pData,Header.nNameCharacters,Data.Names);
+	}
+
+	UnmapViewOfFile(pView);
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+
+	if(!bSuccess)
+	{
+		return FALSE;
+	}
+
+	/* The file may have been truncated or altered,
+	so check that every item refers to a valid name
+	and parent before using it. */
+	int nItems = static_cast<int>(Header.nItems);
+
+	if(nItems > 0 && (Data.Names.empty() || Data.Names.back() != '\0'))
+	{
+		return FALSE;
+	}
+
+	std::vector<bool> Sorted(nItems,false);
+
+	for(int i = 0;i < nItems;i++)
+	{
+		if(Data.NameOffsets[i] >= Header.nNameCharacters ||
+			Data.Parents[i] < -1 || Data.Parents[i] >= i ||
+			Data.Attributes[i] == REMOVED_ITEM)
+		{
+			return FALSE;
+		}
+
+		int iSortedItem = Data.SortedItems[i];
+
+		if(iSortedItem < 0 || iSortedItem >= nItems || Sorted[iSortedItem])
+		{
+			return FALSE;
+		}
+
+		Sorted[iSortedItem] = true;
+	}
+
+	CTrigramIndex Trigrams;
+	IndexNames(Data,Trigrams);
+
+	EnterCriticalSection(&m_cs);
+	m_strRoot = Header.szRoot;
+	std::swap(m_Data,Data);
+	m_Trigrams.Swap(Trigrams);
+	m_strPendingRename.clear();
+	LeaveCriticalSection(&m_cs);
+
+	return TRUE;
+}
+
+void CFileNameIndex::ApplyChange(const TCHAR *szFileName,DWORD dwAction)
+{
+	EnterCriticalSection(&m_cs);
+
+	if(m_bBuilding)
+	{
+		Change_t Change;
+		Change.strFileName = szFileName;
+		Change.dwAction = dwAction;
+		m_QueuedChanges.push_back(Change);
+
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	ApplyChangeInternal(szFileName,dwAction);
+}
+
+void CFileNameIndex::ApplyChangeInternal(const std::wstring &strFileName,DWORD dwAction)
+{
+	switch(dwAction)
+	{
+	case FILE_ACTION_ADDED:
+	case FILE_ACTION_MODIFIED:
+		AddItemFromDisk(strFileName);
+		break;
+
+	case FILE_ACTION_REMOVED:
+		{
+			EnterCriticalSection(&m_cs);
+
+			int iItem;
+
+			if(FindItem(strFileName,iItem))
+			{
+				RemoveItem(iItem);
+			}
+
+			LeaveCriticalSection(&m_cs);
+		}
+		break;
+
+	case FILE_ACTION_RENAMED_OLD_NAME:
+		EnterCriticalSection(&m_cs);
+		m_strPendingRename = strFileName;
+		LeaveCriticalSection(&m_cs);
+		break;
+
+	case FILE_ACTION_RENAMED_NEW_NAME:
+		{
+			EnterCriticalSection(&m_cs);
+			std::wstring strOldFileName = m_strPendingRename;
+			m_strPendingRename.clear();
+			LeaveCriticalSection(&m_cs);
+
+			if(strOldFileName.empty())
+			{
+				AddItemFromDisk(strFileName);
+			}
+			else
+			{
+				RenameItem(strOldFileName,strFileName);
+			}
+		}
+		break;
+	}
+
+	/* Removed items are only dropped here (rather than
+	as they're removed), since compacting the index
+	changes the position of every item. */
+	EnterCriticalSection(&m_cs);
+
+	if(m_Data.nRemovedItems > static_cast<int>(m_Data.Parents.size()) / 2)
+	{
+		Compact();
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+/* Adds the specified item (and, if it's a directory,
+everything within it), or updates it if it's already
+in the index. */
+void CFileNameIndex::AddItemFromDisk(const std::wstring &strFileName)
+{
+	EnterCriticalSection(&m_cs);
+	std::wstring strRoot = m_strRoot;
+	LeaveCriticalSection(&m_cs);
+
+	if(strRoot.empty())
+	{
+		return;
+	}
+
+	std::wstring strFullFileName = CombinePath(strRoot,strFileName.c_str());
+
+	/* The item may have been removed again since
+	the change was reported. */
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+
+	if(!GetFileAttributesEx(strFullFileName.c_str(),GetFileExInfoStandard,&fad))
+	{
+		return;
+	}
+
+	ULONGLONG ulSize = CombineParts(fad.nFileSizeLow,fad.nFileSizeHigh);
+	ULONGLONG ulLastWriteTime = CombineParts(fad.ftLastWriteTime.dwLowDateTime,
+		fad.ftLastWriteTime.dwHighDateTime);
+
+	EnterCriticalSection(&m_cs);
+
+	int iParent;
+	std::wstring strName;
+	BOOL bParentFound = FindParent(strFileName,iParent,strName);
+	int iItem = bParentFound ? FindChild(iParent,strName.c_str()) : -1;
+
+	if(iItem != -1)
+	{
+		m_Data.Attributes[iItem] = fad.dwFileAttributes;
+		m_Data.Sizes[iItem] = ulSize;
+		m_Data.LastWriteTimes[iItem] = ulLastWriteTime;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	if(!bParentFound || iItem != -1)
+	{
+		return;
+	}
+
+	/* A directory that's been moved in from elsewhere
+	is only reported once, so anything within it
+	needs to be found here. */
+	IndexData_t Contents;
+	ClearData(Contents);
+
+	if((fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY &&
+		(fad.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != FILE_ATTRIBUTE_REPARSE_POINT)
+	{
+		WalkDirectory(strFullFileName,-1,Contents,NULL);
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	/* The index may have changed while the directory
+	was being walked, so the parent needs to be
+	looked up again. */
+	if(FindParent(strFileName,iParent,strName) &&
+		FindChild(iParent,strName.c_str()) == -1)
+	{
+		iItem = AddItem(m_Data,strName.c_str(),iParent,fad.dwFileAttributes,
+			ulSize,ulLastWriteTime);
+		m_Data.UnsortedItems.push_back(iItem);
+		m_Trigrams.AddName(iItem,strName.c_str());
+
+		int iFirstContentItem = iItem + 1;
+		int nContentItems = static_cast<int>(Contents.Parents.size());
+
+		for(int i = 0;i < nContentItems;i++)
+		{
+			int iContentParent = Contents.Parents[i];
+
+			int iNewItem = AddItem(m_Data,&Contents.Names[Contents.NameOffsets[i]],
+				(iContentParent == -1) ? iItem : iFirstContentItem + iContentParent,
+				Contents.Attributes[i],Contents.Sizes[i],Contents.LastWriteTimes[i]);
+			m_Data.UnsortedItems.push_back(iNewItem);
+			m_Trigrams.AddName(iNewItem,&Contents.Names[Contents.NameOffsets[i]]);
+		}
+
+		if(m_Data.UnsortedItems.size() >= MAX_UNSORTED_ITEMS)
+		{
+			MergeUnsortedItems();
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+void CFileNameIndex::RenameItem(const std::wstring &strOldFileName,const std::wstring &strNewFileName)
+{
+	EnterCriticalSection(&m_cs);
+
+	int iItem;
+
+	if(!FindItem(strOldFileName,iItem))
+	{
+		LeaveCriticalSection(&m_cs);
+
+		AddItemFromDisk(strNewFileName);
+		return;
+	}
+
+	int iNewParent;
+	std::wstring strNewName;
+
+	if(!FindParent(strNewFileName,iNewParent,strNewName))
+	{
+		/* Moved somewhere the index doesn't cover. */
+		RemoveItem(iItem);
+
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+
+	int iExistingItem = FindChild(iNewParent,strNewName.c_str());
+
+	if(iExistingItem != -1 && iExistingItem != iItem)
+	{
+		RemoveItem(iExistingItem);
+	}
+
+	/* The item can only be renamed in place if its
+	new parent is stored before it. Otherwise, it's
+	removed and then added back at the end. */
+	if(iNewParent < iItem)
+	{
+		RemoveFromNameTables(iItem);
+		m_Trigrams.RemoveName(iItem,&m_Data.Names[m_Data.NameOffsets[iItem]]);
+
+		m_Data.NameOffsets[iItem] = static_cast<DWORD>(m_Data.Names.size());
+		m_Data.Names.insert(m_Data.Names.end(),strNewName.begin(),strNewName.end());
+		m_Data.Names.push_back('\0');
+		m_Data.Parents[iItem] = iNewParent;
+
+		m_Data.UnsortedItems.push_back(iItem);
+		m_Trigrams.AddName(iItem,strNewName.c_str());
+
+		if(m_Data.UnsortedItems.size() >= MAX_UNSORTED_ITEMS)
+		{
+			MergeUnsortedItems();
+		}
+
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+
+	RemoveItem(iItem);
+
+	LeaveCriticalSection(&m_cs);
+
+	AddItemFromDisk(strNewFileName);
+}
+
+BOOL CFileNameIndex::FindItem(const std::wstring &strFileName,int &iItem) const
+{
+	int iParent;
+	std::wstring strName;
+
+	if(!FindParent(strFileName,iParent,strName))
+	{
+		return FALSE;
+	}
+
+	iItem = FindChild(iParent,strName.c_str());
+
+	return iItem != -1;
+}
+
+/* Finds the directory that contains the specified
+item. The item itself doesn't have to exist. */
+BOOL CFileNameIndex::FindParent(const std::wstring &strFileName,int &iParent,std::wstring &strName) const
+{
+	iParent = -1;
+
+	size_t nStart = 0;
+
+	while(TRUE)
+	{
+		size_t nEnd = strFileName.find('\\',nStart);
+
+		if(nEnd == std::wstring::npos)
+		{
+			strName = strFileName.substr(nStart);
+			return !strName.empty();
+		}
+
+		if(nEnd > nStart)
+		{
+			std::wstring strComponent = strFileName.substr(nStart,nEnd - nStart);
+
+			iParent = FindChild(iParent,strComponent.c_str());
+
+			if(iParent == -1)
+			{
+				return FALSE;
+			}
+		}
+
+		nStart = nEnd + 1;
+	}
+}
+
+int CFileNameIndex::FindChild(int iParent,const TCHAR *szName) const
+{
+	auto Range = std::equal_range(m_Data.SortedItems.begin(),m_Data.SortedItems.end(),
+		szName,CNameComparison(m_Data));
+
+	for(auto itr = Range.first;itr != Range.second;itr++)
+	{
+		if(m_Data.Parents[*itr] == iParent &&
+			m_Data.Attributes[*itr] != REMOVED_ITEM)
+		{
+			return *itr;
+		}
+	}
+
+	for(auto itr = m_Data.UnsortedItems.begin();itr != m_Data.UnsortedItems.end();itr++)
+	{
+		if(m_Data.Parents[*itr] == iParent &&
+			m_Data.Attributes[*itr] != REMOVED_ITEM &&
+			_wcsicmp(&m_Data.Names[m_Data.NameOffsets[*itr]],szName) == 0)
+		{
+			return *itr;
+		}
+	}
+
+	return -1;
+}
+
+/* Returns the item for the specified directory, or
+-1 if the directory is the root. */
+BOOL CFileNameIndex::GetDirectoryItem(const TCHAR *szDirectory,int &iItem) const
+{
+	if(m_strRoot.empty())
+	{
+		return FALSE;
+	}
+
+	size_t nRootLength = m_strRoot.length();
+
+	if(_wcsnicmp(szDirectory,m_strRoot.c_str(),nRootLength) != 0)
+	{
+		return FALSE;
+	}
+
+	std::wstring strRelative(szDirectory + nRootLength);
+
+	/* Roots of the form "C:\" already end in a
+	backslash. Otherwise, the directory has to
+	continue with one (so that "C:\Data2" isn't
+	treated as being within "C:\Data"). */
+	if(m_strRoot[nRootLength - 1] != '\\' && !strRelative.empty())
+	{
+		if(strRelative[0] != '\\')
+		{
+			return FALSE;
+		}
+
+		strRelative.erase(0,1);
+	}
+
+	while(!strRelative.empty() && strRelative[strRelative.length() - 1] == '\\')
+	{
+		strRelative.erase(strRelative.length() - 1);
+	}
+
+	if(strRelative.empty())
+	{
+		iItem = -1;
+		return TRUE;
+	}
+
+	if(!FindItem(strRelative,iItem))
+	{
+		return FALSE;
+	}
+
+	return (m_Data.Attributes[iItem] & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY;
+}
+
+void CFileNameIndex::GetFullFileName(int iItem,std::wstring &strFullFileName) const
+{
+	std::vector<int> Path;
+
+	for(int i = iItem;i != -1;i = m_Data.Parents[i])
+	{
+		Path.push_back(i);
+	}
+
+	strFullFileName = m_strRoot;
+
+	for(auto itr = Path.rbegin();itr != Path.rend();itr++)
+	{
+		strFullFileName = CombinePath(strFullFileName,&m_Data.Names[m_Data.NameOffsets[*itr]]);
+	}
+}
+
+/* Removes an item, along with anything
+beneath it. */
+void CFileNameIndex::RemoveItem(int iItem)
+{
+	BOOL bDirectory = (m_Data.Attributes[iItem] & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY;
+
+	m_Data.Attributes[iItem] = REMOVED_ITEM;
+	m_Data.nRemovedItems++;
+	m_Trigrams.RemoveName(iItem,&m_Data.Names[m_Data.NameOffsets[iItem]]);
+
+	/* Since children are always stored after their
+	parents, a single pass is enough to find every
+	item beneath a directory. */
+	if(bDirectory)
+	{
+		int nItems = static_cast<int>(m_Data.Parents.size());
+
+		for(int i = iItem + 1;i < nItems;i++)
+		{
+			int iParent = m_Data.Parents[i];
+
+			if(iParent != -1 &&
+				m_Data.Attributes[i] != REMOVED_ITEM &&
+				m_Data.Attributes[iParent] == REMOVED_ITEM)
+			{
+				m_Data.Attributes[i] = REMOVED_ITEM;
+				m_Data.nRemovedItems++;
+				m_Trigrams.RemoveName(i,&m_Data.Names[m_Data.NameOffsets[i]]);
+			}
+		}
+	}
+}
+
+void CFileNameIndex::RemoveFromNameTables(int iItem)
+{
+	auto itrUnsorted = std::find(m_Data.UnsortedItems.begin(),m_Data.UnsortedItems.end(),iItem);
+
+	if(itrUnsorted != m_Data.UnsortedItems.end())
+	{
+		m_Data.UnsortedItems.erase(itrUnsorted);
+		return;
+	}
+
+	auto Range = std::equal_range(m_Data.SortedItems.begin(),m_Data.SortedItems.end(),
+		&m_Data.Names[m_Data.NameOffsets[iItem]],CNameComparison(m_Data));
+	auto itrSorted = std::find(Range.first,Range.second,iItem);
+
+	if(itrSorted != Range.second)
+	{
+		m_Data.SortedItems.erase(itrSorted);
+	}
+}
+
+void CFileNameIndex::MergeUnsortedItems()
+{
+	CNameComparison NameComparison(m_Data);
+
+	std::sort(m_Data.UnsortedItems.begin(),m_Data.UnsortedItems.end(),NameComparison);
+
+	size_t nSortedItems = m_Data.SortedItems.size();
+	m_Data.SortedItems.insert(m_Data.SortedItems.end(),
+		m_Data.UnsortedItems.begin(),m_Data.UnsortedItems.end());
+	std::inplace_merge(m_Data.SortedItems.begin(),m_Data.SortedItems.begin() + nSortedItems,
+		m_Data.SortedItems.end(),NameComparison);
+
+	m_Data.UnsortedItems.clear();
+}
+
+/* Drops any removed items (and any names that are no
+longer used), then rebuilds the sorted table. */
+void CFileNameIndex::Compact()
+{
+	IndexData_t Data;
+	ClearData(Data);
+
+	int nItems = static_cast<int>(m_Data.Parents.size());
+	std::vector<int> NewItems(nItems,-1);
+
+	for(int i = 0;i < nItems;i++)
+	{
+		if(m_Data.Attributes[i] == REMOVED_ITEM)
+		{
+			continue;
+		}
+
+		/* A parent can't have been removed without
+		this item also having been removed. */
+		int iParent = m_Data.Parents[i];
+
+		NewItems[i] = AddItem(Data,&m_Data.Names[m_Data.NameOffsets[i]],
+			(iParent == -1) ? -1 : NewItems[iParent],m_Data.Attributes[i],
+			m_Data.Sizes[i],m_Data.LastWriteTimes[i]);
+	}
+
+	SortItems(Data);
+
+	std::swap(m_Data,Data);
+
+	/* Items keep their relative order, so the trigram
+	index can simply be renumbered. */
+	m_Trigrams.RemapItems(NewItems);
+}
+
+/* Finds the items that may match a wildcard pattern
+list. Each name that matches must contain one of the
+literal runs from the patterns, so the candidates
+for each run are combined. Returns FALSE if one of
+the runs is too short to be looked up. */
+BOOL CFileNameIndex::GetWildcardCandidates(const CWildcardMatcher &WildcardMatcher,
+	std::vector<int> &Candidates) const
+{
+	std::vector<std::wstring> Literals;
+
+	if(!WildcardMatcher.GetRequiredLiterals(Literals))
+	{
+		return FALSE;
+	}
+
+	Candidates.clear();
+
+	std::vector<int> LiteralCandidates;
+	std::vector<int> CombinedCandidates;
+
+	for(auto itr = Literals.begin();itr != Literals.end();itr++)
+	{
+		if(!m_Trigrams.GetCandidates(itr->c_str(),LiteralCandidates))
+		{
+			return FALSE;
+		}
+
+		CombinedCandidates.clear();
+		std::set_union(Candidates.begin(),Candidates.end(),
+			LiteralCandidates.begin(),LiteralCandidates.end(),
+			std::back_inserter(CombinedCandidates));
+		Candidates.swap(CombinedCandidates);
+	}
+
+	return TRUE;
+}
+
+BOOL CFileNameIndex::Query(const TCHAR *szDirectory,BOOL bRecursive,const TCHAR *szPattern,
+	QueryType_t QueryType,BOOL bCaseInsensitive,DWORD dwAttributes,
+	std::vector<QueryResult_t> &Results) const
+{
+	BOOL bMatchAll = (lstrlen(szPattern) == 0);
+
+	CWildcardMatcher WildcardMatcher;
+	CRegexMatcher RegexMatcher;
+
+	if(!bMatchAll)
+	{
+		switch(QueryType)
+		{
+		case QUERY_WILDCARD:
+			WildcardMatcher = CWildcardMatcher(szPattern,!bCaseInsensitive);
+			break;
+
+		case QUERY_REGEX:
+			if(!RegexMatcher.Compile(szPattern,bCaseInsensitive))
+			{
+				return FALSE;
+			}
+			break;
+		}
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	int iDirectory;
+
+	if(!GetDirectoryItem(szDirectory,iDirectory))
+	{
+		LeaveCriticalSection(&m_cs);
+		return FALSE;
+	}
+
+	/* Where possible, only those items whose names
+	contain the trigrams in the pattern are checked. */
+	std::vector<int> Candidates;
+	BOOL bUseCandidates = FALSE;
+
+	if(!bMatchAll)
+	{
+		switch(QueryType)
+		{
+		case QUERY_WILDCARD:
+			bUseCandidates = GetWildcardCandidates(WildcardMatcher,Candidates);
+			break;
+
+		case QUERY_SUBSTRING:
+			bUseCandidates = m_Trigrams.GetCandidates(szPattern,Candidates);
+			break;
+		}
+	}
+
+	int nItems = static_cast<int>(m_Data.Parents.size());
+
+	/* Anything within the directory must be
+	stored after it. */
+	auto itrCandidate = std::upper_bound(Candidates.begin(),Candidates.end(),iDirectory);
+
+	for(int i = iDirectory + 1;i < nItems;i++)
+	{
+		if(bUseCandidates)
+		{
+			if(itrCandidate == Candidates.end())
+			{
+				break;
+			}
+
+			i = *itrCandidate++;
+		}
+
+		DWORD dwItemAttributes = m_Data.Attributes[i];
+
+		if(dwItemAttributes == REMOVED_ITEM ||
+			(dwItemAttributes & dwAttributes) != dwAttributes)
+		{
+			continue;
+		}
+
+		if(!bMatchAll)
+		{
+			const TCHAR *szName = &m_Data.Names[m_Data.NameOffsets[i]];
+			BOOL bMatch = FALSE;
+
+			switch(QueryType)
+			{
+			case QUERY_WILDCARD:
+				bMatch = WildcardMatcher.Match(szName);
+				break;
+
+			case QUERY_SUBSTRING:
+				if(bCaseInsensitive)
+				{
+					bMatch = (StrStrI(szName,szPattern) != NULL);
+				}
+				else
+				{
+					bMatch = (wcsstr(szName,szPattern) != NULL);
+				}
+				break;
+
+			case QUERY_REGEX:
+				bMatch = RegexMatcher.Match(szName);
+				break;
+			}
+
+			if(!bMatch)
+			{
+				continue;
+			}
+		}
+
+		int iParent = m_Data.Parents[i];
+
+		if(bRecursive)
+		{
+			while(iParent > iDirectory)
+			{
+				iParent = m_Data.Parents[iParent];
+			}
+		}
+
+		if(iParent != iDirectory)
+		{
+			continue;
+		}
+
+		ULARGE_INTEGER uliLastWriteTime;
+		uliLastWriteTime.QuadPart = m_Data.LastWriteTimes[i];
+
+		QueryResult_t Result;
+		GetFullFileName(i,Result.strFullFileName);
+		Result.dwAttributes = dwItemAttributes;
+		Result.ulSize = m_Data.Sizes[i];
+		Result.ftLastWriteTime.dwLowDateTime = uliLastWriteTime.LowPart;
+		Result.ftLastWriteTime.dwHighDateTime = uliLastWriteTime.HighPart;
+		Results.push_back(Result);
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return TRUE;
+}
+
+BOOL CFileNameIndex::IsDirectoryCovered(const TCHAR *szDirectory) const
+{
+	EnterCriticalSection(&m_cs);
+
+	int iItem;
+	BOOL bCovered = GetDirectoryItem(szDirectory,iItem);
+
+	LeaveCriticalSection(&m_cs);
+
+	return bCovered;
+}
+
+std::wstring CFileNameIndex::GetRoot() const
+{
+	EnterCriticalSection(&m_cs);
+	std::wstring strRoot = m_strRoot;
+	LeaveCriticalSection(&m_cs);
+
+	return strRoot;
+}
+
+int CFileNameIndex::GetItemCount() const
+{
+	EnterCriticalSection(&m_cs);
+	int nItems = static_cast<int>(m_Data.Parents.size()) - m_Data.nRemovedItems;
+	LeaveCriticalSection(&m_cs);
+
+	return nItems;
+}
+
+bool CFileNameIndex::CNameComparison::operator()(int iItem1,int iItem2) const
+{
+	return _wcsicmp(&m_Data.Names[m_Data.NameOffsets[iItem1]],
+		&m_Data.Names[m_Data.NameOffsets[iItem2]]) < 0;
+}
+
+bool CFileNameIndex::CNameComparison::operator()(int iItem,const TCHAR *szName) const
+{
+	return _wcsicmp(&m_Data.Names[m_Data.NameOffsets[iItem]],szName) < 0;
+}
+
+bool CFileNameIndex::CNameComparison::operator()(const TCHAR *szName,int iItem) const
+{
+	return _wcsicmp(szName,&m_Data.Names[m_Data.NameOffsets[iItem]]) < 0;
+}
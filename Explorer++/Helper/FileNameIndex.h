@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "TrigramIndex.h"
+#include "Macros.h"
+
+class CWildcardMatcher;
+
+/* An index of every file and folder beneath a root
+directory, which can be searched by name without
+touching the disk.
+
+Each item is stored as a row in a set of columns (name,
+parent, attributes, size and modification time). Names
+are kept back to back in a single buffer, and each item
+refers to its parent by index, so full paths are never
+stored. A table of items sorted by name is used to look
+up individual items when applying changes, and a trigram
+index is used to narrow down the items that need to be
+checked when searching for substring and wildcard
+patterns.
+
+The index can be saved to a file, and loaded back (via a
+file mapping) the next time it's needed. It can be kept
+up to date by passing it the changes reported by a
+directory monitor watching the root. Changes reported
+while the index is being built are held back, then
+applied once the build has finished.
+
+All methods may be called from any thread. */
+class CFileNameIndex
+{
+public:
+
+	enum QueryType_t
+	{
+		QUERY_WILDCARD,
+		QUERY_SUBSTRING,
+		QUERY_REGEX
+	};
+
+	/* The size and last write time are as they were when
+	the item was indexed (or last changed). */
+	struct QueryResult_t
+	{
+		std::wstring	strFullFileName;
+		DWORD			dwAttributes;
+		ULONGLONG		ulSize;
+		FILETIME		ftLastWriteTime;
+	};
+
+	CFileNameIndex();
+	~CFileNameIndex();
+
+	/* Walks the root directory and replaces the contents
+	of the index. If the value pointed to by plStop becomes
+	non-zero, the build is abandoned (leaving the index
+	as it was) and FALSE is returned. */
+	BOOL		Build(const TCHAR *szRoot,const volatile LONG *plStop);
+
+	BOOL		Save(const TCHAR *szFileName);
+	BOOL		Load(const TCHAR *szFileName);
+
+	/* szFileName is relative to the root, and dwAction
+	is one of the FILE_ACTION_* values. */
+	void		ApplyChange(const TCHAR *szFileName,DWORD dwAction);
+
+	/* Finds every item within szDirectory (which must be
+	the root or a directory beneath it) whose name matches
+	the pattern. An empty pattern matches every name. As
+	with a search, dwAttributes (if non-zero) contains
+	attributes that each item must have.
+
+	Returns FALSE if szDirectory isn't covered by the
+	index, or the pattern is invalid. */
+	BOOL		Query(const TCHAR *szDirectory,BOOL bRecursive,const TCHAR *szPattern,
+		QueryType_t QueryType,BOOL bCaseInsensitive,DWORD dwAttributes,
+		std::vector<QueryResult_t> &Results) const;
+
+	BOOL		IsDirectoryCovered(const TCHAR *szDirectory) const;
+	std::wstring	GetRoot() const;
+
+	/* The number of items currently in the index. */
+	int			GetItemCount() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CFileNameIndex);
+
+	static const DWORD	INDEX_FILE_SIGNATURE = 0x58444E49;
+	static const DWORD	INDEX_FILE_VERSION = 1;
+
+	/* Items that have been added or renamed are held in a
+	small unsorted list. Once this list reaches this size,
+	it's merged into the sorted table. */
+	static const size_t	MAX_UNSORTED_ITEMS = 1024;
+
+	/* Marks an item that has been removed. Removed items
+	are left in place until the index is compacted. */
+	static const DWORD	REMOVED_ITEM = INVALID_FILE_ATTRIBUTES;
+
+	/* Every item is stored after its parent (i.e. a
+	parent's index is always lower than those of its
+	children). Items directly beneath the root have a
+	parent of -1. */
+	struct IndexData_t
+	{
+		std::vector<TCHAR>		Names;
+		std::vector<DWORD>		NameOffsets;
+		std::vector<int>		Parents;
+		std::vector<DWORD>		Attributes;
+		std::vector<ULONGLONG>	Sizes;
+		std::vector<ULONGLONG>	LastWriteTimes;
+
+		std::vector<int>		SortedItems;
+		std::vector<int>		UnsortedItems;
+
+		int						nRemovedItems;
+	};
+
+	struct IndexFileHeader_t
+	{
+		DWORD	dwSignature;
+		DWORD	dwVersion;
+		DWORD	nItems;
+		DWORD	nNameCharacters;
+		WCHAR	szRoot[MAX_PATH];
+	};
+
+	struct Change_t
+	{
+		std::wstring	strFileName;
+		DWORD			dwAction;
+	};
+
+	class CNameComparison
+	{
+	public:
+
+		CNameComparison(const IndexData_t &Data) : m_Data(Data) {}
+
+		bool	operator()(int iItem1,int iItem2) const;
+		bool	operator()(int iItem,const TCHAR *szName) const;
+		bool	operator()(const TCHAR *szName,int iItem) const;
+
+	private:
+
+		CNameComparison &operator=(const CNameComparison &);
+
+		const IndexData_t	&m_Data;
+	};
+
+	static BOOL	WalkDirectory(const std::wstring &strDirectory,int iParent,
+		IndexData_t &Data,const volatile LONG *plStop);
+	static int	AddItem(IndexData_t &Data,const TCHAR *szName,int iParent,
+		DWORD dwAttributes,ULONGLONG ulSize,ULONGLONG ulLastWriteTime);
+	static void	SortItems(IndexData_t &Data);
+	static void	IndexNames(const IndexData_t &Data,CTrigramIndex &Trigrams);
+	static void	ClearData(IndexData_t &Data);
+
+	void		ApplyChangeInternal(const std::wstring &strFileName,DWORD dwAction);
+	void		AddItemFromDisk(const std::wstring &strFileName);
+	void		RenameItem(const std::wstring &strOldFileName,const std::wstring &strNewFileName);
+
+	/* These are only called while the lock is held. */
+	BOOL		FindItem(const std::wstring &strFileName,int &iItem) const;
+	BOOL		FindParent(const std::wstring &strFileName,int &iParent,std::wstring &strName) const;
+	int			FindChild(int iParent,const TCHAR *szName) const;
+	BOOL		GetDirectoryItem(const TCHAR *szDirectory,int &iItem) const;
+	void		GetFullFileName(int iItem,std::wstring &strFullFileName) const;
+	void		RemoveItem(int iItem);
+	void		RemoveFromNameTables(int iItem);
+	void		MergeUnsortedItems();
+	void		Compact();
+	BOOL		GetWildcardCandidates(const CWildcardMatcher &WildcardMatcher,
+		std::vector<int> &Candidates) const;
+
+	mutable CRITICAL_SECTION	m_cs;
+
+	std::wstring		m_strRoot;
+	IndexData_t			m_Data;
+
+	/* Trigrams for the names of every item that
+	hasn't been removed. Not saved with the index;
+	it's rebuilt when the index is loaded. */
+	CTrigramIndex		m_Trigrams;
+
+	BOOL				m_bBuilding;
+	std::vector<Change_t>	m_QueuedChanges;
+
+	/* The old name from a FILE_ACTION_RENAMED_OLD_NAME
+	change, waiting for the matching new name. */
+	std::wstring		m_strPendingRename;
+};
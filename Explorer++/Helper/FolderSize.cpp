@@ -12,111 +12,675 @@
  *****************************************************************/
 
 #include "stdafx.h"
-#include <list>
+#include <algorithm>
 #include "FolderSize.h"
+#include "FolderSizeCache.h"
+#include "ThreadPool.h"
 #include "Macros.h"
 
 
-HRESULT CalculateFolderSize(TCHAR *szPath,int *nFolders,
-int *nFiles,PULARGE_INTEGER lTotalFolderSize)
-{
-	HANDLE			hFirstFile;
-	WIN32_FIND_DATA	wfd;
-	TCHAR			InitialPath[MAX_PATH + 2];
-	TCHAR			TempPath[MAX_PATH + 2];
-	ULARGE_INTEGER	l_TotalFolderSize;
-	ULARGE_INTEGER	r_TotalFolderSize;
-	ULARGE_INTEGER	lFileSize;
-	BOOL			bTerminated = FALSE;
-	int				l_NumFiles = 0;
-	int				l_NumFolders = 0;
-	int				r_NumFiles = 0;
-	int				r_NumFolders = 0;
+void	FolderSizeWorkerProc(int iWorker,LPVOID pData);
+void			FolderSizeThreadProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData);
 
-	if(!szPath || ! nFolders || !nFiles || !lTotalFolderSize)
-		return E_INVALIDARG;
+CFolderSizeCalculator::CFolderSizeCalculator() :
+m_nThreads(0),
+m_SizeMode(FOLDER_SIZE_MODE_LOGICAL),
+m_TraversalOrder(TRAVERSAL_ORDER_DEFAULT),
+m_pfnProgress(NULL),
+m_pProgressData(NULL),
+m_dwProgressInterval(0),
+m_pfnListing(NULL),
+m_pListingData(NULL),
+m_pToken(NULL),
+m_pFileIds(NULL),
+m_bLocalityOrder(FALSE),
+m_pWalker(NULL),
+m_pPrefetcher(NULL)
+{
+
+}
+
+CFolderSizeCalculator::~CFolderSizeCalculator()
+{
+	for(auto itr = m_Roots.begin();itr != m_Roots.end();itr++)
+	{
+		DeleteCriticalSection(&(*itr)->cs);
+		delete *itr;
+	}
+}
 
-	l_TotalFolderSize.QuadPart	= 0;
-	r_TotalFolderSize.QuadPart	= 0;
+void CFolderSizeCalculator::SetThreadCount(int nThreads)
+{
+	m_nThreads = nThreads;
+}
 
-	StringCchCopy(InitialPath,SIZEOF_ARRAY(InitialPath),szPath);
-	StringCchCat(InitialPath,SIZEOF_ARRAY(InitialPath),_T("\\*"));
+void CFolderSizeCalculator::SetSizeMode(FolderSizeMode_t SizeMode)
+{
+	m_SizeMode = SizeMode;
+}
 
-	hFirstFile = FindFirstFile(InitialPath,&wfd);
+void CFolderSizeCalculator::SetTraversalOrder(TraversalOrder_t TraversalOrder)
+{
+	m_TraversalOrder = TraversalOrder;
+}
 
-	if(hFirstFile == INVALID_HANDLE_VALUE)
-		return S_OK;
-	
-	if(StrCmp(wfd.cFileName,_T(".")) != 0)
+void CFolderSizeCalculator::SetProgressCallback(FolderSizeProgressProc_t pfnProgress,LPVOID pData)
+{
+	m_pfnProgress = pfnProgress;
+	m_pProgressData = pData;
+}
+
+void CFolderSizeCalculator::SetProgressInterval(DWORD dwInterval)
+{
+	m_dwProgressInterval = dwInterval;
+}
+
+void CFolderSizeCalculator::SetListingCallback(FolderSizeListingProc_t pfnListing,LPVOID pData)
+{
+	m_pfnListing = pfnListing;
+	m_pListingData = pData;
+}
+
+int CFolderSizeCalculator::AddRoot(const TCHAR *szPath)
+{
+	Root_t *pRoot = new Root_t;
+	pRoot->strPath = szPath;
+	InitializeCriticalSection(&pRoot->cs);
+	pRoot->Totals.nFolders = 0;
+	pRoot->Totals.nFiles = 0;
+	pRoot->Totals.ulSize = 0;
+	pRoot->Totals.bComplete = FALSE;
+	pRoot->dwLastProgress = 0;
+	pRoot->dwClusterSize = 0;
+	m_Roots.push_back(pRoot);
+
+	return static_cast<int>(m_Roots.size()) - 1;
+}
+
+BOOL CFolderSizeCalculator::Calculate(const CCancellationToken *pToken)
+{
+	m_pToken = pToken;
+
+	int nThreads = m_nThreads;
+
+	if(nThreads <= 0)
 	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		nThreads = static_cast<int>(si.dwNumberOfProcessors);
+	}
+
+	/* When run as a pool job, the walk is kept
+	within its device's limit. */
+	int nDeviceLimit = CThreadPool::GetJobDeviceLimit();
+
+	if(nDeviceLimit > 0)
+	{
+		nThreads = min(nThreads,nDeviceLimit);
+	}
+
+	m_bLocalityOrder = FALSE;
+
+	for(auto itr = m_Roots.begin();itr != m_Roots.end();itr++)
+	{
+		if(ShouldUseLocalityOrder(m_TraversalOrder,(*itr)->strPath.c_str()))
+		{
+			m_bLocalityOrder = TRUE;
+			nThreads = min(nThreads,GetLocalityOrderThreadLimit((*itr)->strPath.c_str()));
+		}
+	}
+
+	nThreads = max(1,min(nThreads,MAX_THREADS));
+
+	CParallelWalker<Folder_t> Walker(nThreads);
+	m_pWalker = &Walker;
+
+	if(m_bLocalityOrder)
+	{
+		m_pPrefetcher = new CDirectoryPrefetcher(PREFETCH_DEPTH);
+		Walker.SetLocalityOrder(GetFolderLocation,PrefetchFolder,
+			reinterpret_cast<LPVOID>(m_pPrefetcher),PREFETCH_DEPTH);
+	}
+
+	if(m_SizeMode == FOLDER_SIZE_MODE_UNIQUE)
+	{
+		m_pFileIds = new CFileIdSet;
+	}
+
+	std::vector<Folder_t> RootFolders;
+
+	/* The first progress report is only made once an
+	interval has passed, so that folders which are walked
+	quickly don't produce any partial results at all. */
+	DWORD dwStart = GetTickCount();
+
+	for(int i = 0;i < static_cast<int>(m_Roots.size());i++)
+	{
+		m_Roots[i]->dwLastProgress = dwStart;
+
+		if(m_SizeMode == FOLDER_SIZE_MODE_ALLOCATED)
+		{
+			m_Roots[i]->dwClusterSize = GetClusterSize(m_Roots[i]->strPath);
+		}
+
+		Folder_t Folder;
+		Folder.strPath = m_Roots[i]->strPath;
+		Folder.iRoot = i;
+		Folder.ulLocation = 0;
+		Folder.bPrefetched = FALSE;
+
+		if(m_bLocalityOrder)
+		{
+			GetFileLocation(BuildExtendedPath(Folder.strPath),Folder.ulLocation);
+		}
+
+		RootFolders.push_back(Folder);
+	}
+
+	Walker.Push(0,RootFolders);
+	Walker.Run(FolderSizeWorkerProc,reinterpret_cast<LPVOID>(this));
+
+	m_pWalker = NULL;
+
+	delete m_pPrefetcher;
+	m_pPrefetcher = NULL;
+
+	delete m_pFileIds;
+	m_pFileIds = NULL;
+
+	BOOL bCancelled = IsCancelled();
+	m_pToken = NULL;
+
+	if(!bCancelled)
+	{
+		for(auto itr = m_Roots.begin();itr != m_Roots.end();itr++)
+		{
+			(*itr)->Totals.bComplete = TRUE;
+		}
+	}
+
+	return !bCancelled;
+}
+
+void CFolderSizeCalculator::GetTotals(int iRoot,FolderSizeTotals_t &Totals) const
+{
+	Root_t *pRoot = m_Roots[iRoot];
+
+	EnterCriticalSection(&pRoot->cs);
+	Totals = pRoot->Totals;
+	LeaveCriticalSection(&pRoot->cs);
+}
+
+void FolderSizeWorkerProc(int iWorker,LPVOID pData)
+{
+	assert(pData != NULL);
+
+	CFolderSizeCalculator *pCalculator = reinterpret_cast<CFolderSizeCalculator *>(pData);
+	pCalculator->Worker(iWorker);
+}
+
+void CFolderSizeCalculator::Worker(int iWorker)
+{
+	Folder_t Folder;
+
+	while(m_pWalker->Pop(iWorker,Folder))
+	{
+		/* Once cancelled, folders are still taken
+		(so that the walk finishes), but are no
+		longer walked. */
+		if(!IsCancelled())
+		{
+			WalkFolder(iWorker,Folder);
+		}
+
+		m_pWalker->Finish();
+	}
+}
+
+void CFolderSizeCalculator::WalkFolder(int iWorker,const Folder_t &Folder)
+{
+	FolderSizeTotals_t Totals;
+	Totals.nFolders = 0;
+	Totals.nFiles = 0;
+	Totals.ulSize = 0;
+	Totals.bComplete = FALSE;
+
+	std::vector<Folder_t> SubFolders;
+	std::vector<FolderSizeItem_t> Items;
+	std::vector<FolderSizeItem_t> *pItems = (m_pfnListing != NULL) ? &Items : NULL;
+
+	/* A background calculation gives way to
+	anything more urgent on the same disk. */
+	if(!CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE))
+	{
+		return;
+	}
+
+	if(m_bLocalityOrder)
+	{
+		ListFolderInLocalityOrder(Folder,Totals,SubFolders,pItems);
+	}
+	else
+	{
+		ListFolder(Folder,Totals,SubFolders,pItems);
+	}
+
+	m_pWalker->Push(iWorker,SubFolders);
+
+	if(m_pfnListing != NULL)
+	{
+		m_pfnListing(Folder.strPath,Items,m_pListingData);
+	}
+
+	Root_t *pRoot = m_Roots[Folder.iRoot];
+
+	EnterCriticalSection(&pRoot->cs);
+
+	pRoot->Totals.nFolders += Totals.nFolders;
+	pRoot->Totals.nFiles += Totals.nFiles;
+	pRoot->Totals.ulSize += Totals.ulSize;
+
+	/* The callback is made while the lock is held, so
+	that the totals passed to it never go backwards. */
+	if(m_pfnProgress != NULL)
+	{
+		DWORD dwNow = GetTickCount();
+
+		if(dwNow - pRoot->dwLastProgress >= m_dwProgressInterval)
+		{
+			pRoot->dwLastProgress = dwNow;
+			m_pfnProgress(Folder.iRoot,&pRoot->Totals,m_pProgressData);
+		}
+	}
+
+	LeaveCriticalSection(&pRoot->cs);
+}
+
+void CFolderSizeCalculator::ListFolder(const Folder_t &Folder,FolderSizeTotals_t &Totals,
+	std::vector<Folder_t> &SubFolders,std::vector<FolderSizeItem_t> *pItems)
+{
+	WIN32_FIND_DATA wfd;
+	HANDLE hFindFile = FindFirstFile(BuildSearchPath(Folder.strPath).c_str(),&wfd);
+
+	if(hFindFile == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	int nItems = 0;
+
+	do
+	{
+		if(lstrcmp(wfd.cFileName,_T(".")) == 0 ||
+			lstrcmp(wfd.cFileName,_T("..")) == 0)
+		{
+			continue;
+		}
+
 		if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
 		{
-			l_NumFolders++;
+			Totals.nFolders++;
+			AddSubFolder(Folder,wfd,0,SubFolders);
+			AddListedItem(wfd,0,pItems);
 		}
 		else
 		{
-			l_NumFiles++;
+			ULONGLONG ulSize = GetFileSize(Folder,wfd);
+
+			Totals.nFiles++;
+			Totals.ulSize += ulSize;
+			AddListedItem(wfd,ulSize,pItems);
+		}
+
+		if(++nItems % CANCEL_CHECK_INTERVAL == 0 && IsCancelled())
+		{
+			break;
 		}
+	} while(FindNextFile(hFindFile,&wfd) != 0);
+
+	FindClose(hFindFile);
+}
+
+/* Files that need their metadata read are held back
+until the listing is complete, and then read in order
+of where they are on disk. */
+void CFolderSizeCalculator::ListFolderInLocalityOrder(const Folder_t &Folder,FolderSizeTotals_t &Totals,
+	std::vector<Folder_t> &SubFolders,std::vector<FolderSizeItem_t> *pItems)
+{
+	CDirectoryReader DirectoryReader;
+
+	if(!DirectoryReader.Open(BuildExtendedPath(Folder.strPath)))
+	{
+		return;
+	}
+
+	std::vector<LocatedFile_t> Files;
+	LocatedFile_t File;
+	int nItems = 0;
+
+	while(DirectoryReader.Read(File.wfd,File.ulLocation))
+	{
+		if((File.wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+		{
+			Totals.nFolders++;
+			AddSubFolder(Folder,File.wfd,File.ulLocation,SubFolders);
+			AddListedItem(File.wfd,0,pItems);
+		}
+		else
+		{
+			Totals.nFiles++;
+
+			if(NeedsMetadataRead(File.wfd))
+			{
+				/* The size is filled in once
+				it's been read. */
+				File.iItem = (pItems != NULL) ? pItems->size() : 0;
+				Files.push_back(File);
+				AddListedItem(File.wfd,0,pItems);
+			}
+			else
+			{
+				ULONGLONG ulSize = GetFileSize(Folder,File.wfd);
+
+				Totals.ulSize += ulSize;
+				AddListedItem(File.wfd,ulSize,pItems);
+			}
+		}
+
+		if(++nItems % CANCEL_CHECK_INTERVAL == 0 && IsCancelled())
+		{
+			return;
+		}
+	}
+
+	DirectoryReader.Close();
+
+	std::stable_sort(Files.begin(),Files.end(),CompareFileLocations);
+
+	for(auto itr = Files.begin();itr != Files.end();itr++)
+	{
+		ULONGLONG ulSize = GetFileSize(Folder,itr->wfd);
+
+		Totals.ulSize += ulSize;
+
+		if(pItems != NULL)
+		{
+			(*pItems)[itr->iItem].ulSize = ulSize;
+		}
+
+		if(++nItems % CANCEL_CHECK_INTERVAL == 0 && IsCancelled())
+		{
+			return;
+		}
+	}
+}
+
+void CFolderSizeCalculator::AddListedItem(const WIN32_FIND_DATA &wfd,ULONGLONG ulSize,
+	std::vector<FolderSizeItem_t> *pItems)
+{
+	if(pItems == NULL)
+	{
+		return;
+	}
+
+	FolderSizeItem_t Item;
+	Item.strName = wfd.cFileName;
+	Item.dwAttributes = wfd.dwFileAttributes;
+	Item.ulSize = ulSize;
+	pItems->push_back(Item);
+}
+
+/* Reparse points are counted, but not followed. */
+void CFolderSizeCalculator::AddSubFolder(const Folder_t &Folder,const WIN32_FIND_DATA &wfd,ULONGLONG ulLocation,
+	std::vector<Folder_t> &SubFolders)
+{
+	if((wfd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == FILE_ATTRIBUTE_REPARSE_POINT)
+	{
+		return;
+	}
+
+	Folder_t SubFolder;
+	SubFolder.strPath = CombinePath(Folder.strPath,wfd.cFileName);
+	SubFolder.iRoot = Folder.iRoot;
+	SubFolder.ulLocation = ulLocation;
+	SubFolder.bPrefetched = FALSE;
+	SubFolders.push_back(SubFolder);
+}
+
+bool CFolderSizeCalculator::CompareFileLocations(const LocatedFile_t &File1,const LocatedFile_t &File2)
+{
+	return File1.ulLocation < File2.ulLocation;
+}
+
+BOOL CFolderSizeCalculator::NeedsMetadataRead(const WIN32_FIND_DATA &wfd) const
+{
+	switch(m_SizeMode)
+	{
+	case FOLDER_SIZE_MODE_ALLOCATED:
+		return (wfd.dwFileAttributes & (FILE_ATTRIBUTE_COMPRESSED|FILE_ATTRIBUTE_SPARSE_FILE)) != 0;
+
+	case FOLDER_SIZE_MODE_UNIQUE:
+		return TRUE;
 	}
 
-	while(FindNextFile(hFirstFile,&wfd) != 0)
+	return FALSE;
+}
+
+ULONGLONG CFolderSizeCalculator::GetFileSize(const Folder_t &Folder,const WIN32_FIND_DATA &wfd)
+{
+	ULARGE_INTEGER uliFileSize;
+	uliFileSize.LowPart = wfd.nFileSizeLow;
+	uliFileSize.HighPart = wfd.nFileSizeHigh;
+
+	switch(m_SizeMode)
 	{
-		if(StrCmp(wfd.cFileName,_T("..")) != 0)
+	case FOLDER_SIZE_MODE_ALLOCATED:
 		{
-			if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+			/* The size reported for compressed and sparse files
+			is the size of their contents, rather than the space
+			they actually use. */
+			if(NeedsMetadataRead(wfd))
 			{
-				l_NumFolders++;
+				std::wstring strPath = BuildExtendedPath(CombinePath(Folder.strPath,wfd.cFileName));
 
-				StringCchCopy(TempPath,SIZEOF_ARRAY(TempPath),szPath);
-				PathAppend(TempPath,wfd.cFileName);
+				ULARGE_INTEGER uliCompressedSize;
+				uliCompressedSize.LowPart = GetCompressedFileSize(strPath.c_str(),&uliCompressedSize.HighPart);
 
-				CalculateFolderSize(TempPath,&r_NumFolders,&r_NumFiles,&r_TotalFolderSize);
+				if(uliCompressedSize.LowPart != INVALID_FILE_SIZE || GetLastError() == NO_ERROR)
+				{
+					uliFileSize.QuadPart = uliCompressedSize.QuadPart;
+				}
+			}
+
+			DWORD dwClusterSize = m_Roots[Folder.iRoot]->dwClusterSize;
 
-				l_NumFolders				+= r_NumFolders;
-				l_NumFiles					+= r_NumFiles;
-				l_TotalFolderSize.QuadPart	+= r_TotalFolderSize.QuadPart;
+			if(dwClusterSize != 0)
+			{
+				uliFileSize.QuadPart = ((uliFileSize.QuadPart + dwClusterSize - 1) / dwClusterSize) * dwClusterSize;
 			}
-			else
+		}
+		break;
+
+	case FOLDER_SIZE_MODE_UNIQUE:
+		{
+			std::wstring strPath = BuildExtendedPath(CombinePath(Folder.strPath,wfd.cFileName));
+
+			/* No access is needed to read the file ID, so this
+			works even if the file is locked. */
+			HANDLE hFile = CreateFile(strPath.c_str(),FILE_READ_ATTRIBUTES,
+				FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,NULL,OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT,NULL);
+
+			if(hFile != INVALID_HANDLE_VALUE)
 			{
-				l_NumFiles++;
-				lFileSize.LowPart = wfd.nFileSizeLow;
-				lFileSize.HighPart = wfd.nFileSizeHigh;
+				BY_HANDLE_FILE_INFORMATION bhfi;
+				BOOL bRet = GetFileInformationByHandle(hFile,&bhfi);
+				CloseHandle(hFile);
+
+				if(bRet && bhfi.nNumberOfLinks > 1)
+				{
+					ULARGE_INTEGER uliFileIndex;
+					uliFileIndex.LowPart = bhfi.nFileIndexLow;
+					uliFileIndex.HighPart = bhfi.nFileIndexHigh;
 
-				l_TotalFolderSize.QuadPart += lFileSize.QuadPart;
+					if(!m_pFileIds->Insert(bhfi.dwVolumeSerialNumber,uliFileIndex.QuadPart))
+					{
+						return 0;
+					}
+				}
 			}
 		}
+		break;
 	}
 
-	if(bTerminated)
-		ExitThread(0);
+	return uliFileSize.QuadPart;
+}
 
-	*nFolders					= l_NumFolders;
-	*nFiles						= l_NumFiles;
-	lTotalFolderSize->QuadPart	= l_TotalFolderSize.QuadPart;
+DWORD CFolderSizeCalculator::GetClusterSize(const std::wstring &strPath)
+{
+	TCHAR szVolume[MAX_PATH];
 
-	FindClose(hFirstFile);
+	if(!GetVolumePathName(strPath.c_str(),szVolume,SIZEOF_ARRAY(szVolume)))
+	{
+		return 0;
+	}
 
-	return S_OK;
+	DWORD dwSectorsPerCluster;
+	DWORD dwBytesPerSector;
+	DWORD dwFreeClusters;
+	DWORD dwTotalClusters;
+
+	if(!GetDiskFreeSpace(szVolume,&dwSectorsPerCluster,&dwBytesPerSector,
+		&dwFreeClusters,&dwTotalClusters))
+	{
+		return 0;
+	}
+
+	return dwSectorsPerCluster * dwBytesPerSector;
+}
+
+ULONGLONG CFolderSizeCalculator::GetFolderLocation(const Folder_t &Folder)
+{
+	return Folder.ulLocation;
 }
 
-DWORD WINAPI Thread_CalculateFolderSize(LPVOID lpParameter)
+void CFolderSizeCalculator::PrefetchFolder(Folder_t &Folder,LPVOID pData)
 {
-	FolderSize_t	*pFolderSize = NULL;
-	static int		nFiles;
-	static int		nFolders;
-	ULARGE_INTEGER	lTotalDirSize;
-	HRESULT			hr;
+	CDirectoryPrefetcher *pPrefetcher = reinterpret_cast<CDirectoryPrefetcher *>(pData);
 
-	if(lpParameter == NULL)
-		return 0;
+	if(!Folder.bPrefetched)
+	{
+		pPrefetcher->Prefetch(BuildExtendedPath(Folder.strPath));
+		Folder.bPrefetched = TRUE;
+	}
+}
+
+BOOL CFolderSizeCalculator::IsCancelled() const
+{
+	return m_pToken != NULL && m_pToken->IsCancelled();
+}
+
+std::wstring CFolderSizeCalculator::BuildSearchPath(const std::wstring &strDirectory)
+{
+	return BuildExtendedPath(CombinePath(strDirectory,_T("*")));
+}
+
+std::wstring CFolderSizeCalculator::BuildExtendedPath(const std::wstring &strPath)
+{
+	if(strPath.size() < MAX_PATH ||
+		strPath.compare(0,4,_T("\\\\?\\")) == 0)
+	{
+		return strPath;
+	}
+
+	/* UNC paths take the form \\?\UNC\server\share. */
+	if(strPath.compare(0,2,_T("\\\\")) == 0)
+	{
+		return _T("\\\\?\\UNC\\") + strPath.substr(2);
+	}
+
+	return _T("\\\\?\\") + strPath;
+}
 
-	pFolderSize = (FolderSize_t *)lpParameter;
+std::wstring CFolderSizeCalculator::CombinePath(const std::wstring &strDirectory,const TCHAR *szName)
+{
+	std::wstring strPath = strDirectory;
+
+	if(!strPath.empty() && strPath[strPath.size() - 1] != '\\')
+	{
+		strPath += _T("\\");
+	}
+
+	strPath += szName;
+
+	return strPath;
+}
+
+/* Returns E_ABORT if the token was cancelled before
+the calculation finished. */
+HRESULT CalculateFolderSize(TCHAR *szPath,int *nFolders,
+int *nFiles,PULARGE_INTEGER lTotalFolderSize,const CCancellationToken *pToken)
+{
+	if(!szPath || ! nFolders || !nFiles || !lTotalFolderSize)
+		return E_INVALIDARG;
+
+	CFolderSizeCalculator FolderSizeCalculator;
+	int iRoot = FolderSizeCalculator.AddRoot(szPath);
+	BOOL bCompleted = FolderSizeCalculator.Calculate(pToken);
+
+	FolderSizeTotals_t Totals;
+	FolderSizeCalculator.GetTotals(iRoot,Totals);
+
+	*nFolders					= Totals.nFolders;
+	*nFiles						= Totals.nFiles;
+	lTotalFolderSize->QuadPart	= Totals.ulSize;
+
+	return bCompleted ? S_OK : E_ABORT;
+}
 
-	hr = CalculateFolderSize(pFolderSize->szPath,&nFolders,&nFiles,&lTotalDirSize);
+void CalculateFolderSizeJob(LPVOID pParam,const CCancellationToken *pToken)
+{
+	UNREFERENCED_PARAMETER(pToken);
+
+	FolderSize_t		*pFolderSize = NULL;
+	FolderSizeTotals_t	Totals;
+	ULARGE_INTEGER		lTotalDirSize;
+
+	if(pParam == NULL)
+		return;
+
+	pFolderSize = (FolderSize_t *)pParam;
+
+	/* Other requests for the same folder (e.g. from
+	a tab showing folder sizes) share the result. */
+	CFolderSizeCache::GetInstance().GetFolderSize(pFolderSize->szPath,
+		Totals,pFolderSize->pToken,FolderSizeThreadProgress,pFolderSize);
 
-	pFolderSize->pfnCallback(nFolders,nFiles,&lTotalDirSize,pFolderSize->pData);
+	lTotalDirSize.QuadPart = Totals.ulSize;
+
+	/* The callback is still made if the calculation was
+	cancelled, so that the caller can clean up. */
+	pFolderSize->pfnCallback(Totals.nFolders,Totals.nFiles,&lTotalDirSize,pFolderSize->pData);
+
+	if(pFolderSize->pToken != NULL)
+	{
+		pFolderSize->pToken->Release();
+	}
 
 	free(pFolderSize);
+}
+
+void FolderSizeThreadProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData)
+{
+	UNREFERENCED_PARAMETER(iRoot);
+
+	FolderSize_t *pFolderSize = reinterpret_cast<FolderSize_t *>(pData);
 
-	return 1;
-}
\ No newline at end of file
+	if(pFolderSize->pfnProgress != NULL)
+	{
+		ULARGE_INTEGER lTotalDirSize;
+		lTotalDirSize.QuadPart = pTotals->ulSize;
+
+		pFolderSize->pfnProgress(pTotals->nFolders,pTotals->nFiles,&lTotalDirSize,pFolderSize->pData);
+	}
+}
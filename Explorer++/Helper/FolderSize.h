@@ -1,12 +1,246 @@
 #pragma once
 
+#include <vector>
+#include <string>
+#include "CancellationToken.h"
+#include "FileIdSet.h"
+#include "LocalityOrder.h"
+#include "ParallelWalker.h"
+#include "Macros.h"
+
+struct FolderSizeTotals_t
+{
+	int			nFolders;
+	int			nFiles;
+	ULONGLONG	ulSize;
+
+	/* FALSE for the running totals passed to
+	a progress callback, as the folder is still
+	being walked. */
+	BOOL		bComplete;
+};
+
+/* How the size of each file is counted. */
+enum FolderSizeMode_t
+{
+	/* The size of the file's contents. */
+	FOLDER_SIZE_MODE_LOGICAL,
+
+	/* The space the file takes up on disk. Compressed and
+	sparse files count only the clusters they use, and
+	every file is rounded up to a whole cluster. */
+	FOLDER_SIZE_MODE_ALLOCATED,
+
+	/* As for FOLDER_SIZE_MODE_LOGICAL, except that a file
+	with several hard links is only counted once. */
+	FOLDER_SIZE_MODE_UNIQUE
+};
+
+/* An item found while walking a folder. */
+struct FolderSizeItem_t
+{
+	std::wstring	strName;
+	DWORD			dwAttributes;
+
+	/* Counted in the calculator's size
+	mode. Always 0 for folders. */
+	ULONGLONG		ulSize;
+};
+
+typedef void (* FolderSizeProgressProc_t)(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData);
+typedef void (* FolderSizeListingProc_t)(const std::wstring &strFolder,
+	const std::vector<FolderSizeItem_t> &Items,LPVOID pData);
+
+/* Calculates the size of one or more folders. Folders
+are walked in parallel by a set of worker threads (see
+CParallelWalker).
+
+Paths aren't limited to MAX_PATH. Reparse points (e.g.
+junctions) are counted as folders, but aren't followed,
+so that the same files aren't counted twice.
+
+In FOLDER_SIZE_MODE_UNIQUE, every file has to be opened to
+find its ID, so the calculation is considerably slower.
+Only files with more than one link are remembered. Files
+that can't be opened are always counted.
+
+In locality order, the workers share a single queue, which
+hands out folders in order of where they are on disk, and
+folders are listed ahead of the workers. Any metadata that
+has to be read from each file is read once the folder has
+been listed, again in order of where the files are. */
+class CFolderSizeCalculator
+{
+	friend void	FolderSizeWorkerProc(int iWorker,LPVOID pData);
+
+public:
+
+	CFolderSizeCalculator();
+	~CFolderSizeCalculator();
+
+	/* A thread count of 0 uses one thread per processor.
+	Within a pool job, the count is also limited to what
+	the job's device allows. */
+	void		SetThreadCount(int nThreads);
+
+	/* FOLDER_SIZE_MODE_LOGICAL by default. */
+	void		SetSizeMode(FolderSizeMode_t SizeMode);
+
+	/* TRAVERSAL_ORDER_DEFAULT by default. Locality order
+	is used if it applies to any of the roots. */
+	void		SetTraversalOrder(TraversalOrder_t TraversalOrder);
+
+	/* Called on the worker threads as folders are walked,
+	with the totals so far for the root they're under. Calls
+	for the same root are never made at the same time, and
+	are made at most once per interval (in milliseconds).
+	An interval of 0 reports every folder. */
+	void		SetProgressCallback(FolderSizeProgressProc_t pfnProgress,LPVOID pData);
+	void		SetProgressInterval(DWORD dwInterval);
+
+	/* Called on the worker threads once each folder
+	(including each root) has been listed, with every item
+	in it. A sub folder's path is always its parent's path
+	joined to its name with CombinePath. Calls can be made
+	from several threads at once. */
+	void		SetListingCallback(FolderSizeListingProc_t pfnListing,LPVOID pData);
+
+	/* Returns the index of the root. */
+	int			AddRoot(const TCHAR *szPath);
+
+	/* Blocks until every root has been walked. Returns FALSE
+	if the token was cancelled first, in which case the totals
+	only cover what had been counted by then. The token can
+	be NULL. */
+	BOOL		Calculate(const CCancellationToken *pToken);
+
+	void		GetTotals(int iRoot,FolderSizeTotals_t &Totals) const;
+
+	/* Returns the pattern used to enumerate the folder, or
+	the path used to open an item. Paths that are too long
+	for the API are given the \\?\ prefix. */
+	static std::wstring	BuildSearchPath(const std::wstring &strDirectory);
+	static std::wstring	BuildExtendedPath(const std::wstring &strPath);
+	static std::wstring	CombinePath(const std::wstring &strDirectory,const TCHAR *szName);
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CFolderSizeCalculator);
+
+	static const int	MAX_THREADS = 16;
+
+	/* How often (in items) a worker checks whether
+	it's been cancelled, while it's walking a folder. */
+	static const int	CANCEL_CHECK_INTERVAL = 256;
+
+	/* How many folders are listed ahead of the
+	workers, in locality order. */
+	static const size_t	PREFETCH_DEPTH = 16;
+
+	struct Root_t
+	{
+		std::wstring		strPath;
+
+		/* Guards the totals. Each worker adds to them
+		once per folder. */
+		CRITICAL_SECTION	cs;
+		FolderSizeTotals_t	Totals;
+		DWORD				dwLastProgress;
+
+		/* Only used in FOLDER_SIZE_MODE_ALLOCATED. Set
+		to 0 if it couldn't be found. */
+		DWORD				dwClusterSize;
+	};
+
+	struct Folder_t
+	{
+		std::wstring	strPath;
+		int				iRoot;
+
+		/* Only used in locality order. */
+		ULONGLONG		ulLocation;
+		BOOL			bPrefetched;
+	};
+
+	/* A file whose metadata has to be read,
+	and where it is on disk. */
+	struct LocatedFile_t
+	{
+		ULONGLONG		ulLocation;
+		WIN32_FIND_DATA	wfd;
+
+		/* Where the file is in the listing
+		(if one is being kept). */
+		size_t			iItem;
+	};
+
+	void		Worker(int iWorker);
+	void		WalkFolder(int iWorker,const Folder_t &Folder);
+	void		ListFolder(const Folder_t &Folder,FolderSizeTotals_t &Totals,std::vector<Folder_t> &SubFolders,
+		std::vector<FolderSizeItem_t> *pItems);
+	void		ListFolderInLocalityOrder(const Folder_t &Folder,FolderSizeTotals_t &Totals,
+		std::vector<Folder_t> &SubFolders,std::vector<FolderSizeItem_t> *pItems);
+	static void	AddListedItem(const WIN32_FIND_DATA &wfd,ULONGLONG ulSize,std::vector<FolderSizeItem_t> *pItems);
+	void		AddSubFolder(const Folder_t &Folder,const WIN32_FIND_DATA &wfd,ULONGLONG ulLocation,
+		std::vector<Folder_t> &SubFolders);
+	BOOL		NeedsMetadataRead(const WIN32_FIND_DATA &wfd) const;
+	static bool	CompareFileLocations(const LocatedFile_t &File1,const LocatedFile_t &File2);
+	ULONGLONG	GetFileSize(const Folder_t &Folder,const WIN32_FIND_DATA &wfd);
+
+	static DWORD	GetClusterSize(const std::wstring &strPath);
+
+	static ULONGLONG	GetFolderLocation(const Folder_t &Folder);
+	static void	PrefetchFolder(Folder_t &Folder,LPVOID pData);
+
+	BOOL		IsCancelled() const;
+
+	int							m_nThreads;
+	FolderSizeMode_t			m_SizeMode;
+	TraversalOrder_t			m_TraversalOrder;
+	FolderSizeProgressProc_t	m_pfnProgress;
+	LPVOID						m_pProgressData;
+	DWORD						m_dwProgressInterval;
+	FolderSizeListingProc_t		m_pfnListing;
+	LPVOID						m_pListingData;
+
+	std::vector<Root_t *>		m_Roots;
+
+	/* Only valid during a calculation. */
+	const CCancellationToken	*m_pToken;
+	CFileIdSet					*m_pFileIds;
+	CParallelWalker<Folder_t>	*m_pWalker;
+
+	BOOL						m_bLocalityOrder;
+	CDirectoryPrefetcher		*m_pPrefetcher;
+};
+
+/* Used to calculate a single folder size as a thread pool
+job (see CalculateFolderSizeJob). Allocated with malloc;
+the job frees it once the callback has been called. If
+pToken isn't NULL, the job releases it at the same point.
+
+If pfnProgress isn't NULL, it's called with the running
+totals while the folder is being walked (at most once per
+FOLDER_SIZE_PROGRESS_INTERVAL), and always before the
+final callback. */
 typedef struct
 {
 	TCHAR szPath[MAX_PATH];
 	LPVOID pData;
 	void (* pfnCallback)(int nFolders,int nFiles,
 	PULARGE_INTEGER lTotalFolderSize,LPVOID pData);
+	void (* pfnProgress)(int nFolders,int nFiles,
+	PULARGE_INTEGER lTotalFolderSize,LPVOID pData);
+	CCancellationToken *pToken;
 } FolderSize_t;
 
-DWORD WINAPI	Thread_CalculateFolderSize(LPVOID lpParameter);
-HRESULT			CalculateFolderSize(TCHAR *szPath,int *nFolders,int *nFiles,PULARGE_INTEGER lTotalFolderSize);
\ No newline at end of file
+/* How often (in milliseconds) partial folder
+sizes are passed back to be shown. */
+const DWORD FOLDER_SIZE_PROGRESS_INTERVAL = 250;
+
+/* Takes a FolderSize_t. Its own token is the one that's
+checked, so it should also be the one the job is queued
+with. */
+void			CalculateFolderSizeJob(LPVOID pParam,const CCancellationToken *pToken);
+HRESULT			CalculateFolderSize(TCHAR *szPath,int *nFolders,int *nFiles,PULARGE_INTEGER lTotalFolderSize,
+	const CCancellationToken *pToken = NULL);
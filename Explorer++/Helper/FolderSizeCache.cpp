@@ -0,0 +1,424 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: FolderSizeCache.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Caches folder sizes, and shares calculations that
+ * are requested more than once.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <vector>
+#include "FolderSizeCache.h"
+#include "Macros.h"
+
+
+void	FolderSizeCacheProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData);
+
+CFolderSizeCache::CFolderSizeCache() :
+m_dwMaxAge(DEFAULT_MAX_AGE),
+m_SizeMode(FOLDER_SIZE_MODE_LOGICAL)
+{
+	InitializeCriticalSection(&m_cs);
+}
+
+CFolderSizeCache::~CFolderSizeCache()
+{
+	DeleteCriticalSection(&m_cs);
+}
+
+CFolderSizeCache &CFolderSizeCache::GetInstance()
+{
+	static CFolderSizeCache fsc;
+	return fsc;
+}
+
+void CFolderSizeCache::SetMaxAge(DWORD dwMaxAge)
+{
+	EnterCriticalSection(&m_cs);
+	m_dwMaxAge = dwMaxAge;
+	LeaveCriticalSection(&m_cs);
+}
+
+void CFolderSizeCache::SetSizeMode(FolderSizeMode_t SizeMode)
+{
+	EnterCriticalSection(&m_cs);
+
+	/* Any calculations still in progress are using
+	the old mode, so their results won't be kept. */
+	if(SizeMode != m_SizeMode)
+	{
+		m_SizeMode = SizeMode;
+		Clear();
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+FolderSizeMode_t CFolderSizeCache::GetSizeMode() const
+{
+	EnterCriticalSection(&m_cs);
+	FolderSizeMode_t SizeMode = m_SizeMode;
+	LeaveCriticalSection(&m_cs);
+
+	return SizeMode;
+}
+
+HRESULT CFolderSizeCache::GetFolderSize(const TCHAR *szPath,FolderSizeTotals_t &Totals,
+	const CCancellationToken *pToken,FolderSizeProgressProc_t pfnProgress,LPVOID pData)
+{
+	std::wstring strKey = GetCanonicalPath(szPath);
+
+	while(pToken == NULL || !pToken->IsCancelled())
+	{
+		EnterCriticalSection(&m_cs);
+
+		EntryMap_t::iterator itrEntry = m_Entries.find(strKey);
+
+		if(itrEntry != m_Entries.end() && IsCurrent(itrEntry->second))
+		{
+			Totals = itrEntry->second.Totals;
+			LeaveCriticalSection(&m_cs);
+
+			return S_OK;
+		}
+
+		RequestMap_t::iterator itrRequest = m_Requests.find(strKey);
+
+		if(itrRequest == m_Requests.end())
+		{
+			Request_t *pRequest = new Request_t;
+			pRequest->hEvent		= CreateEvent(NULL,TRUE,FALSE,NULL);
+			pRequest->nRefCount		= 1;
+			pRequest->bInvalidated	= FALSE;
+			pRequest->hr			= E_ABORT;
+			ZeroMemory(&pRequest->Totals,sizeof(pRequest->Totals));
+			m_Requests[strKey] = pRequest;
+
+			FolderSizeMode_t SizeMode = m_SizeMode;
+
+			LeaveCriticalSection(&m_cs);
+
+			Progress_t Progress;
+			Progress.pCache			= this;
+			Progress.pRequest		= pRequest;
+			Progress.pfnProgress	= pfnProgress;
+			Progress.pData			= pData;
+
+			CFolderSizeCalculator FolderSizeCalculator;
+			FolderSizeCalculator.SetProgressCallback(FolderSizeCacheProgress,&Progress);
+			FolderSizeCalculator.SetProgressInterval(FOLDER_SIZE_PROGRESS_INTERVAL);
+			FolderSizeCalculator.SetSizeMode(SizeMode);
+			FolderSizeCalculator.SetTraversalOrder(TRAVERSAL_ORDER_AUTOMATIC);
+			int iRoot = FolderSizeCalculator.AddRoot(szPath);
+			BOOL bCompleted = FolderSizeCalculator.Calculate(pToken);
+			FolderSizeCalculator.GetTotals(iRoot,Totals);
+
+			EnterCriticalSection(&m_cs);
+
+			m_Requests.erase(strKey);
+
+			if(bCompleted && !pRequest->bInvalidated)
+			{
+				AddEntry(strKey,Totals);
+			}
+
+			pRequest->hr		= bCompleted ? S_OK : E_ABORT;
+			pRequest->Totals	= Totals;
+			SetEvent(pRequest->hEvent);
+			ReleaseRequest(pRequest);
+
+			LeaveCriticalSection(&m_cs);
+
+			return bCompleted ? S_OK : E_ABORT;
+		}
+
+		/* Another thread is already walking this
+		folder, so wait for its result. */
+		Request_t *pRequest = itrRequest->second;
+		pRequest->nRefCount++;
+
+		LeaveCriticalSection(&m_cs);
+
+		BOOL bCancelled = FALSE;
+		DWORD dwLastProgress = GetTickCount();
+		int nLastItems = 0;
+
+		while(WaitForSingleObject(pRequest->hEvent,WAIT_INTERVAL) == WAIT_TIMEOUT)
+		{
+			if(pToken != NULL && pToken->IsCancelled())
+			{
+				bCancelled = TRUE;
+				break;
+			}
+
+			/* The running totals are passed on from the
+			request that's doing the walk. */
+			if(pfnProgress != NULL &&
+				GetTickCount() - dwLastProgress >= FOLDER_SIZE_PROGRESS_INTERVAL)
+			{
+				EnterCriticalSection(&m_cs);
+				FolderSizeTotals_t PartialTotals = pRequest->Totals;
+				LeaveCriticalSection(&m_cs);
+
+				if(PartialTotals.nFolders + PartialTotals.nFiles != nLastItems)
+				{
+					pfnProgress(0,&PartialTotals,pData);
+					nLastItems = PartialTotals.nFolders + PartialTotals.nFiles;
+				}
+
+				dwLastProgress = GetTickCount();
+			}
+		}
+
+		EnterCriticalSection(&m_cs);
+
+		HRESULT hr = E_ABORT;
+
+		if(!bCancelled)
+		{
+			hr = pRequest->hr;
+			Totals = pRequest->Totals;
+		}
+
+		ReleaseRequest(pRequest);
+
+		LeaveCriticalSection(&m_cs);
+
+		/* If the other request was cancelled, this one
+		still needs the size, so it'll start again. */
+		if(hr == S_OK)
+		{
+			return S_OK;
+		}
+	}
+
+	ZeroMemory(&Totals,sizeof(Totals));
+
+	return E_ABORT;
+}
+
+void FolderSizeCacheProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData)
+{
+	CFolderSizeCache::Progress_t *pProgress = reinterpret_cast<CFolderSizeCache::Progress_t *>(pData);
+
+	EnterCriticalSection(&pProgress->pCache->m_cs);
+	pProgress->pRequest->Totals = *pTotals;
+	LeaveCriticalSection(&pProgress->pCache->m_cs);
+
+	if(pProgress->pfnProgress != NULL)
+	{
+		pProgress->pfnProgress(iRoot,pTotals,pProgress->pData);
+	}
+}
+
+BOOL CFolderSizeCache::Lookup(const TCHAR *szPath,FolderSizeTotals_t &Totals,FILETIME *pftCalculated) const
+{
+	std::wstring strKey = GetCanonicalPath(szPath);
+	BOOL bFound = FALSE;
+
+	EnterCriticalSection(&m_cs);
+
+	EntryMap_t::const_iterator itr = m_Entries.find(strKey);
+
+	if(itr != m_Entries.end() && IsCurrent(itr->second))
+	{
+		Totals = itr->second.Totals;
+
+		if(pftCalculated != NULL)
+		{
+			*pftCalculated = itr->second.ftCalculated;
+		}
+
+		bFound = TRUE;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return bFound;
+}
+
+void CFolderSizeCache::Invalidate(const TCHAR *szPath)
+{
+	std::wstring strKey = GetCanonicalPath(szPath);
+	std::wstring strPrefix = strKey + _T("\\");
+
+	EnterCriticalSection(&m_cs);
+
+	m_Entries.erase(strKey);
+
+	/* Anything below the item is sorted
+	directly after the prefix. */
+	EntryMap_t::iterator itr = m_Entries.lower_bound(strPrefix);
+
+	while(itr != m_Entries.end() &&
+		itr->first.compare(0,strPrefix.size(),strPrefix) == 0)
+	{
+		itr = m_Entries.erase(itr);
+	}
+
+	/* UNC paths start with two separators, which
+	don't separate any folders. */
+	std::wstring strFolder = strKey;
+	size_t nPos;
+
+	while((nPos = strFolder.rfind('\\')) != std::wstring::npos && nPos > 1)
+	{
+		strFolder.erase(nPos);
+		m_Entries.erase(strFolder);
+	}
+
+	for(RequestMap_t::iterator itrRequest = m_Requests.begin();itrRequest != m_Requests.end();itrRequest++)
+	{
+		if(IsSameOrBelow(strKey,itrRequest->first) ||
+			IsSameOrBelow(itrRequest->first,strKey))
+		{
+			itrRequest->second->bInvalidated = TRUE;
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+void CFolderSizeCache::Clear()
+{
+	EnterCriticalSection(&m_cs);
+
+	m_Entries.clear();
+
+	for(RequestMap_t::iterator itr = m_Requests.begin();itr != m_Requests.end();itr++)
+	{
+		itr->second->bInvalidated = TRUE;
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+std::wstring CFolderSizeCache::GetCanonicalPath(const TCHAR *szPath)
+{
+	std::wstring strPath(szPath);
+
+	for(std::wstring::iterator itr = strPath.begin();itr != strPath.end();itr++)
+	{
+		if(*itr == '/')
+		{
+			*itr = '\\';
+		}
+	}
+
+	if(strPath.compare(0,8,_T("\\\\?\\UNC\\")) == 0)
+	{
+		strPath.replace(0,8,_T("\\\\"));
+	}
+	else if(strPath.compare(0,4,_T("\\\\?\\")) == 0)
+	{
+		strPath.erase(0,4);
+	}
+
+	while(!strPath.empty() && strPath[strPath.size() - 1] == '\\')
+	{
+		strPath.erase(strPath.size() - 1);
+	}
+
+	if(!strPath.empty())
+	{
+		std::vector<TCHAR> Lowercase(strPath.size());
+		LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,strPath.c_str(),static_cast<int>(strPath.size()),
+			&Lowercase[0],static_cast<int>(Lowercase.size()));
+		strPath.assign(Lowercase.begin(),Lowercase.end());
+	}
+
+	return strPath;
+}
+
+BOOL CFolderSizeCache::IsCurrent(const Entry_t &Entry) const
+{
+	if(m_dwMaxAge == INFINITE)
+	{
+		return TRUE;
+	}
+
+	FILETIME ftNow;
+	GetSystemTimeAsFileTime(&ftNow);
+
+	ULARGE_INTEGER uliNow;
+	uliNow.LowPart	= ftNow.dwLowDateTime;
+	uliNow.HighPart	= ftNow.dwHighDateTime;
+
+	ULARGE_INTEGER uliCalculated;
+	uliCalculated.LowPart	= Entry.ftCalculated.dwLowDateTime;
+	uliCalculated.HighPart	= Entry.ftCalculated.dwHighDateTime;
+
+	/* FILETIME is in 100 nanosecond intervals. The clock
+	may have been moved back, in which case the entry is
+	treated as expired. */
+	if(uliNow.QuadPart < uliCalculated.QuadPart)
+	{
+		return FALSE;
+	}
+
+	return (uliNow.QuadPart - uliCalculated.QuadPart) < static_cast<ULONGLONG>(m_dwMaxAge) * 10000;
+}
+
+void CFolderSizeCache::AddEntry(const std::wstring &strKey,const FolderSizeTotals_t &Totals)
+{
+	if(m_Entries.size() >= MAX_ENTRIES)
+	{
+		RemoveExpiredEntries();
+
+		if(m_Entries.size() >= MAX_ENTRIES)
+		{
+			m_Entries.clear();
+		}
+	}
+
+	Entry_t Entry;
+	Entry.Totals = Totals;
+	GetSystemTimeAsFileTime(&Entry.ftCalculated);
+
+	m_Entries[strKey] = Entry;
+}
+
+void CFolderSizeCache::RemoveExpiredEntries()
+{
+	EntryMap_t::iterator itr = m_Entries.begin();
+
+	while(itr != m_Entries.end())
+	{
+		if(!IsCurrent(itr->second))
+		{
+			itr = m_Entries.erase(itr);
+		}
+		else
+		{
+			itr++;
+		}
+	}
+}
+
+void CFolderSizeCache::ReleaseRequest(Request_t *pRequest)
+{
+	pRequest->nRefCount--;
+
+	if(pRequest->nRefCount == 0)
+	{
+		CloseHandle(pRequest->hEvent);
+		delete pRequest;
+	}
+}
+
+BOOL CFolderSizeCache::IsSameOrBelow(const std::wstring &strPath,const std::wstring &strFolder)
+{
+	if(strPath.compare(0,strFolder.size(),strFolder) != 0)
+	{
+		return FALSE;
+	}
+
+	return strPath.size() == strFolder.size() ||
+		strPath[strFolder.size()] == '\\';
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include "FolderSize.h"
+#include "Macros.h"
+
+/* Holds the sizes of folders that have already been
+calculated, so that the same folder isn't walked again
+each time its size is shown (e.g. in several tabs, and
+in the display window).
+
+If a folder is asked for while it's still being
+calculated on another thread, the second request waits
+for the first, rather than walking the folder again.
+
+Entries are keyed by the canonical form of the path.
+Once something changes, the entry for every folder that
+contains it has to be dropped, since each of those sizes
+includes the item that changed. */
+class CFolderSizeCache
+{
+	friend void	FolderSizeCacheProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData);
+
+public:
+
+	CFolderSizeCache();
+	~CFolderSizeCache();
+
+	/* The instance shared by the whole process. Should be
+	called from the main thread before any other thread uses
+	it, so that it's never constructed twice. */
+	static CFolderSizeCache &GetInstance();
+
+	/* Entries older than this (in milliseconds) are
+	recalculated. Only the folders that are being shown
+	are monitored, so changes further down the tree won't
+	always be reported. INFINITE keeps entries until
+	they're invalidated. */
+	void		SetMaxAge(DWORD dwMaxAge);
+
+	/* Changing the mode drops every entry, as none of
+	them were calculated in the new mode. */
+	void		SetSizeMode(FolderSizeMode_t SizeMode);
+	FolderSizeMode_t	GetSizeMode() const;
+
+	/* Returns the size of the folder, calculating it if it
+	isn't already cached. Returns E_ABORT if the token was
+	cancelled first, in which case nothing is cached. The
+	token can be NULL.
+
+	If the folder has to be walked (whether by this request,
+	or another one it's waiting on), pfnProgress is called
+	with the running totals at most once every
+	FOLDER_SIZE_PROGRESS_INTERVAL. The root index passed
+	to it is always 0. */
+	HRESULT		GetFolderSize(const TCHAR *szPath,FolderSizeTotals_t &Totals,const CCancellationToken *pToken,
+		FolderSizeProgressProc_t pfnProgress = NULL,LPVOID pData = NULL);
+
+	/* Returns TRUE if the folder has a current entry.
+	pftCalculated (which can be NULL) receives the time the
+	size was calculated. */
+	BOOL		Lookup(const TCHAR *szPath,FolderSizeTotals_t &Totals,FILETIME *pftCalculated) const;
+
+	/* Called when an item has been added, removed or
+	changed. Drops the entries for every folder above the
+	item, as well as the entries for the item itself and
+	anything below it (in case it was a folder that's been
+	removed or renamed). */
+	void		Invalidate(const TCHAR *szPath);
+
+	void		Clear();
+
+	/* Strips any \\?\ prefix and trailing separator, and
+	converts the path to lowercase. */
+	static std::wstring	GetCanonicalPath(const TCHAR *szPath);
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CFolderSizeCache);
+
+	static const DWORD	DEFAULT_MAX_AGE = 10 * 60 * 1000;
+
+	/* Once there are this many entries, any that have
+	expired are removed before adding another. */
+	static const size_t	MAX_ENTRIES = 65536;
+
+	/* How often (in milliseconds) a request that's waiting
+	on another thread checks whether it's been cancelled. */
+	static const DWORD	WAIT_INTERVAL = 100;
+
+	struct Entry_t
+	{
+		FolderSizeTotals_t	Totals;
+		FILETIME			ftCalculated;
+	};
+
+	/* A calculation that's in progress. Freed once
+	every request waiting on it has finished with it. */
+	struct Request_t
+	{
+		HANDLE				hEvent;
+		int					nRefCount;
+
+		/* Set if something within the folder changed while
+		it was being walked. The result is still passed
+		back, but isn't cached. */
+		BOOL				bInvalidated;
+
+		/* The running totals, until the
+		calculation has finished. */
+		HRESULT				hr;
+		FolderSizeTotals_t	Totals;
+	};
+
+	struct Progress_t
+	{
+		CFolderSizeCache			*pCache;
+		Request_t					*pRequest;
+		FolderSizeProgressProc_t	pfnProgress;
+		LPVOID						pData;
+	};
+
+	typedef std::map<std::wstring,Entry_t> EntryMap_t;
+	typedef std::map<std::wstring,Request_t *> RequestMap_t;
+
+	BOOL		IsCurrent(const Entry_t &Entry) const;
+	void		AddEntry(const std::wstring &strKey,const FolderSizeTotals_t &Totals);
+	void		RemoveExpiredEntries();
+	void		ReleaseRequest(Request_t *pRequest);
+
+	static BOOL	IsSameOrBelow(const std::wstring &strPath,const std::wstring &strFolder);
+
+	mutable CRITICAL_SECTION	m_cs;
+
+	EntryMap_t		m_Entries;
+	RequestMap_t	m_Requests;
+	DWORD			m_dwMaxAge;
+	FolderSizeMode_t	m_SizeMode;
+};
@@ -0,0 +1,443 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: LocalityOrder.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Allows recursive walks to visit folders in the
+ * order they're stored on disk.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "LocalityOrder.h"
+#include "FolderSize.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+
+DWORD WINAPI	DirectoryPrefetchThread(LPVOID pParam);
+
+namespace
+{
+	/* These aren't defined when targeting XP (where
+	GetFileInformationByHandleEx doesn't exist). */
+	const int FILE_ID_BOTH_DIRECTORY_INFO_CLASS = 10;
+
+	struct FileIdBothDirInfo_t
+	{
+		DWORD			NextEntryOffset;
+		DWORD			FileIndex;
+		LARGE_INTEGER	CreationTime;
+		LARGE_INTEGER	LastAccessTime;
+		LARGE_INTEGER	LastWriteTime;
+		LARGE_INTEGER	ChangeTime;
+		LARGE_INTEGER	EndOfFile;
+		LARGE_INTEGER	AllocationSize;
+		DWORD			FileAttributes;
+		DWORD			FileNameLength;
+		DWORD			EaSize;
+		CCHAR			ShortNameLength;
+		WCHAR			ShortName[12];
+		LARGE_INTEGER	FileId;
+		WCHAR			FileName[1];
+	};
+
+	typedef BOOL (WINAPI *GetFileInformationByHandleExProc)(HANDLE hFile,int FileInformationClass,
+		LPVOID lpFileInformation,DWORD dwBufferSize);
+
+	GetFileInformationByHandleExProc GetFileInformationByHandleExFunction()
+	{
+		HMODULE hKernel32 = GetModuleHandle(_T("kernel32.dll"));
+
+		if(hKernel32 == NULL)
+		{
+			return NULL;
+		}
+
+		return reinterpret_cast<GetFileInformationByHandleExProc>(
+			GetProcAddress(hKernel32,"GetFileInformationByHandleEx"));
+	}
+
+	FILETIME LargeIntegerToFileTime(const LARGE_INTEGER &li)
+	{
+		FILETIME ft;
+		ft.dwLowDateTime = li.LowPart;
+		ft.dwHighDateTime = static_cast<DWORD>(li.HighPart);
+
+		return ft;
+	}
+
+	BOOL IsDotEntry(const TCHAR *szName)
+	{
+		return lstrcmp(szName,_T(".")) == 0 ||
+			lstrcmp(szName,_T("..")) == 0;
+	}
+}
+
+BOOL ShouldUseLocalityOrder(TraversalOrder_t TraversalOrder,const TCHAR *szPath)
+{
+	switch(TraversalOrder)
+	{
+	case TRAVERSAL_ORDER_LOCALITY:
+		return TRUE;
+
+	case TRAVERSAL_ORDER_AUTOMATIC:
+		{
+			DeviceClass_t DeviceClass;
+
+			if(!CThreadPool::GetInstance().LookupDeviceClass(CThreadPool::GetDeviceName(szPath),
+				DeviceClass))
+			{
+				return FALSE;
+			}
+
+			return DeviceClass == DEVICE_CLASS_ROTATIONAL;
+		}
+	}
+
+	return FALSE;
+}
+
+int GetLocalityOrderThreadLimit(const TCHAR *szPath)
+{
+	CThreadPool &ThreadPool = CThreadPool::GetInstance();
+
+	DeviceClass_t DeviceClass;
+	ThreadPool.LookupDeviceClass(CThreadPool::GetDeviceName(szPath),DeviceClass);
+
+	return ThreadPool.GetMaxJobsPerDevice(DeviceClass);
+}
+
+ULONGLONG GetDiskLocation(ULONGLONG ulFileId)
+{
+	return ulFileId & 0x0000FFFFFFFFFFFFULL;
+}
+
+BOOL GetFileLocation(const std::wstring &strPath,ULONGLONG &ulLocation)
+{
+	HANDLE hFile = CreateFile(strPath.c_str(),FILE_READ_ATTRIBUTES,
+		FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,NULL,OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OPEN_REPARSE_POINT,NULL);
+
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	BY_HANDLE_FILE_INFORMATION bhfi;
+	BOOL bRet = GetFileInformationByHandle(hFile,&bhfi);
+	CloseHandle(hFile);
+
+	if(!bRet)
+	{
+		return FALSE;
+	}
+
+	ULARGE_INTEGER uliFileIndex;
+	uliFileIndex.LowPart = bhfi.nFileIndexLow;
+	uliFileIndex.HighPart = bhfi.nFileIndexHigh;
+
+	ulLocation = GetDiskLocation(uliFileIndex.QuadPart);
+
+	return TRUE;
+}
+
+CDirectoryReader::CDirectoryReader() :
+m_hDirectory(INVALID_HANDLE_VALUE),
+m_hFindFile(INVALID_HANDLE_VALUE),
+m_dwBlockOffset(0),
+m_bBlockValid(FALSE),
+m_bFirstPending(FALSE)
+{
+
+}
+
+CDirectoryReader::~CDirectoryReader()
+{
+	Close();
+}
+
+BOOL CDirectoryReader::Open(const std::wstring &strDirectory)
+{
+	Close();
+
+	m_strDirectory = strDirectory;
+
+	if(GetFileInformationByHandleExFunction() != NULL)
+	{
+		m_hDirectory = CreateFile(strDirectory.c_str(),FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,NULL,OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS,NULL);
+
+		if(m_hDirectory != INVALID_HANDLE_VALUE)
+		{
+			m_Block.resize(BUFFER_SIZE / sizeof(LONGLONG));
+
+			/* Not every file system can return file IDs
+			with the listing, in which case the folder is
+			listed the usual way instead. */
+			if(ReadBlock() || GetLastError() == ERROR_NO_MORE_FILES)
+			{
+				return TRUE;
+			}
+
+			CloseHandle(m_hDirectory);
+			m_hDirectory = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	m_hFindFile = FindFirstFile(CFolderSizeCalculator::CombinePath(strDirectory,_T("*")).c_str(),
+		&m_wfdFirst);
+
+	if(m_hFindFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	m_bFirstPending = TRUE;
+
+	return TRUE;
+}
+
+void CDirectoryReader::Close()
+{
+	if(m_hDirectory != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hDirectory);
+		m_hDirectory = INVALID_HANDLE_VALUE;
+	}
+
+	if(m_hFindFile != INVALID_HANDLE_VALUE)
+	{
+		FindClose(m_hFindFile);
+		m_hFindFile = INVALID_HANDLE_VALUE;
+	}
+
+	m_bBlockValid = FALSE;
+	m_bFirstPending = FALSE;
+}
+
+BOOL CDirectoryReader::Read(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation)
+{
+	if(m_hDirectory != INVALID_HANDLE_VALUE)
+	{
+		return ReadFromBlock(wfd,ulLocation);
+	}
+
+	if(m_hFindFile != INVALID_HANDLE_VALUE)
+	{
+		return ReadFromFindFile(wfd,ulLocation);
+	}
+
+	return FALSE;
+}
+
+BOOL CDirectoryReader::ReadBlock()
+{
+	GetFileInformationByHandleExProc pGetFileInformationByHandleEx = GetFileInformationByHandleExFunction();
+
+	m_bBlockValid = pGetFileInformationByHandleEx(m_hDirectory,FILE_ID_BOTH_DIRECTORY_INFO_CLASS,
+		&m_Block[0],static_cast<DWORD>(m_Block.size() * sizeof(LONGLONG)));
+	m_dwBlockOffset = 0;
+
+	return m_bBlockValid;
+}
+
+BOOL CDirectoryReader::ReadFromBlock(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation)
+{
+	while(m_bBlockValid)
+	{
+		const FileIdBothDirInfo_t *pInfo = reinterpret_cast<const FileIdBothDirInfo_t *>(
+			reinterpret_cast<const BYTE *>(&m_Block[0]) + m_dwBlockOffset);
+
+		ZeroMemory(&wfd,sizeof(wfd));
+		wfd.dwFileAttributes = pInfo->FileAttributes;
+		wfd.ftCreationTime = LargeIntegerToFileTime(pInfo->CreationTime);
+		wfd.ftLastAccessTime = LargeIntegerToFileTime(pInfo->LastAccessTime);
+		wfd.ftLastWriteTime = LargeIntegerToFileTime(pInfo->LastWriteTime);
+		wfd.nFileSizeLow = pInfo->EndOfFile.LowPart;
+		wfd.nFileSizeHigh = static_cast<DWORD>(pInfo->EndOfFile.HighPart);
+
+		/* For reparse points, the EA size
+		field holds the reparse tag. */
+		if((pInfo->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == FILE_ATTRIBUTE_REPARSE_POINT)
+		{
+			wfd.dwReserved0 = pInfo->EaSize;
+		}
+
+		StringCchCopyN(wfd.cFileName,SIZEOF_ARRAY(wfd.cFileName),pInfo->FileName,
+			pInfo->FileNameLength / sizeof(WCHAR));
+		StringCchCopyN(wfd.cAlternateFileName,SIZEOF_ARRAY(wfd.cAlternateFileName),pInfo->ShortName,
+			pInfo->ShortNameLength / sizeof(WCHAR));
+
+		ULARGE_INTEGER uliFileId;
+		uliFileId.LowPart = pInfo->FileId.LowPart;
+		uliFileId.HighPart = static_cast<DWORD>(pInfo->FileId.HighPart);
+		ulLocation = GetDiskLocation(uliFileId.QuadPart);
+
+		if(pInfo->NextEntryOffset != 0)
+		{
+			m_dwBlockOffset += pInfo->NextEntryOffset;
+		}
+		else
+		{
+			ReadBlock();
+		}
+
+		if(!IsDotEntry(wfd.cFileName))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+BOOL CDirectoryReader::ReadFromFindFile(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation)
+{
+	while(TRUE)
+	{
+		if(m_bFirstPending)
+		{
+			wfd = m_wfdFirst;
+			m_bFirstPending = FALSE;
+		}
+		else if(!FindNextFile(m_hFindFile,&wfd))
+		{
+			return FALSE;
+		}
+
+		if(IsDotEntry(wfd.cFileName))
+		{
+			continue;
+		}
+
+		ulLocation = 0;
+
+		if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+		{
+			GetFileLocation(CFolderSizeCalculator::CombinePath(m_strDirectory,wfd.cFileName),ulLocation);
+		}
+
+		return TRUE;
+	}
+}
+
+CDirectoryPrefetcher::CDirectoryPrefetcher(size_t nMaxPending) :
+m_nMaxPending(nMaxPending > 0 ? nMaxPending : 1),
+m_bStopping(FALSE),
+m_lPrefetched(0)
+{
+	InitializeCriticalSection(&m_cs);
+	m_hWorkEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+
+	m_hThread = CreateThread(NULL,0,DirectoryPrefetchThread,
+		reinterpret_cast<LPVOID>(this),0,NULL);
+}
+
+CDirectoryPrefetcher::~CDirectoryPrefetcher()
+{
+	EnterCriticalSection(&m_cs);
+	m_bStopping = TRUE;
+	m_Pending.clear();
+	LeaveCriticalSection(&m_cs);
+
+	if(m_hThread != NULL)
+	{
+		SetEvent(m_hWorkEvent);
+		WaitForSingleObject(m_hThread,INFINITE);
+		CloseHandle(m_hThread);
+	}
+
+	CloseHandle(m_hWorkEvent);
+	DeleteCriticalSection(&m_cs);
+}
+
+void CDirectoryPrefetcher::Prefetch(const std::wstring &strDirectory)
+{
+	if(m_hThread == NULL)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	m_Pending.push_back(strDirectory);
+
+	if(m_Pending.size() > m_nMaxPending)
+	{
+		m_Pending.pop_front();
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	SetEvent(m_hWorkEvent);
+}
+
+LONG CDirectoryPrefetcher::GetPrefetchCount() const
+{
+	return m_lPrefetched;
+}
+
+DWORD WINAPI DirectoryPrefetchThread(LPVOID pParam)
+{
+	assert(pParam != NULL);
+
+	CDirectoryPrefetcher *pPrefetcher = reinterpret_cast<CDirectoryPrefetcher *>(pParam);
+	pPrefetcher->PrefetchThread();
+
+	return 0;
+}
+
+void CDirectoryPrefetcher::PrefetchThread()
+{
+	CDirectoryReader DirectoryReader;
+
+	while(TRUE)
+	{
+		EnterCriticalSection(&m_cs);
+
+		BOOL bStopping = m_bStopping;
+		BOOL bFound = !m_Pending.empty();
+		std::wstring strDirectory;
+
+		if(bFound)
+		{
+			strDirectory = m_Pending.front();
+			m_Pending.pop_front();
+		}
+
+		LeaveCriticalSection(&m_cs);
+
+		if(bStopping)
+		{
+			break;
+		}
+
+		if(!bFound)
+		{
+			WaitForSingleObject(m_hWorkEvent,INFINITE);
+			continue;
+		}
+
+		/* The whole listing is read, so that every
+		block of the folder ends up in the cache. */
+		if(DirectoryReader.Open(strDirectory))
+		{
+			WIN32_FIND_DATA wfd;
+			ULONGLONG ulLocation;
+
+			while(DirectoryReader.Read(wfd,ulLocation))
+			{
+			}
+
+			DirectoryReader.Close();
+		}
+
+		InterlockedIncrement(&m_lPrefetched);
+	}
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "Macros.h"
+
+/* The order in which a recursive walk visits the
+folders it has found. */
+enum TraversalOrder_t
+{
+	/* Folders are visited in roughly the order
+	they're found in (i.e. by name). */
+	TRAVERSAL_ORDER_DEFAULT,
+
+	/* Folders are visited in order of where they are
+	on disk (see CLocalityQueue), and are read ahead of
+	the walk. */
+	TRAVERSAL_ORDER_LOCALITY,
+
+	/* TRAVERSAL_ORDER_LOCALITY on rotational disks, and
+	TRAVERSAL_ORDER_DEFAULT everywhere else (including
+	disks that can't be identified). */
+	TRAVERSAL_ORDER_AUTOMATIC
+};
+
+/* Returns TRUE if a walk starting from the
+given path should be done in locality order. */
+BOOL		ShouldUseLocalityOrder(TraversalOrder_t TraversalOrder,const TCHAR *szPath);
+
+/* The number of threads a walk in locality order should
+use. Reading in one sweep across the disk only helps if the
+disk isn't also being asked for reads from elsewhere, so
+this is the number of jobs the path's device can run at
+once (see CThreadPool::SetDeviceClassLimits). */
+int			GetLocalityOrderThreadLimit(const TCHAR *szPath);
+
+/* Returns where a file is on disk, given its file ID.
+On NTFS, the lower 48 bits of the ID are the file's MFT
+record number (the rest is a sequence number). Records
+are stored in order, so files with nearby records have
+their metadata (and, for small folders, their listing)
+close together. */
+ULONGLONG	GetDiskLocation(ULONGLONG ulFileId);
+
+/* Opens the file or folder to find its location.
+Only attribute access is needed, so this works even
+if the item is locked. */
+BOOL		GetFileLocation(const std::wstring &strPath,ULONGLONG &ulLocation);
+
+/* Items that are waiting to be visited, handed out in
+order of where they are on disk. Items are taken in a
+single sweep across the disk (in ascending order of
+location), starting from wherever the last item was
+taken. Anything queued behind the sweep waits until it
+wraps back around to the start. This keeps the disk head
+moving in one direction, rather than seeking back and
+forth between folders.
+
+Items at the same location are handed out in the order
+they were queued. Not thread safe. */
+template <typename T>
+class CLocalityQueue
+{
+public:
+
+	CLocalityQueue() :
+	m_ulPosition(0)
+	{
+
+	}
+
+	void Push(ULONGLONG ulLocation,const T &Item)
+	{
+		m_Items.insert(std::make_pair(ulLocation,Item));
+	}
+
+	/* Returns FALSE if the queue is empty. */
+	BOOL Pop(T &Item)
+	{
+		if(m_Items.empty())
+		{
+			return FALSE;
+		}
+
+		auto itr = GetNext();
+
+		m_ulPosition = itr->first;
+		Item = itr->second;
+		m_Items.erase(itr);
+
+		return TRUE;
+	}
+
+	/* Returns (up to) the next nItems items, in the order
+	they would be popped. The items stay in the queue; the
+	pointers are valid until they're popped. */
+	void GetUpcoming(size_t nItems,std::vector<T *> &Items)
+	{
+		Items.clear();
+
+		if(m_Items.empty())
+		{
+			return;
+		}
+
+		auto itr = GetNext();
+
+		while(Items.size() < min(nItems,m_Items.size()))
+		{
+			Items.push_back(&itr->second);
+
+			if(++itr == m_Items.end())
+			{
+				itr = m_Items.begin();
+			}
+		}
+	}
+
+	BOOL IsEmpty() const
+	{
+		return m_Items.empty();
+	}
+
+	size_t GetSize() const
+	{
+		return m_Items.size();
+	}
+
+private:
+
+	typename std::multimap<ULONGLONG,T>::iterator GetNext()
+	{
+		auto itr = m_Items.lower_bound(m_ulPosition);
+
+		if(itr == m_Items.end())
+		{
+			itr = m_Items.begin();
+		}
+
+		return itr;
+	}
+
+	std::multimap<ULONGLONG,T>	m_Items;
+
+	/* The location of the last item
+	that was taken. */
+	ULONGLONG					m_ulPosition;
+};
+
+/* Lists a folder, along with the location (see
+GetDiskLocation) of each item in it.
+
+Where GetFileInformationByHandleEx is available (Vista
+and later), the file IDs are returned with the listing
+itself, so nothing extra has to be read. Otherwise, the
+folder is listed with FindFirstFile, and only sub folders
+are located (by opening each one). Items whose location
+isn't known are given a location of 0. */
+class CDirectoryReader
+{
+public:
+
+	CDirectoryReader();
+	~CDirectoryReader();
+
+	/* The path can have the \\?\ prefix. The first block of
+	the listing is read straight away. Returns FALSE if the
+	folder can't be listed. */
+	BOOL		Open(const std::wstring &strDirectory);
+	void		Close();
+
+	/* "." and ".." are skipped. Returns FALSE once
+	every item has been read. */
+	BOOL		Read(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation);
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CDirectoryReader);
+
+	static const DWORD	BUFFER_SIZE = 64 * 1024;
+
+	BOOL		ReadBlock();
+	BOOL		ReadFromBlock(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation);
+	BOOL		ReadFromFindFile(WIN32_FIND_DATA &wfd,ULONGLONG &ulLocation);
+
+	std::wstring	m_strDirectory;
+
+	/* Only one of these is open at a time,
+	depending on how the folder is listed. */
+	HANDLE			m_hDirectory;
+	HANDLE			m_hFindFile;
+
+	/* Used with m_hDirectory. Each entry in the block
+	is 8 byte aligned, so the buffer is as well. */
+	std::vector<LONGLONG>	m_Block;
+	DWORD			m_dwBlockOffset;
+	BOOL			m_bBlockValid;
+
+	/* Used with m_hFindFile. Holds the item returned
+	by FindFirstFile, until it's been read. */
+	WIN32_FIND_DATA	m_wfdFirst;
+	BOOL			m_bFirstPending;
+};
+
+/* Lists folders ahead of a walk, on a thread of its own,
+so that their listings are already cached by the time the
+walk reaches them. Only the most recent requests are kept;
+older requests that haven't been started are dropped, as
+the walk will have caught up with them. */
+class CDirectoryPrefetcher
+{
+	friend DWORD WINAPI	DirectoryPrefetchThread(LPVOID pParam);
+
+public:
+
+	CDirectoryPrefetcher(size_t nMaxPending);
+
+	/* Waits for the folder that's currently
+	being read (if any) to finish. */
+	~CDirectoryPrefetcher();
+
+	void		Prefetch(const std::wstring &strDirectory);
+
+	/* The number of folders that have been read. */
+	LONG		GetPrefetchCount() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CDirectoryPrefetcher);
+
+	void		PrefetchThread();
+
+	CRITICAL_SECTION			m_cs;
+	std::deque<std::wstring>	m_Pending;
+	size_t						m_nMaxPending;
+	BOOL						m_bStopping;
+
+	/* Auto-reset. Set when a folder is queued,
+	or the thread needs to stop. */
+	HANDLE						m_hWorkEvent;
+	HANDLE						m_hThread;
+
+	volatile LONG				m_lPrefetched;
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <climits>
+#include <deque>
+#include <vector>
+#include "LocalityOrder.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+/* Walks a tree (e.g. of folders) on several threads at once.
+Each worker has a queue of its own. Items found by a worker
+are pushed onto its own queue, and it takes from the back, so
+that it stays close to where it's been working. A worker with
+nothing left takes from the front of another worker's queue
+(i.e. the items furthest away from where that worker is).
+
+In locality order, there's a single queue instead, from which
+every worker takes items in order of where they are on disk
+(see CLocalityQueue). The items that are about to be taken are
+handed to a prefetch callback, so that they can be read ahead.
+
+The walk is finished once every item that's been pushed has
+been finished (see Finish). Idle workers wait on a semaphore,
+which is released once for each item that's pushed, so that
+a wakeup can never be lost between workers. */
+template <typename T>
+class CParallelWalker
+{
+public:
+
+	typedef void		(*WorkerProc_t)(int iWorker,LPVOID pData);
+	typedef ULONGLONG	(*LocationProc_t)(const T &Item);
+
+	/* Called with the locality queue locked. */
+	typedef void		(*PrefetchProc_t)(T &Item,LPVOID pData);
+
+	CParallelWalker(int nWorkers) :
+	m_lPending(0),
+	m_bLocalityOrder(FALSE),
+	m_pfnLocation(NULL),
+	m_pfnPrefetch(NULL),
+	m_pPrefetchData(NULL),
+	m_nPrefetchDepth(0)
+	{
+		for(int i = 0;i < max(nWorkers,1);i++)
+		{
+			WorkQueue_t *pWorkQueue = new WorkQueue_t;
+			InitializeCriticalSection(&pWorkQueue->cs);
+			m_WorkQueues.push_back(pWorkQueue);
+		}
+
+		InitializeCriticalSection(&m_csLocality);
+		m_hItems = CreateSemaphore(NULL,0,LONG_MAX,NULL);
+	}
+
+	~CParallelWalker()
+	{
+		CloseHandle(m_hItems);
+		DeleteCriticalSection(&m_csLocality);
+
+		for(auto itr = m_WorkQueues.begin();itr != m_WorkQueues.end();itr++)
+		{
+			DeleteCriticalSection(&(*itr)->cs);
+			delete *itr;
+		}
+	}
+
+	/* Should be called before anything is pushed. pfnPrefetch
+	can be NULL. Otherwise, each time an item is taken, it's
+	called for each of the next nPrefetchDepth items, so it
+	will see most items more than once. */
+	void SetLocalityOrder(LocationProc_t pfnLocation,PrefetchProc_t pfnPrefetch,
+		LPVOID pPrefetchData,size_t nPrefetchDepth)
+	{
+		m_bLocalityOrder = TRUE;
+		m_pfnLocation = pfnLocation;
+		m_pfnPrefetch = pfnPrefetch;
+		m_pPrefetchData = pPrefetchData;
+		m_nPrefetchDepth = nPrefetchDepth;
+	}
+
+	int GetWorkerCount() const
+	{
+		return static_cast<int>(m_WorkQueues.size());
+	}
+
+	/* The items are pushed in reverse, so that the owning
+	worker (which takes from the back) visits them in the
+	order given, while thieves (which take from the front)
+	take the last items, furthest away from where the owner
+	is working. */
+	void Push(int iWorker,const std::vector<T> &Items)
+	{
+		if(Items.empty())
+		{
+			return;
+		}
+
+		/* Counted before the items can be taken, so that
+		the count can't drop to 0 while they're queued. */
+		InterlockedExchangeAdd(&m_lPending,static_cast<LONG>(Items.size()));
+
+		if(m_bLocalityOrder)
+		{
+			EnterCriticalSection(&m_csLocality);
+
+			for(auto itr = Items.begin();itr != Items.end();itr++)
+			{
+				m_LocalityQueue.Push(m_pfnLocation(*itr),*itr);
+			}
+
+			LeaveCriticalSection(&m_csLocality);
+		}
+		else
+		{
+			WorkQueue_t *pWorkQueue = m_WorkQueues[iWorker];
+
+			EnterCriticalSection(&pWorkQueue->cs);
+
+			for(auto itr = Items.rbegin();itr != Items.rend();itr++)
+			{
+				pWorkQueue->Items.push_back(*itr);
+			}
+
+			LeaveCriticalSection(&pWorkQueue->cs);
+		}
+
+		ReleaseSemaphore(m_hItems,static_cast<LONG>(Items.size()),NULL);
+	}
+
+	/* Takes the next item, waiting for one to be pushed if
+	there's nothing queued. Returns FALSE once every item
+	has been finished. */
+	BOOL Pop(int iWorker,T &Item)
+	{
+		WaitForSingleObject(m_hItems,INFINITE);
+
+		return Take(iWorker,Item);
+	}
+
+	/* As Pop, but returns FALSE straight away if there's
+	nothing queued. Pop should then be called to wait. */
+	BOOL TryPop(int iWorker,T &Item)
+	{
+		if(WaitForSingleObject(m_hItems,0) != WAIT_OBJECT_0)
+		{
+			return FALSE;
+		}
+
+		return Take(iWorker,Item);
+	}
+
+	/* Should be called once a worker has dealt with an item
+	it has taken, after any items it found have been pushed. */
+	void Finish()
+	{
+		/* Any items found were pushed before this point, so
+		the count can only reach 0 once there's nothing left
+		anywhere. The waiting workers are then woken in turn
+		(see Take). */
+		if(InterlockedDecrement(&m_lPending) == 0)
+		{
+			ReleaseSemaphore(m_hItems,1,NULL);
+		}
+	}
+
+	/* Runs pfnWorker on each worker, and returns once they've
+	all returned. The calling thread acts as the first worker.
+	If it's running a thread pool job, the other workers report
+	their I/O on the job's behalf. If a thread can't be created,
+	the walk carries on with fewer workers. */
+	void Run(WorkerProc_t pfnWorker,LPVOID pData)
+	{
+		if(m_lPending == 0)
+		{
+			return;
+		}
+
+		int nWorkers = GetWorkerCount();
+		std::vector<Worker_t> Workers(nWorkers);
+		std::vector<HANDLE> Threads;
+
+		for(int i = 0;i < nWorkers;i++)
+		{
+			Workers[i].pfnWorker = pfnWorker;
+			Workers[i].pData = pData;
+			Workers[i].iWorker = i;
+			Workers[i].pJobContext = CThreadPool::GetJobContext();
+		}
+
+		for(int i = 1;i < nWorkers;i++)
+		{
+			HANDLE hThread = CreateThread(NULL,0,WorkerThread,
+				reinterpret_cast<LPVOID>(&Workers[i]),0,NULL);
+
+			if(hThread != NULL)
+			{
+				Threads.push_back(hThread);
+			}
+		}
+
+		pfnWorker(0,pData);
+
+		if(!Threads.empty())
+		{
+			WaitForMultipleObjects(static_cast<DWORD>(Threads.size()),&Threads[0],TRUE,INFINITE);
+
+			for(auto itr = Threads.begin();itr != Threads.end();itr++)
+			{
+				CloseHandle(*itr);
+			}
+		}
+	}
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CParallelWalker);
+
+	struct WorkQueue_t
+	{
+		CRITICAL_SECTION	cs;
+		std::deque<T>		Items;
+	};
+
+	struct Worker_t
+	{
+		WorkerProc_t	pfnWorker;
+		LPVOID			pData;
+		int				iWorker;
+		LPVOID			pJobContext;
+	};
+
+	static DWORD WINAPI WorkerThread(LPVOID pParam)
+	{
+		Worker_t *pWorker = reinterpret_cast<Worker_t *>(pParam);
+
+		CThreadPool::SetJobContext(pWorker->pJobContext);
+		pWorker->pfnWorker(pWorker->iWorker,pWorker->pData);
+		CThreadPool::SetJobContext(NULL);
+
+		return 0;
+	}
+
+	/* Called once the semaphore has been acquired. Each
+	count is only released after its item has been queued,
+	and each taker holds a count of its own, so there's
+	always an item left for this worker. It may briefly be
+	missed (if it's pushed onto a queue that's already been
+	looked at, while another worker takes one that hasn't),
+	in which case the queues are simply checked again.
+
+	Once the walk is finished, the count is passed on, so
+	that every other worker wakes up in turn. */
+	BOOL Take(int iWorker,T &Item)
+	{
+		while(TRUE)
+		{
+			if(PopItem(iWorker,Item) || StealItem(iWorker,Item))
+			{
+				return TRUE;
+			}
+
+			if(m_lPending == 0)
+			{
+				ReleaseSemaphore(m_hItems,1,NULL);
+				return FALSE;
+			}
+		}
+	}
+
+	BOOL PopItem(int iWorker,T &Item)
+	{
+		if(m_bLocalityOrder)
+		{
+			EnterCriticalSection(&m_csLocality);
+
+			BOOL bFound = m_LocalityQueue.Pop(Item);
+
+			if(bFound && m_pfnPrefetch != NULL)
+			{
+				std::vector<T *> UpcomingItems;
+				m_LocalityQueue.GetUpcoming(m_nPrefetchDepth,UpcomingItems);
+
+				for(auto itr = UpcomingItems.begin();itr != UpcomingItems.end();itr++)
+				{
+					m_pfnPrefetch(**itr,m_pPrefetchData);
+				}
+			}
+
+			LeaveCriticalSection(&m_csLocality);
+
+			return bFound;
+		}
+
+		WorkQueue_t *pWorkQueue = m_WorkQueues[iWorker];
+		BOOL bFound = FALSE;
+
+		EnterCriticalSection(&pWorkQueue->cs);
+
+		if(!pWorkQueue->Items.empty())
+		{
+			Item = pWorkQueue->Items.back();
+			pWorkQueue->Items.pop_back();
+			bFound = TRUE;
+		}
+
+		LeaveCriticalSection(&pWorkQueue->cs);
+
+		return bFound;
+	}
+
+	/* In locality order, there's nothing to steal,
+	as every item is in the shared queue. */
+	BOOL StealItem(int iWorker,T &Item)
+	{
+		if(m_bLocalityOrder)
+		{
+			return FALSE;
+		}
+
+		int nWorkQueues = GetWorkerCount();
+
+		for(int i = 1;i < nWorkQueues;i++)
+		{
+			WorkQueue_t *pWorkQueue = m_WorkQueues[(iWorker + i) % nWorkQueues];
+			BOOL bFound = FALSE;
+
+			EnterCriticalSection(&pWorkQueue->cs);
+
+			if(!pWorkQueue->Items.empty())
+			{
+				Item = pWorkQueue->Items.front();
+				pWorkQueue->Items.pop_front();
+				bFound = TRUE;
+			}
+
+			LeaveCriticalSection(&pWorkQueue->cs);
+
+			if(bFound)
+			{
+				return TRUE;
+			}
+		}
+
+		return FALSE;
+	}
+
+	std::vector<WorkQueue_t *>	m_WorkQueues;
+
+	/* The number of items that have been pushed,
+	but not yet finished. */
+	volatile LONG				m_lPending;
+
+	/* Released once for each item that's pushed. */
+	HANDLE						m_hItems;
+
+	/* Used instead of the work queues in locality
+	order. The critical section guards the queue. */
+	BOOL						m_bLocalityOrder;
+	CRITICAL_SECTION			m_csLocality;
+	CLocalityQueue<T>			m_LocalityQueue;
+	LocationProc_t				m_pfnLocation;
+	PrefetchProc_t				m_pfnPrefetch;
+	LPVOID						m_pPrefetchData;
+	size_t						m_nPrefetchDepth;
+};
@@ -0,0 +1,1132 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: RegexMatcher.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Matches strings against a regular expression,
+ * using a literal prefilter and an NFA where
+ * possible.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "RegexMatcher.h"
+#include "Macros.h"
+
+
+namespace
+{
+	/* The largest count accepted in a
+	bounded repeat (e.g. a{2,5}). */
+	const int MAX_REPEAT_COUNT = 100000;
+
+	BOOL ParseHexDigits(const wchar_t *p,size_t nDigits,wchar_t &ch)
+	{
+		unsigned int uValue = 0;
+
+		for(size_t i = 0;i < nDigits;i++)
+		{
+			wchar_t c = p[i];
+			unsigned int uDigit;
+
+			if(c >= '0' && c <= '9')
+			{
+				uDigit = c - '0';
+			}
+			else if(c >= 'a' && c <= 'f')
+			{
+				uDigit = c - 'a' + 10;
+			}
+			else if(c >= 'A' && c <= 'F')
+			{
+				uDigit = c - 'A' + 10;
+			}
+			else
+			{
+				return FALSE;
+			}
+
+			uValue = (uValue * 16) + uDigit;
+		}
+
+		ch = static_cast<wchar_t>(uValue);
+
+		return TRUE;
+	}
+}
+
+CRegexMatcher::CRegexMatcher() :
+m_bCompiled(FALSE),
+m_bCaseInsensitive(FALSE),
+m_bUseFallback(TRUE),
+m_iStartState(-1)
+{
+	const wchar_t szDigit[] = L"d";
+	const wchar_t szWord[] = L"w";
+	const wchar_t szSpace[] = L"s";
+
+	m_DigitClass = m_Traits.lookup_classname(szDigit,szDigit + 1);
+	m_WordClass = m_Traits.lookup_classname(szWord,szWord + 1);
+	m_SpaceClass = m_Traits.lookup_classname(szSpace,szSpace + 1);
+}
+
+BOOL CRegexMatcher::Compile(const TCHAR *szPattern,BOOL bCaseInsensitive)
+{
+	m_bCompiled = FALSE;
+	m_bCaseInsensitive = bCaseInsensitive;
+	m_bUseFallback = TRUE;
+	m_strRequiredLiteral.clear();
+	m_States.clear();
+	m_CharClasses.clear();
+	m_iStartState = -1;
+
+	/* The standard regex is always built. As well as being
+	used for unsupported patterns, this means that a pattern
+	is valid here if (and only if) it's valid for std::wregex. */
+	try
+	{
+		if(bCaseInsensitive)
+		{
+			m_rxPattern.assign(szPattern,std::regex_constants::icase);
+		}
+		else
+		{
+			m_rxPattern.assign(szPattern);
+		}
+	}
+	catch(const std::regex_error &)
+	{
+		return FALSE;
+	}
+
+	m_bCompiled = TRUE;
+
+	ParseState_t ps;
+	ps.pPattern = szPattern;
+	ps.nLength = lstrlen(szPattern);
+	ps.nPos = 0;
+	ps.iDepth = 0;
+
+	int iRoot = -1;
+	BOOL bSupported = ParseAlternation(ps,iRoot) && (ps.nPos == ps.nLength);
+
+	if(bSupported)
+	{
+		int iMatchState = AddState(STATE_MATCH,-1);
+		bSupported = CompileNode(ps,iRoot,iMatchState,m_iStartState);
+	}
+
+	if(!bSupported)
+	{
+		m_States.clear();
+		m_CharClasses.clear();
+		m_iStartState = -1;
+
+		return TRUE;
+	}
+
+	std::wstring strCurrent;
+	FindRequiredLiteral(ps,iRoot,strCurrent);
+
+	m_bUseFallback = FALSE;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::Match(const TCHAR *szString) const
+{
+	if(!m_bCompiled)
+	{
+		return FALSE;
+	}
+
+	if(m_bUseFallback)
+	{
+		return std::regex_match(szString,m_rxPattern);
+	}
+
+	if(!m_strRequiredLiteral.empty())
+	{
+		if(m_bCaseInsensitive)
+		{
+			/* The required literal has already been case
+			folded, so fold the string in the same way. */
+			TCHAR szFolded[MAX_PATH];
+			std::wstring strFolded;
+			const TCHAR *pFolded = NULL;
+			size_t nLength = lstrlen(szString);
+
+			if(nLength < SIZEOF_ARRAY(szFolded))
+			{
+				for(size_t i = 0;i < nLength;i++)
+				{
+					szFolded[i] = TranslateCase(szString[i]);
+				}
+
+				szFolded[nLength] = '\0';
+				pFolded = szFolded;
+			}
+			else
+			{
+				strFolded.resize(nLength);
+
+				for(size_t i = 0;i < nLength;i++)
+				{
+					strFolded[i] = TranslateCase(szString[i]);
+				}
+
+				pFolded = strFolded.c_str();
+			}
+
+			if(wcsstr(pFolded,m_strRequiredLiteral.c_str()) == NULL)
+			{
+				return FALSE;
+			}
+		}
+		else
+		{
+			if(wcsstr(szString,m_strRequiredLiteral.c_str()) == NULL)
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return MatchAutomaton(szString);
+}
+
+BOOL CRegexMatcher::IsUsingFallback() const
+{
+	return m_bUseFallback;
+}
+
+const std::wstring &CRegexMatcher::GetRequiredLiteral() const
+{
+	return m_strRequiredLiteral;
+}
+
+BOOL CRegexMatcher::ParseAlternation(ParseState_t &ps,int &iNode)
+{
+	int iFirst;
+
+	if(!ParseConcatenation(ps,iFirst))
+	{
+		return FALSE;
+	}
+
+	if(ps.nPos >= ps.nLength || ps.pPattern[ps.nPos] != '|')
+	{
+		iNode = iFirst;
+		return TRUE;
+	}
+
+	int iAlternate = AddNode(ps,NODE_ALTERNATE);
+	ps.Nodes[iAlternate].Children.push_back(iFirst);
+
+	while(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == '|')
+	{
+		ps.nPos++;
+
+		int iNext;
+
+		if(!ParseConcatenation(ps,iNext))
+		{
+			return FALSE;
+		}
+
+		ps.Nodes[iAlternate].Children.push_back(iNext);
+	}
+
+	iNode = iAlternate;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseConcatenation(ParseState_t &ps,int &iNode)
+{
+	int iConcat = AddNode(ps,NODE_CONCAT);
+
+	while(ps.nPos < ps.nLength)
+	{
+		wchar_t c = ps.pPattern[ps.nPos];
+
+		if(c == '|' || c == ')')
+		{
+			break;
+		}
+
+		int iTerm;
+
+		if(!ParseTerm(ps,iTerm))
+		{
+			return FALSE;
+		}
+
+		ps.Nodes[iConcat].Children.push_back(iTerm);
+	}
+
+	iNode = iConcat;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseTerm(ParseState_t &ps,int &iNode)
+{
+	int iAtom;
+
+	if(!ParseAtom(ps,iAtom))
+	{
+		return FALSE;
+	}
+
+	int iMin;
+	int iMax;
+	BOOL bFound;
+
+	if(!ParseQuantifier(ps,iMin,iMax,bFound))
+	{
+		return FALSE;
+	}
+
+	if(bFound)
+	{
+		/* Quantified anchors aren't supported. */
+		if(ps.Nodes[iAtom].Type == NODE_EMPTY)
+		{
+			return FALSE;
+		}
+
+		int iRepeat = AddNode(ps,NODE_REPEAT);
+		ps.Nodes[iRepeat].iMin = iMin;
+		ps.Nodes[iRepeat].iMax = iMax;
+		ps.Nodes[iRepeat].Children.push_back(iAtom);
+
+		iAtom = iRepeat;
+	}
+
+	iNode = iAtom;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseAtom(ParseState_t &ps,int &iNode)
+{
+	wchar_t c = ps.pPattern[ps.nPos];
+
+	switch(c)
+	{
+	case '(':
+		ps.nPos++;
+
+		/* Capturing and non-capturing groups are
+		treated the same way (captures are irrelevant
+		here). Lookahead isn't supported. */
+		if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == '?')
+		{
+			if(ps.nPos + 1 < ps.nLength && ps.pPattern[ps.nPos + 1] == ':')
+			{
+				ps.nPos += 2;
+			}
+			else
+			{
+				return FALSE;
+			}
+		}
+
+		if(++ps.iDepth > MAX_GROUP_DEPTH)
+		{
+			return FALSE;
+		}
+
+		if(!ParseAlternation(ps,iNode))
+		{
+			return FALSE;
+		}
+
+		if(ps.nPos >= ps.nLength || ps.pPattern[ps.nPos] != ')')
+		{
+			return FALSE;
+		}
+
+		ps.nPos++;
+		ps.iDepth--;
+		return TRUE;
+
+	case '[':
+		ps.nPos++;
+		return ParseClass(ps,iNode);
+
+	case '.':
+		ps.nPos++;
+		iNode = AddNode(ps,NODE_ANY);
+		return TRUE;
+
+	case '\\':
+		{
+			ps.nPos++;
+
+			wchar_t ch;
+			int iBuiltin;
+			BOOL bNegatedBuiltin;
+
+			if(!ParseEscape(ps,ch,iBuiltin,bNegatedBuiltin))
+			{
+				return FALSE;
+			}
+
+			if(iBuiltin != 0)
+			{
+				CharClass_t CharClass;
+				CharClass.iBuiltins = bNegatedBuiltin ? 0 : iBuiltin;
+				CharClass.iNegatedBuiltins = bNegatedBuiltin ? iBuiltin : 0;
+				CharClass.bNegated = FALSE;
+				m_CharClasses.push_back(CharClass);
+
+				iNode = AddNode(ps,NODE_CLASS);
+				ps.Nodes[iNode].iClass = static_cast<int>(m_CharClasses.size() - 1);
+			}
+			else
+			{
+				iNode = AddNode(ps,NODE_CHAR);
+				ps.Nodes[iNode].ch = ch;
+			}
+		}
+		return TRUE;
+
+	/* Anchors are only supported where they're
+	redundant (i.e. at the very start or end of
+	the pattern), since the whole string is always
+	matched. */
+	case '^':
+		if(ps.nPos != 0)
+		{
+			return FALSE;
+		}
+
+		ps.nPos++;
+		iNode = AddNode(ps,NODE_EMPTY);
+		return TRUE;
+
+	case '$':
+		if(ps.nPos != (ps.nLength - 1) || ps.iDepth != 0)
+		{
+			return FALSE;
+		}
+
+		ps.nPos++;
+		iNode = AddNode(ps,NODE_EMPTY);
+		return TRUE;
+
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+	case '}':
+	case ']':
+		return FALSE;
+	}
+
+	ps.nPos++;
+	iNode = AddNode(ps,NODE_CHAR);
+	ps.Nodes[iNode].ch = c;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseQuantifier(ParseState_t &ps,int &iMin,int &iMax,BOOL &bFound)
+{
+	bFound = FALSE;
+
+	if(ps.nPos >= ps.nLength)
+	{
+		return TRUE;
+	}
+
+	switch(ps.pPattern[ps.nPos])
+	{
+	case '*':
+		iMin = 0;
+		iMax = -1;
+		ps.nPos++;
+		break;
+
+	case '+':
+		iMin = 1;
+		iMax = -1;
+		ps.nPos++;
+		break;
+
+	case '?':
+		iMin = 0;
+		iMax = 1;
+		ps.nPos++;
+		break;
+
+	case '{':
+		ps.nPos++;
+
+		if(!ParseNumber(ps,iMin))
+		{
+			return FALSE;
+		}
+
+		iMax = iMin;
+
+		if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == ',')
+		{
+			ps.nPos++;
+
+			if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == '}')
+			{
+				iMax = -1;
+			}
+			else if(!ParseNumber(ps,iMax))
+			{
+				return FALSE;
+			}
+		}
+
+		if(ps.nPos >= ps.nLength || ps.pPattern[ps.nPos] != '}')
+		{
+			return FALSE;
+		}
+
+		ps.nPos++;
+		break;
+
+	default:
+		return TRUE;
+	}
+
+	if(iMax != -1 && iMax < iMin)
+	{
+		return FALSE;
+	}
+
+	/* Non-greedy quantifiers don't change whether
+	or not the whole string matches. */
+	if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == '?')
+	{
+		ps.nPos++;
+	}
+
+	bFound = TRUE;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseClass(ParseState_t &ps,int &iNode)
+{
+	CharClass_t CharClass;
+	CharClass.iBuiltins = 0;
+	CharClass.iNegatedBuiltins = 0;
+	CharClass.bNegated = FALSE;
+
+	if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == '^')
+	{
+		CharClass.bNegated = TRUE;
+		ps.nPos++;
+	}
+
+	/* Empty classes aren't supported. */
+	if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == ']')
+	{
+		return FALSE;
+	}
+
+	while(TRUE)
+	{
+		if(ps.nPos >= ps.nLength)
+		{
+			return FALSE;
+		}
+
+		if(ps.pPattern[ps.nPos] == ']')
+		{
+			ps.nPos++;
+			break;
+		}
+
+		wchar_t chStart;
+		int iBuiltin;
+		BOOL bNegatedBuiltin;
+
+		if(!ParseClassAtom(ps,chStart,iBuiltin,bNegatedBuiltin))
+		{
+			return FALSE;
+		}
+
+		BOOL bRange = (ps.nPos + 1 < ps.nLength) &&
+			ps.pPattern[ps.nPos] == '-' &&
+			ps.pPattern[ps.nPos + 1] != ']';
+
+		if(iBuiltin != 0)
+		{
+			if(bRange)
+			{
+				return FALSE;
+			}
+
+			if(bNegatedBuiltin)
+			{
+				CharClass.iNegatedBuiltins |= iBuiltin;
+			}
+			else
+			{
+				CharClass.iBuiltins |= iBuiltin;
+			}
+
+			continue;
+		}
+
+		wchar_t chEnd = chStart;
+
+		if(bRange)
+		{
+			ps.nPos++;
+
+			if(!ParseClassAtom(ps,chEnd,iBuiltin,bNegatedBuiltin))
+			{
+				return FALSE;
+			}
+
+			if(iBuiltin != 0 || chEnd < chStart)
+			{
+				return FALSE;
+			}
+		}
+
+		CharClass.Ranges.push_back(std::make_pair(chStart,chEnd));
+	}
+
+	m_CharClasses.push_back(CharClass);
+
+	iNode = AddNode(ps,NODE_CLASS);
+	ps.Nodes[iNode].iClass = static_cast<int>(m_CharClasses.size() - 1);
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseClassAtom(ParseState_t &ps,wchar_t &ch,int &iBuiltin,BOOL &bNegatedBuiltin)
+{
+	wchar_t c = ps.pPattern[ps.nPos];
+
+	if(c == '\\')
+	{
+		ps.nPos++;
+
+		/* Within a class, \b is a backspace
+		rather than a word boundary. */
+		if(ps.nPos < ps.nLength && ps.pPattern[ps.nPos] == 'b')
+		{
+			return FALSE;
+		}
+
+		return ParseEscape(ps,ch,iBuiltin,bNegatedBuiltin);
+	}
+
+	/* Named classes (e.g. [[:alpha:]]), equivalence
+	classes and collating elements. */
+	if(c == '[' && ps.nPos + 1 < ps.nLength &&
+		(ps.pPattern[ps.nPos + 1] == ':' ||
+		ps.pPattern[ps.nPos + 1] == '.' ||
+		ps.pPattern[ps.nPos + 1] == '='))
+	{
+		return FALSE;
+	}
+
+	ps.nPos++;
+	ch = c;
+	iBuiltin = 0;
+	bNegatedBuiltin = FALSE;
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseEscape(ParseState_t &ps,wchar_t &ch,int &iBuiltin,BOOL &bNegatedBuiltin)
+{
+	if(ps.nPos >= ps.nLength)
+	{
+		return FALSE;
+	}
+
+	wchar_t c = ps.pPattern[ps.nPos++];
+
+	ch = c;
+	iBuiltin = 0;
+	bNegatedBuiltin = FALSE;
+
+	switch(c)
+	{
+	case 'd':
+	case 'D':
+		iBuiltin = BUILTIN_CLASS_DIGIT;
+		bNegatedBuiltin = (c == 'D');
+		break;
+
+	case 'w':
+	case 'W':
+		iBuiltin = BUILTIN_CLASS_WORD;
+		bNegatedBuiltin = (c == 'W');
+		break;
+
+	case 's':
+	case 'S':
+		iBuiltin = BUILTIN_CLASS_SPACE;
+		bNegatedBuiltin = (c == 'S');
+		break;
+
+	case 't':
+		ch = '\t';
+		break;
+
+	case 'n':
+		ch = '\n';
+		break;
+
+	case 'r':
+		ch = '\r';
+		break;
+
+	case 'v':
+		ch = '\v';
+		break;
+
+	case 'f':
+		ch = '\f';
+		break;
+
+	case 'x':
+		if(ps.nPos + 2 > ps.nLength ||
+			!ParseHexDigits(ps.pPattern + ps.nPos,2,ch))
+		{
+			return FALSE;
+		}
+
+		ps.nPos += 2;
+		break;
+
+	case 'u':
+		if(ps.nPos + 4 > ps.nLength ||
+			!ParseHexDigits(ps.pPattern + ps.nPos,4,ch))
+		{
+			return FALSE;
+		}
+
+		ps.nPos += 4;
+		break;
+
+	default:
+		/* Any other letter or digit is either a
+		backreference, a word boundary or a control
+		character, none of which are supported. Other
+		characters simply stand for themselves. */
+		if(iswalnum(c) || c == '_')
+		{
+			return FALSE;
+		}
+		break;
+	}
+
+	return TRUE;
+}
+
+BOOL CRegexMatcher::ParseNumber(ParseState_t &ps,int &iNumber)
+{
+	size_t nStart = ps.nPos;
+
+	iNumber = 0;
+
+	while(ps.nPos < ps.nLength &&
+		ps.pPattern[ps.nPos] >= '0' && ps.pPattern[ps.nPos] <= '9')
+	{
+		iNumber = (iNumber * 10) + (ps.pPattern[ps.nPos] - '0');
+
+		if(iNumber > MAX_REPEAT_COUNT)
+		{
+			return FALSE;
+		}
+
+		ps.nPos++;
+	}
+
+	return ps.nPos != nStart;
+}
+
+int CRegexMatcher::AddNode(ParseState_t &ps,NodeType_t Type)
+{
+	Node_t Node;
+	Node.Type = Type;
+	Node.ch = '\0';
+	Node.iClass = -1;
+	Node.iMin = 1;
+	Node.iMax = 1;
+	ps.Nodes.push_back(Node);
+
+	return static_cast<int>(ps.Nodes.size() - 1);
+}
+
+/* Builds the states for the given node, back to front.
+iNext is the state that follows the node, and the first
+state of the node is returned in iStart. */
+BOOL CRegexMatcher::CompileNode(const ParseState_t &ps,int iNode,int iNext,int &iStart)
+{
+	if(static_cast<int>(m_States.size()) > MAX_STATES)
+	{
+		return FALSE;
+	}
+
+	const Node_t &Node = ps.Nodes[iNode];
+
+	switch(Node.Type)
+	{
+	case NODE_EMPTY:
+		iStart = iNext;
+		break;
+
+	case NODE_CHAR:
+		iStart = AddState(STATE_CHAR,iNext);
+		m_States[iStart].ch = m_bCaseInsensitive ? TranslateCase(Node.ch) : Node.ch;
+		break;
+
+	case NODE_ANY:
+		iStart = AddState(STATE_ANY,iNext);
+		break;
+
+	case NODE_CLASS:
+		iStart = AddState(STATE_CLASS,iNext);
+		m_States[iStart].iClass = Node.iClass;
+		break;
+
+	case NODE_CONCAT:
+		{
+			int iCurrent = iNext;
+
+			for(auto itr = Node.Children.rbegin();itr != Node.Children.rend();itr++)
+			{
+				if(!CompileNode(ps,*itr,iCurrent,iCurrent))
+				{
+					return FALSE;
+				}
+			}
+
+			iStart = iCurrent;
+		}
+		break;
+
+	case NODE_ALTERNATE:
+		{
+			int iCurrent;
+
+			if(!CompileNode(ps,Node.Children.back(),iNext,iCurrent))
+			{
+				return FALSE;
+			}
+
+			for(auto itr = Node.Children.rbegin() + 1;itr != Node.Children.rend();itr++)
+			{
+				int iBranch;
+
+				if(!CompileNode(ps,*itr,iNext,iBranch))
+				{
+					return FALSE;
+				}
+
+				int iSplit = AddState(STATE_SPLIT,iBranch);
+				m_States[iSplit].iAlternate = iCurrent;
+				iCurrent = iSplit;
+			}
+
+			iStart = iCurrent;
+		}
+		break;
+
+	case NODE_REPEAT:
+		{
+			int iChild = Node.Children.front();
+			int iCurrent = iNext;
+
+			if(Node.iMax == -1)
+			{
+				/* The split state loops back
+				through the child. */
+				int iSplit = AddState(STATE_SPLIT,-1);
+				int iBody;
+
+				if(!CompileNode(ps,iChild,iSplit,iBody))
+				{
+					return FALSE;
+				}
+
+				m_States[iSplit].iNext = iBody;
+				m_States[iSplit].iAlternate = iNext;
+				iCurrent = iSplit;
+			}
+			else
+			{
+				/* Each optional copy can skip straight
+				to the end of the repeat. */
+				for(int i = 0;i < (Node.iMax - Node.iMin);i++)
+				{
+					int iBody;
+
+					if(!CompileNode(ps,iChild,iCurrent,iBody))
+					{
+						return FALSE;
+					}
+
+					int iSplit = AddState(STATE_SPLIT,iBody);
+					m_States[iSplit].iAlternate = iNext;
+					iCurrent = iSplit;
+				}
+			}
+
+			for(int i = 0;i < Node.iMin;i++)
+			{
+				if(!CompileNode(ps,iChild,iCurrent,iCurrent))
+				{
+					return FALSE;
+				}
+			}
+
+			iStart = iCurrent;
+		}
+		break;
+	}
+
+	return TRUE;
+}
+
+int CRegexMatcher::AddState(StateType_t Type,int iNext)
+{
+	State_t State;
+	State.Type = Type;
+	State.ch = '\0';
+	State.iClass = -1;
+	State.iNext = iNext;
+	State.iAlternate = -1;
+	m_States.push_back(State);
+
+	return static_cast<int>(m_States.size() - 1);
+}
+
+/* Finds the longest run of characters that must appear
+(contiguously) in every matching string. strCurrent holds
+the run that's currently being built. */
+void CRegexMatcher::FindRequiredLiteral(const ParseState_t &ps,int iNode,std::wstring &strCurrent)
+{
+	const Node_t &Node = ps.Nodes[iNode];
+
+	switch(Node.Type)
+	{
+	case NODE_EMPTY:
+		break;
+
+	case NODE_CHAR:
+		strCurrent += m_bCaseInsensitive ? TranslateCase(Node.ch) : Node.ch;
+
+		if(strCurrent.size() > m_strRequiredLiteral.size())
+		{
+			m_strRequiredLiteral = strCurrent;
+		}
+		break;
+
+	case NODE_CONCAT:
+		for(auto itr = Node.Children.begin();itr != Node.Children.end();itr++)
+		{
+			FindRequiredLiteral(ps,*itr,strCurrent);
+		}
+		break;
+
+	case NODE_REPEAT:
+		if(Node.iMin >= 1)
+		{
+			/* The first copy of the child directly follows
+			whatever came before it. However, when there's
+			more than one copy, the last copy of the child
+			won't. */
+			FindRequiredLiteral(ps,Node.Children.front(),strCurrent);
+
+			if(Node.iMax != 1)
+			{
+				strCurrent.clear();
+			}
+		}
+		else
+		{
+			strCurrent.clear();
+		}
+		break;
+
+	default:
+		strCurrent.clear();
+		break;
+	}
+}
+
+BOOL CRegexMatcher::MatchAutomaton(const TCHAR *szString) const
+{
+	std::vector<int> CurrentStates;
+	std::vector<int> NextStates;
+	std::vector<int> Stack;
+	std::vector<int> Generations(m_States.size(),0);
+	int iGeneration = 1;
+
+	AddToStateList(CurrentStates,m_iStartState,iGeneration,Generations,Stack);
+
+	for(const TCHAR *p = szString;*p != '\0';p++)
+	{
+		if(CurrentStates.empty())
+		{
+			return FALSE;
+		}
+
+		iGeneration++;
+		NextStates.clear();
+
+		for(auto itr = CurrentStates.begin();itr != CurrentStates.end();itr++)
+		{
+			const State_t &State = m_States[*itr];
+
+			if(State.Type != STATE_MATCH && MatchState(State,*p))
+			{
+				AddToStateList(NextStates,State.iNext,iGeneration,Generations,Stack);
+			}
+		}
+
+		CurrentStates.swap(NextStates);
+	}
+
+	for(auto itr = CurrentStates.begin();itr != CurrentStates.end();itr++)
+	{
+		if(m_States[*itr].Type == STATE_MATCH)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Adds the given state to the list, following any split
+states. Each state is only added once per generation
+(i.e. per character). */
+void CRegexMatcher::AddToStateList(std::vector<int> &StateList,int iState,int iGeneration,
+	std::vector<int> &Generations,std::vector<int> &Stack) const
+{
+	Stack.push_back(iState);
+
+	while(!Stack.empty())
+	{
+		int iCurrent = Stack.back();
+		Stack.pop_back();
+
+		if(Generations[iCurrent] == iGeneration)
+		{
+			continue;
+		}
+
+		Generations[iCurrent] = iGeneration;
+
+		if(m_States[iCurrent].Type == STATE_SPLIT)
+		{
+			Stack.push_back(m_States[iCurrent].iAlternate);
+			Stack.push_back(m_States[iCurrent].iNext);
+		}
+		else
+		{
+			StateList.push_back(iCurrent);
+		}
+	}
+}
+
+BOOL CRegexMatcher::MatchState(const State_t &State,wchar_t ch) const
+{
+	switch(State.Type)
+	{
+	case STATE_CHAR:
+		if(m_bCaseInsensitive)
+		{
+			return TranslateCase(ch) == State.ch;
+		}
+
+		return ch == State.ch;
+
+	case STATE_ANY:
+		return ch != '\n' && ch != '\r';
+
+	case STATE_CLASS:
+		return MatchClass(m_CharClasses[State.iClass],ch);
+	}
+
+	return FALSE;
+}
+
+BOOL CRegexMatcher::MatchClass(const CharClass_t &CharClass,wchar_t ch) const
+{
+	BOOL bMatch = InRanges(CharClass,ch);
+
+	if(!bMatch && m_bCaseInsensitive)
+	{
+		bMatch = InRanges(CharClass,TranslateCase(ch)) ||
+			InRanges(CharClass,towupper(ch));
+	}
+
+	for(int iBuiltin = BUILTIN_CLASS_DIGIT;!bMatch && iBuiltin <= BUILTIN_CLASS_SPACE;iBuiltin <<= 1)
+	{
+		if((CharClass.iBuiltins & iBuiltin) && MatchBuiltin(iBuiltin,ch))
+		{
+			bMatch = TRUE;
+		}
+		else if((CharClass.iNegatedBuiltins & iBuiltin) && !MatchBuiltin(iBuiltin,ch))
+		{
+			bMatch = TRUE;
+		}
+	}
+
+	if(CharClass.bNegated)
+	{
+		return !bMatch;
+	}
+
+	return bMatch;
+}
+
+BOOL CRegexMatcher::MatchBuiltin(int iBuiltin,wchar_t ch) const
+{
+	switch(iBuiltin)
+	{
+	case BUILTIN_CLASS_DIGIT:
+		return m_Traits.isctype(ch,m_DigitClass);
+
+	case BUILTIN_CLASS_WORD:
+		return m_Traits.isctype(ch,m_WordClass);
+
+	case BUILTIN_CLASS_SPACE:
+		return m_Traits.isctype(ch,m_SpaceClass);
+	}
+
+	return FALSE;
+}
+
+BOOL CRegexMatcher::InRanges(const CharClass_t &CharClass,wchar_t ch) const
+{
+	for(auto itr = CharClass.Ranges.begin();itr != CharClass.Ranges.end();itr++)
+	{
+		if(ch >= itr->first && ch <= itr->second)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+wchar_t CRegexMatcher::TranslateCase(wchar_t ch) const
+{
+	return m_Traits.translate_nocase(ch);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <regex>
+
+/* Matches whole strings against a regular expression
+(ECMAScript syntax), giving the same results as
+std::regex_match.
+
+Patterns used to search for files are usually simple,
+but are run against a very large number of names. So,
+when a pattern is compiled:
+
+- Any literal text that every match must contain is
+  extracted. Names that don't contain this text are
+  rejected with a plain substring search, before any
+  regular expression matching is done.
+- The pattern is converted to an NFA, which is then
+  simulated directly (rather than by backtracking). The
+  time taken is linear in the length of the name.
+
+Patterns that use constructs the NFA doesn't support
+(e.g. backreferences or lookahead) are matched using
+std::wregex instead. */
+class CRegexMatcher
+{
+public:
+
+	CRegexMatcher();
+
+	/* Returns FALSE if the pattern is invalid. */
+	BOOL				Compile(const TCHAR *szPattern,BOOL bCaseInsensitive);
+
+	BOOL				Match(const TCHAR *szString) const;
+
+	/* Exposed for testing. */
+	BOOL				IsUsingFallback() const;
+	const std::wstring	&GetRequiredLiteral() const;
+
+private:
+
+	/* Limits the size of the NFA that bounded
+	repeats (e.g. a{1,1000}) can expand to. */
+	static const int	MAX_STATES = 4096;
+
+	static const int	MAX_GROUP_DEPTH = 64;
+
+	enum BuiltinClass_t
+	{
+		BUILTIN_CLASS_DIGIT = 1,
+		BUILTIN_CLASS_WORD = 2,
+		BUILTIN_CLASS_SPACE = 4
+	};
+
+	struct CharClass_t
+	{
+		std::vector<std::pair<wchar_t,wchar_t>>	Ranges;
+
+		/* Combinations of BuiltinClass_t (i.e. \d, \w
+		and \s, and their negated forms \D, \W, \S). */
+		int		iBuiltins;
+		int		iNegatedBuiltins;
+
+		BOOL	bNegated;
+	};
+
+	enum NodeType_t
+	{
+		NODE_EMPTY,
+		NODE_CHAR,
+		NODE_ANY,
+		NODE_CLASS,
+		NODE_CONCAT,
+		NODE_ALTERNATE,
+		NODE_REPEAT
+	};
+
+	/* Parsed form of the pattern. Only used
+	while compiling. */
+	struct Node_t
+	{
+		NodeType_t			Type;
+		wchar_t				ch;
+		int					iClass;
+
+		/* Repeat bounds. An iMax of -1
+		indicates no upper bound. */
+		int					iMin;
+		int					iMax;
+
+		std::vector<int>	Children;
+	};
+
+	struct ParseState_t
+	{
+		const wchar_t		*pPattern;
+		size_t				nLength;
+		size_t				nPos;
+		int					iDepth;
+		std::vector<Node_t>	Nodes;
+	};
+
+	enum StateType_t
+	{
+		STATE_CHAR,
+		STATE_ANY,
+		STATE_CLASS,
+		STATE_SPLIT,
+		STATE_MATCH
+	};
+
+	struct State_t
+	{
+		StateType_t	Type;
+		wchar_t		ch;
+		int			iClass;
+		int			iNext;
+
+		/* Only used by split states. */
+		int			iAlternate;
+	};
+
+	/* Parsing. Each of these returns FALSE if the
+	pattern uses something that isn't supported. */
+	BOOL				ParseAlternation(ParseState_t &ps,int &iNode);
+	BOOL				ParseConcatenation(ParseState_t &ps,int &iNode);
+	BOOL				ParseTerm(ParseState_t &ps,int &iNode);
+	BOOL				ParseAtom(ParseState_t &ps,int &iNode);
+	BOOL				ParseQuantifier(ParseState_t &ps,int &iMin,int &iMax,BOOL &bFound);
+	BOOL				ParseClass(ParseState_t &ps,int &iNode);
+	BOOL				ParseClassAtom(ParseState_t &ps,wchar_t &ch,int &iBuiltin,BOOL &bNegatedBuiltin);
+	BOOL				ParseEscape(ParseState_t &ps,wchar_t &ch,int &iBuiltin,BOOL &bNegatedBuiltin);
+	BOOL				ParseNumber(ParseState_t &ps,int &iNumber);
+	int					AddNode(ParseState_t &ps,NodeType_t Type);
+
+	/* Compilation. */
+	BOOL				CompileNode(const ParseState_t &ps,int iNode,int iNext,int &iStart);
+	int					AddState(StateType_t Type,int iNext);
+	void				FindRequiredLiteral(const ParseState_t &ps,int iNode,std::wstring &strCurrent);
+
+	/* Matching. */
+	BOOL				MatchAutomaton(const TCHAR *szString) const;
+	void				AddToStateList(std::vector<int> &StateList,int iState,int iGeneration,
+		std::vector<int> &Generations,std::vector<int> &Stack) const;
+	BOOL				MatchState(const State_t &State,wchar_t ch) const;
+	BOOL				MatchClass(const CharClass_t &CharClass,wchar_t ch) const;
+	BOOL				MatchBuiltin(int iBuiltin,wchar_t ch) const;
+	BOOL				InRanges(const CharClass_t &CharClass,wchar_t ch) const;
+	wchar_t				TranslateCase(wchar_t ch) const;
+
+	BOOL				m_bCompiled;
+	BOOL				m_bCaseInsensitive;
+	BOOL				m_bUseFallback;
+	std::wregex			m_rxPattern;
+	std::wstring		m_strRequiredLiteral;
+
+	std::vector<State_t>		m_States;
+	std::vector<CharClass_t>	m_CharClasses;
+	int					m_iStartState;
+
+	/* Used to classify characters for \d, \w and \s, and
+	to fold case, in the same way std::wregex does. */
+	std::regex_traits<wchar_t>	m_Traits;
+	std::regex_traits<wchar_t>::char_class_type	m_DigitClass;
+	std::regex_traits<wchar_t>::char_class_type	m_WordClass;
+	std::regex_traits<wchar_t>::char_class_type	m_SpaceClass;
+};
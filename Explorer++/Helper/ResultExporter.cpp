@@ -0,0 +1,354 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: ResultExporter.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Streams search results to a CSV, TSV or JSON Lines
+ * file.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "ResultExporter.h"
+#include "TimeHelper.h"
+#include "Macros.h"
+
+
+CResultExporter::CResultExporter(Format_t Format) :
+m_Format(Format),
+m_hFile(INVALID_HANDLE_VALUE),
+m_bFailed(FALSE),
+m_nBuffered(0)
+{
+	InitializeCriticalSection(&m_cs);
+}
+
+CResultExporter::~CResultExporter()
+{
+	Close();
+
+	DeleteCriticalSection(&m_cs);
+}
+
+BOOL CResultExporter::Open(const TCHAR *szFileName)
+{
+	m_hFile = CreateFile(szFileName,GENERIC_WRITE,0,NULL,CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+
+	if(m_hFile == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	m_Buffer.resize(BUFFER_SIZE);
+	m_nBuffered = 0;
+	m_bFailed = FALSE;
+
+	switch(m_Format)
+	{
+	case FORMAT_CSV:
+	case FORMAT_TSV:
+		{
+			/* The byte order mark allows spreadsheet programs
+			to tell that the file is UTF-8. */
+			const char UTF8_BOM[] = "\xEF\xBB\xBF";
+			WriteToFile(UTF8_BOM,sizeof(UTF8_BOM) - 1);
+
+			m_strRecord.clear();
+			AppendField(_T("Path"),TRUE);
+			AppendField(_T("Size"),FALSE);
+			AppendField(_T("Created"),FALSE);
+			AppendField(_T("Modified"),FALSE);
+			AppendField(_T("Accessed"),FALSE);
+			AppendField(_T("Attributes"),FALSE);
+			m_strRecord += _T("\r\n");
+
+			Write(m_strRecord);
+		}
+		break;
+	}
+
+	return !m_bFailed;
+}
+
+BOOL CResultExporter::AddResult(const TCHAR *szFullFileName,const WIN32_FIND_DATA *pwfd)
+{
+	TCHAR szSize[32] = EMPTY_STRING;
+	TCHAR szCreated[32];
+	TCHAR szModified[32];
+	TCHAR szAccessed[32];
+	TCHAR szAttributes[16];
+
+	/* Folders don't have a size of their own. */
+	if((pwfd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != FILE_ATTRIBUTE_DIRECTORY)
+	{
+		ULARGE_INTEGER uliSize;
+		uliSize.LowPart = pwfd->nFileSizeLow;
+		uliSize.HighPart = pwfd->nFileSizeHigh;
+
+		StringCchPrintf(szSize,SIZEOF_ARRAY(szSize),_T("%I64u"),uliSize.QuadPart);
+	}
+
+	FormatFileTime(&pwfd->ftCreationTime,szCreated,SIZEOF_ARRAY(szCreated));
+	FormatFileTime(&pwfd->ftLastWriteTime,szModified,SIZEOF_ARRAY(szModified));
+	FormatFileTime(&pwfd->ftLastAccessTime,szAccessed,SIZEOF_ARRAY(szAccessed));
+	FormatAttributes(pwfd->dwFileAttributes,szAttributes,SIZEOF_ARRAY(szAttributes));
+
+	EnterCriticalSection(&m_cs);
+
+	if(m_hFile == INVALID_HANDLE_VALUE || m_bFailed)
+	{
+		LeaveCriticalSection(&m_cs);
+		return FALSE;
+	}
+
+	m_strRecord.clear();
+
+	switch(m_Format)
+	{
+	case FORMAT_CSV:
+	case FORMAT_TSV:
+		AppendField(szFullFileName,TRUE);
+		AppendField(szSize,FALSE);
+		AppendField(szCreated,FALSE);
+		AppendField(szModified,FALSE);
+		AppendField(szAccessed,FALSE);
+		AppendField(szAttributes,FALSE);
+		m_strRecord += _T("\r\n");
+		break;
+
+	case FORMAT_JSON_LINES:
+		/* Missing values are written as null. */
+		m_strRecord += _T("{");
+		AppendJsonString(_T("path"),szFullFileName);
+		m_strRecord += _T(",\"size\":");
+		m_strRecord += (lstrlen(szSize) > 0) ? szSize : _T("null");
+		m_strRecord += _T(",");
+		AppendJsonString(_T("created"),szCreated);
+		m_strRecord += _T(",");
+		AppendJsonString(_T("modified"),szModified);
+		m_strRecord += _T(",");
+		AppendJsonString(_T("accessed"),szAccessed);
+		m_strRecord += _T(",");
+		AppendJsonString(_T("attributes"),szAttributes);
+		m_strRecord += _T("}\n");
+		break;
+	}
+
+	BOOL bRet = Write(m_strRecord);
+
+	LeaveCriticalSection(&m_cs);
+
+	return bRet;
+}
+
+BOOL CResultExporter::Close()
+{
+	EnterCriticalSection(&m_cs);
+
+	BOOL bRet = !m_bFailed;
+
+	if(m_hFile != INVALID_HANDLE_VALUE)
+	{
+		bRet = Flush();
+
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return bRet;
+}
+
+void CResultExporter::AppendField(const TCHAR *szField,BOOL bFirst)
+{
+	if(!bFirst)
+	{
+		m_strRecord += (m_Format == FORMAT_CSV) ? _T(",") : _T("\t");
+	}
+
+	if(m_Format == FORMAT_TSV || _tcspbrk(szField,_T(",\"\r\n")) == NULL)
+	{
+		m_strRecord += szField;
+		return;
+	}
+
+	/* Any quotes within a quoted
+	field are doubled. */
+	m_strRecord += _T("\"");
+
+	for(const TCHAR *p = szField;*p != '\0';p++)
+	{
+		if(*p == '"')
+		{
+			m_strRecord += _T("\"");
+		}
+
+		m_strRecord += *p;
+	}
+
+	m_strRecord += _T("\"");
+}
+
+/* Empty values are written as null. */
+void CResultExporter::AppendJsonString(const TCHAR *szName,const TCHAR *szValue)
+{
+	m_strRecord += _T("\"");
+	m_strRecord += szName;
+	m_strRecord += _T("\":");
+
+	if(lstrlen(szValue) == 0)
+	{
+		m_strRecord += _T("null");
+		return;
+	}
+
+	m_strRecord += _T("\"");
+
+	for(const TCHAR *p = szValue;*p != '\0';p++)
+	{
+		switch(*p)
+		{
+		case '"':
+			m_strRecord += _T("\\\"");
+			break;
+
+		case '\\':
+			m_strRecord += _T("\\\\");
+			break;
+
+		default:
+			if(*p < 0x20)
+			{
+				TCHAR szEscape[8];
+				StringCchPrintf(szEscape,SIZEOF_ARRAY(szEscape),_T("\\u%04x"),*p);
+				m_strRecord += szEscape;
+			}
+			else
+			{
+				m_strRecord += *p;
+			}
+			break;
+		}
+	}
+
+	m_strRecord += _T("\"");
+}
+
+BOOL CResultExporter::Write(const std::wstring &strText)
+{
+	if(strText.empty())
+	{
+		return !m_bFailed;
+	}
+
+	/* Each UTF-16 unit produces at
+	most three bytes of UTF-8. */
+	size_t nMaxBytes = strText.size() * 3;
+
+	if(m_nBuffered + nMaxBytes > m_Buffer.size())
+	{
+		Flush();
+	}
+
+	if(nMaxBytes > m_Buffer.size())
+	{
+		/* Too large to buffer (which only happens
+		with very long paths). */
+		std::string strBytes(nMaxBytes,'\0');
+		int nBytes = WideCharToMultiByte(CP_UTF8,0,strText.c_str(),static_cast<int>(strText.size()),
+			&strBytes[0],static_cast<int>(nMaxBytes),NULL,NULL);
+
+		return WriteToFile(strBytes.c_str(),nBytes);
+	}
+
+	int nBytes = WideCharToMultiByte(CP_UTF8,0,strText.c_str(),static_cast<int>(strText.size()),
+		&m_Buffer[m_nBuffered],static_cast<int>(m_Buffer.size() - m_nBuffered),NULL,NULL);
+	m_nBuffered += nBytes;
+
+	return !m_bFailed;
+}
+
+BOOL CResultExporter::Flush()
+{
+	BOOL bRet = WriteToFile(m_Buffer.empty() ? NULL : &m_Buffer[0],m_nBuffered);
+	m_nBuffered = 0;
+
+	return bRet;
+}
+
+/* Once a write has failed, nothing further
+is written to the file. */
+BOOL CResultExporter::WriteToFile(const char *pData,size_t nSize)
+{
+	if(m_bFailed || nSize == 0)
+	{
+		return !m_bFailed;
+	}
+
+	DWORD nBytesWritten;
+	BOOL bRet = WriteFile(m_hFile,pData,static_cast<DWORD>(nSize),&nBytesWritten,NULL);
+
+	if(!bRet || nBytesWritten != nSize)
+	{
+		m_bFailed = TRUE;
+	}
+
+	return !m_bFailed;
+}
+
+/* Times are written in local time, as YYYY-MM-DD HH:MM:SS.
+Times that aren't set (e.g. the access time on some
+file systems) are left empty. */
+void CResultExporter::FormatFileTime(const FILETIME *pft,TCHAR *szOutput,size_t cchMax)
+{
+	StringCchCopy(szOutput,cchMax,EMPTY_STRING);
+
+	if(pft->dwLowDateTime == 0 && pft->dwHighDateTime == 0)
+	{
+		return;
+	}
+
+	FILETIME ft = *pft;
+	SYSTEMTIME st;
+
+	if(FileTimeToLocalSystemTime(&ft,&st))
+	{
+		StringCchPrintf(szOutput,cchMax,_T("%04d-%02d-%02d %02d:%02d:%02d"),
+			st.wYear,st.wMonth,st.wDay,st.wHour,st.wMinute,st.wSecond);
+	}
+}
+
+/* Uses the same letters as the attrib: search
+query term. */
+void CResultExporter::FormatAttributes(DWORD dwAttributes,TCHAR *szOutput,size_t cchMax)
+{
+	const struct
+	{
+		TCHAR	chFlag;
+		DWORD	dwAttribute;
+	} FLAGS[] = {
+		{'R',FILE_ATTRIBUTE_READONLY},
+		{'H',FILE_ATTRIBUTE_HIDDEN},
+		{'S',FILE_ATTRIBUTE_SYSTEM},
+		{'A',FILE_ATTRIBUTE_ARCHIVE},
+		{'D',FILE_ATTRIBUTE_DIRECTORY}
+	};
+
+	size_t nLength = 0;
+
+	for(int i = 0;i < SIZEOF_ARRAY(FLAGS) && nLength < cchMax - 1;i++)
+	{
+		if((dwAttributes & FLAGS[i].dwAttribute) == FLAGS[i].dwAttribute)
+		{
+			szOutput[nLength++] = FLAGS[i].chFlag;
+		}
+	}
+
+	szOutput[nLength] = '\0';
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "Macros.h"
+
+/* Writes search results (path, size, dates and
+attributes) to a file as they're found.
+
+Records are converted to UTF-8 and collected in a
+fixed size buffer, which is written out whenever it
+fills up. The memory used doesn't depend on the number
+of results.
+
+Once opened, results can be added from several threads
+at once. */
+class CResultExporter
+{
+public:
+
+	enum Format_t
+	{
+		/* Comma separated values, quoted as per RFC 4180. */
+		FORMAT_CSV,
+
+		/* Tab separated values. Tabs and newlines can't
+		appear in file names, so nothing is quoted. */
+		FORMAT_TSV,
+
+		/* One JSON object per line. */
+		FORMAT_JSON_LINES
+	};
+
+	CResultExporter(Format_t Format);
+	~CResultExporter();
+
+	/* Creates (or replaces) the file, and writes
+	any header the format has. */
+	BOOL	Open(const TCHAR *szFileName);
+
+	/* Returns FALSE once any write has failed. */
+	BOOL	AddResult(const TCHAR *szFullFileName,const WIN32_FIND_DATA *pwfd);
+
+	/* Writes out anything still buffered. Returns FALSE if
+	any part of the file couldn't be written. */
+	BOOL	Close();
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CResultExporter);
+
+	static const size_t	BUFFER_SIZE = 64 * 1024;
+
+	void		AppendField(const TCHAR *szField,BOOL bFirst);
+	void		AppendJsonString(const TCHAR *szName,const TCHAR *szValue);
+
+	BOOL		Write(const std::wstring &strText);
+	BOOL		Flush();
+	BOOL		WriteToFile(const char *pData,size_t nSize);
+
+	static void	FormatFileTime(const FILETIME *pft,TCHAR *szOutput,size_t cchMax);
+	static void	FormatAttributes(DWORD dwAttributes,TCHAR *szOutput,size_t cchMax);
+
+	Format_t			m_Format;
+	HANDLE				m_hFile;
+	BOOL				m_bFailed;
+
+	CRITICAL_SECTION	m_cs;
+
+	/* Reused for each record, so that no memory is
+	allocated once the first few have been written. */
+	std::wstring		m_strRecord;
+
+	std::vector<char>	m_Buffer;
+	size_t				m_nBuffered;
+};
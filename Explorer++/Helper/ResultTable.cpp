@@ -0,0 +1,285 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: ResultTable.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Holds a set of search results, and narrows them down
+ * in place.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "ResultTable.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+
+void	RefineRangeProc(LPVOID pParam,int iItem);
+
+void CResultTable::GetItemInfo(const WIN32_FIND_DATA *pwfd,ItemInfo_t &Info)
+{
+	ULARGE_INTEGER uliSize;
+	uliSize.LowPart = pwfd->nFileSizeLow;
+	uliSize.HighPart = pwfd->nFileSizeHigh;
+
+	Info.ulSize = uliSize.QuadPart;
+	Info.ftLastWriteTime = pwfd->ftLastWriteTime;
+	Info.dwAttributes = pwfd->dwFileAttributes;
+}
+
+CResultTable::CResultTable()
+{
+
+}
+
+void CResultTable::SetBaseDirectory(const TCHAR *szBaseDirectory)
+{
+	m_strBaseDirectory = szBaseDirectory;
+
+	/* The base directory is compared against the
+	start of each path, up to the separator. */
+	if(!m_strBaseDirectory.empty() &&
+		m_strBaseDirectory[m_strBaseDirectory.size() - 1] != '\\')
+	{
+		m_strBaseDirectory += _T("\\");
+	}
+}
+
+int CResultTable::AddRow(const TCHAR *szFullFileName,const ItemInfo_t &Info)
+{
+	size_t nLength = lstrlen(szFullFileName) + 1;
+
+	if(m_Blocks.empty() ||
+		m_Blocks.back().size() + nLength > m_Blocks.back().capacity())
+	{
+		m_Blocks.push_back(std::vector<TCHAR>());
+		m_Blocks.back().reserve(max(BLOCK_SIZE,nLength));
+	}
+
+	/* The block has already been reserved, so
+	this won't move any existing strings. */
+	std::vector<TCHAR> &Block = m_Blocks.back();
+	size_t nOffset = Block.size();
+	Block.insert(Block.end(),szFullFileName,szFullFileName + nLength);
+
+	Row_t Row;
+	Row.pszFullFileName = &Block[nOffset];
+	Row.pszFileName = PathFindFileName(Row.pszFullFileName);
+	Row.Info = Info;
+	m_Rows.push_back(Row);
+
+	return static_cast<int>(m_Rows.size()) - 1;
+}
+
+int CResultTable::GetRowCount() const
+{
+	return static_cast<int>(m_Rows.size());
+}
+
+const TCHAR *CResultTable::GetFullFileName(int iRow) const
+{
+	return m_Rows[iRow].pszFullFileName;
+}
+
+const TCHAR *CResultTable::GetFileName(int iRow) const
+{
+	return m_Rows[iRow].pszFileName;
+}
+
+int CResultTable::GetCurrentRowCount() const
+{
+	if(m_Refinements.empty())
+	{
+		return static_cast<int>(m_Rows.size());
+	}
+
+	return static_cast<int>(m_Refinements.back().size());
+}
+
+int CResultTable::GetCurrentRow(int iIndex) const
+{
+	if(m_Refinements.empty())
+	{
+		return iIndex;
+	}
+
+	return m_Refinements.back()[iIndex];
+}
+
+void CResultTable::Refine(const CSearchQuery &Query,int nThreads)
+{
+	int nRows = GetCurrentRowCount();
+
+	if(nThreads <= 0)
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		nThreads = static_cast<int>(si.dwNumberOfProcessors);
+	}
+
+	nThreads = max(1,min(nThreads,MAX_REFINE_THREADS));
+	nThreads = max(1,min(nThreads,nRows / MIN_ROWS_PER_THREAD));
+
+	/* Each thread takes a contiguous range of the
+	current rows, so joining the ranges back up in
+	order keeps the rows in their original order. */
+	std::vector<RefineRange_t> Ranges(nThreads);
+
+	for(int i = 0;i < nThreads;i++)
+	{
+		Ranges[i].pResultTable = this;
+		Ranges[i].pQuery = &Query;
+		Ranges[i].iStart = static_cast<int>((static_cast<LONGLONG>(nRows) * i) / nThreads);
+		Ranges[i].iEnd = static_cast<int>((static_cast<LONGLONG>(nRows) * (i + 1)) / nThreads);
+	}
+
+	/* The user is waiting on the refinement, so the
+	ranges are run at high priority. Any range the pool
+	doesn't get to is filtered on the current thread. */
+	RunInParallel(RefineRangeProc,reinterpret_cast<LPVOID>(&Ranges),nThreads,
+		nThreads - 1,THREAD_POOL_PRIORITY_HIGH);
+
+	size_t nMatches = 0;
+
+	for(auto itr = Ranges.begin();itr != Ranges.end();itr++)
+	{
+		nMatches += itr->Matches.size();
+	}
+
+	std::vector<int> Refinement;
+	Refinement.reserve(nMatches);
+
+	for(auto itr = Ranges.begin();itr != Ranges.end();itr++)
+	{
+		Refinement.insert(Refinement.end(),itr->Matches.begin(),itr->Matches.end());
+	}
+
+	m_Refinements.push_back(std::vector<int>());
+	m_Refinements.back().swap(Refinement);
+}
+
+void RefineRangeProc(LPVOID pParam,int iItem)
+{
+	assert(pParam != NULL);
+
+	std::vector<CResultTable::RefineRange_t> *pRanges =
+		reinterpret_cast<std::vector<CResultTable::RefineRange_t> *>(pParam);
+
+	CResultTable::RefineRange_t &Range = (*pRanges)[iItem];
+	Range.pResultTable->RefineRange(Range);
+}
+
+void CResultTable::RefineRange(RefineRange_t &Range) const
+{
+	/* Rows from the same directory are usually next to each
+	other, so the context for the last directory is kept. */
+	const TCHAR *pszLastDirectory = NULL;
+	size_t nLastDirectoryLength = 0;
+	CSearchQuery::DirectoryContext_t Context;
+
+	WIN32_FIND_DATA wfd = {0};
+
+	for(int i = Range.iStart;i < Range.iEnd;i++)
+	{
+		int iRow = GetCurrentRow(i);
+		const Row_t &Row = m_Rows[iRow];
+
+		size_t nDirectoryLength = Row.pszFileName - Row.pszFullFileName;
+
+		if(pszLastDirectory == NULL || nDirectoryLength != nLastDirectoryLength ||
+			memcmp(Row.pszFullFileName,pszLastDirectory,nDirectoryLength * sizeof(TCHAR)) != 0)
+		{
+			GetDirectoryContext(Row,*Range.pQuery,Context);
+
+			pszLastDirectory = Row.pszFullFileName;
+			nLastDirectoryLength = nDirectoryLength;
+		}
+
+		ULARGE_INTEGER uliSize;
+		uliSize.QuadPart = Row.Info.ulSize;
+
+		StringCchCopy(wfd.cFileName,SIZEOF_ARRAY(wfd.cFileName),Row.pszFileName);
+		wfd.dwFileAttributes = Row.Info.dwAttributes;
+		wfd.nFileSizeLow = uliSize.LowPart;
+		wfd.nFileSizeHigh = uliSize.HighPart;
+		wfd.ftLastWriteTime = Row.Info.ftLastWriteTime;
+
+		if(Range.pQuery->Evaluate(&wfd,Context))
+		{
+			Range.Matches.push_back(iRow);
+		}
+	}
+}
+
+/* Walks the folders between the base directory and
+the row, in the same way the search itself does. Rows
+that aren't below the base directory are treated as
+being directly within it. */
+void CResultTable::GetDirectoryContext(const Row_t &Row,const CSearchQuery &Query,
+	CSearchQuery::DirectoryContext_t &Context) const
+{
+	Query.GetBaseContext(Context);
+
+	size_t nBaseLength = m_strBaseDirectory.size();
+	size_t nDirectoryLength = Row.pszFileName - Row.pszFullFileName;
+
+	if(nBaseLength == 0 || nDirectoryLength <= nBaseLength ||
+		CompareString(LOCALE_INVARIANT,NORM_IGNORECASE,Row.pszFullFileName,static_cast<int>(nBaseLength),
+		m_strBaseDirectory.c_str(),static_cast<int>(nBaseLength)) != CSTR_EQUAL)
+	{
+		return;
+	}
+
+	/* Everything between the base directory and the
+	file name, without the trailing separator. */
+	std::wstring strFolders(Row.pszFullFileName + nBaseLength,
+		nDirectoryLength - nBaseLength - 1);
+
+	size_t nStart = 0;
+
+	while(nStart <= strFolders.size())
+	{
+		size_t nEnd = strFolders.find('\\',nStart);
+
+		if(nEnd == std::wstring::npos)
+		{
+			nEnd = strFolders.size();
+		}
+
+		std::wstring strFolder = strFolders.substr(nStart,nEnd - nStart);
+
+		CSearchQuery::DirectoryContext_t Child;
+		Query.GetChildContext(Context,strFolder.c_str(),Child);
+		Context = Child;
+
+		nStart = nEnd + 1;
+	}
+}
+
+BOOL CResultTable::Undo()
+{
+	if(m_Refinements.empty())
+	{
+		return FALSE;
+	}
+
+	m_Refinements.pop_back();
+
+	return TRUE;
+}
+
+int CResultTable::GetRefinementCount() const
+{
+	return static_cast<int>(m_Refinements.size());
+}
+
+void CResultTable::Clear()
+{
+	m_Rows.clear();
+	m_Blocks.clear();
+	m_Refinements.clear();
+}
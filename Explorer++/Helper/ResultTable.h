@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <string>
+#include "SearchQuery.h"
+#include "Macros.h"
+
+/* Holds a completed set of search results in memory,
+so that the set can be narrowed down further without
+searching the disk again.
+
+Each refinement filters the rows left by the previous
+one, and is kept on a stack, so that refinements can be
+undone in turn. A refinement only stores the indices of
+the rows it kept, so undoing one is immediate. */
+class CResultTable
+{
+public:
+
+	/* The details of an item that a
+	refinement can check. */
+	struct ItemInfo_t
+	{
+		ULONGLONG	ulSize;
+		FILETIME	ftLastWriteTime;
+		DWORD		dwAttributes;
+	};
+
+	static void	GetItemInfo(const WIN32_FIND_DATA *pwfd,ItemInfo_t &Info);
+
+	CResultTable();
+
+	/* in: and depth: terms are relative to
+	the base directory. */
+	void		SetBaseDirectory(const TCHAR *szBaseDirectory);
+
+	/* Rows added while a refinement is in place won't
+	be shown until every refinement has been undone. */
+	int			AddRow(const TCHAR *szFullFileName,const ItemInfo_t &Info);
+	int			GetRowCount() const;
+
+	/* The returned strings remain valid until
+	the table is cleared. */
+	const TCHAR	*GetFullFileName(int iRow) const;
+	const TCHAR	*GetFileName(int iRow) const;
+
+	/* The rows left after every refinement, in
+	the order they were added. */
+	int			GetCurrentRowCount() const;
+	int			GetCurrentRow(int iIndex) const;
+
+	/* Keeps only the current rows that match the query.
+	The rows are split into nThreads ranges (0 uses one
+	per processor), which are filtered on the calling
+	thread and the shared thread pool. */
+	void		Refine(const CSearchQuery &Query,int nThreads);
+
+	/* Returns FALSE if there's nothing to undo. */
+	BOOL		Undo();
+	int			GetRefinementCount() const;
+
+	void		Clear();
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CResultTable);
+
+	static const int	MAX_REFINE_THREADS = 16;
+
+	/* Tables smaller than this aren't worth
+	splitting between threads. */
+	static const int	MIN_ROWS_PER_THREAD = 4096;
+
+	/* Paths are stored back to back in blocks of (at
+	least) this many characters. A block is never
+	reallocated, so pointers into it stay valid. */
+	static const size_t	BLOCK_SIZE = 65536;
+
+	struct Row_t
+	{
+		const TCHAR	*pszFullFileName;
+		const TCHAR	*pszFileName;
+		ItemInfo_t	Info;
+	};
+
+	struct RefineRange_t
+	{
+		const CResultTable	*pResultTable;
+		const CSearchQuery	*pQuery;
+		int					iStart;
+		int					iEnd;
+		std::vector<int>	Matches;
+	};
+
+	friend void	RefineRangeProc(LPVOID pParam,int iItem);
+
+	void		RefineRange(RefineRange_t &Range) const;
+	void		GetDirectoryContext(const Row_t &Row,const CSearchQuery &Query,
+		CSearchQuery::DirectoryContext_t &Context) const;
+
+	std::wstring					m_strBaseDirectory;
+
+	std::vector<Row_t>				m_Rows;
+	std::list<std::vector<TCHAR> >	m_Blocks;
+
+	/* The rows kept by each refinement, with
+	the most recent at the back. */
+	std::vector<std::vector<int> >	m_Refinements;
+};
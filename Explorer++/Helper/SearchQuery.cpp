@@ -0,0 +1,796 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: SearchQuery.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Parses and evaluates search queries (name, size, date
+ * and attribute terms, combined with AND/OR/NOT).
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <limits.h>
+#include "SearchQuery.h"
+#include "TimeHelper.h"
+#include "Macros.h"
+
+
+namespace
+{
+	/* The number of 100-nanosecond
+	intervals in a day. */
+	const ULONGLONG	FILETIME_DAY = 24ULL * 60 * 60 * 10000000;
+}
+
+CSearchQuery::CSearchQuery() :
+m_iRoot(-1),
+m_nInTerms(0),
+m_nPosition(0)
+{
+
+}
+
+BOOL CSearchQuery::Parse(const TCHAR *szQuery)
+{
+	m_Nodes.clear();
+	m_iRoot = -1;
+	m_nInTerms = 0;
+
+	m_Tokens.clear();
+	m_nPosition = 0;
+
+	BOOL bSuccess = Tokenize(szQuery,m_Tokens);
+
+	if(bSuccess && !m_Tokens.empty())
+	{
+		m_iRoot = ParseOr(0);
+
+		/* Anything left over (e.g. an unmatched closing
+		parenthesis) means the query is invalid. */
+		bSuccess = (m_iRoot != -1 && m_nPosition == m_Tokens.size());
+	}
+
+	if(!bSuccess)
+	{
+		m_Nodes.clear();
+		m_iRoot = -1;
+		m_nInTerms = 0;
+	}
+
+	m_Tokens.clear();
+
+	return bSuccess;
+}
+
+BOOL CSearchQuery::IsEmpty() const
+{
+	return m_iRoot == -1;
+}
+
+/* Tokens are separated by whitespace. Parentheses are
+always tokens on their own, unless they're quoted. */
+BOOL CSearchQuery::Tokenize(const TCHAR *szQuery,std::vector<Token_t> &Tokens)
+{
+	const TCHAR *p = szQuery;
+
+	while(*p != '\0')
+	{
+		if(_istspace(*p))
+		{
+			p++;
+			continue;
+		}
+
+		Token_t Token;
+		Token.bQuoted = FALSE;
+
+		if(*p == '(' || *p == ')')
+		{
+			Token.strText = *p;
+			Tokens.push_back(Token);
+
+			p++;
+			continue;
+		}
+
+		BOOL bInQuotes = FALSE;
+
+		while(*p != '\0' && (bInQuotes || (!_istspace(*p) && *p != '(' && *p != ')')))
+		{
+			if(*p == '"')
+			{
+				bInQuotes = !bInQuotes;
+				Token.bQuoted = TRUE;
+			}
+			else
+			{
+				Token.strText += *p;
+			}
+
+			p++;
+		}
+
+		if(bInQuotes)
+		{
+			return FALSE;
+		}
+
+		Tokens.push_back(Token);
+	}
+
+	return TRUE;
+}
+
+int CSearchQuery::ParseOr(int iDepth)
+{
+	if(iDepth > MAX_NESTING_DEPTH)
+	{
+		return -1;
+	}
+
+	int iLeft = ParseAnd(iDepth);
+
+	while(iLeft != -1 && IsKeyword(_T("OR")))
+	{
+		m_nPosition++;
+
+		int iRight = ParseAnd(iDepth);
+
+		if(iRight == -1)
+		{
+			return -1;
+		}
+
+		Node_t Node;
+		Node.Type = NODE_OR;
+		Node.iLeft = iLeft;
+		Node.iRight = iRight;
+		iLeft = AddNode(Node);
+	}
+
+	return iLeft;
+}
+
+/* Terms that simply follow each other are ANDed,
+so the AND keyword itself is optional. */
+int CSearchQuery::ParseAnd(int iDepth)
+{
+	int iLeft = ParseNot(iDepth);
+
+	while(iLeft != -1 && m_nPosition < m_Tokens.size() &&
+		!IsKeyword(_T("OR")) && !IsKeyword(_T(")")))
+	{
+		if(IsKeyword(_T("AND")))
+		{
+			m_nPosition++;
+		}
+
+		int iRight = ParseNot(iDepth);
+
+		if(iRight == -1)
+		{
+			return -1;
+		}
+
+		Node_t Node;
+		Node.Type = NODE_AND;
+		Node.iLeft = iLeft;
+		Node.iRight = iRight;
+		iLeft = AddNode(Node);
+	}
+
+	return iLeft;
+}
+
+int CSearchQuery::ParseNot(int iDepth)
+{
+	if(iDepth > MAX_NESTING_DEPTH || m_nPosition >= m_Tokens.size())
+	{
+		return -1;
+	}
+
+	if(IsKeyword(_T("NOT")))
+	{
+		m_nPosition++;
+
+		int iOperand = ParseNot(iDepth + 1);
+
+		if(iOperand == -1)
+		{
+			return -1;
+		}
+
+		Node_t Node;
+		Node.Type = NODE_NOT;
+		Node.iLeft = iOperand;
+		Node.iRight = -1;
+		return AddNode(Node);
+	}
+
+	if(IsKeyword(_T("(")))
+	{
+		m_nPosition++;
+
+		int iInner = ParseOr(iDepth + 1);
+
+		if(iInner == -1 || !IsKeyword(_T(")")))
+		{
+			return -1;
+		}
+
+		m_nPosition++;
+
+		return iInner;
+	}
+
+	if(IsKeyword(_T(")")) || IsKeyword(_T("AND")) || IsKeyword(_T("OR")))
+	{
+		return -1;
+	}
+
+	return ParseTerm(m_Tokens[m_nPosition++]);
+}
+
+int CSearchQuery::ParseTerm(const Token_t &Token)
+{
+	Node_t Node;
+	Node.iLeft = -1;
+	Node.iRight = -1;
+	Node.ulMin = 0;
+	Node.ulMax = ULLONG_MAX;
+	Node.dwMask = 0;
+	Node.dwValue = 0;
+	Node.iInIndex = -1;
+
+	if(Token.strText.empty())
+	{
+		return -1;
+	}
+
+	size_t nColon = Token.strText.find(':');
+
+	if(nColon == std::wstring::npos)
+	{
+		Node.Type = NODE_NAME;
+		Node.WildcardMatcher = CWildcardMatcher(GetNamePatterns(Token.strText).c_str(),FALSE);
+		return AddNode(Node);
+	}
+
+	std::wstring strKey = Token.strText.substr(0,nColon);
+	std::wstring strValue = Token.strText.substr(nColon + 1);
+
+	if(strValue.empty())
+	{
+		return -1;
+	}
+
+	BOOL bValid = TRUE;
+
+	if(lstrcmpi(strKey.c_str(),_T("name")) == 0)
+	{
+		Node.Type = NODE_NAME;
+		Node.WildcardMatcher = CWildcardMatcher(GetNamePatterns(strValue).c_str(),FALSE);
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("size")) == 0)
+	{
+		Node.Type = NODE_SIZE;
+		bValid = ParseRange(strValue,ParseSize,Node.ulMin,Node.ulMax);
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("modified")) == 0)
+	{
+		Node.Type = NODE_MODIFIED;
+		bValid = ParseRange(strValue,ParseDate,Node.ulMin,Node.ulMax);
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("attrib")) == 0)
+	{
+		Node.Type = NODE_ATTRIBUTES;
+		bValid = ParseAttributes(strValue,Node.dwMask);
+		Node.dwValue = Node.dwMask;
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("type")) == 0)
+	{
+		Node.Type = NODE_ATTRIBUTES;
+		Node.dwMask = FILE_ATTRIBUTE_DIRECTORY;
+
+		if(lstrcmpi(strValue.c_str(),_T("file")) == 0)
+		{
+			Node.dwValue = 0;
+		}
+		else if(lstrcmpi(strValue.c_str(),_T("folder")) == 0)
+		{
+			Node.dwValue = FILE_ATTRIBUTE_DIRECTORY;
+		}
+		else
+		{
+			bValid = FALSE;
+		}
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("in")) == 0)
+	{
+		Node.Type = NODE_IN;
+		Node.WildcardMatcher = CWildcardMatcher(strValue.c_str(),FALSE);
+		Node.iInIndex = m_nInTerms++;
+	}
+	else if(lstrcmpi(strKey.c_str(),_T("depth")) == 0)
+	{
+		Node.Type = NODE_DEPTH;
+		bValid = ParseRange(strValue,ParseNumber,Node.ulMin,Node.ulMax);
+	}
+	else
+	{
+		bValid = FALSE;
+	}
+
+	if(!bValid)
+	{
+		return -1;
+	}
+
+	return AddNode(Node);
+}
+
+/* Quoted tokens are never treated as keywords, so that
+(for example) a file named "and" can be searched for. */
+BOOL CSearchQuery::IsKeyword(const TCHAR *szKeyword) const
+{
+	if(m_nPosition >= m_Tokens.size())
+	{
+		return FALSE;
+	}
+
+	const Token_t &Token = m_Tokens[m_nPosition];
+
+	return !Token.bQuoted && lstrcmpi(Token.strText.c_str(),szKeyword) == 0;
+}
+
+int CSearchQuery::AddNode(const Node_t &Node)
+{
+	m_Nodes.push_back(Node);
+	return static_cast<int>(m_Nodes.size() - 1);
+}
+
+/* Each value covers a range of its own (e.g. a date
+covers a whole day), which determines where the bounds
+of a comparison fall. */
+BOOL CSearchQuery::ParseRange(const std::wstring &strRange,ParseValueProc_t pParseValue,
+	ULONGLONG &ulMin,ULONGLONG &ulMax)
+{
+	ULONGLONG ulLow;
+	ULONGLONG ulHigh;
+
+	ulMin = 0;
+	ulMax = ULLONG_MAX;
+
+	if(strRange.compare(0,2,_T(">=")) == 0)
+	{
+		if(!pParseValue(strRange.substr(2),ulLow,ulHigh))
+		{
+			return FALSE;
+		}
+
+		ulMin = ulLow;
+	}
+	else if(strRange.compare(0,2,_T("<=")) == 0)
+	{
+		if(!pParseValue(strRange.substr(2),ulLow,ulHigh))
+		{
+			return FALSE;
+		}
+
+		ulMax = ulHigh;
+	}
+	else if(strRange[0] == '>')
+	{
+		if(!pParseValue(strRange.substr(1),ulLow,ulHigh) || ulHigh == ULLONG_MAX)
+		{
+			return FALSE;
+		}
+
+		ulMin = ulHigh + 1;
+	}
+	else if(strRange[0] == '<')
+	{
+		if(!pParseValue(strRange.substr(1),ulLow,ulHigh) || ulLow == 0)
+		{
+			return FALSE;
+		}
+
+		ulMax = ulLow - 1;
+	}
+	else if(strRange[0] == '=')
+	{
+		if(!pParseValue(strRange.substr(1),ulMin,ulMax))
+		{
+			return FALSE;
+		}
+	}
+	else
+	{
+		size_t nSeparator = strRange.find(_T(".."));
+
+		if(nSeparator == std::wstring::npos)
+		{
+			return pParseValue(strRange,ulMin,ulMax);
+		}
+
+		std::wstring strLow = strRange.substr(0,nSeparator);
+		std::wstring strHigh = strRange.substr(nSeparator + 2);
+
+		if(strLow.empty() && strHigh.empty())
+		{
+			return FALSE;
+		}
+
+		if(!strLow.empty() && !pParseValue(strLow,ulMin,ulHigh))
+		{
+			return FALSE;
+		}
+
+		if(!strHigh.empty() && !pParseValue(strHigh,ulLow,ulMax))
+		{
+			return FALSE;
+		}
+
+		if(ulMin > ulMax)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+BOOL CSearchQuery::ParseNumber(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh)
+{
+	if(strValue.empty())
+	{
+		return FALSE;
+	}
+
+	ULONGLONG ulValue = 0;
+
+	for(auto itr = strValue.begin();itr != strValue.end();itr++)
+	{
+		if(*itr < '0' || *itr > '9')
+		{
+			return FALSE;
+		}
+
+		ULONGLONG ulDigit = *itr - '0';
+
+		if(ulValue > (ULLONG_MAX - ulDigit) / 10)
+		{
+			return FALSE;
+		}
+
+		ulValue = ulValue * 10 + ulDigit;
+	}
+
+	ulLow = ulValue;
+	ulHigh = ulValue;
+
+	return TRUE;
+}
+
+BOOL CSearchQuery::ParseSize(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh)
+{
+	const struct
+	{
+		const TCHAR	*szUnit;
+		ULONGLONG	ulMultiplier;
+	} UNITS[] = {
+		{_T("B"),1ULL},
+		{_T("KB"),1024ULL},
+		{_T("MB"),1024ULL * 1024},
+		{_T("GB"),1024ULL * 1024 * 1024},
+		{_T("TB"),1024ULL * 1024 * 1024 * 1024}
+	};
+
+	size_t nDigits = strValue.find_first_not_of(_T("0123456789"));
+
+	if(nDigits == std::wstring::npos)
+	{
+		return ParseNumber(strValue,ulLow,ulHigh);
+	}
+
+	std::wstring strUnit = strValue.substr(nDigits);
+	ULONGLONG ulMultiplier = 0;
+
+	for(int i = 0;i < SIZEOF_ARRAY(UNITS);i++)
+	{
+		if(lstrcmpi(strUnit.c_str(),UNITS[i].szUnit) == 0)
+		{
+			ulMultiplier = UNITS[i].ulMultiplier;
+			break;
+		}
+	}
+
+	ULONGLONG ulValue;
+
+	if(ulMultiplier == 0 || !ParseNumber(strValue.substr(0,nDigits),ulValue,ulValue))
+	{
+		return FALSE;
+	}
+
+	if(ulValue > ULLONG_MAX / ulMultiplier)
+	{
+		return FALSE;
+	}
+
+	ulLow = ulValue * ulMultiplier;
+	ulHigh = ulLow;
+
+	return TRUE;
+}
+
+/* Dates are in the form YYYY-MM-DD, and cover
+the whole (local) day. */
+BOOL CSearchQuery::ParseDate(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh)
+{
+	if(strValue.size() != 10 || strValue[4] != '-' || strValue[7] != '-')
+	{
+		return FALSE;
+	}
+
+	ULONGLONG ulYear;
+	ULONGLONG ulMonth;
+	ULONGLONG ulDay;
+	ULONGLONG ulUnused;
+
+	if(!ParseNumber(strValue.substr(0,4),ulYear,ulUnused) ||
+		!ParseNumber(strValue.substr(5,2),ulMonth,ulUnused) ||
+		!ParseNumber(strValue.substr(8,2),ulDay,ulUnused))
+	{
+		return FALSE;
+	}
+
+	SYSTEMTIME st = {0};
+	st.wYear = static_cast<WORD>(ulYear);
+	st.wMonth = static_cast<WORD>(ulMonth);
+	st.wDay = static_cast<WORD>(ulDay);
+
+	/* Also rejects dates that don't exist
+	(e.g. the 30th of February). */
+	FILETIME ft;
+
+	if(!LocalSystemTimeToFileTime(&st,&ft))
+	{
+		return FALSE;
+	}
+
+	ULARGE_INTEGER uli;
+	uli.LowPart = ft.dwLowDateTime;
+	uli.HighPart = ft.dwHighDateTime;
+
+	ulLow = uli.QuadPart;
+	ulHigh = uli.QuadPart + FILETIME_DAY - 1;
+
+	return TRUE;
+}
+
+BOOL CSearchQuery::ParseAttributes(const std::wstring &strValue,DWORD &dwAttributes)
+{
+	const struct
+	{
+		TCHAR	chFlag;
+		DWORD	dwAttribute;
+	} FLAGS[] = {
+		{'R',FILE_ATTRIBUTE_READONLY},
+		{'H',FILE_ATTRIBUTE_HIDDEN},
+		{'S',FILE_ATTRIBUTE_SYSTEM},
+		{'A',FILE_ATTRIBUTE_ARCHIVE},
+		{'D',FILE_ATTRIBUTE_DIRECTORY}
+	};
+
+	dwAttributes = 0;
+
+	for(auto itr = strValue.begin();itr != strValue.end();itr++)
+	{
+		DWORD dwAttribute = 0;
+
+		for(int i = 0;i < SIZEOF_ARRAY(FLAGS);i++)
+		{
+			if(_totupper(*itr) == FLAGS[i].chFlag)
+			{
+				dwAttribute = FLAGS[i].dwAttribute;
+				break;
+			}
+		}
+
+		if(dwAttribute == 0)
+		{
+			return FALSE;
+		}
+
+		dwAttributes |= dwAttribute;
+	}
+
+	return TRUE;
+}
+
+/* Uses the same rule as the filename box in the search
+dialog: '???' is searched for as '*???*'. */
+std::wstring CSearchQuery::GetNamePatterns(const std::wstring &strValue)
+{
+	if(strValue[0] != '*' && strValue[strValue.size() - 1] != '*')
+	{
+		return _T("*") + strValue + _T("*");
+	}
+
+	return strValue;
+}
+
+void CSearchQuery::GetBaseContext(DirectoryContext_t &Context) const
+{
+	Context.iDepth = 1;
+	Context.InMatches.assign(m_nInTerms,FALSE);
+}
+
+void CSearchQuery::GetChildContext(const DirectoryContext_t &Parent,const TCHAR *szFolderName,
+	DirectoryContext_t &Child) const
+{
+	Child.iDepth = Parent.iDepth + 1;
+	Child.InMatches = Parent.InMatches;
+
+	for(auto itr = m_Nodes.begin();itr != m_Nodes.end();itr++)
+	{
+		if(itr->Type == NODE_IN && !Child.InMatches[itr->iInIndex] &&
+			itr->WildcardMatcher.Match(szFolderName))
+		{
+			Child.InMatches[itr->iInIndex] = TRUE;
+		}
+	}
+}
+
+BOOL CSearchQuery::Evaluate(const WIN32_FIND_DATA *pwfd,const DirectoryContext_t &Context) const
+{
+	if(m_iRoot == -1)
+	{
+		return TRUE;
+	}
+
+	return EvaluateNode(m_iRoot,pwfd,Context);
+}
+
+BOOL CSearchQuery::EvaluateNode(int iNode,const WIN32_FIND_DATA *pwfd,const DirectoryContext_t &Context) const
+{
+	const Node_t &Node = m_Nodes[iNode];
+
+	switch(Node.Type)
+	{
+	case NODE_AND:
+		return EvaluateNode(Node.iLeft,pwfd,Context) && EvaluateNode(Node.iRight,pwfd,Context);
+
+	case NODE_OR:
+		return EvaluateNode(Node.iLeft,pwfd,Context) || EvaluateNode(Node.iRight,pwfd,Context);
+
+	case NODE_NOT:
+		return !EvaluateNode(Node.iLeft,pwfd,Context);
+
+	case NODE_NAME:
+		return Node.WildcardMatcher.Match(pwfd->cFileName);
+
+	case NODE_SIZE:
+		{
+			/* Folders don't have a size of their own. */
+			if((pwfd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+			{
+				return FALSE;
+			}
+
+			ULARGE_INTEGER uliSize;
+			uliSize.LowPart = pwfd->nFileSizeLow;
+			uliSize.HighPart = pwfd->nFileSizeHigh;
+
+			return uliSize.QuadPart >= Node.ulMin && uliSize.QuadPart <= Node.ulMax;
+		}
+
+	case NODE_MODIFIED:
+		{
+			ULARGE_INTEGER uliModified;
+			uliModified.LowPart = pwfd->ftLastWriteTime.dwLowDateTime;
+			uliModified.HighPart = pwfd->ftLastWriteTime.dwHighDateTime;
+
+			return uliModified.QuadPart >= Node.ulMin && uliModified.QuadPart <= Node.ulMax;
+		}
+
+	case NODE_ATTRIBUTES:
+		return (pwfd->dwFileAttributes & Node.dwMask) == Node.dwValue;
+
+	case NODE_IN:
+		return Context.InMatches[Node.iInIndex];
+
+	case NODE_DEPTH:
+		return static_cast<ULONGLONG>(Context.iDepth) >= Node.ulMin &&
+			static_cast<ULONGLONG>(Context.iDepth) <= Node.ulMax;
+	}
+
+	return FALSE;
+}
+
+BOOL CSearchQuery::CanMatchWithin(const DirectoryContext_t &Context) const
+{
+	if(m_iRoot == -1)
+	{
+		return TRUE;
+	}
+
+	return EvaluateNodeWithin(m_iRoot,Context) != TRUTH_FALSE;
+}
+
+/* Works out whether a node is true for every item in
+the directory and below it, false for every such item,
+or varies between them. in: terms can only go from false
+to true further down the tree, and depth only
+increases. */
+CSearchQuery::Truth_t CSearchQuery::EvaluateNodeWithin(int iNode,const DirectoryContext_t &Context) const
+{
+	const Node_t &Node = m_Nodes[iNode];
+
+	switch(Node.Type)
+	{
+	case NODE_AND:
+		{
+			Truth_t Left = EvaluateNodeWithin(Node.iLeft,Context);
+			Truth_t Right = EvaluateNodeWithin(Node.iRight,Context);
+
+			if(Left == TRUTH_FALSE || Right == TRUTH_FALSE)
+			{
+				return TRUTH_FALSE;
+			}
+
+			return (Left == TRUTH_TRUE && Right == TRUTH_TRUE) ? TRUTH_TRUE : TRUTH_UNKNOWN;
+		}
+
+	case NODE_OR:
+		{
+			Truth_t Left = EvaluateNodeWithin(Node.iLeft,Context);
+			Truth_t Right = EvaluateNodeWithin(Node.iRight,Context);
+
+			if(Left == TRUTH_TRUE || Right == TRUTH_TRUE)
+			{
+				return TRUTH_TRUE;
+			}
+
+			return (Left == TRUTH_FALSE && Right == TRUTH_FALSE) ? TRUTH_FALSE : TRUTH_UNKNOWN;
+		}
+
+	case NODE_NOT:
+		switch(EvaluateNodeWithin(Node.iLeft,Context))
+		{
+		case TRUTH_FALSE:
+			return TRUTH_TRUE;
+
+		case TRUTH_TRUE:
+			return TRUTH_FALSE;
+		}
+		return TRUTH_UNKNOWN;
+
+	case NODE_IN:
+		return Context.InMatches[Node.iInIndex] ? TRUTH_TRUE : TRUTH_UNKNOWN;
+
+	case NODE_DEPTH:
+		{
+			ULONGLONG ulDepth = static_cast<ULONGLONG>(Context.iDepth);
+
+			if(ulDepth > Node.ulMax)
+			{
+				return TRUTH_FALSE;
+			}
+
+			if(ulDepth >= Node.ulMin && Node.ulMax == ULLONG_MAX)
+			{
+				return TRUTH_TRUE;
+			}
+		}
+		return TRUTH_UNKNOWN;
+	}
+
+	/* Every other term depends on the
+	item itself. */
+	return TRUTH_UNKNOWN;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "WildcardMatcher.h"
+
+/* A compiled search query, evaluated directly against
+the WIN32_FIND_DATA returned while enumerating a
+directory (so no further file system calls are needed).
+
+A query is a list of terms, which are implicitly ANDed
+together. Terms can be combined with AND, OR and NOT
+(case insensitive), and grouped with parentheses. NOT
+binds tightest, followed by AND, then OR. For example:
+
+  size:>10MB (name:*.log OR name:*.txt) NOT attrib:H
+
+Each term is one of:
+
+- name:<patterns>  The name matches the wildcard pattern
+                   list. As with the filename box in the
+                   search dialog, a pattern that neither
+                   starts nor ends with * matches anywhere
+                   in the name. A term with no prefix is
+                   a name term.
+- size:<range>     The size, in bytes, is within the range.
+                   Sizes may end with KB, MB, GB or TB.
+                   Folders never match.
+- modified:<range> The last modified date (YYYY-MM-DD, local
+                   time) is within the range. A single date
+                   covers the whole day.
+- attrib:<flags>   Every listed attribute is set (R, H, S,
+                   A, or D for directories).
+- type:file|folder
+- in:<patterns>    One of the folders between the base
+                   directory and the item matches.
+- depth:<range>    The depth of the item below the base
+                   directory (1 being an item directly
+                   within it).
+
+A range is one of x, =x, >x, >=x, <x, <=x, x..y, x.. or
+..y (bounds inclusive). Values containing spaces can be
+quoted.
+
+in: and depth: terms depend only on the directory an
+item is in. Before a directory is searched, these terms
+can be checked on their own, and the directory (along
+with everything below it) skipped if no item within it
+could match. */
+class CSearchQuery
+{
+public:
+
+	/* The state of the directory-level terms for the
+	items within a particular directory. */
+	struct DirectoryContext_t
+	{
+		int					iDepth;
+
+		/* One entry for each in: term. */
+		std::vector<BOOL>	InMatches;
+	};
+
+	CSearchQuery();
+
+	/* Returns FALSE if the query is invalid. An empty
+	query matches everything. */
+	BOOL	Parse(const TCHAR *szQuery);
+
+	BOOL	IsEmpty() const;
+
+	/* The context for the items directly within
+	the base directory. */
+	void	GetBaseContext(DirectoryContext_t &Context) const;
+	void	GetChildContext(const DirectoryContext_t &Parent,const TCHAR *szFolderName,
+		DirectoryContext_t &Child) const;
+
+	BOOL	Evaluate(const WIN32_FIND_DATA *pwfd,const DirectoryContext_t &Context) const;
+
+	/* Returns FALSE if nothing in the directory, or in
+	any folder below it, can match. */
+	BOOL	CanMatchWithin(const DirectoryContext_t &Context) const;
+
+private:
+
+	static const int	MAX_NESTING_DEPTH = 64;
+
+	enum NodeType_t
+	{
+		NODE_AND,
+		NODE_OR,
+		NODE_NOT,
+		NODE_NAME,
+		NODE_SIZE,
+		NODE_MODIFIED,
+		NODE_ATTRIBUTES,
+		NODE_IN,
+		NODE_DEPTH
+	};
+
+	/* Three-valued logic, used when checking
+	every item in a directory at once. */
+	enum Truth_t
+	{
+		TRUTH_FALSE,
+		TRUTH_TRUE,
+		TRUTH_UNKNOWN
+	};
+
+	struct Node_t
+	{
+		NodeType_t			Type;
+
+		/* Operands, for AND/OR/NOT. */
+		int					iLeft;
+		int					iRight;
+
+		CWildcardMatcher	WildcardMatcher;
+
+		/* Inclusive bounds, for size, modified and
+		depth terms. */
+		ULONGLONG			ulMin;
+		ULONGLONG			ulMax;
+
+		/* For attribute terms, the attributes in
+		dwMask must be equal to dwValue. */
+		DWORD				dwMask;
+		DWORD				dwValue;
+
+		/* For in: terms, the entry within
+		DirectoryContext_t::InMatches. */
+		int					iInIndex;
+	};
+
+	struct Token_t
+	{
+		std::wstring	strText;
+		BOOL			bQuoted;
+	};
+
+	typedef BOOL (*ParseValueProc_t)(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh);
+
+	static BOOL	Tokenize(const TCHAR *szQuery,std::vector<Token_t> &Tokens);
+
+	int			ParseOr(int iDepth);
+	int			ParseAnd(int iDepth);
+	int			ParseNot(int iDepth);
+	int			ParseTerm(const Token_t &Token);
+	BOOL		IsKeyword(const TCHAR *szKeyword) const;
+	int			AddNode(const Node_t &Node);
+
+	static BOOL	ParseRange(const std::wstring &strRange,ParseValueProc_t pParseValue,
+		ULONGLONG &ulMin,ULONGLONG &ulMax);
+	static BOOL	ParseNumber(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh);
+	static BOOL	ParseSize(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh);
+	static BOOL	ParseDate(const std::wstring &strValue,ULONGLONG &ulLow,ULONGLONG &ulHigh);
+	static BOOL	ParseAttributes(const std::wstring &strValue,DWORD &dwAttributes);
+	static std::wstring	GetNamePatterns(const std::wstring &strValue);
+
+	BOOL		EvaluateNode(int iNode,const WIN32_FIND_DATA *pwfd,const DirectoryContext_t &Context) const;
+	Truth_t		EvaluateNodeWithin(int iNode,const DirectoryContext_t &Context) const;
+
+	std::vector<Node_t>		m_Nodes;
+	int						m_iRoot;
+	int						m_nInTerms;
+
+	/* Only used while parsing. */
+	std::vector<Token_t>	m_Tokens;
+	size_t					m_nPosition;
+};
@@ -0,0 +1,1114 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: ThreadPool.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Runs background jobs on a shared set of threads.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+#include "Macros.h"
+
+
+DWORD WINAPI	ThreadPoolWorkerThread(LPVOID pParam);
+DWORD WINAPI	ThreadPoolClassifierThread(LPVOID pParam);
+
+namespace
+{
+	struct DeviceClassLimits_t
+	{
+		DeviceClass_t	DeviceClass;
+		int				nMaxJobsPerDevice;
+		ULONGLONG		ulMaxBytesPerSecond;
+	};
+
+	/* Background jobs aren't throttled by default; they
+	still give way to interactive jobs. */
+	const DeviceClassLimits_t DEFAULT_DEVICE_CLASS_LIMITS[] =
+	{
+		{DEVICE_CLASS_SOLID_STATE,4,0},
+		{DEVICE_CLASS_ROTATIONAL,2,0},
+		{DEVICE_CLASS_REMOVABLE,1,0},
+		{DEVICE_CLASS_NETWORK,2,0}
+	};
+
+	/* These aren't defined when targeting XP (where
+	the query simply fails). */
+	const int STORAGE_DEVICE_SEEK_PENALTY_PROPERTY = 7;
+
+	struct SeekPenaltyDescriptor_t
+	{
+		DWORD	Version;
+		DWORD	Size;
+		BOOLEAN	IncursSeekPenalty;
+	};
+
+	struct RunningJob_t
+	{
+		CThreadPool					*pThreadPool;
+		CThreadPoolQueue::Job_t		*pJob;
+	};
+
+	/* The job the current thread is running, if any. */
+	__declspec(thread) RunningJob_t *g_pRunningJob = NULL;
+}
+
+CThreadPoolQueue::CThreadPoolQueue(int nMaxJobsPerDevice)
+{
+	for(int i = 0;i < NUM_DEVICE_CLASSES;i++)
+	{
+		m_nMaxJobsPerDevice[i] = max(1,nMaxJobsPerDevice);
+	}
+}
+
+void CThreadPoolQueue::SetMaxJobsPerDevice(DeviceClass_t DeviceClass,int nMaxJobsPerDevice)
+{
+	m_nMaxJobsPerDevice[DeviceClass] = max(1,nMaxJobsPerDevice);
+}
+
+int CThreadPoolQueue::GetMaxJobsPerDevice(DeviceClass_t DeviceClass) const
+{
+	return m_nMaxJobsPerDevice[DeviceClass];
+}
+
+void CThreadPoolQueue::Push(const Job_t &Job)
+{
+	assert(Job.Priority >= 0 && Job.Priority < NUM_THREAD_POOL_PRIORITIES);
+
+	m_Jobs[Job.Priority].push_back(Job);
+
+	if(Job.strDevice.empty())
+	{
+		return;
+	}
+
+	auto itr = m_Devices.find(Job.strDevice);
+
+	if(itr == m_Devices.end())
+	{
+		DeviceState_t DeviceState;
+		DeviceState.DeviceClass = Job.DeviceClass;
+		DeviceState.nQueued = 0;
+		DeviceState.nInteractiveQueued = 0;
+		DeviceState.nRunning = 0;
+		DeviceState.nInteractiveRunning = 0;
+		DeviceState.nJobsStarted = 0;
+		DeviceState.ulTotalQueueWait = 0;
+		DeviceState.dwMaxQueueWait = 0;
+
+		itr = m_Devices.insert(std::make_pair(Job.strDevice,DeviceState)).first;
+	}
+
+	itr->second.nQueued++;
+
+	if(IsInteractive(Job.Priority))
+	{
+		itr->second.nInteractiveQueued++;
+	}
+}
+
+BOOL CThreadPoolQueue::Pop(Job_t &Job,DWORD dwNow)
+{
+	for(int i = 0;i < NUM_THREAD_POOL_PRIORITIES;i++)
+	{
+		for(auto itr = m_Jobs[i].begin();itr != m_Jobs[i].end();itr++)
+		{
+			if(itr->pToken->IsCancelled())
+			{
+				Job = *itr;
+				Job.bCounted = FALSE;
+				m_Jobs[i].erase(itr);
+
+				RemoveQueuedJob(Job,dwNow);
+
+				return TRUE;
+			}
+
+			if(CanRun(*itr))
+			{
+				Job = *itr;
+				Job.bCounted = FALSE;
+				m_Jobs[i].erase(itr);
+
+				RemoveQueuedJob(Job,dwNow);
+				CountRunningJob(Job);
+
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+void CThreadPoolQueue::JobFinished(const Job_t &Job)
+{
+	if(!Job.bCounted)
+	{
+		return;
+	}
+
+	auto itr = m_Devices.find(Job.strDevice);
+	assert(itr != m_Devices.end());
+
+	itr->second.nRunning--;
+
+	if(IsInteractive(Job.Priority))
+	{
+		itr->second.nInteractiveRunning--;
+	}
+}
+
+void CThreadPoolQueue::SuspendJob(Job_t &Job)
+{
+	JobFinished(Job);
+	Job.bCounted = FALSE;
+}
+
+BOOL CThreadPoolQueue::ResumeJob(Job_t &Job)
+{
+	if(Job.bCounted || Job.strDevice.empty())
+	{
+		return TRUE;
+	}
+
+	if(!IsInteractive(Job.Priority) && HasInteractiveWork(Job.strDevice))
+	{
+		return FALSE;
+	}
+
+	if(!CanRun(Job))
+	{
+		return FALSE;
+	}
+
+	CountRunningJob(Job);
+
+	return TRUE;
+}
+
+BOOL CThreadPoolQueue::HasInteractiveWork(const std::wstring &strDevice) const
+{
+	auto itr = m_Devices.find(strDevice);
+
+	if(itr == m_Devices.end())
+	{
+		return FALSE;
+	}
+
+	return itr->second.nInteractiveQueued > 0 || itr->second.nInteractiveRunning > 0;
+}
+
+void CThreadPoolQueue::CancelAll()
+{
+	for(int i = 0;i < NUM_THREAD_POOL_PRIORITIES;i++)
+	{
+		for(auto itr = m_Jobs[i].begin();itr != m_Jobs[i].end();itr++)
+		{
+			itr->pToken->Cancel();
+		}
+	}
+}
+
+size_t CThreadPoolQueue::GetQueuedCount() const
+{
+	size_t nJobs = 0;
+
+	for(int i = 0;i < NUM_THREAD_POOL_PRIORITIES;i++)
+	{
+		nJobs += m_Jobs[i].size();
+	}
+
+	return nJobs;
+}
+
+int CThreadPoolQueue::GetRunningCount(const std::wstring &strDevice) const
+{
+	auto itr = m_Devices.find(strDevice);
+
+	if(itr == m_Devices.end())
+	{
+		return 0;
+	}
+
+	return itr->second.nRunning;
+}
+
+void CThreadPoolQueue::GetDeviceStats(std::vector<DeviceStats_t> &DeviceStats) const
+{
+	for(auto itr = m_Devices.begin();itr != m_Devices.end();itr++)
+	{
+		DeviceStats_t Stats;
+		Stats.strDevice = itr->first;
+		Stats.DeviceClass = itr->second.DeviceClass;
+		Stats.nQueued = itr->second.nQueued;
+		Stats.nRunning = itr->second.nRunning;
+		Stats.nJobsStarted = itr->second.nJobsStarted;
+		Stats.ulTotalQueueWait = itr->second.ulTotalQueueWait;
+		Stats.dwMaxQueueWait = itr->second.dwMaxQueueWait;
+		Stats.ulBytes = 0;
+		Stats.ulThrottledTime = 0;
+
+		DeviceStats.push_back(Stats);
+	}
+}
+
+BOOL CThreadPoolQueue::CanRun(const Job_t &Job) const
+{
+	if(Job.strDevice.empty())
+	{
+		return TRUE;
+	}
+
+	int nLimit = m_nMaxJobsPerDevice[Job.DeviceClass];
+
+	if(Job.Priority == THREAD_POOL_PRIORITY_LOW && nLimit > 1)
+	{
+		nLimit--;
+	}
+
+	return GetRunningCount(Job.strDevice) < nLimit;
+}
+
+void CThreadPoolQueue::RemoveQueuedJob(const Job_t &Job,DWORD dwNow)
+{
+	if(Job.strDevice.empty())
+	{
+		return;
+	}
+
+	DeviceState_t &DeviceState = m_Devices[Job.strDevice];
+	DeviceState.nQueued--;
+
+	if(IsInteractive(Job.Priority))
+	{
+		DeviceState.nInteractiveQueued--;
+	}
+
+	/* Tick counts wrap, but the
+	difference is still correct. */
+	DWORD dwWait = dwNow - Job.dwQueuedTime;
+	DeviceState.nJobsStarted++;
+	DeviceState.ulTotalQueueWait += dwWait;
+	DeviceState.dwMaxQueueWait = max(DeviceState.dwMaxQueueWait,dwWait);
+}
+
+void CThreadPoolQueue::CountRunningJob(Job_t &Job)
+{
+	if(Job.strDevice.empty())
+	{
+		return;
+	}
+
+	DeviceState_t &DeviceState = m_Devices[Job.strDevice];
+	DeviceState.nRunning++;
+
+	if(IsInteractive(Job.Priority))
+	{
+		DeviceState.nInteractiveRunning++;
+	}
+
+	Job.bCounted = TRUE;
+}
+
+BOOL CThreadPoolQueue::IsInteractive(ThreadPoolPriority_t Priority)
+{
+	return Priority != THREAD_POOL_PRIORITY_LOW;
+}
+
+CThreadPool::CThreadPool(int nMaxThreads) :
+m_Queue(1),
+m_nMaxThreads(max(1,nMaxThreads)),
+m_nIdleThreads(0),
+m_nSuspendedJobs(0),
+m_bShuttingDown(FALSE),
+m_hClassifierThread(NULL)
+{
+	InitializeCriticalSection(&m_cs);
+
+	m_hWorkEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+	m_hClassifyEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+
+	for(int i = 0;i < SIZEOF_ARRAY(DEFAULT_DEVICE_CLASS_LIMITS);i++)
+	{
+		const DeviceClassLimits_t &Limits = DEFAULT_DEVICE_CLASS_LIMITS[i];
+
+		m_Queue.SetMaxJobsPerDevice(Limits.DeviceClass,Limits.nMaxJobsPerDevice);
+		m_ulMaxBytesPerSecond[Limits.DeviceClass] = Limits.ulMaxBytesPerSecond;
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	EnterCriticalSection(&m_cs);
+	m_bShuttingDown = TRUE;
+	m_Queue.CancelAll();
+
+	for(auto itr = m_UnclassifiedJobs.begin();itr != m_UnclassifiedJobs.end();itr++)
+	{
+		itr->Job.pToken->Cancel();
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	/* The classifier may still create a worker (to
+	run the jobs it's passing on), so it has to finish
+	before the workers are waited on. */
+	if(m_hClassifierThread != NULL)
+	{
+		SetEvent(m_hClassifyEvent);
+
+		if(WaitForSingleObject(m_hClassifierThread,SHUTDOWN_TIMEOUT) == WAIT_TIMEOUT)
+		{
+			return;
+		}
+
+		CloseHandle(m_hClassifierThread);
+	}
+
+	SetEvent(m_hWorkEvent);
+
+	if(!m_Threads.empty())
+	{
+		DWORD dwRet = WaitForMultipleObjects(static_cast<DWORD>(m_Threads.size()),
+			&m_Threads[0],TRUE,SHUTDOWN_TIMEOUT);
+
+		/* A job that's still running is left to be
+		stopped when the process exits. It may still be
+		using the pool, so nothing is freed. */
+		if(dwRet == WAIT_TIMEOUT)
+		{
+			return;
+		}
+
+		for(auto itr = m_Threads.begin();itr != m_Threads.end();itr++)
+		{
+			CloseHandle(*itr);
+		}
+	}
+
+	CloseHandle(m_hClassifyEvent);
+	CloseHandle(m_hWorkEvent);
+	DeleteCriticalSection(&m_cs);
+}
+
+CThreadPool &CThreadPool::GetInstance()
+{
+	static CThreadPool tp(DEFAULT_MAX_THREADS);
+	return tp;
+}
+
+void CThreadPool::SetDeviceClassLimits(DeviceClass_t DeviceClass,int nMaxJobsPerDevice,
+	ULONGLONG ulMaxBytesPerSecond)
+{
+	EnterCriticalSection(&m_cs);
+	m_Queue.SetMaxJobsPerDevice(DeviceClass,nMaxJobsPerDevice);
+	m_ulMaxBytesPerSecond[DeviceClass] = ulMaxBytesPerSecond;
+	LeaveCriticalSection(&m_cs);
+
+	/* Raising the limit may allow
+	queued jobs to start. */
+	SetEvent(m_hWorkEvent);
+}
+
+void CThreadPool::GetDefaultDeviceClassLimits(DeviceClass_t DeviceClass,int *pnMaxJobsPerDevice,
+	ULONGLONG *pulMaxBytesPerSecond)
+{
+	assert(pnMaxJobsPerDevice != NULL && pulMaxBytesPerSecond != NULL);
+
+	for(int i = 0;i < SIZEOF_ARRAY(DEFAULT_DEVICE_CLASS_LIMITS);i++)
+	{
+		if(DEFAULT_DEVICE_CLASS_LIMITS[i].DeviceClass == DeviceClass)
+		{
+			*pnMaxJobsPerDevice = DEFAULT_DEVICE_CLASS_LIMITS[i].nMaxJobsPerDevice;
+			*pulMaxBytesPerSecond = DEFAULT_DEVICE_CLASS_LIMITS[i].ulMaxBytesPerSecond;
+			return;
+		}
+	}
+}
+
+BOOL CThreadPool::QueueJob(ThreadPoolJobProc_t pfnJob,LPVOID pParam,ThreadPoolPriority_t Priority,
+	const TCHAR *szPath,CCancellationToken *pToken)
+{
+	CThreadPoolQueue::Job_t Job;
+	Job.pfnJob = pfnJob;
+	Job.pParam = pParam;
+	Job.Priority = Priority;
+	Job.DeviceClass = DEVICE_CLASS_ROTATIONAL;
+	Job.bCounted = FALSE;
+
+	/* Every job is given a token, so that it
+	can be cancelled if the pool is shut down. */
+	if(pToken != NULL)
+	{
+		Job.pToken = pToken;
+		Job.pToken->AddRef();
+	}
+	else
+	{
+		Job.pToken = new CCancellationToken();
+	}
+
+	EnterCriticalSection(&m_cs);
+
+	if(m_bShuttingDown)
+	{
+		LeaveCriticalSection(&m_cs);
+		Job.pToken->Release();
+
+		return FALSE;
+	}
+
+	Job.dwQueuedTime = GetTickCount();
+
+	/* Finding the device can mean querying the volume,
+	which can be slow (e.g. for a disconnected share), so
+	it's left to the classifier thread, rather than the
+	caller (which is often the UI thread). Every job goes
+	through it, so that jobs stay in the order they were
+	queued. */
+	UnclassifiedJob_t UnclassifiedJob;
+	UnclassifiedJob.Job = Job;
+
+	if(szPath != NULL)
+	{
+		UnclassifiedJob.strPath = szPath;
+	}
+
+	m_UnclassifiedJobs.push_back(UnclassifiedJob);
+	CreateClassifierThreadIfNeeded();
+
+	LeaveCriticalSection(&m_cs);
+
+	SetEvent(m_hClassifyEvent);
+
+	return TRUE;
+}
+
+/* Should be called with the lock held. */
+void CThreadPool::CreateClassifierThreadIfNeeded()
+{
+	if(m_hClassifierThread != NULL)
+	{
+		return;
+	}
+
+	m_hClassifierThread = CreateThread(NULL,0,ThreadPoolClassifierThread,
+		reinterpret_cast<LPVOID>(this),0,NULL);
+}
+
+/* Should be called with the lock held. */
+void CThreadPool::CreateThreadIfNeeded()
+{
+	/* Threads with a suspended job aren't counted, as
+	the work they're waiting on may need a thread of its
+	own. */
+	if(m_nIdleThreads > 0 ||
+		static_cast<int>(m_Threads.size()) >= m_nMaxThreads + m_nSuspendedJobs)
+	{
+		return;
+	}
+
+	HANDLE hThread = CreateThread(NULL,0,ThreadPoolWorkerThread,
+		reinterpret_cast<LPVOID>(this),0,NULL);
+
+	if(hThread != NULL)
+	{
+		m_Threads.push_back(hThread);
+		m_nIdleThreads++;
+	}
+}
+
+BOOL CThreadPool::ThrottleIo(ULONGLONG ulBytes)
+{
+	RunningJob_t *pRunningJob = g_pRunningJob;
+
+	if(pRunningJob == NULL)
+	{
+		return TRUE;
+	}
+
+	return pRunningJob->pThreadPool->ThrottleJob(*pRunningJob->pJob,ulBytes);
+}
+
+LPVOID CThreadPool::GetJobContext()
+{
+	return reinterpret_cast<LPVOID>(g_pRunningJob);
+}
+
+void CThreadPool::SetJobContext(LPVOID pJobContext)
+{
+	g_pRunningJob = reinterpret_cast<RunningJob_t *>(pJobContext);
+}
+
+int CThreadPool::GetJobDeviceLimit()
+{
+	RunningJob_t *pRunningJob = g_pRunningJob;
+
+	if(pRunningJob == NULL || pRunningJob->pJob->strDevice.empty())
+	{
+		return 0;
+	}
+
+	CThreadPool *pThreadPool = pRunningJob->pThreadPool;
+
+	EnterCriticalSection(&pThreadPool->m_cs);
+	int nLimit = pThreadPool->m_Queue.GetMaxJobsPerDevice(pRunningJob->pJob->DeviceClass);
+	LeaveCriticalSection(&pThreadPool->m_cs);
+
+	return nLimit;
+}
+
+BOOL CThreadPool::ThrottleJob(CThreadPoolQueue::Job_t &Job,ULONGLONG ulBytes)
+{
+	if(Job.strDevice.empty())
+	{
+		return !Job.pToken->IsCancelled();
+	}
+
+	DWORD dwStart = GetTickCount();
+	BOOL bThrottled = FALSE;
+
+	EnterCriticalSection(&m_cs);
+
+	/* Interactive jobs are never held up; their
+	I/O is only counted. */
+	if(Job.Priority != THREAD_POOL_PRIORITY_LOW)
+	{
+		ConsumeBandwidth(Job,ulBytes,dwStart);
+		LeaveCriticalSection(&m_cs);
+
+		return !Job.pToken->IsCancelled();
+	}
+
+	BOOL bSuspended = FALSE;
+
+	while(!Job.pToken->IsCancelled())
+	{
+		BOOL bContinue = FALSE;
+
+		if(m_Queue.HasInteractiveWork(Job.strDevice))
+		{
+			/* The job gives up its slot while it's paused,
+			as the interactive work may be waiting on it. */
+			if(Job.bCounted)
+			{
+				m_Queue.SuspendJob(Job);
+				m_nSuspendedJobs++;
+				bSuspended = TRUE;
+
+				CreateThreadIfNeeded();
+				SetEvent(m_hWorkEvent);
+			}
+		}
+		/* An interactive job that hasn't been classified
+		yet may be for the same device, so the job waits
+		(keeping its slot) until it's known. */
+		else if(!HasUnclassifiedInteractiveWork() && m_Queue.ResumeJob(Job))
+		{
+			bContinue = ConsumeBandwidth(Job,ulBytes,GetTickCount());
+		}
+
+		if(bContinue)
+		{
+			break;
+		}
+
+		LeaveCriticalSection(&m_cs);
+		Sleep(THROTTLE_INTERVAL);
+		bThrottled = TRUE;
+		EnterCriticalSection(&m_cs);
+	}
+
+	if(bSuspended)
+	{
+		m_nSuspendedJobs--;
+	}
+
+	if(bThrottled)
+	{
+		m_Bandwidth[Job.strDevice].ulThrottledTime += GetTickCount() - dwStart;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	return !Job.pToken->IsCancelled();
+}
+
+/* Returns FALSE (without using any of the budget)
+if the device is over its budget. */
+BOOL CThreadPool::ConsumeBandwidth(const CThreadPoolQueue::Job_t &Job,ULONGLONG ulBytes,DWORD dwNow)
+{
+	ULONGLONG ulMaxBytesPerSecond = m_ulMaxBytesPerSecond[Job.DeviceClass];
+
+	auto itr = m_Bandwidth.find(Job.strDevice);
+
+	if(itr == m_Bandwidth.end())
+	{
+		Bandwidth_t Bandwidth;
+		Bandwidth.lAvailable = static_cast<LONGLONG>(ulMaxBytesPerSecond);
+		Bandwidth.dwLastRefill = dwNow;
+		Bandwidth.ulBytes = 0;
+		Bandwidth.ulThrottledTime = 0;
+
+		itr = m_Bandwidth.insert(std::make_pair(Job.strDevice,Bandwidth)).first;
+	}
+
+	Bandwidth_t &Bandwidth = itr->second;
+
+	if(Job.Priority == THREAD_POOL_PRIORITY_LOW && ulMaxBytesPerSecond != 0)
+	{
+		/* At most a second's worth of
+		budget is saved up. */
+		ULONGLONG ulRefill = ulMaxBytesPerSecond * (dwNow - Bandwidth.dwLastRefill) / 1000;
+		Bandwidth.lAvailable = min(static_cast<LONGLONG>(ulMaxBytesPerSecond),
+			Bandwidth.lAvailable + static_cast<LONGLONG>(ulRefill));
+		Bandwidth.dwLastRefill = dwNow;
+
+		if(Bandwidth.lAvailable <= 0)
+		{
+			return FALSE;
+		}
+
+		Bandwidth.lAvailable -= static_cast<LONGLONG>(ulBytes);
+	}
+
+	Bandwidth.ulBytes += ulBytes;
+
+	return TRUE;
+}
+
+void CThreadPool::GetDeviceStats(std::vector<DeviceStats_t> &DeviceStats) const
+{
+	EnterCriticalSection(&m_cs);
+
+	m_Queue.GetDeviceStats(DeviceStats);
+
+	for(auto itr = DeviceStats.begin();itr != DeviceStats.end();itr++)
+	{
+		auto itrBandwidth = m_Bandwidth.find(itr->strDevice);
+
+		if(itrBandwidth != m_Bandwidth.end())
+		{
+			itr->ulBytes = itrBandwidth->second.ulBytes;
+			itr->ulThrottledTime = itrBandwidth->second.ulThrottledTime;
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+std::wstring CThreadPool::GetDeviceName(const TCHAR *szPath)
+{
+	if(szPath == NULL || *szPath == '\0')
+	{
+		return std::wstring();
+	}
+
+	TCHAR szVolume[MAX_PATH];
+
+	if(!GetVolumePathName(szPath,szVolume,SIZEOF_ARRAY(szVolume)))
+	{
+		return std::wstring();
+	}
+
+	int iLength = lstrlen(szVolume);
+
+	if(iLength > 0)
+	{
+		LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,szVolume,iLength,
+			szVolume,SIZEOF_ARRAY(szVolume));
+	}
+
+	return std::wstring(szVolume,iLength);
+}
+
+BOOL CThreadPool::GetDeviceClass(const std::wstring &strDevice,DeviceClass_t &DeviceClass)
+{
+	DeviceClass = DEVICE_CLASS_ROTATIONAL;
+
+	switch(GetDriveType(strDevice.c_str()))
+	{
+	case DRIVE_REMOTE:
+		DeviceClass = DEVICE_CLASS_NETWORK;
+		return TRUE;
+
+	case DRIVE_REMOVABLE:
+	case DRIVE_CDROM:
+		DeviceClass = DEVICE_CLASS_REMOVABLE;
+		return TRUE;
+	}
+
+	/* Whether or not the disk is solid state is found
+	by asking whether it incurs a seek penalty. The volume
+	is opened without any access rights, so this doesn't
+	need elevation. */
+	TCHAR szVolumeName[MAX_PATH];
+
+	if(!GetVolumeNameForVolumeMountPoint(strDevice.c_str(),szVolumeName,SIZEOF_ARRAY(szVolumeName)))
+	{
+		return FALSE;
+	}
+
+	/* The volume is opened as a device, so
+	the trailing separator is removed. */
+	PathRemoveBackslash(szVolumeName);
+
+	HANDLE hVolume = CreateFile(szVolumeName,0,FILE_SHARE_READ|FILE_SHARE_WRITE,
+		NULL,OPEN_EXISTING,0,NULL);
+
+	if(hVolume == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+
+	STORAGE_PROPERTY_QUERY Query;
+	ZeroMemory(&Query,sizeof(Query));
+	Query.PropertyId = static_cast<STORAGE_PROPERTY_ID>(STORAGE_DEVICE_SEEK_PENALTY_PROPERTY);
+	Query.QueryType = PropertyStandardQuery;
+
+	SeekPenaltyDescriptor_t Descriptor;
+	DWORD dwBytesReturned;
+
+	BOOL bRes = DeviceIoControl(hVolume,IOCTL_STORAGE_QUERY_PROPERTY,&Query,sizeof(Query),
+		&Descriptor,sizeof(Descriptor),&dwBytesReturned,NULL);
+
+	CloseHandle(hVolume);
+
+	if(!bRes || dwBytesReturned < sizeof(Descriptor))
+	{
+		return FALSE;
+	}
+
+	DeviceClass = Descriptor.IncursSeekPenalty ? DEVICE_CLASS_ROTATIONAL : DEVICE_CLASS_SOLID_STATE;
+
+	return TRUE;
+}
+
+BOOL CThreadPool::LookupDeviceClass(const std::wstring &strDevice,DeviceClass_t &DeviceClass)
+{
+	DeviceClass = DEVICE_CLASS_ROTATIONAL;
+
+	if(strDevice.empty())
+	{
+		return FALSE;
+	}
+
+	EnterCriticalSection(&m_cs);
+	auto itr = m_DeviceClasses.find(strDevice);
+	BOOL bFound = (itr != m_DeviceClasses.end());
+	DeviceClassEntry_t Entry;
+
+	if(bFound)
+	{
+		Entry = itr->second;
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	if(!bFound)
+	{
+		Entry.bKnown = GetDeviceClass(strDevice,Entry.DeviceClass);
+
+		EnterCriticalSection(&m_cs);
+		m_DeviceClasses[strDevice] = Entry;
+		LeaveCriticalSection(&m_cs);
+	}
+
+	DeviceClass = Entry.DeviceClass;
+
+	return Entry.bKnown;
+}
+
+int CThreadPool::GetMaxJobsPerDevice(DeviceClass_t DeviceClass) const
+{
+	EnterCriticalSection(&m_cs);
+	int nMaxJobsPerDevice = m_Queue.GetMaxJobsPerDevice(DeviceClass);
+	LeaveCriticalSection(&m_cs);
+
+	return nMaxJobsPerDevice;
+}
+
+/* Should be called with the lock held. */
+BOOL CThreadPool::HasUnclassifiedInteractiveWork() const
+{
+	for(auto itr = m_UnclassifiedJobs.begin();itr != m_UnclassifiedJobs.end();itr++)
+	{
+		if(itr->Job.Priority != THREAD_POOL_PRIORITY_LOW && !itr->strPath.empty())
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+DWORD WINAPI ThreadPoolClassifierThread(LPVOID pParam)
+{
+	assert(pParam != NULL);
+
+	CThreadPool *pThreadPool = reinterpret_cast<CThreadPool *>(pParam);
+	pThreadPool->ClassifierThread();
+
+	return 0;
+}
+
+void CThreadPool::ClassifierThread()
+{
+	while(TRUE)
+	{
+		EnterCriticalSection(&m_cs);
+
+		if(m_UnclassifiedJobs.empty())
+		{
+			BOOL bShuttingDown = m_bShuttingDown;
+
+			LeaveCriticalSection(&m_cs);
+
+			if(bShuttingDown)
+			{
+				break;
+			}
+
+			WaitForSingleObject(m_hClassifyEvent,INFINITE);
+			continue;
+		}
+
+		UnclassifiedJob_t UnclassifiedJob = m_UnclassifiedJobs.front();
+
+		LeaveCriticalSection(&m_cs);
+
+		CThreadPoolQueue::Job_t &Job = UnclassifiedJob.Job;
+		Job.strDevice = GetDeviceName(UnclassifiedJob.strPath.c_str());
+		LookupDeviceClass(Job.strDevice,Job.DeviceClass);
+
+		/* The job is only taken off the list once it's
+		been queued, so that the workers don't exit while
+		it's in between. */
+		EnterCriticalSection(&m_cs);
+		m_UnclassifiedJobs.pop_front();
+		m_Queue.Push(Job);
+		CreateThreadIfNeeded();
+		LeaveCriticalSection(&m_cs);
+
+		SetEvent(m_hWorkEvent);
+	}
+}
+
+DWORD WINAPI ThreadPoolWorkerThread(LPVOID pParam)
+{
+	assert(pParam != NULL);
+
+	CThreadPool *pThreadPool = reinterpret_cast<CThreadPool *>(pParam);
+
+	CoInitializeEx(NULL,COINIT_APARTMENTTHREADED);
+	pThreadPool->WorkerThread();
+	CoUninitialize();
+
+	return 0;
+}
+
+void CThreadPool::WorkerThread()
+{
+	while(TRUE)
+	{
+		CThreadPoolQueue::Job_t Job;
+
+		EnterCriticalSection(&m_cs);
+
+		BOOL bFound = m_Queue.Pop(Job,GetTickCount());
+
+		if(bFound)
+		{
+			m_nIdleThreads--;
+		}
+
+		BOOL bExit = !bFound && m_bShuttingDown && m_Queue.GetQueuedCount() == 0 &&
+			m_UnclassifiedJobs.empty();
+		BOOL bMoreQueued = m_Queue.GetQueuedCount() != 0;
+
+		LeaveCriticalSection(&m_cs);
+
+		/* The event only wakes a single thread, so
+		it's passed on if there's more to do (or if
+		every thread needs to exit). */
+		if((bFound && bMoreQueued) || bExit)
+		{
+			SetEvent(m_hWorkEvent);
+		}
+
+		if(bExit)
+		{
+			break;
+		}
+
+		if(!bFound)
+		{
+			WaitForSingleObject(m_hWorkEvent,INFINITE);
+			continue;
+		}
+
+		RunJob(Job);
+
+		EnterCriticalSection(&m_cs);
+		m_Queue.JobFinished(Job);
+		m_nIdleThreads++;
+		bMoreQueued = m_Queue.GetQueuedCount() != 0;
+		LeaveCriticalSection(&m_cs);
+
+		/* A job that was waiting on the same
+		device may now be able to run. */
+		if(bMoreQueued)
+		{
+			SetEvent(m_hWorkEvent);
+		}
+	}
+}
+
+void CThreadPool::RunJob(CThreadPoolQueue::Job_t &Job)
+{
+	if(Job.Priority == THREAD_POOL_PRIORITY_LOW)
+	{
+		SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_BELOW_NORMAL);
+	}
+
+	/* The job's slot on its device can be given up (and
+	taken back) while it runs, so ThrottleIo works on
+	this copy. Any threads the job has handed its context
+	to share it, so it's only changed under the lock. */
+	RunningJob_t RunningJob;
+	RunningJob.pThreadPool = this;
+	RunningJob.pJob = &Job;
+	g_pRunningJob = &RunningJob;
+
+	Job.pfnJob(Job.pParam,Job.pToken);
+
+	g_pRunningJob = NULL;
+
+	if(Job.Priority == THREAD_POOL_PRIORITY_LOW)
+	{
+		SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_NORMAL);
+	}
+
+	Job.pToken->Release();
+}
+
+
+namespace
+{
+	struct ParallelWork_t
+	{
+		ParallelWorkProc_t	pfnWork;
+		LPVOID				pParam;
+		LONG				nItems;
+		volatile LONG		lNextItem;
+
+		/* The number of jobs that are
+		currently working on items. */
+		volatile LONG		lActiveJobs;
+
+		/* Held by the caller, and by every
+		job that's been queued. */
+		volatile LONG		lRefCount;
+
+		/* Auto-reset. Set when the last
+		active job stops working. */
+		HANDLE				hIdle;
+	};
+
+	void ReleaseParallelWork(ParallelWork_t *pWork)
+	{
+		if(InterlockedDecrement(&pWork->lRefCount) == 0)
+		{
+			if(pWork->hIdle != NULL)
+			{
+				CloseHandle(pWork->hIdle);
+			}
+
+			delete pWork;
+		}
+	}
+
+	/* Each caller takes the next item that
+	hasn't been started, until none remain. */
+	void DoParallelWork(ParallelWork_t *pWork)
+	{
+		LONG lItem;
+
+		while((lItem = InterlockedIncrement(&pWork->lNextItem) - 1) < pWork->nItems)
+		{
+			pWork->pfnWork(pWork->pParam,lItem);
+		}
+	}
+
+	void ParallelWorkJob(LPVOID pParam,const CCancellationToken *pToken)
+	{
+		ParallelWork_t *pWork = reinterpret_cast<ParallelWork_t *>(pParam);
+
+		/* If the pool is shutting down, the
+		items are left to the caller. A job that
+		starts after the caller has taken the last
+		item won't find anything to do. */
+		if(!pToken->IsCancelled())
+		{
+			InterlockedIncrement(&pWork->lActiveJobs);
+
+			DoParallelWork(pWork);
+
+			if(InterlockedDecrement(&pWork->lActiveJobs) == 0)
+			{
+				SetEvent(pWork->hIdle);
+			}
+		}
+
+		ReleaseParallelWork(pWork);
+	}
+}
+
+void RunInParallel(ParallelWorkProc_t pfnWork,LPVOID pParam,int nItems,int nJobs,
+	ThreadPoolPriority_t Priority)
+{
+	ParallelWork_t *pWork = new ParallelWork_t;
+	pWork->pfnWork = pfnWork;
+	pWork->pParam = pParam;
+	pWork->nItems = nItems;
+	pWork->lNextItem = 0;
+	pWork->lActiveJobs = 0;
+	pWork->lRefCount = 1;
+	pWork->hIdle = CreateEvent(NULL,FALSE,FALSE,NULL);
+
+	if(pWork->hIdle != NULL)
+	{
+		nJobs = min(nJobs,nItems - 1);
+
+		for(int i = 0;i < nJobs;i++)
+		{
+			InterlockedIncrement(&pWork->lRefCount);
+
+			if(!CThreadPool::GetInstance().QueueJob(ParallelWorkJob,pWork,Priority,NULL))
+			{
+				/* The job won't be called, so the
+				reference it was given is dropped. */
+				InterlockedDecrement(&pWork->lRefCount);
+				break;
+			}
+		}
+	}
+
+	DoParallelWork(pWork);
+
+	/* Every item has been taken by now, so only
+	items that a job is part way through remain. */
+	while(pWork->lActiveJobs != 0)
+	{
+		WaitForSingleObject(pWork->hIdle,INFINITE);
+	}
+
+	ReleaseParallelWork(pWork);
+}
\ No newline at end of file
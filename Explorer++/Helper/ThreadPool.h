@@ -0,0 +1,342 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "CancellationToken.h"
+#include "Macros.h"
+
+/* High and normal priority jobs are interactive (the
+user is waiting on them). Low priority jobs are
+background work, and give way to interactive jobs on
+the same device. */
+enum ThreadPoolPriority_t
+{
+	THREAD_POOL_PRIORITY_HIGH,
+	THREAD_POOL_PRIORITY_NORMAL,
+	THREAD_POOL_PRIORITY_LOW
+};
+
+const int NUM_THREAD_POOL_PRIORITIES = 3;
+
+/* The kind of device a job reads from. Each
+class has its own limits. */
+enum DeviceClass_t
+{
+	DEVICE_CLASS_SOLID_STATE,
+	DEVICE_CLASS_ROTATIONAL,
+	DEVICE_CLASS_REMOVABLE,
+	DEVICE_CLASS_NETWORK
+};
+
+const int NUM_DEVICE_CLASSES = 4;
+
+struct DeviceStats_t
+{
+	std::wstring	strDevice;
+	DeviceClass_t	DeviceClass;
+
+	int				nQueued;
+	int				nRunning;
+
+	/* Times are in milliseconds. Queue wait is measured
+	from when a job was queued to when it started. */
+	ULONGLONG		nJobsStarted;
+	ULONGLONG		ulTotalQueueWait;
+	DWORD			dwMaxQueueWait;
+
+	/* The bytes reported through ThrottleIo, and
+	the time background jobs spent paused in it. */
+	ULONGLONG		ulBytes;
+	ULONGLONG		ulThrottledTime;
+};
+
+/* pToken is never NULL. A job is always called exactly
+once, even if it's cancelled before it starts (in which
+case the token will already be cancelled), so that it can
+free its parameter. */
+typedef void (*ThreadPoolJobProc_t)(LPVOID pParam,const CCancellationToken *pToken);
+
+/* Decides which queued job runs next. It holds no locks
+and creates no threads, so the same rules apply however
+the jobs are eventually run.
+
+Jobs are handed out in priority order, and in the order
+they were queued within each priority. A job that's tied
+to a device is passed over while that device already has
+the maximum number of jobs (for its class) running, so
+that a burst of requests against one disk doesn't hold up
+requests for another. Low priority jobs can't take the
+last slot on a device, which leaves room for anything more
+urgent that arrives while they're running. Jobs that have
+been cancelled are handed out straight away, as they only
+need to clean up. */
+class CThreadPoolQueue
+{
+public:
+
+	struct Job_t
+	{
+		ThreadPoolJobProc_t		pfnJob;
+		LPVOID					pParam;
+		ThreadPoolPriority_t	Priority;
+		CCancellationToken		*pToken;
+
+		/* Empty if the job isn't tied to a device, in
+		which case it isn't limited. */
+		std::wstring			strDevice;
+		DeviceClass_t			DeviceClass;
+
+		/* The tick count when the job was queued. */
+		DWORD					dwQueuedTime;
+
+		/* Set while the job counts against its
+		device's limit. */
+		BOOL					bCounted;
+	};
+
+	CThreadPoolQueue(int nMaxJobsPerDevice);
+
+	void		SetMaxJobsPerDevice(DeviceClass_t DeviceClass,int nMaxJobsPerDevice);
+	int			GetMaxJobsPerDevice(DeviceClass_t DeviceClass) const;
+
+	void		Push(const Job_t &Job);
+
+	/* Returns FALSE if nothing that's queued can run yet.
+	JobFinished should be called once the job has run. */
+	BOOL		Pop(Job_t &Job,DWORD dwNow);
+	void		JobFinished(const Job_t &Job);
+
+	/* A running job that's been suspended doesn't count
+	against its device, until it's resumed. ResumeJob
+	returns FALSE (and leaves the job suspended) if the
+	device is full, or has interactive work waiting. */
+	void		SuspendJob(Job_t &Job);
+	BOOL		ResumeJob(Job_t &Job);
+
+	/* Returns TRUE if a high or normal priority job for
+	the device is either queued or running. */
+	BOOL		HasInteractiveWork(const std::wstring &strDevice) const;
+
+	/* Cancels every job that's still queued. */
+	void		CancelAll();
+
+	size_t		GetQueuedCount() const;
+	int			GetRunningCount(const std::wstring &strDevice) const;
+
+	/* Returns an entry for every device a job has been
+	queued for. The byte counts and throttled time are
+	left at 0. */
+	void		GetDeviceStats(std::vector<DeviceStats_t> &DeviceStats) const;
+
+private:
+
+	struct DeviceState_t
+	{
+		DeviceClass_t	DeviceClass;
+		int				nQueued;
+		int				nInteractiveQueued;
+		int				nRunning;
+		int				nInteractiveRunning;
+		ULONGLONG		nJobsStarted;
+		ULONGLONG		ulTotalQueueWait;
+		DWORD			dwMaxQueueWait;
+	};
+
+	BOOL		CanRun(const Job_t &Job) const;
+	void		RemoveQueuedJob(const Job_t &Job,DWORD dwNow);
+	void		CountRunningJob(Job_t &Job);
+
+	static BOOL	IsInteractive(ThreadPoolPriority_t Priority);
+
+	std::deque<Job_t>						m_Jobs[NUM_THREAD_POOL_PRIORITIES];
+	std::map<std::wstring,DeviceState_t>	m_Devices;
+	int										m_nMaxJobsPerDevice[NUM_DEVICE_CLASSES];
+};
+
+/* A fixed set of threads that background work is queued
+on, rather than each request creating a thread of its own.
+Threads are only created as they're needed, up to the
+maximum, and stay around once they have been.
+
+Each job is classified by the device it reads from. Every
+device class has its own concurrency limit, and can also
+have a bandwidth budget for background jobs. Background
+jobs that report their I/O through ThrottleIo pause while
+there's interactive work for the same device, and while
+they're over budget.
+
+COM is initialized (as a single-threaded apartment) on
+every thread that runs jobs. Low priority jobs are run at
+below normal thread priority. */
+class CThreadPool
+{
+	friend DWORD WINAPI	ThreadPoolWorkerThread(LPVOID pParam);
+	friend DWORD WINAPI	ThreadPoolClassifierThread(LPVOID pParam);
+
+public:
+
+	/* What's reported to ThrottleIo for listing a folder
+	(or reading an item's metadata), where the amount that's
+	actually read isn't known. */
+	static const ULONGLONG	ITEM_IO_SIZE = 4096;
+
+	CThreadPool(int nMaxThreads);
+
+	/* Cancels any jobs that haven't started, and waits
+	(for up to SHUTDOWN_TIMEOUT) for the rest to finish. */
+	~CThreadPool();
+
+	/* The instance shared by the whole process. Should be
+	called from the main thread before any other thread uses
+	it, so that it's never constructed twice. */
+	static CThreadPool	&GetInstance();
+
+	/* A bandwidth of 0 leaves background jobs
+	on the device class unthrottled. */
+	void		SetDeviceClassLimits(DeviceClass_t DeviceClass,int nMaxJobsPerDevice,
+		ULONGLONG ulMaxBytesPerSecond);
+
+	/* The limits each device class starts with. */
+	static void	GetDefaultDeviceClassLimits(DeviceClass_t DeviceClass,int *pnMaxJobsPerDevice,
+		ULONGLONG *pulMaxBytesPerSecond);
+
+	/* szPath (which can be NULL) is the file or folder
+	the job works on. It's used to find the device the job
+	will be reading from. That's done on a thread owned by
+	the pool, so queueing a job never touches the volume.
+	pToken can be NULL; otherwise, the pool holds a
+	reference to it until the job has run. Returns FALSE
+	if the pool is shutting down, in which case the job
+	won't be called. */
+	BOOL		QueueJob(ThreadPoolJobProc_t pfnJob,LPVOID pParam,ThreadPoolPriority_t Priority,
+		const TCHAR *szPath,CCancellationToken *pToken = NULL);
+
+	/* Should be called by a job before it reads or writes
+	each block of data. If the job is a background job,
+	this waits until the device is free of interactive
+	work, and the job is within its device's budget.
+	Returns FALSE if the job has been cancelled. Does
+	nothing (other than return TRUE) if the calling thread
+	isn't running a job. */
+	static BOOL	ThrottleIo(ULONGLONG ulBytes);
+
+	/* A job that spreads its work across threads of its own
+	can have those threads report I/O on its behalf. The
+	context returned by GetJobContext (on the job's thread)
+	is passed to SetJobContext on each of the other threads.
+	It's only valid while the job is running, so the threads
+	have to have finished by the time the job returns. */
+	static LPVOID	GetJobContext();
+	static void		SetJobContext(LPVOID pJobContext);
+
+	/* The number of jobs that can run at once on the device
+	the calling thread's job is tied to. A job that spreads
+	its work across threads of its own should use no more
+	threads than this, so that it stays within the device's
+	limit. Returns 0 if the calling thread isn't running a
+	job, or the job isn't tied to a device. */
+	static int	GetJobDeviceLimit();
+
+	void		GetDeviceStats(std::vector<DeviceStats_t> &DeviceStats) const;
+
+	/* Jobs that are tied to the same device count against
+	the same limit. Currently, this is the lowercased root
+	of the volume the path is on (or the share, for network
+	paths). Returns an empty string if the path is NULL, or
+	the volume can't be determined. */
+	static std::wstring	GetDeviceName(const TCHAR *szPath);
+
+	/* Returns FALSE if the device can't be identified, in
+	which case it's treated as a rotational disk (and
+	DeviceClass is set accordingly). */
+	static BOOL	GetDeviceClass(const std::wstring &strDevice,DeviceClass_t &DeviceClass);
+
+	/* As above, except that the result is remembered,
+	so each device is only ever opened once. */
+	BOOL		LookupDeviceClass(const std::wstring &strDevice,DeviceClass_t &DeviceClass);
+
+	int			GetMaxJobsPerDevice(DeviceClass_t DeviceClass) const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CThreadPool);
+
+	static const int	DEFAULT_MAX_THREADS = 8;
+	static const DWORD	SHUTDOWN_TIMEOUT = 5000;
+
+	/* How often (in milliseconds) a throttled
+	job checks whether it can continue. */
+	static const DWORD	THROTTLE_INTERVAL = 20;
+
+	/* A device's bandwidth budget. Jobs can overdraw
+	it, after which the next job to report I/O waits
+	until the budget has been paid back. */
+	struct Bandwidth_t
+	{
+		LONGLONG	lAvailable;
+		DWORD		dwLastRefill;
+		ULONGLONG	ulBytes;
+		ULONGLONG	ulThrottledTime;
+	};
+
+	struct DeviceClassEntry_t
+	{
+		DeviceClass_t	DeviceClass;
+		BOOL			bKnown;
+	};
+
+	/* A job whose device hasn't been found yet. Jobs
+	are classified on a thread of their own, in the order
+	they were queued, and only then queued by device. */
+	struct UnclassifiedJob_t
+	{
+		CThreadPoolQueue::Job_t	Job;
+		std::wstring			strPath;
+	};
+
+	void		CreateThreadIfNeeded();
+	void		WorkerThread();
+	void		RunJob(CThreadPoolQueue::Job_t &Job);
+	void		CreateClassifierThreadIfNeeded();
+	void		ClassifierThread();
+	BOOL		HasUnclassifiedInteractiveWork() const;
+	BOOL		ThrottleJob(CThreadPoolQueue::Job_t &Job,ULONGLONG ulBytes);
+	BOOL		ConsumeBandwidth(const CThreadPoolQueue::Job_t &Job,ULONGLONG ulBytes,DWORD dwNow);
+
+	mutable CRITICAL_SECTION	m_cs;
+
+	/* Auto-reset. Set whenever there may be a job
+	that an idle thread could pick up. */
+	HANDLE				m_hWorkEvent;
+
+	CThreadPoolQueue	m_Queue;
+	std::vector<HANDLE>	m_Threads;
+	int					m_nMaxThreads;
+	int					m_nIdleThreads;
+	int					m_nSuspendedJobs;
+	BOOL				m_bShuttingDown;
+
+	/* Auto-reset. Set when a job is
+	waiting to be classified. */
+	HANDLE							m_hClassifyEvent;
+	HANDLE							m_hClassifierThread;
+	std::deque<UnclassifiedJob_t>	m_UnclassifiedJobs;
+
+	ULONGLONG			m_ulMaxBytesPerSecond[NUM_DEVICE_CLASSES];
+	std::map<std::wstring,Bandwidth_t>		m_Bandwidth;
+	std::map<std::wstring,DeviceClassEntry_t>	m_DeviceClasses;
+};
+
+typedef void (*ParallelWorkProc_t)(LPVOID pParam,int iItem);
+
+/* Calls pfnWork once for each of nItems items, spread across
+the calling thread and up to nJobs jobs on the shared pool
+(queued at the given priority, and not tied to a device).
+The calling thread takes every item that a job hasn't already
+started, so it never waits on a job that's still queued, only
+on items that are already being worked on. Returns once every
+item has been done. */
+void	RunInParallel(ParallelWorkProc_t pfnWork,LPVOID pParam,int nItems,int nJobs,
+	ThreadPoolPriority_t Priority);
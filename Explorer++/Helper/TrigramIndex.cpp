@@ -0,0 +1,366 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: TrigramIndex.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Indexes names by the three character sequences
+ * they contain, so that substring searches only need
+ * to check a small number of candidate names.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <algorithm>
+#include <iterator>
+#include "TrigramIndex.h"
+#include "Macros.h"
+
+
+CTrigramIndex::CTrigramIndex()
+{
+
+}
+
+void CTrigramIndex::AddName(int iItem,const TCHAR *szName)
+{
+	std::vector<Trigram_t> Trigrams;
+	GetTrigrams(szName,Trigrams);
+
+	for(auto itr = Trigrams.begin();itr != Trigrams.end();itr++)
+	{
+		auto itrPostingList = m_PostingLists.find(*itr);
+
+		if(itrPostingList == m_PostingLists.end())
+		{
+			PostingList_t PostingList;
+			PostingList.nEncodedItems = 0;
+			PostingList.iLastEncodedItem = -1;
+
+			itrPostingList = m_PostingLists.insert(std::make_pair(*itr,PostingList)).first;
+		}
+
+		AddToList(itrPostingList->second,iItem);
+	}
+}
+
+void CTrigramIndex::RemoveName(int iItem,const TCHAR *szName)
+{
+	std::vector<Trigram_t> Trigrams;
+	GetTrigrams(szName,Trigrams);
+
+	for(auto itr = Trigrams.begin();itr != Trigrams.end();itr++)
+	{
+		auto itrPostingList = m_PostingLists.find(*itr);
+
+		if(itrPostingList == m_PostingLists.end())
+		{
+			continue;
+		}
+
+		RemoveFromList(itrPostingList->second,iItem);
+
+		if(itrPostingList->second.nEncodedItems == 0 &&
+			itrPostingList->second.AddedItems.empty())
+		{
+			m_PostingLists.erase(itrPostingList);
+		}
+	}
+}
+
+BOOL CTrigramIndex::GetCandidates(const TCHAR *szSubstring,std::vector<int> &Items) const
+{
+	Items.clear();
+
+	if(static_cast<size_t>(lstrlen(szSubstring)) < MIN_SUBSTRING_LENGTH)
+	{
+		return FALSE;
+	}
+
+	std::vector<Trigram_t> Trigrams;
+	GetTrigrams(szSubstring,Trigrams);
+
+	std::vector<const PostingList_t *> PostingLists;
+
+	for(auto itr = Trigrams.begin();itr != Trigrams.end();itr++)
+	{
+		auto itrPostingList = m_PostingLists.find(*itr);
+
+		/* No name contains this trigram, so no
+		name can contain the substring. */
+		if(itrPostingList == m_PostingLists.end())
+		{
+			return TRUE;
+		}
+
+		PostingLists.push_back(&itrPostingList->second);
+	}
+
+	/* Starting with the shortest list keeps the set
+	of candidates as small as possible. */
+	std::sort(PostingLists.begin(),PostingLists.end(),
+		[] (const PostingList_t *pPostingList1,const PostingList_t *pPostingList2)
+	{
+		return pPostingList1->nEncodedItems + pPostingList1->AddedItems.size() <
+			pPostingList2->nEncodedItems + pPostingList2->AddedItems.size();
+	});
+
+	DecodeList(*PostingLists.front(),Items);
+
+	std::vector<int> OtherItems;
+
+	for(auto itr = PostingLists.begin() + 1;itr != PostingLists.end() && !Items.empty();itr++)
+	{
+		DecodeList(**itr,OtherItems);
+		IntersectItems(Items,OtherItems);
+	}
+
+	return TRUE;
+}
+
+void CTrigramIndex::RemapItems(const std::vector<int> &NewItems)
+{
+	std::vector<int> Items;
+	std::vector<int> RemappedItems;
+
+	for(auto itr = m_PostingLists.begin();itr != m_PostingLists.end();)
+	{
+		DecodeList(itr->second,Items);
+
+		RemappedItems.clear();
+
+		for(auto itrItem = Items.begin();itrItem != Items.end();itrItem++)
+		{
+			if(NewItems[*itrItem] != -1)
+			{
+				RemappedItems.push_back(NewItems[*itrItem]);
+			}
+		}
+
+		if(RemappedItems.empty())
+		{
+			itr = m_PostingLists.erase(itr);
+			continue;
+		}
+
+		EncodeList(RemappedItems,itr->second);
+		itr++;
+	}
+}
+
+void CTrigramIndex::Clear()
+{
+	m_PostingLists.clear();
+}
+
+void CTrigramIndex::Swap(CTrigramIndex &Other)
+{
+	m_PostingLists.swap(Other.m_PostingLists);
+}
+
+size_t CTrigramIndex::GetTrigramCount() const
+{
+	return m_PostingLists.size();
+}
+
+/* Retrieves the distinct (case folded) trigrams
+within a string, in ascending order. */
+void CTrigramIndex::GetTrigrams(const TCHAR *szString,std::vector<Trigram_t> &Trigrams)
+{
+	Trigrams.clear();
+
+	size_t nLength = lstrlen(szString);
+
+	if(nLength < MIN_SUBSTRING_LENGTH)
+	{
+		return;
+	}
+
+	/* Folded in the same way as CWildcardMatcher
+	folds names and patterns. */
+	std::wstring strFolded(nLength,' ');
+	LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,szString,static_cast<int>(nLength),
+		&strFolded[0],static_cast<int>(nLength));
+
+	for(size_t i = 0;i + MIN_SUBSTRING_LENGTH <= nLength;i++)
+	{
+		Trigram_t Trigram = (static_cast<Trigram_t>(static_cast<WORD>(strFolded[i])) << 32) |
+			(static_cast<Trigram_t>(static_cast<WORD>(strFolded[i + 1])) << 16) |
+			static_cast<Trigram_t>(static_cast<WORD>(strFolded[i + 2]));
+
+		Trigrams.push_back(Trigram);
+	}
+
+	std::sort(Trigrams.begin(),Trigrams.end());
+	Trigrams.erase(std::unique(Trigrams.begin(),Trigrams.end()),Trigrams.end());
+}
+
+void CTrigramIndex::AddToList(PostingList_t &PostingList,int iItem)
+{
+	/* The item is already encoded, but was marked
+	as removed. */
+	auto itrRemoved = std::find(PostingList.RemovedItems.begin(),PostingList.RemovedItems.end(),iItem);
+
+	if(itrRemoved != PostingList.RemovedItems.end())
+	{
+		PostingList.RemovedItems.erase(itrRemoved);
+		return;
+	}
+
+	if(iItem > PostingList.iLastEncodedItem)
+	{
+		AppendItem(PostingList,iItem);
+		return;
+	}
+
+	PostingList.AddedItems.push_back(iItem);
+
+	size_t nPendingChanges = PostingList.AddedItems.size() + PostingList.RemovedItems.size();
+
+	if(nPendingChanges > MIN_PENDING_CHANGES &&
+		nPendingChanges > PostingList.nEncodedItems / 8)
+	{
+		std::vector<int> Items;
+		DecodeList(PostingList,Items);
+		EncodeList(Items,PostingList);
+	}
+}
+
+void CTrigramIndex::RemoveFromList(PostingList_t &PostingList,int iItem)
+{
+	auto itrAdded = std::find(PostingList.AddedItems.begin(),PostingList.AddedItems.end(),iItem);
+
+	if(itrAdded != PostingList.AddedItems.end())
+	{
+		PostingList.AddedItems.erase(itrAdded);
+		return;
+	}
+
+	PostingList.RemovedItems.push_back(iItem);
+
+	size_t nPendingChanges = PostingList.AddedItems.size() + PostingList.RemovedItems.size();
+
+	/* Once every encoded item has been removed, the
+	list is re-encoded straight away, so that it can
+	be dropped. */
+	if((nPendingChanges > MIN_PENDING_CHANGES &&
+		nPendingChanges > PostingList.nEncodedItems / 8) ||
+		PostingList.RemovedItems.size() >= PostingList.nEncodedItems)
+	{
+		std::vector<int> Items;
+		DecodeList(PostingList,Items);
+		EncodeList(Items,PostingList);
+	}
+}
+
+/* Each item is stored as the difference from the
+previous item, seven bits per byte. The top bit of
+each byte is set if more bytes follow. */
+void CTrigramIndex::AppendItem(PostingList_t &PostingList,int iItem)
+{
+	DWORD dwDelta = static_cast<DWORD>(iItem - PostingList.iLastEncodedItem);
+
+	while(dwDelta >= 0x80)
+	{
+		PostingList.EncodedItems.push_back(static_cast<BYTE>(dwDelta | 0x80));
+		dwDelta >>= 7;
+	}
+
+	PostingList.EncodedItems.push_back(static_cast<BYTE>(dwDelta));
+
+	PostingList.iLastEncodedItem = iItem;
+	PostingList.nEncodedItems++;
+}
+
+void CTrigramIndex::DecodeList(const PostingList_t &PostingList,std::vector<int> &Items)
+{
+	Items.clear();
+	Items.reserve(PostingList.nEncodedItems + PostingList.AddedItems.size());
+
+	int iItem = -1;
+	DWORD dwDelta = 0;
+	int iShift = 0;
+
+	for(auto itr = PostingList.EncodedItems.begin();itr != PostingList.EncodedItems.end();itr++)
+	{
+		dwDelta |= static_cast<DWORD>(*itr & 0x7F) << iShift;
+
+		if((*itr & 0x80) == 0x80)
+		{
+			iShift += 7;
+			continue;
+		}
+
+		iItem += static_cast<int>(dwDelta);
+		Items.push_back(iItem);
+
+		dwDelta = 0;
+		iShift = 0;
+	}
+
+	if(!PostingList.AddedItems.empty())
+	{
+		std::vector<int> AddedItems(PostingList.AddedItems);
+		std::sort(AddedItems.begin(),AddedItems.end());
+
+		size_t nItems = Items.size();
+		Items.insert(Items.end(),AddedItems.begin(),AddedItems.end());
+		std::inplace_merge(Items.begin(),Items.begin() + nItems,Items.end());
+		Items.erase(std::unique(Items.begin(),Items.end()),Items.end());
+	}
+
+	if(!PostingList.RemovedItems.empty())
+	{
+		std::vector<int> RemovedItems(PostingList.RemovedItems);
+		std::sort(RemovedItems.begin(),RemovedItems.end());
+
+		std::vector<int> RemainingItems;
+		std::set_difference(Items.begin(),Items.end(),RemovedItems.begin(),RemovedItems.end(),
+			std::back_inserter(RemainingItems));
+		Items.swap(RemainingItems);
+	}
+}
+
+void CTrigramIndex::EncodeList(const std::vector<int> &Items,PostingList_t &PostingList)
+{
+	PostingList.EncodedItems.clear();
+	PostingList.nEncodedItems = 0;
+	PostingList.iLastEncodedItem = -1;
+	PostingList.AddedItems.clear();
+	PostingList.RemovedItems.clear();
+
+	for(auto itr = Items.begin();itr != Items.end();itr++)
+	{
+		AppendItem(PostingList,*itr);
+	}
+}
+
+/* Keeps only those items that also appear in OtherItems.
+Both lists are sorted. Since Items is usually much
+shorter, each item is found with a binary search over
+the part of OtherItems that hasn't yet been passed. */
+void CTrigramIndex::IntersectItems(std::vector<int> &Items,const std::vector<int> &OtherItems)
+{
+	auto itrOther = OtherItems.begin();
+	auto itrOutput = Items.begin();
+
+	for(auto itr = Items.begin();itr != Items.end();itr++)
+	{
+		itrOther = std::lower_bound(itrOther,OtherItems.end(),*itr);
+
+		if(itrOther == OtherItems.end())
+		{
+			break;
+		}
+
+		if(*itrOther == *itr)
+		{
+			*itrOutput++ = *itr;
+		}
+	}
+
+	Items.erase(itrOutput,Items.end());
+}
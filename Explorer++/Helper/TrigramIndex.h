@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include "Macros.h"
+
+/* Maps each three character sequence (trigram) that
+appears in a set of names to the items whose names
+contain it. A name can only contain a substring if it
+contains every trigram within that substring, so the
+index can be used to narrow the names that need to be
+checked before doing an exact match.
+
+Trigrams are case folded, so the candidates returned
+for a substring include any names that contain it in
+a different case.
+
+Each item list (posting list) is stored as a sorted,
+delta encoded sequence of variable length integers.
+Items are usually added in ascending order, in which
+case they're simply appended. Items added out of order,
+and items that are removed, are held separately and
+folded into the encoded list once enough of them have
+built up. */
+class CTrigramIndex
+{
+public:
+
+	/* Substrings shorter than this can't
+	be looked up. */
+	static const size_t	MIN_SUBSTRING_LENGTH = 3;
+
+	CTrigramIndex();
+
+	/* The same name must be passed when an item is
+	removed as was passed when it was added. */
+	void	AddName(int iItem,const TCHAR *szName);
+	void	RemoveName(int iItem,const TCHAR *szName);
+
+	/* Retrieves (in ascending order) every item whose
+	name may contain szSubstring. Returns FALSE if the
+	substring is too short to be looked up. */
+	BOOL	GetCandidates(const TCHAR *szSubstring,std::vector<int> &Items) const;
+
+	/* Renumbers every item. NewItems maps each existing
+	item to its new number, or to -1 if the item should
+	be dropped. The mapping must preserve the order of
+	the items that remain. */
+	void	RemapItems(const std::vector<int> &NewItems);
+
+	void	Clear();
+	void	Swap(CTrigramIndex &Other);
+
+	/* The number of distinct trigrams in the index. */
+	size_t	GetTrigramCount() const;
+
+private:
+
+	DISALLOW_COPY_AND_ASSIGN(CTrigramIndex);
+
+	/* Once the number of pending changes to a list
+	exceeds both this and an eighth of the size of
+	the list, the list is re-encoded. */
+	static const size_t	MIN_PENDING_CHANGES = 32;
+
+	typedef ULONGLONG	Trigram_t;
+
+	struct PostingList_t
+	{
+		std::vector<BYTE>	EncodedItems;
+		size_t				nEncodedItems;
+		int					iLastEncodedItem;
+
+		std::vector<int>	AddedItems;
+		std::vector<int>	RemovedItems;
+	};
+
+	static void	GetTrigrams(const TCHAR *szString,std::vector<Trigram_t> &Trigrams);
+
+	static void	AddToList(PostingList_t &PostingList,int iItem);
+	static void	RemoveFromList(PostingList_t &PostingList,int iItem);
+	static void	AppendItem(PostingList_t &PostingList,int iItem);
+	static void	DecodeList(const PostingList_t &PostingList,std::vector<int> &Items);
+	static void	EncodeList(const std::vector<int> &Items,PostingList_t &PostingList);
+	static void	IntersectItems(std::vector<int> &Items,const std::vector<int> &OtherItems);
+
+	std::unordered_map<Trigram_t,PostingList_t>	m_PostingLists;
+};
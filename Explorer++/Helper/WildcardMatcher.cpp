@@ -0,0 +1,339 @@
+/******************************************************************
+ *
+ * Project: Helper
+ * File: WildcardMatcher.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Matches strings against a precompiled list of
+ * wildcard patterns.
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include "WildcardMatcher.h"
+#include "StringHelper.h"
+#include "Macros.h"
+
+
+namespace
+{
+	const TCHAR PATTERN_SEPARATOR = ':';
+
+	std::wstring ToLowerCase(const std::wstring &str)
+	{
+		if(str.empty())
+		{
+			return str;
+		}
+
+		std::wstring strLower(str.size(),' ');
+		LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,str.c_str(),static_cast<int>(str.size()),
+			&strLower[0],static_cast<int>(strLower.size()));
+
+		return strLower;
+	}
+
+	BOOL ContainsWildcards(const std::wstring &str)
+	{
+		return (str.find_first_of(_T("*?")) != std::wstring::npos);
+	}
+
+	BOOL MatchCharacter(TCHAR chPattern,TCHAR chString,BOOL bStringIsPattern)
+	{
+		if(bStringIsPattern)
+		{
+			if(chPattern == '?')
+			{
+				return (chString != '*');
+			}
+
+			return (chPattern == chString && chString != '?');
+		}
+
+		return (chPattern == '?' || chPattern == chString);
+	}
+}
+
+CWildcardMatcher::CWildcardMatcher() :
+m_bCaseSensitive(FALSE),
+m_bMatchAll(FALSE)
+{
+	AddPattern(EMPTY_STRING);
+}
+
+CWildcardMatcher::CWildcardMatcher(const TCHAR *szPatterns,BOOL bCaseSensitive) :
+m_bCaseSensitive(bCaseSensitive),
+m_bMatchAll(FALSE)
+{
+	std::wstring strPatterns(szPatterns);
+
+	/* As with CheckWildcardMatch, a pattern is only split
+	(and each piece trimmed) if it contains a separator. */
+	if(strPatterns.find(PATTERN_SEPARATOR) == std::wstring::npos)
+	{
+		AddPattern(strPatterns);
+		return;
+	}
+
+	size_t uStart = 0;
+
+	while(uStart <= strPatterns.size())
+	{
+		size_t uEnd = strPatterns.find(PATTERN_SEPARATOR,uStart);
+
+		if(uEnd == std::wstring::npos)
+		{
+			uEnd = strPatterns.size();
+		}
+
+		/* Empty patterns (e.g. "*.h::*.cpp") are skipped
+		entirely. Patterns that become empty after trimming
+		are kept, and only match the empty string. */
+		if(uEnd > uStart)
+		{
+			std::wstring strPattern = strPatterns.substr(uStart,uEnd - uStart);
+			TrimString(strPattern,_T(" "));
+			AddPattern(strPattern);
+		}
+
+		uStart = uEnd + 1;
+	}
+}
+
+void CWildcardMatcher::AddPattern(const std::wstring &strPatternIn)
+{
+	std::wstring strPattern = m_bCaseSensitive ? strPatternIn : ToLowerCase(strPatternIn);
+
+	m_Patterns.push_back(strPattern);
+
+	if(!ContainsWildcards(strPattern))
+	{
+		m_ExactMatches.insert(strPattern);
+		return;
+	}
+
+	size_t uFirstNonStar = strPattern.find_first_not_of('*');
+
+	if(uFirstNonStar == std::wstring::npos)
+	{
+		m_bMatchAll = TRUE;
+		return;
+	}
+
+	size_t uLastNonStar = strPattern.find_last_not_of('*');
+	std::wstring strLiteral = strPattern.substr(uFirstNonStar,uLastNonStar - uFirstNonStar + 1);
+
+	if(!ContainsWildcards(strLiteral))
+	{
+		BOOL bLeadingStar = (uFirstNonStar > 0);
+		BOOL bTrailingStar = (uLastNonStar < strPattern.size() - 1);
+
+		if(bLeadingStar && !bTrailingStar)
+		{
+			/* "*.ext" is equivalent to checking that the
+			text after the last '.' is "ext", provided the
+			extension doesn't itself contain a '.'. */
+			if(strLiteral[0] == '.' && strLiteral.find('.',1) == std::wstring::npos)
+			{
+				m_Extensions.insert(strLiteral.substr(1));
+			}
+			else
+			{
+				m_Suffixes.push_back(strLiteral);
+			}
+
+			return;
+		}
+		else if(!bLeadingStar && bTrailingStar)
+		{
+			m_Prefixes.push_back(strLiteral);
+			return;
+		}
+	}
+
+	m_GlobPatterns.push_back(strPattern);
+}
+
+BOOL CWildcardMatcher::Match(const TCHAR *szString) const
+{
+	if(m_bMatchAll)
+	{
+		return TRUE;
+	}
+
+	if(m_bCaseSensitive)
+	{
+		return MatchInternal(szString);
+	}
+
+	return MatchInternal(ToLowerCase(szString));
+}
+
+BOOL CWildcardMatcher::MatchInternal(const std::wstring &str) const
+{
+	if(!m_ExactMatches.empty() &&
+		m_ExactMatches.find(str) != m_ExactMatches.end())
+	{
+		return TRUE;
+	}
+
+	if(!m_Extensions.empty())
+	{
+		size_t uDot = str.rfind('.');
+
+		if(uDot != std::wstring::npos &&
+			m_Extensions.find(str.substr(uDot + 1)) != m_Extensions.end())
+		{
+			return TRUE;
+		}
+	}
+
+	for(auto itr = m_Prefixes.begin();itr != m_Prefixes.end();itr++)
+	{
+		if(str.compare(0,itr->size(),*itr) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	for(auto itr = m_Suffixes.begin();itr != m_Suffixes.end();itr++)
+	{
+		if(str.size() >= itr->size() &&
+			str.compare(str.size() - itr->size(),itr->size(),*itr) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	for(auto itr = m_GlobPatterns.begin();itr != m_GlobPatterns.end();itr++)
+	{
+		if(GlobMatch(itr->c_str(),str.c_str(),FALSE))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+BOOL CWildcardMatcher::IsSubsetOf(const CWildcardMatcher &Other) const
+{
+	/* A case insensitive pattern can match strings
+	that a case sensitive one can't. */
+	if(!m_bCaseSensitive && Other.m_bCaseSensitive)
+	{
+		return FALSE;
+	}
+
+	for(auto itr = m_Patterns.begin();itr != m_Patterns.end();itr++)
+	{
+		std::wstring strPattern = (m_bCaseSensitive && !Other.m_bCaseSensitive) ? ToLowerCase(*itr) : *itr;
+		BOOL bContained = FALSE;
+
+		/* If the other pattern matches this pattern (treating
+		this pattern's wildcards as ordinary characters that
+		can only be matched by an equivalent or broader
+		wildcard), then it will also match anything this
+		pattern matches. */
+		for(auto itrOther = Other.m_Patterns.begin();itrOther != Other.m_Patterns.end();itrOther++)
+		{
+			if(GlobMatch(itrOther->c_str(),strPattern.c_str(),TRUE))
+			{
+				bContained = TRUE;
+				break;
+			}
+		}
+
+		if(!bContained)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+BOOL CWildcardMatcher::GetRequiredLiterals(std::vector<std::wstring> &Literals) const
+{
+	Literals.clear();
+
+	for(auto itr = m_Patterns.begin();itr != m_Patterns.end();itr++)
+	{
+		std::wstring strLongestLiteral;
+		size_t uStart = 0;
+
+		while(uStart < itr->size())
+		{
+			size_t uEnd = itr->find_first_of(_T("*?"),uStart);
+
+			if(uEnd == std::wstring::npos)
+			{
+				uEnd = itr->size();
+			}
+
+			if(uEnd - uStart > strLongestLiteral.size())
+			{
+				strLongestLiteral = itr->substr(uStart,uEnd - uStart);
+			}
+
+			uStart = uEnd + 1;
+		}
+
+		if(strLongestLiteral.empty())
+		{
+			return FALSE;
+		}
+
+		Literals.push_back(strLongestLiteral);
+	}
+
+	return TRUE;
+}
+
+/* Standard greedy glob matching. When a mismatch occurs,
+only the most recent '*' needs to be revisited (earlier
+stars can never produce a match the latest one can't),
+so there's no recursion and no exponential blowup.
+
+If bStringIsPattern is set, the string is itself treated
+as a pattern. In that case, a '?' in the pattern can't
+match a '*' in the string, and a literal character can't
+match either wildcard. */
+BOOL CWildcardMatcher::GlobMatch(const TCHAR *szPattern,const TCHAR *szString,BOOL bStringIsPattern)
+{
+	const TCHAR *szStarPattern = NULL;
+	const TCHAR *szStarString = NULL;
+
+	while(*szString != '\0')
+	{
+		if(*szPattern == '*')
+		{
+			szStarPattern = szPattern++;
+			szStarString = szString;
+		}
+		else if(*szPattern != '\0' && MatchCharacter(*szPattern,*szString,bStringIsPattern))
+		{
+			szPattern++;
+			szString++;
+		}
+		else if(szStarPattern != NULL)
+		{
+			szPattern = szStarPattern + 1;
+			szString = ++szStarString;
+		}
+		else
+		{
+			return FALSE;
+		}
+	}
+
+	while(*szPattern == '*')
+	{
+		szPattern++;
+	}
+
+	return (*szPattern == '\0');
+}
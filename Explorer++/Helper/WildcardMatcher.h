@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <unordered_set>
+
+/* A compiled form of the wildcard pattern lists accepted
+by CheckWildcardMatch (e.g. "*.h: *.cpp"). The pattern
+list is parsed once, after which each string can be
+checked without any further parsing or copying of the
+patterns.
+
+Patterns are sorted into the cheapest check that can
+handle them:
+
+- Patterns with no wildcards are matched exactly.
+- "*.ext" patterns are matched by looking up the
+  string's extension in a hash set.
+- "abc*" and "*abc" patterns are prefix/suffix checks.
+- Anything else is matched with an iterative (non-recursive)
+  glob matcher. */
+class CWildcardMatcher
+{
+public:
+
+	CWildcardMatcher();
+	CWildcardMatcher(const TCHAR *szPatterns,BOOL bCaseSensitive);
+
+	BOOL	Match(const TCHAR *szString) const;
+
+	/* Returns TRUE if every string this matcher accepts
+	is also accepted by Other. A FALSE result doesn't
+	necessarily mean that isn't the case; only simple
+	containment (e.g. "*abc*" within "*ab*") is
+	detected. */
+	BOOL	IsSubsetOf(const CWildcardMatcher &Other) const;
+
+	/* Retrieves the longest run of characters without
+	wildcards from each pattern (lowercased, if matching
+	is case insensitive). Every string this matcher
+	accepts contains at least one of these runs. Returns
+	FALSE if some pattern has no such run (e.g. "*"). */
+	BOOL	GetRequiredLiterals(std::vector<std::wstring> &Literals) const;
+
+private:
+
+	void	AddPattern(const std::wstring &strPattern);
+	BOOL	MatchInternal(const std::wstring &str) const;
+
+	static BOOL	GlobMatch(const TCHAR *szPattern,const TCHAR *szString,BOOL bStringIsPattern);
+
+	BOOL								m_bCaseSensitive;
+	BOOL								m_bMatchAll;
+
+	std::unordered_set<std::wstring>	m_ExactMatches;
+	std::unordered_set<std::wstring>	m_Extensions;
+	std::vector<std::wstring>			m_Prefixes;
+	std::vector<std::wstring>			m_Suffixes;
+	std::vector<std::wstring>			m_GlobPatterns;
+
+	/* Every pattern, as it was added. Only used
+	when comparing matchers. */
+	std::vector<std::wstring>			m_Patterns;
+};
@@ -25,12 +25,13 @@
 #include "../Helper/Helper.h"
 #include "../Helper/DriveInfo.h"
 #include "../Helper/ShellHelper.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
 LRESULT CALLBACK	TreeViewProcStub(HWND hwnd,UINT uMsg,WPARAM wParam,LPARAM lParam,UINT_PTR uIdSubclass,DWORD_PTR dwRefData);
 int CALLBACK		CompareItemsStub(LPARAM lParam1,LPARAM lParam2,LPARAM lParamSort);
-DWORD WINAPI		Thread_SubFoldersStub(LPVOID pVoid);
+void				SubFoldersJob(LPVOID pParam,const CCancellationToken *pToken);
 DWORD WINAPI		Thread_MonitorAllDrives(LPVOID pParam);
 void CALLBACK		TVFindIconAPC(ULONG_PTR dwParam);
 BOOL				RemoveFromIconFinderQueue(TreeViewInfo_t *pListViewInfo);
@@ -656,8 +657,8 @@ HTREEITEM hParent)
 		pThreadInfo->hParent		= hParent;
 		pThreadInfo->pMyTreeView	= this;
 
-		HANDLE hThread = CreateThread(NULL,0,Thread_SubFoldersStub,pThreadInfo,0,NULL);
-		CloseHandle(hThread);
+		CThreadPool::GetInstance().QueueJob(SubFoldersJob,pThreadInfo,THREAD_POOL_PRIORITY_NORMAL,
+			bVirtualFolder ? NULL : szDirectory);
 	}
 }
 
@@ -709,8 +710,10 @@ int CMyTreeView::GenerateUniqueItemId(void)
 	}
 }
 
-DWORD WINAPI Thread_SubFoldersStub(LPVOID pParam)
+void SubFoldersJob(LPVOID pParam,const CCancellationToken *pToken)
 {
+	UNREFERENCED_PARAMETER(pToken);
+
 	CMyTreeView		*pMyTreeView = NULL;
 	ThreadInfo_t	*pThreadInfo = NULL;
 
@@ -718,13 +721,7 @@ DWORD WINAPI Thread_SubFoldersStub(LPVOID pParam)
 
 	pMyTreeView = pThreadInfo->pMyTreeView;
 
-	CoInitializeEx(NULL,COINIT_APARTMENTTHREADED);
-
 	pMyTreeView->Thread_SubFolders(pParam);
-
-	CoUninitialize();
-
-	return 0;
 }
 
 DWORD WINAPI CMyTreeView::Thread_SubFolders(LPVOID pParam)
@@ -778,6 +775,10 @@ DWORD WINAPI CMyTreeView::Thread_SubFolders(LPVOID pParam)
 
 			if(bValid)
 			{
+				/* Probes are interactive, so this never
+				waits; the I/O is only counted. */
+				CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE);
+
 				hr = SHBindToParent(pidl, IID_PPV_ARGS(&pShellFolder), (LPCITEMIDLIST *) &pidlRelative);
 
 				if(SUCCEEDED(hr))
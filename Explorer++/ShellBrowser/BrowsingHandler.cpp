@@ -256,6 +256,11 @@ void inline CShellBrowser::InsertAwaitingItems(BOOL bInsertIntoGroup)
 	if(m_bAutoArrange)
 		NListView::ListView_SetAutoArrange(m_hListView,TRUE);
 
+	/* Group item counts are only written out
+	once all items have been inserted. */
+	if(bInsertIntoGroup)
+		UpdateGroupHeaders();
+
 	m_nTotalItems = nPrevItems + nAdded;
 
 	if(m_ViewMode == VM_DETAILS)
@@ -263,8 +268,6 @@ void inline CShellBrowser::InsertAwaitingItems(BOOL bInsertIntoGroup)
 		TCHAR szDrive[MAX_PATH];
 		BOOL bNetworkRemovable = FALSE;
 
-		QueueUserAPC(SetAllColumnDataAPC,m_hThread,(ULONG_PTR)this);
-
 		StringCchCopy(szDrive,SIZEOF_ARRAY(szDrive),m_CurDir);
 		PathStripToRoot(szDrive);
 
@@ -277,8 +280,8 @@ void inline CShellBrowser::InsertAwaitingItems(BOOL bInsertIntoGroup)
 		/* If the user has selected to disable folder sizes
 		on removable drives or networks, and we are currently
 		on such a drive, do not calculate folder sizes. */
-		if(m_bShowFolderSizes && !(m_bDisableFolderSizesNetworkRemovable && bNetworkRemovable))
-			QueueUserAPC(SetAllFolderSizeColumnDataAPC,m_hFolderSizeThread,(ULONG_PTR)this);
+		QueueColumnDataJobs(m_bShowFolderSizes &&
+			!(m_bDisableFolderSizesNetworkRemovable && bNetworkRemovable));
 	}
 
 	PositionDroppedItems();
@@ -611,6 +614,10 @@ LPITEMIDLIST pidlRelative,const TCHAR *szFileName)
 
 	uItemId = GenerateUniqueItemId();
 
+	/* The internal index may have been used by a
+	previous item. */
+	InvalidateItemKeys(uItemId);
+
 	m_pExtraItemInfo[uItemId].pridl					= ILClone(pidlRelative);
 	m_pExtraItemInfo[uItemId].bIconRetrieved		= FALSE;
 	m_pExtraItemInfo[uItemId].bThumbnailRetreived	= FALSE;
@@ -660,5 +667,7 @@ LPITEMIDLIST pidlRelative,const TCHAR *szFileName)
 		m_pExtraItemInfo[uItemId].bReal = FALSE;
 	}
 
+	DetermineItemColorRule(uItemId);
+
 	return uItemId;
 }
\ No newline at end of file
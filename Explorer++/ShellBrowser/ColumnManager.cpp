@@ -43,6 +43,8 @@ http://stackoverflow.com/questions/2364774/why-do-i-need-to-compile-datetime-in-
 #include "../Helper/DriveInfo.h"
 #include "../Helper/ShellHelper.h"
 #include "../Helper/FolderSize.h"
+#include "../Helper/FolderSizeCache.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
@@ -52,9 +54,9 @@ BOOL GetPrinterStatusDescription(DWORD dwStatus, TCHAR *szStatus, size_t cchMax)
 When first browsing into a folder, all items in queue
 are cleared.
 Then, all new items are added.
-Finally, the APC is queued to the worker thread.
+Finally, a job is queued on the thread pool.
 
-The worker thread will process items, removing items
+The job will process items, removing items
 from the queue as it does. Interlocking is required
 between queue removal and emptying the queue.
 
@@ -116,10 +118,19 @@ void CShellBrowser::EmptyFolderQueue(void)
 
 	m_pFolderInfoList.clear();
 
+	/* Any folder that's still being walked belongs
+	to the previous listing. */
+	m_pFolderSizeToken->Cancel();
+	m_pFolderSizeToken->Release();
+	m_pFolderSizeToken = new CCancellationToken();
+
 	LeaveCriticalSection(&m_folder_cs);
 }
 
-BOOL CShellBrowser::RemoveFromFolderQueue(int *iItem)
+/* The token is checked under the same lock it's
+cancelled under, so that a job for a previous listing
+can't take items queued for the current one. */
+BOOL CShellBrowser::RemoveFromFolderQueue(const CCancellationToken *pToken,int *iItem)
 {
 	BOOL bQueueNotEmpty;
 
@@ -127,7 +138,7 @@ BOOL CShellBrowser::RemoveFromFolderQueue(int *iItem)
 
 	SetEvent(m_hFolderQueueEvent);
 
-	if(m_pFolderInfoList.empty() == TRUE)
+	if(pToken->IsCancelled() || m_pFolderInfoList.empty() == TRUE)
 	{
 		bQueueNotEmpty = FALSE;
 	}
@@ -153,13 +164,68 @@ BOOL CShellBrowser::RemoveFromFolderQueue(int *iItem)
 	return bQueueNotEmpty;
 }
 
-void CALLBACK SetAllFolderSizeColumnDataAPC(ULONG_PTR dwParam)
+/* Passed to the folder size cache, so that the
+size column can be updated as the folder is walked. */
+struct FolderSizeColumnProgress_t
+{
+	CShellBrowser				*pShellBrowser;
+	const CCancellationToken	*pToken;
+	int							iItem;
+	int							iItemInternal;
+	int							iColumnIndex;
+};
+
+void FolderSizeColumnProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData)
 {
-	CShellBrowser *pShellBrowser = reinterpret_cast<CShellBrowser *>(dwParam);
-	pShellBrowser->SetAllFolderSizeColumnData();
+	UNREFERENCED_PARAMETER(iRoot);
+
+	FolderSizeColumnProgress_t *pProgress = reinterpret_cast<FolderSizeColumnProgress_t *>(pData);
+	CShellBrowser *pShellBrowser = pProgress->pShellBrowser;
+
+	/* The token is replaced for each listing, so once
+	it's been cancelled, the row may belong to another
+	folder. Within the listing, the row may since have
+	moved (e.g. after a sort). */
+	if(pProgress->pToken->IsCancelled())
+	{
+		return;
+	}
+
+	LVITEM lvItem;
+	lvItem.mask		= LVIF_PARAM;
+	lvItem.iItem	= pProgress->iItem;
+	lvItem.iSubItem	= 0;
+
+	if(!ListView_GetItem(pShellBrowser->m_hListView,&lvItem) ||
+		static_cast<int>(lvItem.lParam) != pProgress->iItemInternal)
+	{
+		return;
+	}
+
+	ULARGE_INTEGER lTotalFolderSize;
+	lTotalFolderSize.QuadPart = pTotals->ulSize;
+
+	TCHAR lpszFileSize[32];
+	FormatSizeString(lTotalFolderSize,lpszFileSize,SIZEOF_ARRAY(lpszFileSize),
+		pShellBrowser->m_bForceSize,pShellBrowser->m_SizeDisplayFormat);
+
+	/* The size isn't stored against the item until it's
+	complete (so that it isn't sorted on); the trailing
+	ellipsis marks it as a partial size. */
+	TCHAR lpszPartialSize[40];
+	StringCchPrintf(lpszPartialSize,SIZEOF_ARRAY(lpszPartialSize),_T("%s..."),lpszFileSize);
+
+	ListView_SetItemText(pShellBrowser->m_hListView,pProgress->iItem,
+		pProgress->iColumnIndex,lpszPartialSize);
 }
 
-int CShellBrowser::SetAllFolderSizeColumnData(void)
+void SetAllFolderSizeColumnDataJob(LPVOID pParam,const CCancellationToken *pToken)
+{
+	CShellBrowser *pShellBrowser = reinterpret_cast<CShellBrowser *>(pParam);
+	pShellBrowser->SetAllFolderSizeColumnData(pToken);
+}
+
+int CShellBrowser::SetAllFolderSizeColumnData(const CCancellationToken *pToken)
 {
 	std::list<Column_t>::iterator itr;
 	LVITEM lvItem;
@@ -167,7 +233,7 @@ int CShellBrowser::SetAllFolderSizeColumnData(void)
 	int iItem;
 	int iColumnIndex = 0;
 
-	bQueueNotEmpty = RemoveFromFolderQueue(&iItem);
+	bQueueNotEmpty = RemoveFromFolderQueue(pToken,&iItem);
 
 	while(bQueueNotEmpty)
 	{
@@ -186,8 +252,7 @@ int CShellBrowser::SetAllFolderSizeColumnData(void)
 					TCHAR			FullItemPath[MAX_PATH];
 					TCHAR			lpszFileSize[32];
 					ULARGE_INTEGER	lTotalFolderSize;
-					int				nFolders;
-					int				nFiles;
+					FolderSizeTotals_t	Totals;
 
 					LVITEM lvChildItem;
 					int iItemInternal;
@@ -204,12 +269,24 @@ int CShellBrowser::SetAllFolderSizeColumnData(void)
 
 						QueryFullItemName(iItem,FullItemPath,SIZEOF_ARRAY(FullItemPath));
 
-						CalculateFolderSize(FullItemPath,&nFolders,&nFiles,&lTotalFolderSize);
+						FolderSizeColumnProgress_t Progress;
+						Progress.pShellBrowser	= this;
+						Progress.pToken			= pToken;
+						Progress.iItem			= iItem;
+						Progress.iItemInternal	= iItemInternal;
+						Progress.iColumnIndex	= iColumnIndex;
+
+						/* Shared with any other tab (or the display
+						window) showing the size of the same folder. */
+						HRESULT hr = CFolderSizeCache::GetInstance().GetFolderSize(FullItemPath,Totals,pToken,
+							FolderSizeColumnProgress,&Progress);
+						lTotalFolderSize.QuadPart = Totals.ulSize;
 
 						/* Does the item still exist? */
 						/* TODO: Need to lock this against the main thread. */
 						/* TODO: Discard the result if the folder was deleted. */
-						if(m_pItemMap[(int)lvChildItem.lParam] == 1)
+						if(SUCCEEDED(hr) && !pToken->IsCancelled() &&
+							m_pItemMap[(int)lvChildItem.lParam] == 1)
 						{
 							m_pwfdFiles[(int)lvChildItem.lParam].nFileSizeLow = lTotalFolderSize.LowPart;
 							m_pwfdFiles[(int)lvChildItem.lParam].nFileSizeHigh = lTotalFolderSize.HighPart;
@@ -232,7 +309,7 @@ int CShellBrowser::SetAllFolderSizeColumnData(void)
 
 		iColumnIndex = 0;
 
-		bQueueNotEmpty = RemoveFromFolderQueue(&iItem);
+		bQueueNotEmpty = RemoveFromFolderQueue(pToken,&iItem);
 	}
 
 	ApplyHeaderSortArrow();
@@ -240,12 +317,31 @@ int CShellBrowser::SetAllFolderSizeColumnData(void)
 	return 0;
 }
 
-void CALLBACK SetAllColumnDataAPC(ULONG_PTR dwParam)
+void SetAllColumnDataJob(LPVOID pParam,const CCancellationToken *pToken)
 {
-	CShellBrowser *pShellBrowser = reinterpret_cast<CShellBrowser *>(dwParam);
+	UNREFERENCED_PARAMETER(pToken);
+
+	CShellBrowser *pShellBrowser = reinterpret_cast<CShellBrowser *>(pParam);
 	pShellBrowser->SetAllColumnText();
 }
 
+/* The column text is shown straight away, so it's
+queued as interactive work. Folder sizes can take a
+long time to walk, so they're left to the background,
+where they give way to anything more urgent on the
+same disk. */
+void CShellBrowser::QueueColumnDataJobs(BOOL bFolderSizes)
+{
+	CThreadPool::GetInstance().QueueJob(SetAllColumnDataJob,reinterpret_cast<LPVOID>(this),
+		THREAD_POOL_PRIORITY_NORMAL,m_CurDir);
+
+	if(bFolderSizes)
+	{
+		CThreadPool::GetInstance().QueueJob(SetAllFolderSizeColumnDataJob,reinterpret_cast<LPVOID>(this),
+			THREAD_POOL_PRIORITY_LOW,m_CurDir,m_pFolderSizeToken);
+	}
+}
+
 void CShellBrowser::SetAllColumnText(void)
 {
 	int ItemIndex;
@@ -255,6 +351,10 @@ void CShellBrowser::SetAllColumnText(void)
 	{
 		int iColumnIndex = 0;
 
+		/* Some columns read the item's metadata. This
+		is interactive work, so it's only counted. */
+		CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE);
+
 		for(auto itr = m_pActiveColumnList->begin();itr != m_pActiveColumnList->end();itr++)
 		{
 			if(itr->bChecked)
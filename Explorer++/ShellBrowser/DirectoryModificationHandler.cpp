@@ -410,6 +410,9 @@ void CShellBrowser::ModifyItemInternal(const TCHAR *FileName)
 
 		hFirstFile = FindFirstFile(FullFileName,&m_pwfdFiles[iItemInternal]);
 
+		InvalidateItemKeys(iItemInternal);
+		DetermineItemColorRule(iItemInternal);
+
 		if(hFirstFile != INVALID_HANDLE_VALUE)
 		{
 			ulFileSize.LowPart = m_pwfdFiles[iItemInternal].nFileSizeLow;
@@ -565,6 +568,9 @@ void CShellBrowser::RenameItem(int iItemInternal,const TCHAR *szNewFileName)
 					SIZEOF_ARRAY(m_pwfdFiles[iItemInternal].cFileName),
 					szNewFileName);
 
+				InvalidateItemKeys(iItemInternal);
+				DetermineItemColorRule(iItemInternal);
+
 				/* The files' type may have changed, so retrieve the files'
 				icon again. */
 				res = SHGetFileInfo((LPTSTR)pidlFull,0,&shfi,
@@ -14,11 +14,13 @@
 
 #include "stdafx.h"
 #include <list>
+#include <vector>
 #include <cassert>
 #include "IShellView.h"
 #include "iShellBrowser_internal.h"
 #include "../Helper/Helper.h"
 #include "../Helper/ShellHelper.h"
+#include "../Helper/ThreadPool.h"
 #include "../Helper/Macros.h"
 
 
@@ -27,8 +29,40 @@ namespace
 	static const UINT KBYTE = 1024;
 	static const UINT MBYTE = 1024 * 1024;
 	static const UINT GBYTE = 1024 * 1024 *1024;
+
+	/* Below this number of items, group headers
+	are determined on the calling thread. */
+	static const size_t PARALLEL_GROUP_KEY_THRESHOLD = 256;
+	static const int MAX_GROUP_KEY_THREADS = 8;
+
+	/* Groups in these modes depend on more than the
+	item itself (the current date, or how full a disk
+	is), so their keys can't be kept between regroups. */
+	BOOL IsGroupKeyVolatile(UINT SortMode)
+	{
+		switch(SortMode)
+		{
+		case FSM_DATEMODIFIED:
+		case FSM_CREATED:
+		case FSM_ACCESSED:
+		case FSM_TOTALSIZE:
+		case FSM_FREESPACE:
+		case FSM_NETWORKADAPTER_STATUS:
+			return TRUE;
+		}
+
+		return FALSE;
+	}
 }
 
+struct GroupKeyJob_t
+{
+	const CShellBrowser			*pShellBrowser;
+	UINT						SortMode;
+	const std::vector<int>		*pItems;
+	std::vector<std::wstring>	*pHeaders;
+};
+
 #define GROUP_BY_DATECREATED	0
 #define GROUP_BY_DATEMODIFIED	1
 #define GROUP_BY_DATEACCESSED	2
@@ -39,6 +73,9 @@ namespace
 #define GROUP_OTHER				27
 
 TCHAR *RetrieveGroupHeader(int iGroupId);
+PFNLVGROUPCOMPARE GetGroupComparisonFunction(UINT SortMode);
+void DetermineGroupKeyProc(LPVOID pParam,int iItem);
+std::wstring BuildGroupKey(const TCHAR *szGroupHeader);
 
 /* Group sorting. */
 INT CALLBACK	NameComparison(INT Group1_ID, INT Group2_ID, void *pvData);
@@ -46,7 +83,7 @@ INT CALLBACK	FreeSpaceComparison(INT Group1_ID, INT Group2_ID, void *pvData);
 
 BOOL g_bSortAscending;
 
-std::list<TypeGroup_t> *g_pGroupList = NULL;
+std::vector<TypeGroup_t> *g_pGroupList = NULL;
 
 /* Simply sets the grouping flag, without actually moving
 items into groups. */
@@ -147,17 +184,32 @@ INT CALLBACK FreeSpaceComparison(INT Group1_ID, INT Group2_ID, void *pvData)
 
 TCHAR *RetrieveGroupHeader(int iGroupId)
 {
-	std::list<TypeGroup_t>::iterator	itr;
+	/* Group id's are allocated sequentially, so
+	the id can be used to index directly into
+	the group list. */
+	if(iGroupId < 0 || iGroupId >= static_cast<int>(g_pGroupList->size()))
+	{
+		return NULL;
+	}
+
+	return (*g_pGroupList)[iGroupId].szHeader;
+}
+
+/* Groups are matched case-insensitively, so the
+key used to look up a group is its lowercased
+header. */
+std::wstring BuildGroupKey(const TCHAR *szGroupHeader)
+{
+	TCHAR szKey[512];
+	int iRet = LCMapString(LOCALE_USER_DEFAULT,LCMAP_LOWERCASE,szGroupHeader,-1,
+		szKey,SIZEOF_ARRAY(szKey));
 
-	for(itr = g_pGroupList->begin();itr != g_pGroupList->end();itr++)
+	if(iRet == 0)
 	{
-		if(itr->iGroupId == iGroupId)
-		{
-			return itr->szHeader;
-		}
+		return szGroupHeader;
 	}
 
-	return NULL;
+	return szKey;
 }
 
 /*
@@ -166,40 +218,58 @@ TCHAR *RetrieveGroupHeader(int iGroupId)
  */
 int CShellBrowser::DetermineItemGroup(int iItemInternal)
 {
-	PFNLVGROUPCOMPARE	pfnGroupCompare = NULL;
-	TCHAR				szGroupHeader[512];
-	int					iGroupId;
+	std::wstring strGroupHeader;
+
+	/* The group header may have already been determined
+	(either in a parallel pass, or the last time items
+	were grouped in this mode). */
+	if(!LookupGroupKey(m_SortMode,iItemInternal,strGroupHeader))
+	{
+		TCHAR szGroupHeader[512];
+		DetermineItemGroupHeader(iItemInternal,m_SortMode,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
+
+		strGroupHeader = szGroupHeader;
+		StoreGroupKey(m_SortMode,iItemInternal,strGroupHeader);
+	}
+
+	return CheckGroup(strGroupHeader.c_str(),GetGroupComparisonFunction(m_SortMode));
+}
+
+/*
+ * Determines the header of the group the specified
+ * item belongs to, for the given sort mode. Only
+ * reads item data, so this may be called from
+ * worker threads.
+ */
+void CShellBrowser::DetermineItemGroupHeader(int iItemInternal,UINT SortMode,
+	TCHAR *szGroupHeader,int cchMax) const
+{
+	StringCchCopy(szGroupHeader,cchMax,EMPTY_STRING);
 
-	switch(m_SortMode)
+	switch(SortMode)
 	{
 		case FSM_NAME:
-			DetermineItemNameGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemNameGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_TYPE:
-			DetermineItemTypeGroupVirtual(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemTypeGroupVirtual(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_SIZE:
-			DetermineItemSizeGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSizeGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_DATEMODIFIED:
-			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATEMODIFIED,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATEMODIFIED,szGroupHeader,cchMax);
 			break;
 
 		case FSM_TOTALSIZE:
-			DetermineItemTotalSizeGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemTotalSizeGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_FREESPACE:
-			DetermineItemFreeSpaceGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = FreeSpaceComparison;
+			DetermineItemFreeSpaceGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_DATEDELETED:
@@ -209,43 +279,35 @@ int CShellBrowser::DetermineItemGroup(int iItemInternal)
 			break;
 
 		case FSM_ATTRIBUTES:
-			DetermineItemAttributeGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemAttributeGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_SHORTNAME:
-			DetermineItemNameGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemNameGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_OWNER:
-			DetermineItemOwnerGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemOwnerGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_PRODUCTNAME:
-			DetermineItemVersionGroup(iItemInternal,_T("ProductName"),szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemVersionGroup(iItemInternal,_T("ProductName"),szGroupHeader,cchMax);
 			break;
 
 		case FSM_COMPANY:
-			DetermineItemVersionGroup(iItemInternal,_T("CompanyName"),szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemVersionGroup(iItemInternal,_T("CompanyName"),szGroupHeader,cchMax);
 			break;
 
 		case FSM_DESCRIPTION:
-			DetermineItemVersionGroup(iItemInternal,_T("FileDescription"),szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemVersionGroup(iItemInternal,_T("FileDescription"),szGroupHeader,cchMax);
 			break;
 
 		case FSM_FILEVERSION:
-			DetermineItemVersionGroup(iItemInternal,_T("FileVersion"),szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemVersionGroup(iItemInternal,_T("FileVersion"),szGroupHeader,cchMax);
 			break;
 
 		case FSM_PRODUCTVERSION:
-			DetermineItemVersionGroup(iItemInternal,_T("ProductVersion"),szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemVersionGroup(iItemInternal,_T("ProductVersion"),szGroupHeader,cchMax);
 			break;
 
 		case FSM_SHORTCUTTO:
@@ -255,64 +317,52 @@ int CShellBrowser::DetermineItemGroup(int iItemInternal)
 			break;
 
 		case FSM_EXTENSION:
-			DetermineItemExtensionGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemExtensionGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_CREATED:
-			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATECREATED,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATECREATED,szGroupHeader,cchMax);
 			break;
 
 		case FSM_ACCESSED:
-			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATEACCESSED,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemDateGroup(iItemInternal,GROUP_BY_DATEACCESSED,szGroupHeader,cchMax);
 			break;
 
 		case FSM_TITLE:
-			DetermineItemSummaryGroup(iItemInternal,&SCID_TITLE,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSummaryGroup(iItemInternal,&SCID_TITLE,szGroupHeader,cchMax);
 			break;
 
 		case FSM_SUBJECT:
-			DetermineItemSummaryGroup(iItemInternal,&SCID_SUBJECT,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSummaryGroup(iItemInternal,&SCID_SUBJECT,szGroupHeader,cchMax);
 			break;
 
 		case FSM_AUTHOR:
-			DetermineItemSummaryGroup(iItemInternal,&SCID_AUTHOR,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSummaryGroup(iItemInternal,&SCID_AUTHOR,szGroupHeader,cchMax);
 			break;
 
 		case FSM_KEYWORDS:
-			DetermineItemSummaryGroup(iItemInternal,&SCID_KEYWORDS,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSummaryGroup(iItemInternal,&SCID_KEYWORDS,szGroupHeader,cchMax);
 			break;
 
 		case FSM_COMMENTS:
-			DetermineItemSummaryGroup(iItemInternal,&SCID_COMMENTS,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemSummaryGroup(iItemInternal,&SCID_COMMENTS,szGroupHeader,cchMax);
 			break;
 
 
 		case FSM_CAMERAMODEL:
-			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagEquipModel,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagEquipModel,szGroupHeader,cchMax);
 			break;
 
 		case FSM_DATETAKEN:
-			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagDateTime,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagDateTime,szGroupHeader,cchMax);
 			break;
 
 		case FSM_WIDTH:
-			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagImageWidth,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagImageWidth,szGroupHeader,cchMax);
 			break;
 
 		case FSM_HEIGHT:
-			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagImageHeight,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemCameraPropertyGroup(iItemInternal,PropertyTagImageHeight,szGroupHeader,cchMax);
 			break;
 
 
@@ -320,8 +370,7 @@ int CShellBrowser::DetermineItemGroup(int iItemInternal)
 			break;
 
 		case FSM_FILESYSTEM:
-			DetermineItemFileSystemGroup(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemFileSystemGroup(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		case FSM_NUMPRINTERDOCUMENTS:
@@ -337,115 +386,292 @@ int CShellBrowser::DetermineItemGroup(int iItemInternal)
 			break;
 
 		case FSM_NETWORKADAPTER_STATUS:
-			DetermineItemNetworkStatus(iItemInternal,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
-			pfnGroupCompare = NameComparison;
+			DetermineItemNetworkStatus(iItemInternal,szGroupHeader,cchMax);
 			break;
 
 		default:
 			assert(false);
 			break;
 	}
+}
 
-	iGroupId = CheckGroup(szGroupHeader,pfnGroupCompare);
+/*
+ * Returns the function used to sort groups in
+ * the given sort mode. Modes that don't support
+ * grouping return NULL.
+ */
+PFNLVGROUPCOMPARE GetGroupComparisonFunction(UINT SortMode)
+{
+	switch(SortMode)
+	{
+	case FSM_FREESPACE:
+		return FreeSpaceComparison;
+		break;
 
-	return iGroupId;
+	case FSM_DATEDELETED:
+	case FSM_ORIGINALLOCATION:
+	case FSM_SHORTCUTTO:
+	case FSM_HARDLINKS:
+	case FSM_VIRTUALCOMMENTS:
+	case FSM_NUMPRINTERDOCUMENTS:
+	case FSM_PRINTERSTATUS:
+	case FSM_PRINTERCOMMENTS:
+	case FSM_PRINTERLOCATION:
+		return NULL;
+		break;
+	}
+
+	return NameComparison;
 }
 
 /*
- * Checks if a group with specified id is already
- * in the listview. If not, the group is inserted
- * into its sorted position with the specified
- * header text.
+ * Determines (and caches) the group header for
+ * each of the specified items in the current sort
+ * mode. For large folders, the work is split across
+ * the thread pool.
  */
-int CShellBrowser::CheckGroup(const TCHAR *szGroupHeader,
-PFNLVGROUPCOMPARE pfnGroupCompare)
+void CShellBrowser::DetermineGroupKeys(const std::vector<int> &Items)
 {
-	LVINSERTGROUPSORTED			lvigs;
-	std::list<TypeGroup_t>::iterator	itr;
-	TypeGroup_t					TypeGroup;
-	WCHAR						wszHeader[512];
-	BOOL						bFoundGroup = FALSE;
-	int							iGroupId = -1;
+	/* Keys that may have changed since the last
+	regroup are always determined again. */
+	if(IsGroupKeyVolatile(m_SortMode))
+	{
+		m_GroupKeyCache.erase(m_SortMode);
+	}
 
-	/* Check to see if the group has already been inserted... */
-	for(itr = m_GroupList.begin();itr != m_GroupList.end();itr++)
+	std::vector<int> PendingItems;
+
+	for(auto itr = Items.begin();itr != Items.end();itr++)
 	{
-		if(lstrcmpi(szGroupHeader,itr->szHeader) == 0)
+		std::wstring strKey;
+
+		if(!LookupGroupKey(m_SortMode,*itr,strKey))
 		{
-			LVGROUP lvGroup;
+			PendingItems.push_back(*itr);
+		}
+	}
 
-			bFoundGroup = TRUE;
-			iGroupId = itr->iGroupId;
-			itr->nItems++;
+	if(PendingItems.empty())
+	{
+		return;
+	}
 
-			if(m_dwMajorVersion >= WINDOWS_VISTA_SEVEN_MAJORVERSION)
-			{
-				StringCchPrintf(wszHeader,SIZEOF_ARRAY(wszHeader),
-					_T("%s (%d)"),szGroupHeader,itr->nItems);
+	std::vector<std::wstring> Headers(PendingItems.size());
 
-				lvGroup.cbSize		= sizeof(LVGROUP);
-				lvGroup.mask		= LVGF_HEADER;
-				lvGroup.pszHeader	= wszHeader;
+	GroupKeyJob_t GroupKeyJob;
+	GroupKeyJob.pShellBrowser	= this;
+	GroupKeyJob.SortMode		= m_SortMode;
+	GroupKeyJob.pItems			= &PendingItems;
+	GroupKeyJob.pHeaders		= &Headers;
 
-				ListView_SetGroupInfo(m_hListView,iGroupId,&lvGroup);
-			}
+	/* The calling thread always takes part, so the
+	number of pool jobs is one less than the number
+	of threads. */
+	int nJobs = 0;
 
-			break;
-		}
+	if(PendingItems.size() >= PARALLEL_GROUP_KEY_THRESHOLD)
+	{
+		SYSTEM_INFO SystemInfo;
+		GetSystemInfo(&SystemInfo);
+
+		nJobs = min(static_cast<int>(SystemInfo.dwNumberOfProcessors),MAX_GROUP_KEY_THREADS) - 1;
 	}
 
-	if(!bFoundGroup)
+	/* The window is waiting on the result, so the work
+	runs ahead of anything in the background. */
+	RunInParallel(DetermineGroupKeyProc,&GroupKeyJob,static_cast<int>(PendingItems.size()),
+		nJobs,THREAD_POOL_PRIORITY_HIGH);
+
+	for(size_t i = 0;i < PendingItems.size();i++)
 	{
-		iGroupId = m_iGroupId++;
+		StoreGroupKey(m_SortMode,PendingItems[i],Headers[i]);
+	}
+}
 
-		StringCchCopy(TypeGroup.szHeader,SIZEOF_ARRAY(TypeGroup.szHeader),
-			szGroupHeader);
-		TypeGroup.iGroupId = iGroupId;
-		TypeGroup.nItems = 1;
-		m_GroupList.push_back(TypeGroup);
+/* Some of the group functions (e.g. those that retrieve
+item details) use COM, which the pool's threads have
+already initialized. Every item has its own output slot,
+so no locking is needed. */
+void DetermineGroupKeyProc(LPVOID pParam,int iItem)
+{
+	GroupKeyJob_t *pGroupKeyJob = reinterpret_cast<GroupKeyJob_t *>(pParam);
 
-		if(m_dwMajorVersion >= WINDOWS_VISTA_SEVEN_MAJORVERSION)
-		{
-			StringCchPrintf(wszHeader,SIZEOF_ARRAY(wszHeader),
-				_T("%s (%d)"),szGroupHeader,TypeGroup.nItems);
-		}
-		else if(m_dwMajorVersion >= WINDOWS_XP_MAJORVERSION)
-		{
-			StringCchPrintf(wszHeader,SIZEOF_ARRAY(wszHeader),
-				_T("%s"),szGroupHeader);
-		}
+	TCHAR szGroupHeader[512];
+	pGroupKeyJob->pShellBrowser->DetermineItemGroupHeader((*pGroupKeyJob->pItems)[iItem],
+		pGroupKeyJob->SortMode,szGroupHeader,SIZEOF_ARRAY(szGroupHeader));
+
+	(*pGroupKeyJob->pHeaders)[iItem] = szGroupHeader;
+}
+
+BOOL CShellBrowser::LookupGroupKey(UINT SortMode,int iItemInternal,std::wstring &strKey) const
+{
+	auto itr = m_GroupKeyCache.find(SortMode);
+
+	if(itr == m_GroupKeyCache.end() ||
+		iItemInternal >= static_cast<int>(itr->second.Valid.size()) ||
+		!itr->second.Valid[iItemInternal])
+	{
+		return FALSE;
+	}
+
+	strKey = itr->second.Keys[iItemInternal];
+
+	return TRUE;
+}
 
-		/* The group is not in the listview, so insert it in. */
-		lvigs.lvGroup.cbSize	= sizeof(LVGROUP);
-		lvigs.lvGroup.mask		= LVGF_HEADER|LVGF_GROUPID;
-		lvigs.lvGroup.pszHeader	= wszHeader;
-		lvigs.lvGroup.iGroupId	= iGroupId;
-		lvigs.lvGroup.stateMask	= 0;
+void CShellBrowser::StoreGroupKey(UINT SortMode,int iItemInternal,const std::wstring &strKey)
+{
+	ItemKeyCache_t &ItemKeyCache = m_GroupKeyCache[SortMode];
 
-		OSVERSIONINFO vi;
+	if(iItemInternal >= static_cast<int>(ItemKeyCache.Valid.size()))
+	{
+		ItemKeyCache.Keys.resize(max(iItemInternal + 1,m_iCurrentAllocation));
+		ItemKeyCache.Valid.resize(ItemKeyCache.Keys.size(),FALSE);
+	}
 
-		vi.dwOSVersionInfoSize	= sizeof(OSVERSIONINFO);
+	ItemKeyCache.Keys[iItemInternal] = strKey;
+	ItemKeyCache.Valid[iItemInternal] = TRUE;
+}
 
-		if(GetVersionEx(&vi) != 0)
+/*
+ * Should be called whenever an item's data changes
+ * (or an internal index is reused for a new item).
+ */
+void CShellBrowser::InvalidateItemKeys(int iItemInternal)
+{
+	for(auto itr = m_GroupKeyCache.begin();itr != m_GroupKeyCache.end();itr++)
+	{
+		if(iItemInternal < static_cast<int>(itr->second.Valid.size()))
 		{
-			/* LVGS_COLLAPSIBLE is only valid on Windows Vista
-			and later. */
-			if(vi.dwMajorVersion > WINDOWS_XP_MAJORVERSION)
-			{
-				lvigs.lvGroup.mask	|= LVGF_STATE;
-				lvigs.lvGroup.state	= LVGS_COLLAPSIBLE;
-			}
+			itr->second.Valid[iItemInternal] = FALSE;
 		}
+	}
+}
 
-		lvigs.pfnGroupCompare = (PFNLVGROUPCOMPARE)pfnGroupCompare;
-		lvigs.pvData = NULL;
+void CShellBrowser::ClearItemKeys(void)
+{
+	m_GroupKeyCache.clear();
+}
+
+void CShellBrowser::GetListViewItemsInternal(std::vector<int> &Items) const
+{
+	int nItems = ListView_GetItemCount(m_hListView);
+
+	Items.clear();
+	Items.reserve(nItems);
+
+	for(int i = 0;i < nItems;i++)
+	{
+		LVITEM Item;
+		Item.mask		= LVIF_PARAM;
+		Item.iItem		= i;
+		Item.iSubItem	= 0;
+		ListView_GetItem(m_hListView,&Item);
 
-		ListView_InsertGroupSorted(m_hListView,&lvigs);
+		Items.push_back(static_cast<int>(Item.lParam));
+	}
+}
+
+/*
+ * Checks if a group with specified id is already
+ * in the listview. If not, the group is inserted
+ * into its sorted position with the specified
+ * header text.
+ * The item counts shown in the group headers
+ * are not updated here. Once a batch of items
+ * has been placed into groups, UpdateGroupHeaders
+ * should be called to refresh them.
+ */
+int CShellBrowser::CheckGroup(const TCHAR *szGroupHeader,
+PFNLVGROUPCOMPARE pfnGroupCompare)
+{
+	std::wstring strKey = BuildGroupKey(szGroupHeader);
+
+	/* Check to see if the group has already been inserted... */
+	auto itr = m_GroupMap.find(strKey);
+
+	if(itr != m_GroupMap.end())
+	{
+		m_GroupList[itr->second].nItems++;
+
+		return itr->second;
+	}
+
+	int iGroupId = m_iGroupId++;
+
+	TypeGroup_t TypeGroup;
+	StringCchCopy(TypeGroup.szHeader,SIZEOF_ARRAY(TypeGroup.szHeader),
+		szGroupHeader);
+	TypeGroup.iGroupId = iGroupId;
+	TypeGroup.nItems = 1;
+	TypeGroup.nItemsDisplayed = 0;
+	m_GroupList.push_back(TypeGroup);
+
+	m_GroupMap.insert(std::unordered_map<std::wstring,int>::value_type(strKey,iGroupId));
+
+	/* The header is inserted without a count. The
+	count will be added by UpdateGroupHeaders. */
+	WCHAR wszHeader[512];
+	StringCchCopy(wszHeader,SIZEOF_ARRAY(wszHeader),szGroupHeader);
+
+	/* The group is not in the listview, so insert it in. */
+	LVINSERTGROUPSORTED lvigs;
+	lvigs.lvGroup.cbSize	= sizeof(LVGROUP);
+	lvigs.lvGroup.mask		= LVGF_HEADER|LVGF_GROUPID;
+	lvigs.lvGroup.pszHeader	= wszHeader;
+	lvigs.lvGroup.iGroupId	= iGroupId;
+	lvigs.lvGroup.stateMask	= 0;
+
+	/* LVGS_COLLAPSIBLE is only valid on Windows Vista
+	and later. */
+	if(m_dwMajorVersion > WINDOWS_XP_MAJORVERSION)
+	{
+		lvigs.lvGroup.mask	|= LVGF_STATE;
+		lvigs.lvGroup.state	= LVGS_COLLAPSIBLE;
 	}
 
+	lvigs.pfnGroupCompare = (PFNLVGROUPCOMPARE)pfnGroupCompare;
+	lvigs.pvData = NULL;
+
+	ListView_InsertGroupSorted(m_hListView,&lvigs);
+
 	return iGroupId;
 }
 
+/*
+ * Rewrites the header of any group whose item
+ * count has changed since the header was last
+ * set. Only applies to Windows Vista and later
+ * (on XP, headers never show a count).
+ */
+void CShellBrowser::UpdateGroupHeaders(void)
+{
+	if(m_dwMajorVersion < WINDOWS_VISTA_SEVEN_MAJORVERSION)
+	{
+		return;
+	}
+
+	for(auto itr = m_GroupList.begin();itr != m_GroupList.end();itr++)
+	{
+		if(itr->nItems == itr->nItemsDisplayed)
+		{
+			continue;
+		}
+
+		WCHAR wszHeader[512];
+		StringCchPrintf(wszHeader,SIZEOF_ARRAY(wszHeader),
+			_T("%s (%d)"),itr->szHeader,itr->nItems);
+
+		LVGROUP lvGroup;
+		lvGroup.cbSize		= sizeof(LVGROUP);
+		lvGroup.mask		= LVGF_HEADER;
+		lvGroup.pszHeader	= wszHeader;
+		ListView_SetGroupInfo(m_hListView,itr->iGroupId,&lvGroup);
+
+		itr->nItemsDisplayed = itr->nItems;
+	}
+}
+
 /*
  * Determines the id of the group to which the specified
  * item belongs, based on the item's name.
@@ -456,7 +682,6 @@ PFNLVGROUPCOMPARE pfnGroupCompare)
 void CShellBrowser::DetermineItemNameGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const
 {
 	TCHAR ch;
-	std::list<TypeGroup_t>::iterator itr;
 
 	/* Take the first character of the item's name,
 	and use it to determine which group it belongs to. */
@@ -580,21 +805,9 @@ void CShellBrowser::DetermineItemTotalSizeGroup(int iItemInternal,TCHAR *szGroup
 
 void CShellBrowser::DetermineItemTypeGroupVirtual(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const
 {
-	LPITEMIDLIST				pidlComplete = NULL;
-	LPITEMIDLIST				pidlDirectory = NULL;
-	SHFILEINFO					shfi;
-	std::list<TypeGroup_t>::iterator	itr;
-
-	GetIdlFromParsingName(m_CurDir,&pidlDirectory);
-
-	pidlComplete = ILCombine(pidlDirectory,m_pExtraItemInfo[iItemInternal].pridl);
-
-	SHGetFileInfo((LPTSTR)pidlComplete,0,&shfi,sizeof(shfi),SHGFI_PIDL|SHGFI_TYPENAME);
-
-	StringCchCopy(szGroupHeader,cchMax,shfi.szTypeName);
-
-	CoTaskMemFree(pidlComplete);
-	CoTaskMemFree(pidlDirectory);
+	/* The type group is the same text shown (and
+	sorted on) in the type column. */
+	StringCchCopy(szGroupHeader,cchMax,GetTypeColumnText(iItemInternal).c_str());
 }
 
 void CShellBrowser::DetermineItemDateGroup(int iItemInternal,int iDateType,TCHAR *szGroupHeader,int cchMax) const
@@ -678,7 +891,6 @@ void CShellBrowser::DetermineItemSummaryGroup(int iItemInternal, const SHCOLUMNI
 /* TODO: Need to sort based on percentage free. */
 void CShellBrowser::DetermineItemFreeSpaceGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const
 {
-	std::list<TypeGroup_t>::iterator itr;
 	LPITEMIDLIST pidlComplete	= NULL;
 	LPITEMIDLIST pidlDirectory	= NULL;
 	TCHAR szFreeSpace[MAX_PATH];
@@ -731,7 +943,6 @@ void CShellBrowser::DetermineItemFreeSpaceGroup(int iItemInternal,TCHAR *szGroup
 void CShellBrowser::DetermineItemAttributeGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const
 {
 	TCHAR FullFileName[MAX_PATH];
-	std::list<TypeGroup_t>::iterator itr;
 	TCHAR szAttributes[32];
 
 	StringCchCopy(FullFileName,SIZEOF_ARRAY(FullFileName),m_CurDir);
@@ -746,7 +957,6 @@ void CShellBrowser::DetermineItemAttributeGroup(int iItemInternal,TCHAR *szGroup
 void CShellBrowser::DetermineItemOwnerGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const
 {
 	TCHAR FullFileName[MAX_PATH];
-	std::list<TypeGroup_t>::iterator itr;
 	TCHAR szOwner[512];
 
 	StringCchCopy(FullFileName,SIZEOF_ARRAY(FullFileName),m_CurDir);
@@ -766,7 +976,6 @@ void CShellBrowser::DetermineItemVersionGroup(int iItemInternal,TCHAR *szVersion
 {
 	BOOL bGroupFound = FALSE;
 	TCHAR FullFileName[MAX_PATH];
-	std::list<TypeGroup_t>::iterator itr;
 	TCHAR szVersion[512];
 	BOOL bVersionInfoObtained;
 
@@ -787,7 +996,6 @@ void CShellBrowser::DetermineItemVersionGroup(int iItemInternal,TCHAR *szVersion
 void CShellBrowser::DetermineItemCameraPropertyGroup(int iItemInternal,PROPID PropertyId,TCHAR *szGroupHeader,int cchMax) const
 {
 	TCHAR szFullFileName[MAX_PATH];
-	std::list<TypeGroup_t>::iterator itr;
 	TCHAR szProperty[512];
 	BOOL bRes;
 
@@ -876,7 +1084,6 @@ void CShellBrowser::DetermineItemNetworkStatus(int iItemInternal,TCHAR *szGroupH
 	can be removed. */
 	UNREFERENCED_PARAMETER(iItemInternal);
 
-	std::list<TypeGroup_t>::iterator itr;
 
 	TCHAR szStatus[32] = EMPTY_STRING;
 	IP_ADAPTER_ADDRESSES *pAdapterAddresses = NULL;
@@ -941,36 +1148,44 @@ void CShellBrowser::InsertItemIntoGroup(int iItem,int iGroupId)
 
 void CShellBrowser::MoveItemsIntoGroups(void)
 {
-	LVITEM Item;
-	int nItems;
-	int iGroupId;
-	int i = 0;
-
 	ListView_RemoveAllGroups(m_hListView);
 	ListView_EnableGroupView(m_hListView,TRUE);
 
-	nItems = ListView_GetItemCount(m_hListView);
+	int nItems = ListView_GetItemCount(m_hListView);
 
 	SendMessage(m_hListView,WM_SETREDRAW,(WPARAM)FALSE,(LPARAM)NULL);
 
 	m_GroupList.clear();
+	m_GroupMap.clear();
 	m_iGroupId = 0;
 
 	g_bSortAscending = m_bSortAscending;
 
 	g_pGroupList = &m_GroupList;
 
-	for(i = 0;i < nItems ;i++)
-	{
-		Item.mask		= LVIF_PARAM;
-		Item.iItem		= i;
-		Item.iSubItem	= 0;
-		ListView_GetItem(m_hListView,&Item);
+	/* Determine the group for every item first, then
+	move the items into their groups. The group
+	headers are only set once all the items have
+	been assigned. */
+	std::vector<int> Items;
+	GetListViewItemsInternal(Items);
+
+	DetermineGroupKeys(Items);
 
-		iGroupId = DetermineItemGroup((int)Item.lParam);
+	std::vector<int> GroupIds;
+	GroupIds.reserve(nItems);
 
-		InsertItemIntoGroup(i,iGroupId);
+	for(int i = 0;i < nItems;i++)
+	{
+		GroupIds.push_back(DetermineItemGroup(Items[i]));
 	}
 
+	for(int i = 0;i < nItems;i++)
+	{
+		InsertItemIntoGroup(i,GroupIds[i]);
+	}
+
+	UpdateGroupHeaders();
+
 	SendMessage(m_hListView,WM_SETREDRAW,(WPARAM)TRUE,(LPARAM)NULL);
 }
\ No newline at end of file
@@ -22,6 +22,7 @@
 #include "../Helper/ShellHelper.h"
 #include "../Helper/FileOperations.h"
 #include "../Helper/FolderSize.h"
+#include "../Helper/ThreadPool.h"
 
 
 BOOL RemoveFromThumbnailsFinderQueue(ListViewInfo_t *pListViewInfo);
@@ -30,8 +31,9 @@ std::list<ListViewInfo_t>	g_ThumbnailQueue;
 CRITICAL_SECTION		g_csThumbnails;
 BOOL					g_bcsThumbnailInitialized = FALSE;
 
-int g_nThumbnailAPCsQueued = 0;
-int g_nThumbnailAPCsRun = 0;
+/* Only one job drains the queue at a time. */
+int g_nThumbnailJobsQueued = 0;
+int g_nThumbnailJobsRun = 0;
 
 void CShellBrowser::SetupThumbnailsView(void)
 {
@@ -128,11 +130,15 @@ void CShellBrowser::AddToThumbnailFinderQueue(LPARAM lParam)
 
 	g_ThumbnailQueue.push_back(lvil);
 
-	if(g_nThumbnailAPCsRun == g_nThumbnailAPCsQueued)
+	if(g_nThumbnailJobsRun == g_nThumbnailJobsQueued)
 	{
-		g_nThumbnailAPCsQueued++;
+		g_nThumbnailJobsQueued++;
 
-		QueueUserAPC(FindThumbnailAPC,m_hThread,(ULONG_PTR)this);
+		if(!CThreadPool::GetInstance().QueueJob(FindThumbnailJob,reinterpret_cast<LPVOID>(this),
+			THREAD_POOL_PRIORITY_NORMAL,m_CurDir))
+		{
+			g_nThumbnailJobsQueued--;
+		}
 	}
 
 	LeaveCriticalSection(&g_csThumbnails);
@@ -148,7 +154,7 @@ BOOL RemoveFromThumbnailsFinderQueue(ListViewInfo_t *pListViewInfo)
 	{
 		bQueueNotEmpty = FALSE;
 
-		g_nThumbnailAPCsRun++;
+		g_nThumbnailJobsRun++;
 	}
 	else
 	{
@@ -191,7 +197,7 @@ Bitmap creation occurs as follows:
    be the index of the combined bitmap in the
    imagelist.
 */
-void CALLBACK FindThumbnailAPC(ULONG_PTR dwParam)
+void FindThumbnailJob(LPVOID pParam,const CCancellationToken *pToken)
 {
 	IExtractImage *pExtractImage = NULL;
 	IShellFolder *pShellFolder = NULL;
@@ -207,7 +213,9 @@ void CALLBACK FindThumbnailAPC(ULONG_PTR dwParam)
 	ListViewInfo_t	pListViewInfo;
 	CShellBrowser *pShellBrowser = NULL;
 
-	pShellBrowser = reinterpret_cast<CShellBrowser *>(dwParam);
+	UNREFERENCED_PARAMETER(pToken);
+
+	pShellBrowser = reinterpret_cast<CShellBrowser *>(pParam);
 
 	/* If this module is in the process of been
 	shut down, DO NOT load any more thumbnails. */
@@ -218,6 +226,10 @@ void CALLBACK FindThumbnailAPC(ULONG_PTR dwParam)
 
 	while(bQueueNotEmpty)
 	{
+		/* The thumbnail is shown straight away, so
+		the I/O is only counted. */
+		CThreadPool::ThrottleIo(CThreadPool::ITEM_IO_SIZE);
+
 		pidlParent = ILClone(pListViewInfo.pidlFull);
 		ILRemoveLastID(pidlParent);
 
@@ -0,0 +1,131 @@
+/******************************************************************
+ *
+ * Project: ShellBrowser
+ * File: SelectionManager.cpp
+ * License: GPL - See LICENSE in the top level directory
+ *
+ * Handles bulk changes to the selection
+ * within the listview (select all, invert
+ * and wildcard selection).
+ *
+ * Written by David Erceg
+ * www.explorerplusplus.com
+ *
+ *****************************************************************/
+
+#include "stdafx.h"
+#include <vector>
+#include <algorithm>
+#include "IShellView.h"
+#include "iShellBrowser_internal.h"
+#include "../Helper/ListViewHelper.h"
+#include "../Helper/WildcardMatcher.h"
+#include "../Helper/Macros.h"
+
+
+void CShellBrowser::SelectAllItems(BOOL bSelect)
+{
+	std::vector<bool> Selection(ListView_GetItemCount(m_hListView),bSelect ? true : false);
+
+	ApplySelection(Selection);
+}
+
+void CShellBrowser::InvertSelection(void)
+{
+	std::vector<bool> Selection;
+
+	GetSelection(Selection);
+
+	Selection.flip();
+
+	ApplySelection(Selection);
+}
+
+void CShellBrowser::SelectItemsMatching(const TCHAR *szPattern,BOOL bCaseSensitive,BOOL bSelect)
+{
+	CWildcardMatcher WildcardMatcher(szPattern,bCaseSensitive);
+	std::vector<bool> Selection;
+	TCHAR szDisplayName[MAX_PATH];
+
+	GetSelection(Selection);
+
+	/* Items are matched on the name the
+	user sees in the listview. */
+	for(int i = 0;i < static_cast<int>(Selection.size());i++)
+	{
+		QueryDisplayName(i,SIZEOF_ARRAY(szDisplayName),szDisplayName);
+
+		if(WildcardMatcher.Match(szDisplayName))
+		{
+			Selection[i] = bSelect ? true : false;
+		}
+	}
+
+	ApplySelection(Selection);
+}
+
+BOOL CShellBrowser::IsSelectionBatchInProgress(void) const
+{
+	return m_bSelectionBatchInProgress;
+}
+
+/* Builds a bitset (indexed by listview position)
+holding the current selection state of each item.
+Only the selected items are visited. */
+void CShellBrowser::GetSelection(std::vector<bool> &Selection) const
+{
+	Selection.assign(ListView_GetItemCount(m_hListView),false);
+
+	int iItem = -1;
+
+	while((iItem = ListView_GetNextItem(m_hListView,iItem,LVNI_SELECTED)) != -1)
+	{
+		Selection[iItem] = true;
+	}
+}
+
+/* Pushes the given selection out to the listview.
+If every item ends up in the same state, the change
+is made with a single call. Otherwise, only those
+items whose state actually differs are touched.
+
+The per-item change notifications that result still
+keep the selection totals up to date, but the owner
+is only asked to refresh its status displays once,
+after the whole batch has been applied. */
+void CShellBrowser::ApplySelection(const std::vector<bool> &Selection)
+{
+	std::vector<bool> CurrentSelection;
+
+	GetSelection(CurrentSelection);
+
+	if(Selection == CurrentSelection)
+	{
+		return;
+	}
+
+	size_t nSelected = std::count(Selection.begin(),Selection.end(),true);
+
+	m_bSelectionBatchInProgress = TRUE;
+	SendMessage(m_hListView,WM_SETREDRAW,FALSE,0);
+
+	if(nSelected == 0 || nSelected == Selection.size())
+	{
+		ListView_SetItemState(m_hListView,-1,(nSelected != 0) ? LVIS_SELECTED : 0,LVIS_SELECTED);
+	}
+	else
+	{
+		for(size_t i = 0;i < Selection.size();i++)
+		{
+			if(Selection[i] != CurrentSelection[i])
+			{
+				NListView::ListView_SelectItem(m_hListView,static_cast<int>(i),Selection[i] ? TRUE : FALSE);
+			}
+		}
+	}
+
+	SendMessage(m_hListView,WM_SETREDRAW,TRUE,0);
+	m_bSelectionBatchInProgress = FALSE;
+
+	SendMessage(m_hOwner,WM_USER_SELECTIONCHANGED,m_ID,0);
+}
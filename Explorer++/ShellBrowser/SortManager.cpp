@@ -38,6 +38,18 @@ void CShellBrowser::SortFolder(UINT SortMode)
 		SetGrouping(TRUE);
 	}
 
+	/* Type text is relatively expensive to retrieve,
+	so it's determined up front (in parallel) rather
+	than on every comparison. The same keys are used
+	when grouping by type. */
+	if(m_SortMode == FSM_TYPE)
+	{
+		std::vector<int> Items;
+		GetListViewItemsInternal(Items);
+
+		DetermineGroupKeys(Items);
+	}
+
 	SendMessage(m_hListView,LVM_SORTITEMS,reinterpret_cast<WPARAM>(this),reinterpret_cast<LPARAM>(SortStub));
 
 	/* If in details view, the column sort
@@ -445,8 +457,18 @@ int CALLBACK CShellBrowser::SortByType(int InternalIndex1,int InternalIndex2) co
 		}
 	}
 
-	std::wstring Type1 = GetTypeColumnText(InternalIndex1);
-	std::wstring Type2 = GetTypeColumnText(InternalIndex2);
+	std::wstring Type1;
+	std::wstring Type2;
+
+	if(!LookupGroupKey(FSM_TYPE,InternalIndex1,Type1))
+	{
+		Type1 = GetTypeColumnText(InternalIndex1);
+	}
+
+	if(!LookupGroupKey(FSM_TYPE,InternalIndex2,Type2))
+	{
+		Type2 = GetTypeColumnText(InternalIndex2);
+	}
 
 	return StrCmpLogicalW(Type1.c_str(),Type2.c_str());
 }
@@ -65,18 +65,16 @@ ULONG __stdcall CShellBrowser::Release(void)
 }
 
 CShellBrowser *CShellBrowser::CreateNew(HWND hOwner,HWND hListView,
-	const InitialSettings_t *pSettings,HANDLE hIconThread,HANDLE hFolderSizeThread)
+	const InitialSettings_t *pSettings,HANDLE hIconThread)
 {
-	return new CShellBrowser(hOwner,hListView,pSettings,hIconThread,hFolderSizeThread);
+	return new CShellBrowser(hOwner,hListView,pSettings,hIconThread);
 }
 
 CShellBrowser::CShellBrowser(HWND hOwner,HWND hListView,
-const InitialSettings_t *pSettings,HANDLE hIconThread,
-HANDLE hFolderSizeThread) :
+const InitialSettings_t *pSettings,HANDLE hIconThread) :
 m_hOwner(hOwner),
 m_hListView(hListView),
-m_hThread(hIconThread),
-m_hFolderSizeThread(hFolderSizeThread)
+m_hThread(hIconThread)
 {
 	m_iRefCount = 1;
 
@@ -103,6 +101,8 @@ m_hFolderSizeThread(hFolderSizeThread)
 	m_bFolderVisited		= FALSE;
 	m_bApplyFilter			= FALSE;
 	m_bFilterCaseSensitive	= FALSE;
+	m_pColorRuleSet			= NULL;
+	m_bSelectionBatchInProgress	= FALSE;
 	m_bGridlinesActive		= TRUE;
 	m_bShowHidden			= FALSE;
 	m_bShowExtensions		= TRUE;
@@ -142,6 +142,8 @@ m_hFolderSizeThread(hFolderSizeThread)
 	InitializeCriticalSection(&m_column_cs);
 	InitializeCriticalSection(&m_folder_cs);
 
+	m_pFolderSizeToken = new CCancellationToken();
+
 	if(!g_bcsThumbnailInitialized)
 	{
 		InitializeCriticalSection(&g_csThumbnails);
@@ -172,6 +174,8 @@ CShellBrowser::~CShellBrowser()
 	EmptyColumnQueue();
 	EmptyFolderQueue();
 
+	m_pFolderSizeToken->Release();
+
 	/* Wait for any current processing to finish. */
 	WaitForSingleObject(m_hIconEvent,INFINITE);
 
@@ -253,10 +257,7 @@ void CShellBrowser::SetCurrentViewMode(UINT ViewMode)
 				for(i = 0;i < m_nTotalItems;i++)
 					AddToColumnQueue(i);
 
-				QueueUserAPC(SetAllColumnDataAPC,m_hThread,(ULONG_PTR)this);
-
-				if(m_bShowFolderSizes)
-					QueueUserAPC(SetAllFolderSizeColumnDataAPC,m_hFolderSizeThread,(ULONG_PTR)this);
+				QueueColumnDataJobs(m_bShowFolderSizes);
 			}
 			break;
 
@@ -442,6 +443,7 @@ void CShellBrowser::SetUserOptions(const InitialSettings_t *is)
 	m_SizeDisplayFormat		= is->sdf;
 
 	StringCchCopy(m_szFilter,SIZEOF_ARRAY(m_szFilter),is->szFilter);
+	UpdateFilterMatcher();
 
 	m_ControlPanelColumnList = *is->pControlPanelColumnList;
 	m_MyComputerColumnList = *is->pMyComputerColumnList;
@@ -546,6 +548,22 @@ void CShellBrowser::SetSizeDisplayFormat(SizeDisplayFormat_t sdf)
 	m_SizeDisplayFormat = sdf;
 }
 
+/* Should be called whenever the rule set changes,
+so that each item can be checked against the new
+rules. */
+void CShellBrowser::SetColorRuleSet(const CColorRuleSet *pColorRuleSet)
+{
+	m_pColorRuleSet = pColorRuleSet;
+
+	for(int i = 0;i < m_iCurrentAllocation;i++)
+	{
+		if(m_pItemMap[i] == 1)
+		{
+			DetermineItemColorRule(i);
+		}
+	}
+}
+
 void CShellBrowser::InsertTileViewColumns(void)
 {
 	LVTILEVIEWINFO lvtvi;
@@ -67,7 +67,7 @@ void CShellBrowser::UpdateFileSelectionInfo(int iCacheIndex,BOOL Selected)
 
 BOOL CShellBrowser::IsFilenameFiltered(const TCHAR *FileName) const
 {
-	if(CheckWildcardMatch(m_szFilter,FileName,m_bFilterCaseSensitive))
+	if(m_FilterMatcher.Match(FileName))
 		return FALSE;
 
 	return TRUE;
@@ -118,6 +118,62 @@ void CShellBrowser::QueryFullItemNameInternal(int iItemInternal,TCHAR *szFullFil
 	CoTaskMemFree(pidlComplete);
 }
 
+/* Returns FALSE if the item doesn't match any
+colour rule. */
+BOOL CShellBrowser::QueryItemColor(int iItem,COLORREF *pColor) const
+{
+	LVITEM lvItem;
+
+	lvItem.mask		= LVIF_PARAM;
+	lvItem.iItem	= iItem;
+	lvItem.iSubItem	= 0;
+	BOOL bRes = ListView_GetItem(m_hListView,&lvItem);
+
+	if(!bRes || m_pColorRuleSet == NULL)
+	{
+		return FALSE;
+	}
+
+	int iColorRule = m_pExtraItemInfo[(int)lvItem.lParam].iColorRule;
+
+	if(iColorRule == CColorRuleSet::NO_MATCH)
+	{
+		return FALSE;
+	}
+
+	*pColor = m_pColorRuleSet->GetRuleColor(iColorRule);
+
+	return TRUE;
+}
+
+void CShellBrowser::DetermineItemColorRule(int iItemInternal)
+{
+	m_pExtraItemInfo[iItemInternal].iColorRule = CColorRuleSet::NO_MATCH;
+
+	if(m_pColorRuleSet == NULL || m_pColorRuleSet->IsEmpty())
+	{
+		return;
+	}
+
+	/* Rules are matched against the last component of
+	the parsing name. For real files, that's simply the
+	name returned by FindFirstFile. */
+	TCHAR szFileName[MAX_PATH];
+
+	if(m_pExtraItemInfo[iItemInternal].bReal)
+	{
+		StringCchCopy(szFileName,SIZEOF_ARRAY(szFileName),m_pwfdFiles[iItemInternal].cFileName);
+	}
+	else
+	{
+		QueryFullItemNameInternal(iItemInternal,szFileName,SIZEOF_ARRAY(szFileName));
+		PathStripPath(szFileName);
+	}
+
+	m_pExtraItemInfo[iItemInternal].iColorRule = m_pColorRuleSet->FindMatchingRule(szFileName,
+		m_pwfdFiles[iItemInternal].dwFileAttributes);
+}
+
 UINT CShellBrowser::QueryCurrentDirectory(int BufferSize,TCHAR *Buffer) const
 {
 	if(BufferSize < (lstrlen(m_CurDir) + 1))
@@ -1021,11 +1077,27 @@ void CShellBrowser::DetermineFolderVirtual(LPITEMIDLIST pidlDirectory)
 void CShellBrowser::SetFilter(const TCHAR *szFilter)
 {
 	StringCchCopy(m_szFilter,SIZEOF_ARRAY(m_szFilter),szFilter);
+	UpdateFilterMatcher();
 
 	if(m_bApplyFilter)
 	{
-		UnfilterAllItems();
+		/* All items are removed/inserted at once, rather
+		than redrawing the listview after each change. */
+		SendMessage(m_hListView,WM_SETREDRAW,FALSE,NULL);
+
+		/* If the new filter can only match a subset of the
+		items the current filter matches (e.g. when going
+		from "*ab*" to "*abc*"), none of the items that are
+		currently hidden can be shown. In that case, only
+		the items currently shown need to be checked. */
+		if(!m_FilterMatcher.IsSubsetOf(m_AppliedFilterMatcher))
+		{
+			UnfilterAllItems();
+		}
+
 		UpdateFiltering();
+
+		SendMessage(m_hListView,WM_SETREDRAW,TRUE,NULL);
 	}
 }
 
@@ -1048,7 +1120,24 @@ BOOL CShellBrowser::GetFilterStatus(void) const
 
 void CShellBrowser::SetFilterCaseSensitive(BOOL bFilterCaseSensitive)
 {
+	if(bFilterCaseSensitive != m_bFilterCaseSensitive)
+	{
+		/* Items aren't refiltered here, so the items shown
+		may no longer reflect a single filter. Resetting the
+		applied filter means everything will be checked the
+		next time the filter changes. */
+		m_AppliedFilterMatcher = CWildcardMatcher();
+	}
+
 	m_bFilterCaseSensitive = bFilterCaseSensitive;
+	UpdateFilterMatcher();
+}
+
+/* The filter is checked against every item in the
+folder, so it's only parsed when it changes. */
+void CShellBrowser::UpdateFilterMatcher(void)
+{
+	m_FilterMatcher = CWildcardMatcher(m_szFilter,m_bFilterCaseSensitive);
 }
 
 BOOL CShellBrowser::GetFilterCaseSensitive(void) const
@@ -1062,6 +1151,8 @@ void CShellBrowser::UpdateFiltering(void)
 	{
 		RemoveFilteredItems();
 
+		m_AppliedFilterMatcher = m_FilterMatcher;
+
 		SendMessage(m_hOwner,WM_USER_FILTERINGAPPLIED,m_ID,TRUE);
 	}
 	else
@@ -1080,8 +1171,20 @@ void CShellBrowser::UnfilterAllItems(void)
 	std::list<int>::iterator	itr;
 	AwaitingAdd_t		AwaitingAdd;
 
+	std::list<int>	StillFilteredItemsList;
+
 	for(itr = m_FilteredItemsList.begin();itr != m_FilteredItemsList.end();itr++)
 	{
+		/* Items that would be filtered again on insertion
+		are simply left in the filtered list (determining
+		the sorted position of an item is relatively
+		expensive). */
+		if(IsFileFiltered(*itr))
+		{
+			StillFilteredItemsList.push_back(*itr);
+			continue;
+		}
+
 		int iSorted = DetermineItemSortedPosition(*itr);
 
 		AwaitingAdd.iItem			= iSorted;
@@ -1092,7 +1195,7 @@ void CShellBrowser::UnfilterAllItems(void)
 		m_AwaitingAddList.push_back(AwaitingAdd);
 	}
 
-	m_FilteredItemsList.clear();
+	m_FilteredItemsList.swap(StillFilteredItemsList);
 
 	InsertAwaitingItems(m_bShowInGroups);
 
@@ -1255,6 +1358,8 @@ void CShellBrowser::ResetFolderMemoryAllocations(void)
 		}
 	}
 
+	ClearItemKeys();
+
 	/* If we're in thumbnails view, destroy the current
 	imagelist, and create a new one. */
 	if(m_ViewMode == VM_THUMBNAILS)
@@ -1293,7 +1398,10 @@ void CShellBrowser::ResetFolderMemoryAllocations(void)
 
 	CoTaskMemFree(m_pidlDirectory);
 
+	/* Items in the next folder will be filtered
+	using the current filter as they're added. */
 	m_FilteredItemsList.clear();
+	m_AppliedFilterMatcher = m_FilterMatcher;
 	m_AwaitingAddList.clear();
 }
 
@@ -70,7 +70,8 @@ FSM_OWNER};
 extern CRITICAL_SECTION g_csThumbnails;
 extern BOOL g_bcsThumbnailInitialized;
 
-/* Thumbnails. */
-void CALLBACK	FindThumbnailAPC(ULONG_PTR dwParam);
-
-void CALLBACK SetAllFolderSizeColumnDataAPC(ULONG_PTR dwParam);
\ No newline at end of file
+/* Thread pool jobs. Each takes the browser
+whose queue it should drain. */
+void	FindThumbnailJob(LPVOID pParam,const CCancellationToken *pToken);
+void	SetAllColumnDataJob(LPVOID pParam,const CCancellationToken *pToken);
+void	SetAllFolderSizeColumnDataJob(LPVOID pParam,const CCancellationToken *pToken);
\ No newline at end of file
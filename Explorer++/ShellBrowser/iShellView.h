@@ -1,10 +1,15 @@
 #pragma once
 
 #include <list>
+#include <vector>
+#include <unordered_map>
 #include "iPathManager.h"
 #include "../Helper/Helper.h"
 #include "../Helper/DropHandler.h"
 #include "../Helper/StringHelper.h"
+#include "../Helper/WildcardMatcher.h"
+#include "../Helper/ColorRuleSet.h"
+#include "../Helper/FolderSize.h"
 #include "../Helper/Macros.h"
 
 #define WM_USER_UPDATEWINDOWS		(WM_APP + 17)
@@ -15,6 +20,7 @@
 #define WM_USER_FILTERINGAPPLIED	(WM_APP + 202)
 #define WM_USER_GETCOLUMNNAMEINDEX	(WM_APP + 203)
 #define WM_USER_DIRECTORYMODIFIED	(WM_APP + 204)
+#define WM_USER_SELECTIONCHANGED	(WM_APP + 205)
 
 typedef struct
 {
@@ -283,6 +289,11 @@ public:
 	/* Used for temporary sorting in details mode (i.e.
 	when items need to be rearranged). */
 	int				iRelativeSort;
+
+	/* The colour rule this item matches (or
+	CColorRuleSet::NO_MATCH). Determined when the item
+	is added or changes, rather than on each paint. */
+	int				iColorRule;
 };
 
 typedef struct
@@ -293,12 +304,21 @@ typedef struct
 	/* Used to record the number of items in this group.
 	Mimics the feature available in Windows Vista and later. */
 	int nItems;
+
+	/* The item count currently shown in the group header.
+	Headers are only rewritten (once per batch) when this
+	differs from nItems. */
+	int nItemsDisplayed;
 } TypeGroup_t;
 
+struct GroupKeyJob_t;
+
 class CShellBrowser : public IDropTarget, public IDropFilesCallback
 {
 	friend int CALLBACK SortStub(LPARAM lParam1,LPARAM lParam2,LPARAM lParamSort);
-	friend void CALLBACK SetAllColumnDataAPC(ULONG_PTR dwParam);
+	friend void SetAllColumnDataJob(LPVOID pParam,const CCancellationToken *pToken);
+	friend void DetermineGroupKeyProc(LPVOID pParam,int iItem);
+	friend void FolderSizeColumnProgress(int iRoot,const FolderSizeTotals_t *pTotals,LPVOID pData);
 
 public:
 
@@ -307,8 +327,7 @@ public:
 	static const int THUMBNAIL_ITEM_HEIGHT = 120;
 
 	static CShellBrowser *CreateNew(HWND hOwner, HWND hListView,
-		const InitialSettings_t *pSettings, HANDLE hIconThread,
-		HANDLE hFolderSizeThread);
+		const InitialSettings_t *pSettings, HANDLE hIconThread);
 
 	/* IUnknown methods. */
 	HRESULT __stdcall	QueryInterface(REFIID iid,void **ppvObject);
@@ -382,6 +401,7 @@ public:
 	int					QueryDisplayName(int iItem,UINT BufferSize,TCHAR *Buffer) const;
 	BOOL				IsFileReal(int iItem) const;
 	HRESULT				QueryFullItemName(int iIndex,TCHAR *FullItemPath,UINT cchMax) const;
+	BOOL				QueryItemColor(int iItem,COLORREF *pColor) const;
 	
 	/* Column support. */
 	void				ExportCurrentColumns(std::list<Column_t> *pColumns);
@@ -391,7 +411,7 @@ public:
 	int					GetExtractedThumbnail(HBITMAP hThumbnailBitmap);
 
 	/* Folder size support. */
-	int					SetAllFolderSizeColumnData(void);
+	int					SetAllFolderSizeColumnData(const CCancellationToken *pToken);
 
 	/* Filtering. */
 	void				GetFilter(TCHAR *szFilter,int cchMax) const;
@@ -401,6 +421,12 @@ public:
 	BOOL				GetFilterCaseSensitive(void) const;
 	void				SetFilterCaseSensitive(BOOL bCaseSensitive);
 
+	/* Bulk selection. */
+	void				SelectAllItems(BOOL bSelect);
+	void				InvertSelection(void);
+	void				SelectItemsMatching(const TCHAR *szPattern,BOOL bCaseSensitive,BOOL bSelect);
+	BOOL				IsSelectionBatchInProgress(void) const;
+
 	void				UpdateFileSelectionInfo(int,BOOL);
 	HRESULT				CreateHistoryPopup(IN HWND hParent,OUT LPITEMIDLIST *pidl,IN POINT *pt,IN BOOL bBackOrForward);
 	int					SelectFiles(const TCHAR *FileNamePattern);
@@ -424,7 +450,7 @@ public:
 	/* Folder size queueing. */
 	void				AddToFolderQueue(int iItem);
 	void				EmptyFolderQueue(void);
-	BOOL				RemoveFromFolderQueue(int *iItem);
+	BOOL				RemoveFromFolderQueue(const CCancellationToken *pToken,int *iItem);
 
 	void				ToggleGrouping(void);
 	void				SetGrouping(BOOL bShowInGroups);
@@ -439,6 +465,7 @@ public:
 	void				SetInsertSorted(BOOL bInsertSorted);
 	void				SetForceSize(BOOL bForceSize);
 	void				SetSizeDisplayFormat(SizeDisplayFormat_t sdf);
+	void				SetColorRuleSet(const CColorRuleSet *pColorRuleSet);
 
 	int CALLBACK		SortTemporary(LPARAM lParam1,LPARAM lParam2);
 
@@ -558,8 +585,7 @@ private:
 	static const int THUMBNAIL_ITEM_VERTICAL_SPACING = 20;
 
 	CShellBrowser(HWND hOwner, HWND hListView,
-		const InitialSettings_t *pSettings, HANDLE hIconThread,
-		HANDLE hFolderSizeThread);
+		const InitialSettings_t *pSettings, HANDLE hIconThread);
 	~CShellBrowser();
 
 	void				InitializeItemMap(int iStart,int iEnd);
@@ -608,6 +634,7 @@ private:
 
 	/* Listview column support. */
 	void				SetAllColumnText(void);
+	void				QueueColumnDataJobs(BOOL bFolderSizes);
 	void				SetColumnText(UINT ColumnID,int ItemIndex,int ColumnIndex);
 	void				PlaceColumns(void);
 	std::wstring		GetColumnText(UINT ColumnID,int InternalIndex) const;
@@ -660,13 +687,23 @@ private:
 
 	/* Filtering support. */
 	BOOL				IsFilenameFiltered(const TCHAR *FileName) const;
+	void				UpdateFilterMatcher(void);
 	void				RemoveFilteredItems(void);
 	void				RemoveFilteredItem(int iItem,int iItemInternal);
 	void				UpdateFiltering(void);
 	void				UnfilterAllItems(void);
 
+	/* Colour rules. */
+	void				DetermineItemColorRule(int iItemInternal);
+
+	/* Bulk selection support. */
+	void				GetSelection(std::vector<bool> &Selection) const;
+	void				ApplySelection(const std::vector<bool> &Selection);
+
 	/* Listview group support (real files). */
 	int					DetermineItemGroup(int iItemInternal);
+	void				DetermineItemGroupHeader(int iItemInternal,UINT SortMode,TCHAR *szGroupHeader,int cchMax) const;
+	void				DetermineGroupKeys(const std::vector<int> &Items);
 	void				DetermineItemNameGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const;
 	void				DetermineItemSizeGroup(int iItemInternal,TCHAR *szGroupHeader,int cchMax) const;
 	void				DetermineItemDateGroup(int iItemInternal,int iDateType,TCHAR *szGroupHeader,int cchMax) const;
@@ -686,8 +723,16 @@ private:
 
 	/* Other grouping support. */
 	int					CheckGroup(const TCHAR *szGroupHeader, PFNLVGROUPCOMPARE pfnGroupCompare);
+	void				UpdateGroupHeaders(void);
 	void				InsertItemIntoGroup(int iItem,int iGroupId);
 	void				MoveItemsIntoGroups(void);
+	void				GetListViewItemsInternal(std::vector<int> &Items) const;
+
+	/* Cached group keys. */
+	BOOL				LookupGroupKey(UINT SortMode,int iItemInternal,std::wstring &strKey) const;
+	void				StoreGroupKey(UINT SortMode,int iItemInternal,const std::wstring &strKey);
+	void				InvalidateItemKeys(int iItemInternal);
+	void				ClearItemKeys(void);
 
 	/* Thumbnails view. */
 	void				SetupThumbnailsView(void);
@@ -740,7 +785,6 @@ private:
 	CPathManager *		m_pPathManager;
 
 	HANDLE				m_hThread;
-	HANDLE				m_hFolderSizeThread;
 
 	/* Internal state. */
 	LPITEMIDLIST		m_pidlDirectory;
@@ -821,6 +865,11 @@ private:
 	CRITICAL_SECTION	m_folder_cs;
 	HANDLE				m_hFolderQueueEvent;
 
+	/* Given to each folder size job. Cancelled (and
+	replaced) whenever the folder queue is emptied, so
+	that a walk doesn't outlive the listing it's for. */
+	CCancellationToken	*m_pFolderSizeToken;
+
 	/* Thumbnails. */
 	BOOL				m_bThumbnailsSetup;
 
@@ -855,13 +904,45 @@ private:
 	/* Listview groups. The group id is declared
 	explicitly, rather than taken from the size
 	of the group list, to avoid warnings concerning
-	size_t and int. */
-	std::list<TypeGroup_t>	m_GroupList;
+	size_t and int. Group ids are allocated
+	sequentially, so they also index m_GroupList.
+	m_GroupMap maps a (case-folded) group header
+	to its group id. */
+	std::vector<TypeGroup_t>	m_GroupList;
+	std::unordered_map<std::wstring,int>	m_GroupMap;
 	int					m_iGroupId;
 
+	/* Group headers, cached per sort mode, so that
+	switching between sort/group modes doesn't
+	require items to be examined again. The type
+	header is also used as the type sort key.
+	Headers that depend on the date or on disk
+	space are dropped each time items are
+	regrouped. Both vectors are indexed by
+	internal item index. */
+	struct ItemKeyCache_t
+	{
+		std::vector<std::wstring>	Keys;
+		std::vector<BOOL>			Valid;
+	};
+	std::unordered_map<UINT,ItemKeyCache_t>	m_GroupKeyCache;
+
 	/* Filtering related data. */
 	std::list<int>		m_FilteredItemsList;
 	TCHAR				m_szFilter[512];
+	CWildcardMatcher	m_FilterMatcher;
 	BOOL				m_bApplyFilter;
 	BOOL				m_bFilterCaseSensitive;
+
+	/* The filter the currently shown items were
+	last checked against. */
+	CWildcardMatcher	m_AppliedFilterMatcher;
+
+	/* Colour rules. Owned by the caller, and
+	shared between tabs. */
+	const CColorRuleSet	*m_pColorRuleSet;
+
+	/* Bulk selection data. Set while a selection
+	change is being pushed out to the listview. */
+	BOOL				m_bSelectionBatchInProgress;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "stdafx.h"
+#include <vector>
 #include "../Helper/ProcessHelper.h"
 #include "../Helper/ShellHelper.h"
 #include "../Helper/Macros.h"
@@ -51,4 +52,77 @@ void GetTestResourceFileIdl(const TCHAR *szFile, LPITEMIDLIST *pidl)
 
 	HRESULT hr = GetIdlFromParsingName(szFullFileName, pidl);
 	ASSERT_TRUE(SUCCEEDED(hr));
+}
+
+void GetTestTempDirectory(TCHAR *szTempDirectory, size_t cchMax)
+{
+	DWORD dwRet = GetTempPath(static_cast<DWORD>(cchMax), szTempDirectory);
+	ASSERT_NE(0, dwRet);
+	ASSERT_GT(cchMax, dwRet);
+}
+
+void GetTestTempFilePath(const TCHAR *szFile, TCHAR *szOutput, size_t cchMax)
+{
+	TCHAR szTempDirectory[MAX_PATH];
+	GetTestTempDirectory(szTempDirectory, SIZEOF_ARRAY(szTempDirectory));
+
+	ASSERT_EQ(MAX_PATH, cchMax);
+	TCHAR *szRet = PathCombine(szOutput, szTempDirectory, szFile);
+	ASSERT_NE(nullptr, szRet);
+}
+
+std::wstring GetExtendedPath(const std::wstring &strPath)
+{
+	return L"\\\\?\\" + strPath;
+}
+
+void CreateTestFile(const std::wstring &strFileName, DWORD dwSize)
+{
+	HANDLE hFile = CreateFile(GetExtendedPath(strFileName).c_str(), GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	ASSERT_NE(INVALID_HANDLE_VALUE, hFile);
+
+	std::vector<char> Buffer(dwSize, 'x');
+	DWORD nBytesWritten = 0;
+
+	if(dwSize > 0)
+	{
+		BOOL bRet = WriteFile(hFile, &Buffer[0], dwSize, &nBytesWritten, NULL);
+		EXPECT_EQ(TRUE, bRet);
+	}
+
+	EXPECT_EQ(dwSize, nBytesWritten);
+	CloseHandle(hFile);
+}
+
+void DeleteDirectoryTree(const std::wstring &strDirectory)
+{
+	WIN32_FIND_DATA wfd;
+	HANDLE hFindFile = FindFirstFile(GetExtendedPath(strDirectory + L"\\*").c_str(), &wfd);
+
+	if(hFindFile != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if(lstrcmp(wfd.cFileName, L".") == 0 || lstrcmp(wfd.cFileName, L"..") == 0)
+			{
+				continue;
+			}
+
+			std::wstring strFullFileName = strDirectory + L"\\" + wfd.cFileName;
+
+			if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+			{
+				DeleteDirectoryTree(strFullFileName);
+			}
+			else
+			{
+				DeleteFile(GetExtendedPath(strFullFileName).c_str());
+			}
+		} while(FindNextFile(hFindFile, &wfd) != 0);
+
+		FindClose(hFindFile);
+	}
+
+	RemoveDirectory(GetExtendedPath(strDirectory).c_str());
 }
\ No newline at end of file
@@ -1,7 +1,20 @@
 #pragma once
 
+#include <string>
+
 DWORD GetCurrentProcessImageName(TCHAR *szProcessPath, DWORD cchMax);
 void GetTestResourceDirectory(TCHAR *szResourceDirectory, size_t cchMax);
 void GetTestResourceDirectoryIdl(LPITEMIDLIST *pidl);
 void GetTestResourceFilePath(const TCHAR *szFile, TCHAR *szOutput, size_t cchMax);
-void GetTestResourceFileIdl(const TCHAR *szFile, LPITEMIDLIST *pidl);
\ No newline at end of file
+void GetTestResourceFileIdl(const TCHAR *szFile, LPITEMIDLIST *pidl);
+
+/* Tests that need to create files do so
+within the temporary directory. */
+void GetTestTempDirectory(TCHAR *szTempDirectory, size_t cchMax);
+void GetTestTempFilePath(const TCHAR *szFile, TCHAR *szOutput, size_t cchMax);
+
+/* Paths can be longer than MAX_PATH. GetExtendedPath
+adds the \\?\ prefix, which lifts the limit. */
+std::wstring GetExtendedPath(const std::wstring &strPath);
+void CreateTestFile(const std::wstring &strFileName, DWORD dwSize = 0);
+void DeleteDirectoryTree(const std::wstring &strDirectory);
\ No newline at end of file
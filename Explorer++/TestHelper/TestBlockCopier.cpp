@@ -0,0 +1,355 @@
+#include "stdafx.h"
+#include <climits>
+#include <vector>
+#include <string>
+#include "../Helper/BlockCopier.h"
+#include "../Helper/CancellationToken.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	const DWORD INPUT_SIZE = 100000;
+	const int NUM_OUTPUTS = 3;
+}
+
+class BlockCopierTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		TCHAR szFileName[MAX_PATH];
+		GetTestTempFilePath(L"TestBlockCopier.in", szFileName, SIZEOF_ARRAY(szFileName));
+		m_strInput = szFileName;
+
+		for(int i = 0; i < NUM_OUTPUTS; i++)
+		{
+			std::wstring strName = L"TestBlockCopier.out" + std::to_wstring(static_cast<long long>(i));
+			GetTestTempFilePath(strName.c_str(), szFileName, SIZEOF_ARRAY(szFileName));
+			m_Outputs.push_back(szFileName);
+		}
+
+		/* The pattern doesn't repeat on any power of two,
+		so misplaced blocks show up. */
+		for(DWORD i = 0; i < INPUT_SIZE; i++)
+		{
+			m_Data.push_back(static_cast<char>((i * 31) + (i / 251)));
+		}
+
+		HANDLE hFile = CreateFile(m_strInput.c_str(), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		ASSERT_NE(INVALID_HANDLE_VALUE, hFile);
+
+		DWORD nBytesWritten;
+		BOOL bRet = WriteFile(hFile, &m_Data[0], INPUT_SIZE, &nBytesWritten, NULL);
+		EXPECT_EQ(TRUE, bRet);
+		EXPECT_EQ(INPUT_SIZE, nBytesWritten);
+
+		CloseHandle(hFile);
+	}
+
+	void TearDown()
+	{
+		DeleteFile(m_strInput.c_str());
+
+		for(const auto &strOutput : m_Outputs)
+		{
+			DeleteFile(strOutput.c_str());
+		}
+	}
+
+	HANDLE OpenInput()
+	{
+		return CreateFile(m_strInput.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, 0, NULL);
+	}
+
+	HANDLE CreateOutput(int iOutput)
+	{
+		return CreateFile(m_Outputs[iOutput].c_str(), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	}
+
+	std::vector<char> ReadOutput(int iOutput)
+	{
+		std::vector<char> Contents;
+
+		HANDLE hFile = CreateFile(m_Outputs[iOutput].c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, 0, NULL);
+
+		if(hFile == INVALID_HANDLE_VALUE)
+		{
+			return Contents;
+		}
+
+		char Buffer[4096];
+		DWORD dwRead;
+
+		while(ReadFile(hFile, Buffer, sizeof(Buffer), &dwRead, NULL) && dwRead > 0)
+		{
+			Contents.insert(Contents.end(), Buffer, Buffer + dwRead);
+		}
+
+		CloseHandle(hFile);
+
+		return Contents;
+	}
+
+	void TestCopy(DWORD dwBufferSize)
+	{
+		HANDLE hInput = OpenInput();
+		ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+		HANDLE hOutput = CreateOutput(0);
+		ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+		CBlockCopier BlockCopier(dwBufferSize);
+		EXPECT_EQ(dwBufferSize, BlockCopier.GetBufferSize());
+
+		ULONGLONG ulBytesRead;
+		BOOL bRet = BlockCopier.Copy(hInput, hOutput, INPUT_SIZE, &ulBytesRead, NULL);
+		EXPECT_EQ(TRUE, bRet);
+		EXPECT_EQ(INPUT_SIZE, ulBytesRead);
+
+		bRet = BlockCopier.Flush();
+		EXPECT_EQ(TRUE, bRet);
+
+		CloseHandle(hOutput);
+		CloseHandle(hInput);
+
+		EXPECT_EQ(m_Data, ReadOutput(0));
+	}
+
+	std::wstring m_strInput;
+	std::vector<std::wstring> m_Outputs;
+	std::vector<char> m_Data;
+};
+
+TEST_F(BlockCopierTest, Copy)
+{
+	/* Covers buffers that are smaller than, don't divide
+	evenly into, and are larger than the input. */
+	TestCopy(1);
+	TestCopy(7);
+	TestCopy(4096);
+	TestCopy(INPUT_SIZE);
+	TestCopy(CBlockCopier::DEFAULT_BUFFER_SIZE);
+}
+
+TEST_F(BlockCopierTest, MultipleOutputs)
+{
+	HANDLE hInput = OpenInput();
+	ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+	CBlockCopier BlockCopier(4096);
+
+	/* The last output only receives what's left
+	of the input. */
+	const ULONGLONG ulPieceSize = 40000;
+
+	for(int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		HANDLE hOutput = CreateOutput(i);
+		ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+		ULONGLONG ulBytesRead;
+		BOOL bRet = BlockCopier.Copy(hInput, hOutput, ulPieceSize, &ulBytesRead, NULL);
+		EXPECT_EQ(TRUE, bRet);
+		EXPECT_EQ(min(ulPieceSize, INPUT_SIZE - (i * ulPieceSize)), ulBytesRead);
+
+		bRet = BlockCopier.Flush();
+		EXPECT_EQ(TRUE, bRet);
+
+		CloseHandle(hOutput);
+	}
+
+	CloseHandle(hInput);
+
+	std::vector<char> Joined;
+
+	for(int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		std::vector<char> Contents = ReadOutput(i);
+		Joined.insert(Joined.end(), Contents.begin(), Contents.end());
+	}
+
+	EXPECT_EQ(m_Data, Joined);
+}
+
+TEST_F(BlockCopierTest, MultipleInputs)
+{
+	HANDLE hOutput = CreateOutput(0);
+	ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+	/* Each input is read in full, without waiting for
+	the previous input to be written. */
+	CBlockCopier BlockCopier(4096);
+
+	for(int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		HANDLE hInput = OpenInput();
+		ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+		ULONGLONG ulBytesRead;
+		BOOL bRet = BlockCopier.Copy(hInput, hOutput, ULLONG_MAX, &ulBytesRead, NULL);
+		EXPECT_EQ(TRUE, bRet);
+		EXPECT_EQ(INPUT_SIZE, ulBytesRead);
+
+		CloseHandle(hInput);
+	}
+
+	BOOL bRet = BlockCopier.Flush();
+	EXPECT_EQ(TRUE, bRet);
+
+	CloseHandle(hOutput);
+
+	std::vector<char> Expected;
+
+	for(int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		Expected.insert(Expected.end(), m_Data.begin(), m_Data.end());
+	}
+
+	EXPECT_EQ(Expected, ReadOutput(0));
+}
+
+TEST_F(BlockCopierTest, SplitAndMerge)
+{
+	const DWORD dwBufferSize = 4096;
+
+	/* The pieces fall on either side of buffer boundaries,
+	and include an empty piece, and a piece that's larger
+	than both buffers put together. */
+	ULONGLONG PieceSizes[NUM_OUTPUTS] = {dwBufferSize - 1, 0, (3 * dwBufferSize) + 1};
+
+	{
+		HANDLE hInput = OpenInput();
+		ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+		CBlockCopier BlockCopier(dwBufferSize);
+
+		for(int i = 0; i < NUM_OUTPUTS; i++)
+		{
+			HANDLE hOutput = CreateOutput(i);
+			ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+			ULONGLONG ulBytesRead;
+			BOOL bRet = BlockCopier.Copy(hInput, hOutput, PieceSizes[i], &ulBytesRead, NULL);
+			EXPECT_EQ(TRUE, bRet);
+			EXPECT_EQ(PieceSizes[i], ulBytesRead);
+
+			bRet = BlockCopier.Flush();
+			EXPECT_EQ(TRUE, bRet);
+
+			CloseHandle(hOutput);
+		}
+
+		CloseHandle(hInput);
+	}
+
+	/* The input is overwritten with the pieces, joined
+	back together. */
+	HANDLE hOutput = CreateFile(m_strInput.c_str(), GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+	CBlockCopier BlockCopier(dwBufferSize);
+
+	for(int i = 0; i < NUM_OUTPUTS; i++)
+	{
+		HANDLE hInput = CreateFile(m_Outputs[i].c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+		LARGE_INTEGER lFileSize;
+		BOOL bRet = GetFileSizeEx(hInput, &lFileSize);
+		ASSERT_EQ(TRUE, bRet);
+		EXPECT_EQ(PieceSizes[i], static_cast<ULONGLONG>(lFileSize.QuadPart));
+
+		bRet = BlockCopier.Copy(hInput, hOutput, lFileSize.QuadPart, NULL, NULL);
+		EXPECT_EQ(TRUE, bRet);
+
+		CloseHandle(hInput);
+	}
+
+	BOOL bRet = BlockCopier.Flush();
+	EXPECT_EQ(TRUE, bRet);
+
+	CloseHandle(hOutput);
+
+	HANDLE hInput = OpenInput();
+	ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+	std::vector<char> Merged(INPUT_SIZE);
+	DWORD dwRead;
+	bRet = ReadFile(hInput, &Merged[0], INPUT_SIZE, &dwRead, NULL);
+	EXPECT_EQ(TRUE, bRet);
+
+	CloseHandle(hInput);
+
+	ULONGLONG ulTotalSize = PieceSizes[0] + PieceSizes[1] + PieceSizes[2];
+	ASSERT_EQ(ulTotalSize, dwRead);
+
+	Merged.resize(dwRead);
+	EXPECT_EQ(std::vector<char>(m_Data.begin(), m_Data.begin() + dwRead), Merged);
+}
+
+TEST_F(BlockCopierTest, Cancelled)
+{
+	HANDLE hInput = OpenInput();
+	ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+	HANDLE hOutput = CreateOutput(0);
+	ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+	CCancellationToken *pToken = new CCancellationToken();
+	pToken->Cancel();
+
+	CBlockCopier BlockCopier(4096);
+
+	ULONGLONG ulBytesRead;
+	BOOL bRet = BlockCopier.Copy(hInput, hOutput, INPUT_SIZE, &ulBytesRead, pToken);
+	EXPECT_EQ(FALSE, bRet);
+	EXPECT_EQ(0, ulBytesRead);
+
+	/* Cancelling doesn't affect later copies that
+	aren't given the token. */
+	bRet = BlockCopier.Copy(hInput, hOutput, INPUT_SIZE, &ulBytesRead, NULL);
+	EXPECT_EQ(TRUE, bRet);
+	EXPECT_EQ(INPUT_SIZE, ulBytesRead);
+
+	bRet = BlockCopier.Flush();
+	EXPECT_EQ(TRUE, bRet);
+
+	pToken->Release();
+
+	CloseHandle(hOutput);
+	CloseHandle(hInput);
+
+	EXPECT_EQ(m_Data, ReadOutput(0));
+}
+
+TEST_F(BlockCopierTest, WriteFailed)
+{
+	HANDLE hInput = OpenInput();
+	ASSERT_NE(INVALID_HANDLE_VALUE, hInput);
+
+	/* The output can't be written to. */
+	HANDLE hOutput = OpenInput();
+	ASSERT_NE(INVALID_HANDLE_VALUE, hOutput);
+
+	CBlockCopier BlockCopier(4096);
+
+	ULONGLONG ulBytesRead;
+	BlockCopier.Copy(hInput, hOutput, INPUT_SIZE, &ulBytesRead, NULL);
+
+	BOOL bRet = BlockCopier.Flush();
+	EXPECT_EQ(FALSE, bRet);
+
+	bRet = BlockCopier.Copy(hInput, hOutput, INPUT_SIZE, &ulBytesRead, NULL);
+	EXPECT_EQ(FALSE, bRet);
+
+	CloseHandle(hOutput);
+	CloseHandle(hInput);
+}
@@ -0,0 +1,195 @@
+#include "stdafx.h"
+#include "../Helper/ContentMatcher.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+class ContentMatcherTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		GetTestTempFilePath(L"TestContentMatcher.txt", m_szFileName, SIZEOF_ARRAY(m_szFileName));
+	}
+
+	void TearDown()
+	{
+		DeleteFile(m_szFileName);
+	}
+
+	void WriteTestFile(const void *pData, size_t nSize)
+	{
+		HANDLE hFile = CreateFile(m_szFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		ASSERT_NE(INVALID_HANDLE_VALUE, hFile);
+
+		DWORD nBytesWritten = 0;
+
+		if(nSize > 0)
+		{
+			BOOL bRet = WriteFile(hFile, pData, static_cast<DWORD>(nSize), &nBytesWritten, NULL);
+			EXPECT_EQ(TRUE, bRet);
+		}
+
+		EXPECT_EQ(nSize, nBytesWritten);
+
+		CloseHandle(hFile);
+	}
+
+	void WriteTestFile(const char *szData)
+	{
+		WriteTestFile(szData, strlen(szData));
+	}
+
+	/* Writes the text as UTF-16, with the given byte
+	order mark (which may be NULL). */
+	void WriteUtf16TestFile(const WCHAR *szData, const BYTE *pBom, BOOL bBigEndian)
+	{
+		std::vector<BYTE> Data;
+
+		if(pBom != NULL)
+		{
+			Data.push_back(pBom[0]);
+			Data.push_back(pBom[1]);
+		}
+
+		for(const WCHAR *p = szData; *p != '\0'; p++)
+		{
+			if(bBigEndian)
+			{
+				Data.push_back(HIBYTE(*p));
+				Data.push_back(LOBYTE(*p));
+			}
+			else
+			{
+				Data.push_back(LOBYTE(*p));
+				Data.push_back(HIBYTE(*p));
+			}
+		}
+
+		WriteTestFile(&Data[0], Data.size());
+	}
+
+	CContentMatcher::MatchResult_t Match(const TCHAR *szText, BOOL bUseRegularExpressions, BOOL bCaseInsensitive)
+	{
+		CContentMatcher ContentMatcher;
+		BOOL bRet = ContentMatcher.Compile(szText, bUseRegularExpressions, bCaseInsensitive);
+		EXPECT_EQ(TRUE, bRet);
+
+		return ContentMatcher.MatchFile(m_szFileName, NULL);
+	}
+
+	TCHAR m_szFileName[MAX_PATH];
+};
+
+TEST_F(ContentMatcherTest, Literal)
+{
+	WriteTestFile("first line\r\nsecond line\r\n");
+
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"second", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"line\r\nsecond", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"third", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"SECOND", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"SECOND", FALSE, TRUE));
+}
+
+TEST_F(ContentMatcherTest, Utf8)
+{
+	/* "caf\u00e9" with a UTF-8 byte order mark. */
+	WriteTestFile("\xEF\xBB\xBFmenu: caf\xC3\xA9\n");
+
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"caf\u00e9", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"CAF\u00c9", FALSE, TRUE));
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"cafe", FALSE, FALSE));
+}
+
+TEST_F(ContentMatcherTest, Utf16)
+{
+	const BYTE BOM_LE[] = {0xFF, 0xFE};
+	const BYTE BOM_BE[] = {0xFE, 0xFF};
+
+	WriteUtf16TestFile(L"alpha\r\nbeta\r\n", BOM_LE, FALSE);
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"beta", FALSE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"^beta$", TRUE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"gamma", FALSE, FALSE));
+
+	WriteUtf16TestFile(L"alpha\r\nbeta\r\n", BOM_BE, TRUE);
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"BETA", FALSE, TRUE));
+
+	/* Without a byte order mark, the encoding is
+	worked out from the position of null bytes. */
+	WriteUtf16TestFile(L"alpha\r\nbeta\r\n", NULL, FALSE);
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"alpha", FALSE, FALSE));
+}
+
+TEST_F(ContentMatcherTest, RegularExpression)
+{
+	WriteTestFile("#include <stdio.h>\nint main(void)\n{\n}\n");
+
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"^int\\s+main", TRUE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"std[a-z]+\\.h", TRUE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"^\\{$", TRUE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"^main", TRUE, FALSE));
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, Match(L"^INT MAIN", TRUE, TRUE));
+
+	CContentMatcher ContentMatcher;
+	EXPECT_EQ(FALSE, ContentMatcher.Compile(L"a)|(b", TRUE, FALSE));
+	EXPECT_EQ(FALSE, ContentMatcher.Compile(L"", FALSE, FALSE));
+}
+
+TEST_F(ContentMatcherTest, Binary)
+{
+	const char DATA[] = "MZ\x90\0\x03\0\0\0text";
+	WriteTestFile(DATA, sizeof(DATA) - 1);
+
+	EXPECT_EQ(CContentMatcher::MATCH_SKIPPED_BINARY, Match(L"text", FALSE, FALSE));
+}
+
+TEST_F(ContentMatcherTest, MaxFileSize)
+{
+	WriteTestFile("0123456789");
+
+	CContentMatcher ContentMatcher;
+	ContentMatcher.Compile(L"5", FALSE, FALSE);
+
+	ContentMatcher.SetMaxFileSize(9);
+	EXPECT_EQ(CContentMatcher::MATCH_SKIPPED_TOO_LARGE, ContentMatcher.MatchFile(m_szFileName, NULL));
+
+	ContentMatcher.SetMaxFileSize(10);
+	EXPECT_EQ(CContentMatcher::MATCH_FOUND, ContentMatcher.MatchFile(m_szFileName, NULL));
+}
+
+TEST_F(ContentMatcherTest, EmptyFile)
+{
+	WriteTestFile("");
+
+	EXPECT_EQ(CContentMatcher::MATCH_NOT_FOUND, Match(L"text", FALSE, FALSE));
+}
+
+TEST(ContentMatcherEncodingTest, DetectEncoding)
+{
+	size_t nHeaderSize;
+
+	const BYTE UTF8_BOM[] = {0xEF, 0xBB, 0xBF, 'a'};
+	EXPECT_EQ(CContentMatcher::ENCODING_UTF8, CContentMatcher::DetectEncoding(UTF8_BOM, sizeof(UTF8_BOM), TRUE, nHeaderSize));
+	EXPECT_EQ(3, nHeaderSize);
+
+	const BYTE UTF8[] = {'a', 0xC3, 0xA9};
+	EXPECT_EQ(CContentMatcher::ENCODING_UTF8, CContentMatcher::DetectEncoding(UTF8, sizeof(UTF8), TRUE, nHeaderSize));
+	EXPECT_EQ(0, nHeaderSize);
+
+	/* A lone 0xE9 isn't valid UTF-8. */
+	const BYTE ANSI[] = {'a', 0xE9, 'b'};
+	EXPECT_EQ(CContentMatcher::ENCODING_ANSI, CContentMatcher::DetectEncoding(ANSI, sizeof(ANSI), TRUE, nHeaderSize));
+
+	/* A sequence cut off at the end of the data is
+	only allowed if the data isn't the whole file. */
+	const BYTE UTF8_TRUNCATED[] = {'a', 0xC3};
+	EXPECT_EQ(CContentMatcher::ENCODING_UTF8, CContentMatcher::DetectEncoding(UTF8_TRUNCATED, sizeof(UTF8_TRUNCATED), FALSE, nHeaderSize));
+	EXPECT_EQ(CContentMatcher::ENCODING_ANSI, CContentMatcher::DetectEncoding(UTF8_TRUNCATED, sizeof(UTF8_TRUNCATED), TRUE, nHeaderSize));
+
+	const BYTE UTF16BE[] = {0, 'a', 0, 'b'};
+	EXPECT_EQ(CContentMatcher::ENCODING_UTF16BE, CContentMatcher::DetectEncoding(UTF16BE, sizeof(UTF16BE), TRUE, nHeaderSize));
+
+	const BYTE BINARY[] = {'a', 0, 0, 'b'};
+	EXPECT_EQ(CContentMatcher::ENCODING_BINARY, CContentMatcher::DetectEncoding(BINARY, sizeof(BINARY), TRUE, nHeaderSize));
+}
@@ -0,0 +1,239 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "../Helper/DiskUsageTree.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	const DWORD ROOT_NODE = CDiskUsageTree::ROOT_NODE;
+	const DWORD NO_NODE = CDiskUsageTree::NO_NODE;
+}
+
+class DiskUsageTreeTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		TCHAR szDirectory[MAX_PATH];
+		GetTestTempFilePath(L"DiskUsageTree", szDirectory, SIZEOF_ARRAY(szDirectory));
+		m_strDirectory = szDirectory;
+
+		DeleteDirectoryTree(m_strDirectory);
+
+		ASSERT_EQ(TRUE, CreateDirectory(m_strDirectory.c_str(), NULL));
+		ASSERT_EQ(TRUE, CreateDirectory((m_strDirectory + L"\\Docs").c_str(), NULL));
+		ASSERT_EQ(TRUE, CreateDirectory((m_strDirectory + L"\\Docs\\Old").c_str(), NULL));
+		ASSERT_EQ(TRUE, CreateDirectory((m_strDirectory + L"\\Media").c_str(), NULL));
+		ASSERT_EQ(TRUE, CreateDirectory((m_strDirectory + L"\\Empty").c_str(), NULL));
+
+		CreateTestFile(m_strDirectory + L"\\a.txt", 100);
+		CreateTestFile(m_strDirectory + L"\\b.dat", 2000);
+		CreateTestFile(m_strDirectory + L"\\Docs\\c.txt", 300);
+		CreateTestFile(m_strDirectory + L"\\Docs\\d.TXT", 50);
+		CreateTestFile(m_strDirectory + L"\\Docs\\Old\\e.log", 5000);
+		CreateTestFile(m_strDirectory + L"\\Media\\f.dat", 10000);
+		CreateTestFile(m_strDirectory + L"\\Media\\g", 7);
+
+		m_strSaveFile = m_strDirectory + L".tree";
+	}
+
+	void TearDown()
+	{
+		DeleteDirectoryTree(m_strDirectory);
+		DeleteFile(m_strSaveFile.c_str());
+	}
+
+	DWORD FindNode(const CDiskUsageTree &Tree, const TCHAR *szPath)
+	{
+		DWORD dwNode = NO_NODE;
+		BOOL bRet = Tree.FindNode(szPath, dwNode);
+		EXPECT_EQ(TRUE, bRet);
+
+		return dwNode;
+	}
+
+	std::vector<std::wstring> GetNames(const CDiskUsageTree &Tree, const std::vector<DWORD> &Nodes)
+	{
+		std::vector<std::wstring> Names;
+
+		for(auto itr = Nodes.begin(); itr != Nodes.end(); itr++)
+		{
+			Names.push_back(Tree.GetName(*itr));
+		}
+
+		return Names;
+	}
+
+	void CheckTree(const CDiskUsageTree &Tree)
+	{
+		ASSERT_EQ(12u, Tree.GetNodeCount());
+		EXPECT_EQ(m_strDirectory, Tree.GetName(ROOT_NODE));
+		EXPECT_EQ(NO_NODE, Tree.GetParent(ROOT_NODE));
+		EXPECT_EQ(17457ULL, Tree.GetSize(ROOT_NODE));
+
+		DWORD dwDocs = FindNode(Tree, L"Docs");
+		EXPECT_EQ(TRUE, Tree.IsFolder(dwDocs));
+		EXPECT_EQ(5350ULL, Tree.GetSize(dwDocs));
+		EXPECT_EQ(5000ULL, Tree.GetSize(FindNode(Tree, L"docs\\old")));
+		EXPECT_EQ(10007ULL, Tree.GetSize(FindNode(Tree, L"Media")));
+		EXPECT_EQ(0ULL, Tree.GetSize(FindNode(Tree, L"Empty")));
+
+		DWORD dwFile = FindNode(Tree, L"Docs\\Old\\e.log");
+		EXPECT_EQ(FALSE, Tree.IsFolder(dwFile));
+		EXPECT_EQ(m_strDirectory + L"\\Docs\\Old\\e.log", Tree.GetFullPath(dwFile));
+
+		DWORD dwNode;
+		EXPECT_EQ(FALSE, Tree.FindNode(L"Docs\\Missing", dwNode));
+		EXPECT_EQ(TRUE, Tree.FindNode(L"", dwNode));
+		EXPECT_EQ(ROOT_NODE, dwNode);
+
+		std::vector<DWORD> Nodes;
+		Tree.GetChildren(ROOT_NODE, Nodes);
+		std::vector<std::wstring> Expected;
+		Expected.push_back(L"Media");
+		Expected.push_back(L"Docs");
+		Expected.push_back(L"b.dat");
+		Expected.push_back(L"a.txt");
+		Expected.push_back(L"Empty");
+		EXPECT_EQ(Expected, GetNames(Tree, Nodes));
+
+		for(auto itr = Nodes.begin(); itr != Nodes.end(); itr++)
+		{
+			EXPECT_EQ(ROOT_NODE, Tree.GetParent(*itr));
+		}
+	}
+
+	std::wstring m_strDirectory;
+	std::wstring m_strSaveFile;
+};
+
+TEST_F(DiskUsageTreeTest, Build)
+{
+	CDiskUsageTree Tree;
+	EXPECT_EQ(0u, Tree.GetNodeCount());
+
+	ASSERT_EQ(TRUE, Tree.Build(m_strDirectory.c_str(), 1, NULL));
+	CheckTree(Tree);
+
+	/* The result shouldn't depend on how
+	the walk was split up. */
+	CDiskUsageTree ParallelTree;
+	ASSERT_EQ(TRUE, ParallelTree.Build((m_strDirectory + L"\\").c_str(), 4, NULL));
+	CheckTree(ParallelTree);
+}
+
+TEST_F(DiskUsageTreeTest, Largest)
+{
+	CDiskUsageTree Tree;
+	ASSERT_EQ(TRUE, Tree.Build(m_strDirectory.c_str(), 0, NULL));
+
+	std::vector<DWORD> Nodes;
+	Tree.GetLargestFiles(ROOT_NODE, 3, Nodes);
+	std::vector<std::wstring> Expected;
+	Expected.push_back(L"f.dat");
+	Expected.push_back(L"e.log");
+	Expected.push_back(L"b.dat");
+	EXPECT_EQ(Expected, GetNames(Tree, Nodes));
+
+	Tree.GetLargestFolders(ROOT_NODE, 2, Nodes);
+	Expected.clear();
+	Expected.push_back(L"Media");
+	Expected.push_back(L"Docs");
+	EXPECT_EQ(Expected, GetNames(Tree, Nodes));
+
+	/* Only items beneath the given
+	folder are considered. */
+	DWORD dwDocs = FindNode(Tree, L"Docs");
+	Tree.GetLargestFiles(dwDocs, 10, Nodes);
+	Expected.clear();
+	Expected.push_back(L"e.log");
+	Expected.push_back(L"c.txt");
+	Expected.push_back(L"d.TXT");
+	EXPECT_EQ(Expected, GetNames(Tree, Nodes));
+
+	Tree.GetLargestFolders(dwDocs, 10, Nodes);
+	Expected.clear();
+	Expected.push_back(L"Old");
+	EXPECT_EQ(Expected, GetNames(Tree, Nodes));
+
+	Tree.GetLargestFiles(ROOT_NODE, 0, Nodes);
+	EXPECT_TRUE(Nodes.empty());
+}
+
+TEST_F(DiskUsageTreeTest, ExtensionTotals)
+{
+	CDiskUsageTree Tree;
+	ASSERT_EQ(TRUE, Tree.Build(m_strDirectory.c_str(), 0, NULL));
+
+	std::vector<CDiskUsageTree::ExtensionTotal_t> Totals;
+	Tree.GetExtensionTotals(ROOT_NODE, Totals);
+	ASSERT_EQ(4u, Totals.size());
+
+	EXPECT_EQ(L".dat", Totals[0].strExtension);
+	EXPECT_EQ(12000ULL, Totals[0].ulSize);
+	EXPECT_EQ(2, Totals[0].nFiles);
+
+	EXPECT_EQ(L".log", Totals[1].strExtension);
+	EXPECT_EQ(5000ULL, Totals[1].ulSize);
+	EXPECT_EQ(1, Totals[1].nFiles);
+
+	EXPECT_EQ(L".txt", Totals[2].strExtension);
+	EXPECT_EQ(450ULL, Totals[2].ulSize);
+	EXPECT_EQ(3, Totals[2].nFiles);
+
+	EXPECT_EQ(L"", Totals[3].strExtension);
+	EXPECT_EQ(7ULL, Totals[3].ulSize);
+	EXPECT_EQ(1, Totals[3].nFiles);
+
+	Tree.GetExtensionTotals(FindNode(Tree, L"Media"), Totals);
+	ASSERT_EQ(2u, Totals.size());
+	EXPECT_EQ(10000ULL, Totals[0].ulSize);
+	EXPECT_EQ(7ULL, Totals[1].ulSize);
+}
+
+TEST_F(DiskUsageTreeTest, SaveAndLoad)
+{
+	CDiskUsageTree Tree;
+	ASSERT_EQ(TRUE, Tree.Build(m_strDirectory.c_str(), 0, NULL));
+	ASSERT_EQ(TRUE, Tree.Save(m_strSaveFile.c_str()));
+
+	CDiskUsageTree LoadedTree;
+	ASSERT_EQ(TRUE, LoadedTree.Load(m_strSaveFile.c_str()));
+	EXPECT_EQ(m_strDirectory, LoadedTree.GetRoot());
+	EXPECT_EQ(Tree.GetBuildTime().dwLowDateTime, LoadedTree.GetBuildTime().dwLowDateTime);
+	EXPECT_EQ(Tree.GetBuildTime().dwHighDateTime, LoadedTree.GetBuildTime().dwHighDateTime);
+	CheckTree(LoadedTree);
+
+	/* A truncated file is rejected, and the
+	existing tree is left as it was. */
+	HANDLE hFile = CreateFile(m_strSaveFile.c_str(), GENERIC_WRITE, 0, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	ASSERT_NE(INVALID_HANDLE_VALUE, hFile);
+
+	LARGE_INTEGER liFileSize;
+	ASSERT_EQ(TRUE, GetFileSizeEx(hFile, &liFileSize));
+	liFileSize.QuadPart -= 2;
+	SetFilePointerEx(hFile, liFileSize, NULL, FILE_BEGIN);
+	SetEndOfFile(hFile);
+	CloseHandle(hFile);
+
+	EXPECT_EQ(FALSE, LoadedTree.Load(m_strSaveFile.c_str()));
+	CheckTree(LoadedTree);
+}
+
+TEST_F(DiskUsageTreeTest, Cancelled)
+{
+	CDiskUsageTree Tree;
+	ASSERT_EQ(TRUE, Tree.Build(m_strDirectory.c_str(), 0, NULL));
+
+	CCancellationToken *pToken = new CCancellationToken();
+	pToken->Cancel();
+
+	EXPECT_EQ(FALSE, Tree.Build((m_strDirectory + L"\\Docs").c_str(), 0, pToken));
+	CheckTree(Tree);
+
+	pToken->Release();
+}
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include <vector>
+#include "../Helper/FileIdSet.h"
+
+namespace
+{
+	struct InsertThread_t
+	{
+		CFileIdSet *pFileIds;
+		ULONGLONG ulFirstIndex;
+		int nItems;
+		int nInserted;
+	};
+
+	DWORD WINAPI InsertThread(LPVOID pParam)
+	{
+		InsertThread_t *pInsertThread = reinterpret_cast<InsertThread_t *>(pParam);
+
+		for(int i = 0; i < pInsertThread->nItems; i++)
+		{
+			if(pInsertThread->pFileIds->Insert(1, pInsertThread->ulFirstIndex + i))
+			{
+				pInsertThread->nInserted++;
+			}
+		}
+
+		return 0;
+	}
+}
+
+TEST(FileIdSetTest, Insert)
+{
+	CFileIdSet FileIds;
+
+	EXPECT_EQ(TRUE, FileIds.Insert(1, 100));
+	EXPECT_EQ(FALSE, FileIds.Insert(1, 100));
+
+	/* The same index on another volume
+	is a different file. */
+	EXPECT_EQ(TRUE, FileIds.Insert(2, 100));
+
+	EXPECT_EQ(TRUE, FileIds.Insert(1, 0));
+	EXPECT_EQ(FALSE, FileIds.Insert(1, 0));
+
+	EXPECT_EQ(3u, FileIds.GetCount());
+}
+
+TEST(FileIdSetTest, Grow)
+{
+	const int NUM_ITEMS = 100000;
+
+	CFileIdSet FileIds;
+
+	for(int i = 1; i <= NUM_ITEMS; i++)
+	{
+		EXPECT_EQ(TRUE, FileIds.Insert(1, static_cast<ULONGLONG>(i) << 16));
+	}
+
+	for(int i = 1; i <= NUM_ITEMS; i++)
+	{
+		EXPECT_EQ(FALSE, FileIds.Insert(1, static_cast<ULONGLONG>(i) << 16));
+	}
+
+	EXPECT_EQ(static_cast<size_t>(NUM_ITEMS), FileIds.GetCount());
+}
+
+/* Threads insert overlapping ranges, so each ID
+should be reported as new exactly once. */
+TEST(FileIdSetTest, Concurrent)
+{
+	const int NUM_THREADS = 4;
+	const int NUM_ITEMS = 20000;
+
+	CFileIdSet FileIds;
+	std::vector<InsertThread_t> InsertThreads(NUM_THREADS);
+	std::vector<HANDLE> Threads;
+
+	for(int i = 0; i < NUM_THREADS; i++)
+	{
+		InsertThreads[i].pFileIds = &FileIds;
+		InsertThreads[i].ulFirstIndex = i * (NUM_ITEMS / 2);
+		InsertThreads[i].nItems = NUM_ITEMS;
+		InsertThreads[i].nInserted = 0;
+
+		HANDLE hThread = CreateThread(NULL, 0, InsertThread, &InsertThreads[i], 0, NULL);
+		ASSERT_NE(static_cast<HANDLE>(NULL), hThread);
+		Threads.push_back(hThread);
+	}
+
+	WaitForMultipleObjects(static_cast<DWORD>(Threads.size()), &Threads[0], TRUE, INFINITE);
+
+	int nInserted = 0;
+
+	for(int i = 0; i < NUM_THREADS; i++)
+	{
+		CloseHandle(Threads[i]);
+		nInserted += InsertThreads[i].nInserted;
+	}
+
+	size_t nExpected = (NUM_THREADS - 1) * (NUM_ITEMS / 2) + NUM_ITEMS;
+	EXPECT_EQ(nExpected, static_cast<size_t>(nInserted));
+	EXPECT_EQ(nExpected, FileIds.GetCount());
+}
@@ -0,0 +1,275 @@
+#include "stdafx.h"
+#include <algorithm>
+#include "../Helper/FileNameIndex.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	/* Returns the names (rather than the full paths) of
+	the matching items, in sorted order. */
+	void QueryIndex(const CFileNameIndex &FileNameIndex, const TCHAR *szDirectory, BOOL bRecursive,
+		const TCHAR *szPattern, CFileNameIndex::QueryType_t QueryType, DWORD dwAttributes,
+		std::vector<std::wstring> &FileNames)
+	{
+		std::vector<CFileNameIndex::QueryResult_t> Results;
+		BOOL bRet = FileNameIndex.Query(szDirectory, bRecursive, szPattern, QueryType, TRUE, dwAttributes, Results);
+		ASSERT_EQ(TRUE, bRet);
+
+		for(auto itr = Results.begin(); itr != Results.end(); itr++)
+		{
+			FileNames.push_back(PathFindFileName(itr->strFullFileName.c_str()));
+		}
+
+		std::sort(FileNames.begin(), FileNames.end());
+	}
+
+	void CheckQuery(const CFileNameIndex &FileNameIndex, const TCHAR *szDirectory, BOOL bRecursive,
+		const TCHAR *szPattern, CFileNameIndex::QueryType_t QueryType, DWORD dwAttributes,
+		const TCHAR *szExpectedNames[], size_t nExpectedNames)
+	{
+		std::vector<std::wstring> FileNames;
+		QueryIndex(FileNameIndex, szDirectory, bRecursive, szPattern, QueryType, dwAttributes, FileNames);
+
+		std::vector<std::wstring> ExpectedNames(szExpectedNames, szExpectedNames + nExpectedNames);
+		EXPECT_EQ(ExpectedNames, FileNames);
+	}
+}
+
+class FileNameIndexTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		GetTestResourceFilePath(L"FolderSize", m_szRoot, SIZEOF_ARRAY(m_szRoot));
+
+		BOOL bRet = m_FileNameIndex.Build(m_szRoot, NULL);
+		ASSERT_EQ(TRUE, bRet);
+	}
+
+	TCHAR m_szRoot[MAX_PATH];
+	CFileNameIndex m_FileNameIndex;
+};
+
+TEST_F(FileNameIndexTest, Build)
+{
+	EXPECT_EQ(8, m_FileNameIndex.GetItemCount());
+	EXPECT_EQ(std::wstring(m_szRoot), m_FileNameIndex.GetRoot());
+}
+
+TEST_F(FileNameIndexTest, Wildcard)
+{
+	const TCHAR *szAll[] = {L"VersionInfo1.dll", L"VersionInfo2.dll", L"VersionInfo3.dll",
+		L"VersionInfo4.dll", L"VersionInfo5.dll", L"VersionInfo6.dll"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"*.dll", CFileNameIndex::QUERY_WILDCARD, 0, szAll, SIZEOF_ARRAY(szAll));
+
+	const TCHAR *szTopLevel[] = {L"VersionInfo5.dll", L"VersionInfo6.dll"};
+	CheckQuery(m_FileNameIndex, m_szRoot, FALSE, L"*.DLL", CFileNameIndex::QUERY_WILDCARD, 0, szTopLevel, SIZEOF_ARRAY(szTopLevel));
+
+	const TCHAR *szFolders[] = {L"Folder1", L"Folder2"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"Folder*", CFileNameIndex::QUERY_WILDCARD, 0, szFolders, SIZEOF_ARRAY(szFolders));
+}
+
+TEST_F(FileNameIndexTest, Substring)
+{
+	const TCHAR *szExpected[] = {L"VersionInfo3.dll"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"info3", CFileNameIndex::QUERY_SUBSTRING, 0, szExpected, SIZEOF_ARRAY(szExpected));
+
+	std::vector<CFileNameIndex::QueryResult_t> Results;
+	BOOL bRet = m_FileNameIndex.Query(m_szRoot, TRUE, L"info3", CFileNameIndex::QUERY_SUBSTRING, FALSE, 0, Results);
+	ASSERT_EQ(TRUE, bRet);
+	EXPECT_TRUE(Results.empty());
+
+	bRet = m_FileNameIndex.Query(m_szRoot, TRUE, L"Info3", CFileNameIndex::QUERY_SUBSTRING, FALSE, 0, Results);
+	ASSERT_EQ(TRUE, bRet);
+	ASSERT_EQ(1, Results.size());
+
+	TCHAR szFullFileName[MAX_PATH];
+	PathCombine(szFullFileName, m_szRoot, L"Folder2\\VersionInfo3.dll");
+	EXPECT_EQ(std::wstring(szFullFileName), Results[0].strFullFileName);
+
+	/* The size and date come from the index, and match
+	what's on disk. */
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	bRet = GetFileAttributesEx(szFullFileName, GetFileExInfoStandard, &fad);
+	ASSERT_EQ(TRUE, bRet);
+
+	ULARGE_INTEGER uliSize;
+	uliSize.LowPart = fad.nFileSizeLow;
+	uliSize.HighPart = fad.nFileSizeHigh;
+	EXPECT_NE(0, uliSize.QuadPart);
+	EXPECT_EQ(uliSize.QuadPart, Results[0].ulSize);
+	EXPECT_EQ(0, CompareFileTime(&fad.ftLastWriteTime, &Results[0].ftLastWriteTime));
+}
+
+TEST_F(FileNameIndexTest, Regex)
+{
+	const TCHAR *szExpected[] = {L"VersionInfo1.dll", L"VersionInfo2.dll"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"versioninfo[12]\\.dll", CFileNameIndex::QUERY_REGEX, 0, szExpected, SIZEOF_ARRAY(szExpected));
+
+	std::vector<CFileNameIndex::QueryResult_t> Results;
+	BOOL bRet = m_FileNameIndex.Query(m_szRoot, TRUE, L"(", CFileNameIndex::QUERY_REGEX, FALSE, 0, Results);
+	EXPECT_EQ(FALSE, bRet);
+}
+
+TEST_F(FileNameIndexTest, Directory)
+{
+	TCHAR szDirectory[MAX_PATH];
+	PathCombine(szDirectory, m_szRoot, L"Folder1");
+
+	const TCHAR *szExpected[] = {L"VersionInfo1.dll", L"VersionInfo2.dll"};
+	CheckQuery(m_FileNameIndex, szDirectory, TRUE, L"", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+
+	EXPECT_EQ(TRUE, m_FileNameIndex.IsDirectoryCovered(szDirectory));
+
+	/* Files and directories that don't exist (or are
+	outside the root) aren't covered. */
+	PathCombine(szDirectory, m_szRoot, L"VersionInfo5.dll");
+	EXPECT_EQ(FALSE, m_FileNameIndex.IsDirectoryCovered(szDirectory));
+
+	PathCombine(szDirectory, m_szRoot, L"Folder3");
+	EXPECT_EQ(FALSE, m_FileNameIndex.IsDirectoryCovered(szDirectory));
+
+	StringCchCopy(szDirectory, SIZEOF_ARRAY(szDirectory), m_szRoot);
+	StringCchCat(szDirectory, SIZEOF_ARRAY(szDirectory), L"2");
+	EXPECT_EQ(FALSE, m_FileNameIndex.IsDirectoryCovered(szDirectory));
+
+	std::vector<CFileNameIndex::QueryResult_t> Results;
+	BOOL bRet = m_FileNameIndex.Query(szDirectory, TRUE, L"", CFileNameIndex::QUERY_WILDCARD, FALSE, 0, Results);
+	EXPECT_EQ(FALSE, bRet);
+}
+
+TEST_F(FileNameIndexTest, Attributes)
+{
+	const TCHAR *szExpected[] = {L"Folder1", L"Folder2"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"", CFileNameIndex::QUERY_WILDCARD, FILE_ATTRIBUTE_DIRECTORY, szExpected, SIZEOF_ARRAY(szExpected));
+}
+
+TEST_F(FileNameIndexTest, SaveAndLoad)
+{
+	TCHAR szIndexFile[MAX_PATH];
+	GetTestTempFilePath(L"TestFileNameIndex.idx", szIndexFile, SIZEOF_ARRAY(szIndexFile));
+
+	BOOL bRet = m_FileNameIndex.Save(szIndexFile);
+	ASSERT_EQ(TRUE, bRet);
+
+	CFileNameIndex LoadedIndex;
+	bRet = LoadedIndex.Load(szIndexFile);
+	DeleteFile(szIndexFile);
+	ASSERT_EQ(TRUE, bRet);
+
+	EXPECT_EQ(8, LoadedIndex.GetItemCount());
+	EXPECT_EQ(std::wstring(m_szRoot), LoadedIndex.GetRoot());
+
+	const TCHAR *szExpected[] = {L"VersionInfo3.dll", L"VersionInfo4.dll"};
+	CheckQuery(LoadedIndex, m_szRoot, TRUE, L"VersionInfo[34].dll", CFileNameIndex::QUERY_REGEX, 0, szExpected, SIZEOF_ARRAY(szExpected));
+
+	CFileNameIndex MissingIndex;
+	bRet = MissingIndex.Load(szIndexFile);
+	EXPECT_EQ(FALSE, bRet);
+}
+
+/* Changes are checked against a directory that's
+created (and deleted) by each test. */
+class FileNameIndexChangesTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		GetTestTempFilePath(L"TestFileNameIndex", m_szRoot, SIZEOF_ARRAY(m_szRoot));
+		DeleteDirectoryTree(m_szRoot);
+
+		BOOL bRet = CreateDirectory(m_szRoot, NULL);
+		ASSERT_EQ(TRUE, bRet);
+
+		CreateTestFile(GetPath(L"a.txt"));
+
+		bRet = CreateDirectory(GetPath(L"Sub").c_str(), NULL);
+		ASSERT_EQ(TRUE, bRet);
+
+		CreateTestFile(GetPath(L"Sub\\b.txt"));
+
+		bRet = m_FileNameIndex.Build(m_szRoot, NULL);
+		ASSERT_EQ(TRUE, bRet);
+		ASSERT_EQ(3, m_FileNameIndex.GetItemCount());
+	}
+
+	void TearDown()
+	{
+		DeleteDirectoryTree(m_szRoot);
+	}
+
+	std::wstring GetPath(const TCHAR *szFileName)
+	{
+		return std::wstring(m_szRoot) + L"\\" + szFileName;
+	}
+
+	TCHAR m_szRoot[MAX_PATH];
+	CFileNameIndex m_FileNameIndex;
+};
+
+TEST_F(FileNameIndexChangesTest, Added)
+{
+	CreateTestFile(GetPath(L"Sub\\c.txt"));
+	m_FileNameIndex.ApplyChange(L"Sub\\c.txt", FILE_ACTION_ADDED);
+
+	const TCHAR *szExpected[] = {L"b.txt", L"c.txt"};
+	CheckQuery(m_FileNameIndex, GetPath(L"Sub").c_str(), FALSE, L"*.txt", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+
+	/* Reporting an item that's already in the
+	index shouldn't add it again. */
+	m_FileNameIndex.ApplyChange(L"Sub\\c.txt", FILE_ACTION_ADDED);
+	EXPECT_EQ(4, m_FileNameIndex.GetItemCount());
+}
+
+TEST_F(FileNameIndexChangesTest, AddedDirectory)
+{
+	BOOL bRet = CreateDirectory(GetPath(L"New").c_str(), NULL);
+	ASSERT_EQ(TRUE, bRet);
+
+	CreateTestFile(GetPath(L"New\\d.txt"));
+
+	/* Only the directory itself is reported. */
+	m_FileNameIndex.ApplyChange(L"New", FILE_ACTION_ADDED);
+
+	const TCHAR *szExpected[] = {L"d.txt"};
+	CheckQuery(m_FileNameIndex, GetPath(L"New").c_str(), TRUE, L"", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+	EXPECT_EQ(5, m_FileNameIndex.GetItemCount());
+}
+
+TEST_F(FileNameIndexChangesTest, Removed)
+{
+	DeleteDirectoryTree(GetPath(L"Sub"));
+	m_FileNameIndex.ApplyChange(L"Sub", FILE_ACTION_REMOVED);
+
+	const TCHAR *szExpected[] = {L"a.txt"};
+	CheckQuery(m_FileNameIndex, m_szRoot, TRUE, L"", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+	EXPECT_EQ(1, m_FileNameIndex.GetItemCount());
+	EXPECT_EQ(FALSE, m_FileNameIndex.IsDirectoryCovered(GetPath(L"Sub").c_str()));
+}
+
+TEST_F(FileNameIndexChangesTest, Renamed)
+{
+	BOOL bRet = MoveFile(GetPath(L"a.txt").c_str(), GetPath(L"Sub\\e.txt").c_str());
+	ASSERT_EQ(TRUE, bRet);
+
+	m_FileNameIndex.ApplyChange(L"a.txt", FILE_ACTION_RENAMED_OLD_NAME);
+	m_FileNameIndex.ApplyChange(L"Sub\\e.txt", FILE_ACTION_RENAMED_NEW_NAME);
+
+	const TCHAR *szExpected[] = {L"b.txt", L"e.txt"};
+	CheckQuery(m_FileNameIndex, GetPath(L"Sub").c_str(), FALSE, L"", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+	EXPECT_EQ(3, m_FileNameIndex.GetItemCount());
+
+	/* Renaming a directory should carry its
+	contents along with it. */
+	bRet = MoveFile(GetPath(L"Sub").c_str(), GetPath(L"Renamed").c_str());
+	ASSERT_EQ(TRUE, bRet);
+
+	m_FileNameIndex.ApplyChange(L"Sub", FILE_ACTION_RENAMED_OLD_NAME);
+	m_FileNameIndex.ApplyChange(L"Renamed", FILE_ACTION_RENAMED_NEW_NAME);
+
+	CheckQuery(m_FileNameIndex, GetPath(L"Renamed").c_str(), FALSE, L"", CFileNameIndex::QUERY_WILDCARD, 0, szExpected, SIZEOF_ARRAY(szExpected));
+	EXPECT_EQ(FALSE, m_FileNameIndex.IsDirectoryCovered(GetPath(L"Sub").c_str()));
+}
@@ -1,4 +1,6 @@
 #include "stdafx.h"
+#include <vector>
+#include <string>
 #include "../Helper/FolderSize.h"
 #include "../Helper/Macros.h"
 #include "Helper.h"
@@ -79,4 +81,385 @@ TEST(CalculateFolderSize, FilesAndFolders)
 	ULARGE_INTEGER ulTotalFolderSizeExpected;
 	ulTotalFolderSizeExpected.QuadPart = 18432;
 	TestCalculateFolderSize(L"FolderSize", 2, 6, ulTotalFolderSizeExpected);
-}
\ No newline at end of file
+}
+
+namespace
+{
+	struct ProgressInfo_t
+	{
+		CRITICAL_SECTION cs;
+		int nCalls;
+		std::vector<FolderSizeTotals_t> LastTotals;
+	};
+
+	void ProgressCallback(int iRoot, const FolderSizeTotals_t *pTotals, LPVOID pData)
+	{
+		ProgressInfo_t *pProgressInfo = reinterpret_cast<ProgressInfo_t *>(pData);
+
+		EnterCriticalSection(&pProgressInfo->cs);
+
+		pProgressInfo->nCalls++;
+
+		EXPECT_EQ(FALSE, pTotals->bComplete);
+
+		/* Totals only ever grow. */
+		EXPECT_GE(pTotals->ulSize, pProgressInfo->LastTotals[iRoot].ulSize);
+		EXPECT_GE(pTotals->nFiles, pProgressInfo->LastTotals[iRoot].nFiles);
+		pProgressInfo->LastTotals[iRoot] = *pTotals;
+
+		LeaveCriticalSection(&pProgressInfo->cs);
+	}
+}
+
+/* Runs against a tree that's generated in the temporary
+directory, large enough to be split between threads. */
+class FolderSizeCalculatorTest : public ::testing::Test
+{
+protected:
+
+	static const int NUM_FOLDERS = 20;
+	static const int NUM_SUB_FOLDERS = 5;
+
+	void SetUp()
+	{
+		TCHAR szDirectory[MAX_PATH];
+		GetTestTempFilePath(L"FolderSizeCalculator", szDirectory, SIZEOF_ARRAY(szDirectory));
+		m_strDirectory = szDirectory;
+
+		DeleteDirectoryTree(m_strDirectory);
+
+		BOOL bRet = CreateDirectory(m_strDirectory.c_str(), NULL);
+		ASSERT_EQ(TRUE, bRet);
+
+		m_ExpectedTotals.nFolders = 0;
+		m_ExpectedTotals.nFiles = 0;
+		m_ExpectedTotals.ulSize = 0;
+		m_FileSizes.clear();
+
+		for(int i = 0; i < NUM_FOLDERS; i++)
+		{
+			std::wstring strFolder = m_strDirectory + L"\\Folder" + std::to_wstring(static_cast<long long>(i));
+			bRet = CreateDirectory(strFolder.c_str(), NULL);
+			ASSERT_EQ(TRUE, bRet);
+			m_ExpectedTotals.nFolders++;
+
+			for(int j = 0; j < NUM_SUB_FOLDERS; j++)
+			{
+				std::wstring strSubFolder = strFolder + L"\\Sub" + std::to_wstring(static_cast<long long>(j));
+				bRet = CreateDirectory(strSubFolder.c_str(), NULL);
+				ASSERT_EQ(TRUE, bRet);
+				m_ExpectedTotals.nFolders++;
+
+				for(int k = 0; k <= j; k++)
+				{
+					DWORD dwSize = 100 * (i + 1) + k;
+					CreateTestFile(strSubFolder + L"\\File" + std::to_wstring(static_cast<long long>(k)), dwSize);
+					m_ExpectedTotals.nFiles++;
+					m_ExpectedTotals.ulSize += dwSize;
+					m_FileSizes.push_back(dwSize);
+				}
+			}
+
+			CreateTestFile(strFolder + L"\\File", 7);
+			m_ExpectedTotals.nFiles++;
+			m_ExpectedTotals.ulSize += 7;
+			m_FileSizes.push_back(7);
+		}
+	}
+
+	void TearDown()
+	{
+		DeleteDirectoryTree(m_strDirectory);
+	}
+
+	void CheckTotals(const FolderSizeTotals_t &Expected, const FolderSizeTotals_t &Actual)
+	{
+		EXPECT_EQ(Expected.nFolders, Actual.nFolders);
+		EXPECT_EQ(Expected.nFiles, Actual.nFiles);
+		EXPECT_EQ(Expected.ulSize, Actual.ulSize);
+	}
+
+	FolderSizeTotals_t Calculate(FolderSizeMode_t SizeMode,
+		TraversalOrder_t TraversalOrder = TRAVERSAL_ORDER_DEFAULT)
+	{
+		CFolderSizeCalculator FolderSizeCalculator;
+		FolderSizeCalculator.SetThreadCount(4);
+		FolderSizeCalculator.SetSizeMode(SizeMode);
+		FolderSizeCalculator.SetTraversalOrder(TraversalOrder);
+		int iRoot = FolderSizeCalculator.AddRoot(m_strDirectory.c_str());
+
+		BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+		EXPECT_EQ(TRUE, bRet);
+
+		FolderSizeTotals_t Totals;
+		FolderSizeCalculator.GetTotals(iRoot, Totals);
+
+		return Totals;
+	}
+
+	std::wstring m_strDirectory;
+	FolderSizeTotals_t m_ExpectedTotals;
+	std::vector<DWORD> m_FileSizes;
+};
+
+TEST_F(FolderSizeCalculatorTest, ThreadCounts)
+{
+	const int THREAD_COUNTS[] = {1, 2, 8, 0};
+
+	for(int i = 0; i < SIZEOF_ARRAY(THREAD_COUNTS); i++)
+	{
+		CFolderSizeCalculator FolderSizeCalculator;
+		FolderSizeCalculator.SetThreadCount(THREAD_COUNTS[i]);
+		int iRoot = FolderSizeCalculator.AddRoot(m_strDirectory.c_str());
+
+		BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+		EXPECT_EQ(TRUE, bRet);
+
+		FolderSizeTotals_t Totals;
+		FolderSizeCalculator.GetTotals(iRoot, Totals);
+		CheckTotals(m_ExpectedTotals, Totals);
+		EXPECT_EQ(TRUE, Totals.bComplete);
+	}
+}
+
+TEST_F(FolderSizeCalculatorTest, LocalityOrder)
+{
+	CheckTotals(m_ExpectedTotals, Calculate(FOLDER_SIZE_MODE_LOGICAL, TRAVERSAL_ORDER_LOCALITY));
+
+	const int THREAD_COUNTS[] = {1, 8};
+
+	for(int i = 0; i < SIZEOF_ARRAY(THREAD_COUNTS); i++)
+	{
+		CFolderSizeCalculator FolderSizeCalculator;
+		FolderSizeCalculator.SetThreadCount(THREAD_COUNTS[i]);
+		FolderSizeCalculator.SetTraversalOrder(TRAVERSAL_ORDER_LOCALITY);
+		int iRoot1 = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Folder0").c_str());
+		int iRoot2 = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Missing").c_str());
+
+		BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+		EXPECT_EQ(TRUE, bRet);
+
+		FolderSizeTotals_t Expected1 = {NUM_SUB_FOLDERS, 16, 1527};
+		FolderSizeTotals_t Expected2 = {0, 0, 0};
+
+		FolderSizeTotals_t Totals;
+		FolderSizeCalculator.GetTotals(iRoot1, Totals);
+		CheckTotals(Expected1, Totals);
+		FolderSizeCalculator.GetTotals(iRoot2, Totals);
+		CheckTotals(Expected2, Totals);
+	}
+}
+
+TEST_F(FolderSizeCalculatorTest, MultipleRoots)
+{
+	CFolderSizeCalculator FolderSizeCalculator;
+	FolderSizeCalculator.SetThreadCount(4);
+
+	int iRoot1 = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Folder0").c_str());
+	int iRoot2 = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Folder1\\Sub4").c_str());
+	int iRoot3 = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Missing").c_str());
+
+	BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+	EXPECT_EQ(TRUE, bRet);
+
+	FolderSizeTotals_t Expected1 = {NUM_SUB_FOLDERS, 16, 1527};
+	FolderSizeTotals_t Expected2 = {0, 5, 1010};
+	FolderSizeTotals_t Expected3 = {0, 0, 0};
+
+	FolderSizeTotals_t Totals;
+	FolderSizeCalculator.GetTotals(iRoot1, Totals);
+	CheckTotals(Expected1, Totals);
+	FolderSizeCalculator.GetTotals(iRoot2, Totals);
+	CheckTotals(Expected2, Totals);
+	FolderSizeCalculator.GetTotals(iRoot3, Totals);
+	CheckTotals(Expected3, Totals);
+}
+
+TEST_F(FolderSizeCalculatorTest, Progress)
+{
+	ProgressInfo_t ProgressInfo;
+	InitializeCriticalSection(&ProgressInfo.cs);
+	ProgressInfo.nCalls = 0;
+
+	FolderSizeTotals_t EmptyTotals = {0, 0, 0};
+	ProgressInfo.LastTotals.assign(1, EmptyTotals);
+
+	CFolderSizeCalculator FolderSizeCalculator;
+	FolderSizeCalculator.SetThreadCount(4);
+	FolderSizeCalculator.SetProgressCallback(ProgressCallback, &ProgressInfo);
+	int iRoot = FolderSizeCalculator.AddRoot(m_strDirectory.c_str());
+
+	BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+	EXPECT_EQ(TRUE, bRet);
+
+	/* One call for each folder (including the root). The last
+	call carries the final totals. */
+	EXPECT_EQ(m_ExpectedTotals.nFolders + 1, ProgressInfo.nCalls);
+	CheckTotals(m_ExpectedTotals, ProgressInfo.LastTotals[iRoot]);
+
+	DeleteCriticalSection(&ProgressInfo.cs);
+}
+
+TEST_F(FolderSizeCalculatorTest, ProgressInterval)
+{
+	ProgressInfo_t ProgressInfo;
+	InitializeCriticalSection(&ProgressInfo.cs);
+	ProgressInfo.nCalls = 0;
+
+	FolderSizeTotals_t EmptyTotals = {0, 0, 0};
+	ProgressInfo.LastTotals.assign(1, EmptyTotals);
+
+	/* The walk finishes well within the interval,
+	so there shouldn't be any partial results. */
+	CFolderSizeCalculator FolderSizeCalculator;
+	FolderSizeCalculator.SetThreadCount(4);
+	FolderSizeCalculator.SetProgressCallback(ProgressCallback, &ProgressInfo);
+	FolderSizeCalculator.SetProgressInterval(60 * 1000);
+	int iRoot = FolderSizeCalculator.AddRoot(m_strDirectory.c_str());
+
+	BOOL bRet = FolderSizeCalculator.Calculate(NULL);
+	EXPECT_EQ(TRUE, bRet);
+	EXPECT_EQ(0, ProgressInfo.nCalls);
+
+	FolderSizeTotals_t Totals;
+	FolderSizeCalculator.GetTotals(iRoot, Totals);
+	CheckTotals(m_ExpectedTotals, Totals);
+
+	DeleteCriticalSection(&ProgressInfo.cs);
+}
+
+TEST_F(FolderSizeCalculatorTest, Cancelled)
+{
+	CCancellationToken *pToken = new CCancellationToken();
+	pToken->Cancel();
+
+	CFolderSizeCalculator FolderSizeCalculator;
+	int iRoot = FolderSizeCalculator.AddRoot(m_strDirectory.c_str());
+
+	BOOL bRet = FolderSizeCalculator.Calculate(pToken);
+	EXPECT_EQ(FALSE, bRet);
+
+	FolderSizeTotals_t Totals;
+	FolderSizeCalculator.GetTotals(iRoot, Totals);
+	EXPECT_EQ(0, Totals.nFiles);
+	EXPECT_EQ(FALSE, Totals.bComplete);
+
+	TCHAR szDirectory[MAX_PATH];
+	StringCchCopy(szDirectory, SIZEOF_ARRAY(szDirectory), m_strDirectory.c_str());
+
+	int nFolders;
+	int nFiles;
+	ULARGE_INTEGER ulTotalFolderSize;
+	HRESULT hr = CalculateFolderSize(szDirectory, &nFolders, &nFiles, &ulTotalFolderSize, pToken);
+	EXPECT_EQ(E_ABORT, hr);
+
+	pToken->Release();
+}
+
+TEST_F(FolderSizeCalculatorTest, LongPath)
+{
+	std::wstring strFolder = m_strDirectory + L"\\Long";
+	BOOL bRet = CreateDirectory(strFolder.c_str(), NULL);
+	ASSERT_EQ(TRUE, bRet);
+
+	int nFolders = 0;
+
+	while(strFolder.size() <= MAX_PATH)
+	{
+		strFolder += L"\\" + std::wstring(50, L'a');
+
+		bRet = CreateDirectory(GetExtendedPath(strFolder).c_str(), NULL);
+		ASSERT_EQ(TRUE, bRet);
+		nFolders++;
+	}
+
+	CreateTestFile(strFolder + L"\\File", 1234);
+
+	CFolderSizeCalculator FolderSizeCalculator;
+	int iRoot = FolderSizeCalculator.AddRoot((m_strDirectory + L"\\Long").c_str());
+
+	bRet = FolderSizeCalculator.Calculate(NULL);
+	EXPECT_EQ(TRUE, bRet);
+
+	FolderSizeTotals_t Expected = {nFolders, 1, 1234};
+
+	FolderSizeTotals_t Totals;
+	FolderSizeCalculator.GetTotals(iRoot, Totals);
+	CheckTotals(Expected, Totals);
+
+	CFolderSizeCalculator LocalityCalculator;
+	LocalityCalculator.SetTraversalOrder(TRAVERSAL_ORDER_LOCALITY);
+	iRoot = LocalityCalculator.AddRoot((m_strDirectory + L"\\Long").c_str());
+
+	bRet = LocalityCalculator.Calculate(NULL);
+	EXPECT_EQ(TRUE, bRet);
+
+	LocalityCalculator.GetTotals(iRoot, Totals);
+	CheckTotals(Expected, Totals);
+}
+
+TEST_F(FolderSizeCalculatorTest, AllocatedSize)
+{
+	TCHAR szVolume[MAX_PATH];
+	BOOL bRet = GetVolumePathName(m_strDirectory.c_str(), szVolume, SIZEOF_ARRAY(szVolume));
+	ASSERT_EQ(TRUE, bRet);
+
+	DWORD dwSectorsPerCluster;
+	DWORD dwBytesPerSector;
+	DWORD dwFreeClusters;
+	DWORD dwTotalClusters;
+	bRet = GetDiskFreeSpace(szVolume, &dwSectorsPerCluster, &dwBytesPerSector, &dwFreeClusters, &dwTotalClusters);
+	ASSERT_EQ(TRUE, bRet);
+
+	/* None of the test files are compressed or
+	sparse, so each is simply rounded up. */
+	ULONGLONG ulClusterSize = dwSectorsPerCluster * dwBytesPerSector;
+	FolderSizeTotals_t Expected = m_ExpectedTotals;
+	Expected.ulSize = 0;
+
+	for(auto itr = m_FileSizes.begin(); itr != m_FileSizes.end(); itr++)
+	{
+		Expected.ulSize += ((*itr + ulClusterSize - 1) / ulClusterSize) * ulClusterSize;
+	}
+
+	CheckTotals(Expected, Calculate(FOLDER_SIZE_MODE_ALLOCATED));
+	CheckTotals(Expected, Calculate(FOLDER_SIZE_MODE_ALLOCATED, TRAVERSAL_ORDER_LOCALITY));
+}
+
+TEST_F(FolderSizeCalculatorTest, UniqueSize)
+{
+	/* Each link is a file in its own right, but the
+	data they share should only be counted once. */
+	std::wstring strFileName = m_strDirectory + L"\\Folder0\\Sub4\\File4";
+
+	for(int i = 0; i < 3; i++)
+	{
+		std::wstring strLinkName = m_strDirectory + L"\\Folder" + std::to_wstring(static_cast<long long>(i + 1)) + L"\\Link";
+		BOOL bRet = CreateHardLink(strLinkName.c_str(), strFileName.c_str(), NULL);
+		ASSERT_EQ(TRUE, bRet);
+	}
+
+	FolderSizeTotals_t Expected = m_ExpectedTotals;
+	Expected.nFiles += 3;
+	CheckTotals(Expected, Calculate(FOLDER_SIZE_MODE_UNIQUE));
+	CheckTotals(Expected, Calculate(FOLDER_SIZE_MODE_UNIQUE, TRAVERSAL_ORDER_LOCALITY));
+
+	Expected.ulSize += 3 * 104;
+	CheckTotals(Expected, Calculate(FOLDER_SIZE_MODE_LOGICAL));
+}
+
+TEST(FolderSizeCalculatorPathTest, BuildSearchPath)
+{
+	EXPECT_EQ(L"C:\\*", CFolderSizeCalculator::BuildSearchPath(L"C:\\"));
+	EXPECT_EQ(L"C:\\Folder\\*", CFolderSizeCalculator::BuildSearchPath(L"C:\\Folder"));
+
+	std::wstring strLongName(300, L'a');
+	EXPECT_EQ(L"\\\\?\\C:\\" + strLongName + L"\\*",
+		CFolderSizeCalculator::BuildSearchPath(L"C:\\" + strLongName));
+	EXPECT_EQ(L"\\\\?\\UNC\\server\\share\\" + strLongName + L"\\*",
+		CFolderSizeCalculator::BuildSearchPath(L"\\\\server\\share\\" + strLongName));
+
+	EXPECT_EQ(L"C:\\Folder\\File", CFolderSizeCalculator::BuildExtendedPath(L"C:\\Folder\\File"));
+	EXPECT_EQ(L"\\\\?\\C:\\" + strLongName,
+		CFolderSizeCalculator::BuildExtendedPath(L"C:\\" + strLongName));
+}
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "../Helper/FolderSizeCache.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	std::wstring GetResourcePath(const TCHAR *szPath)
+	{
+		TCHAR szFullFileName[MAX_PATH];
+		GetTestResourceFilePath(szPath, szFullFileName, SIZEOF_ARRAY(szFullFileName));
+
+		return szFullFileName;
+	}
+
+	struct CacheRequest_t
+	{
+		CFolderSizeCache *pCache;
+		const TCHAR *szPath;
+		HRESULT hr;
+		FolderSizeTotals_t Totals;
+	};
+
+	DWORD WINAPI CacheRequestThread(LPVOID pParam)
+	{
+		CacheRequest_t *pRequest = reinterpret_cast<CacheRequest_t *>(pParam);
+		pRequest->hr = pRequest->pCache->GetFolderSize(pRequest->szPath, pRequest->Totals, NULL);
+
+		return 0;
+	}
+}
+
+class FolderSizeCacheTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		m_strRoot = GetResourcePath(L"FolderSize");
+		m_strFolder1 = GetResourcePath(L"FolderSize\\Folder1");
+		m_strFolder2 = GetResourcePath(L"FolderSize\\Folder2");
+	}
+
+	void CalculateAll()
+	{
+		FolderSizeTotals_t Totals;
+		ASSERT_EQ(S_OK, m_Cache.GetFolderSize(m_strRoot.c_str(), Totals, NULL));
+		ASSERT_EQ(S_OK, m_Cache.GetFolderSize(m_strFolder1.c_str(), Totals, NULL));
+		ASSERT_EQ(S_OK, m_Cache.GetFolderSize(m_strFolder2.c_str(), Totals, NULL));
+	}
+
+	BOOL IsCached(const std::wstring &strPath)
+	{
+		FolderSizeTotals_t Totals;
+		return m_Cache.Lookup(strPath.c_str(), Totals, NULL);
+	}
+
+	CFolderSizeCache m_Cache;
+	std::wstring m_strRoot;
+	std::wstring m_strFolder1;
+	std::wstring m_strFolder2;
+};
+
+TEST_F(FolderSizeCacheTest, CachesResult)
+{
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+
+	FolderSizeTotals_t Totals;
+	HRESULT hr = m_Cache.GetFolderSize(m_strRoot.c_str(), Totals, NULL);
+	ASSERT_EQ(S_OK, hr);
+	EXPECT_EQ(2, Totals.nFolders);
+	EXPECT_EQ(6, Totals.nFiles);
+	EXPECT_EQ(18432ULL, Totals.ulSize);
+
+	/* Different forms of the same path
+	should find the same entry. */
+	FolderSizeTotals_t CachedTotals;
+	FILETIME ftCalculated;
+	BOOL bRet = m_Cache.Lookup((m_strRoot + L"\\").c_str(), CachedTotals, &ftCalculated);
+	ASSERT_EQ(TRUE, bRet);
+	EXPECT_EQ(Totals.ulSize, CachedTotals.ulSize);
+	EXPECT_NE(0, ftCalculated.dwLowDateTime | ftCalculated.dwHighDateTime);
+
+	EXPECT_EQ(TRUE, IsCached(L"\\\\?\\" + m_strRoot));
+
+	/* Subfolders aren't cached by
+	calculating their parent. */
+	EXPECT_EQ(FALSE, IsCached(m_strFolder1));
+}
+
+TEST_F(FolderSizeCacheTest, InvalidateItem)
+{
+	CalculateAll();
+
+	m_Cache.Invalidate(GetResourcePath(L"FolderSize\\Folder1\\VersionInfo1.dll").c_str());
+
+	/* Both folders containing the file are
+	out of date, but its sibling folder isn't. */
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+	EXPECT_EQ(FALSE, IsCached(m_strFolder1));
+	EXPECT_EQ(TRUE, IsCached(m_strFolder2));
+}
+
+TEST_F(FolderSizeCacheTest, InvalidateFolder)
+{
+	CalculateAll();
+
+	/* Shares a prefix with Folder1 and Folder2,
+	but doesn't contain them. */
+	m_Cache.Invalidate(GetResourcePath(L"FolderSize\\Folder").c_str());
+
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+	EXPECT_EQ(TRUE, IsCached(m_strFolder1));
+	EXPECT_EQ(TRUE, IsCached(m_strFolder2));
+
+	CalculateAll();
+
+	/* Everything below a folder that's been
+	removed is dropped as well. */
+	m_Cache.Invalidate(m_strRoot.c_str());
+
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+	EXPECT_EQ(FALSE, IsCached(m_strFolder1));
+	EXPECT_EQ(FALSE, IsCached(m_strFolder2));
+}
+
+TEST_F(FolderSizeCacheTest, Cancelled)
+{
+	CCancellationToken *pToken = new CCancellationToken();
+	pToken->Cancel();
+
+	FolderSizeTotals_t Totals;
+	HRESULT hr = m_Cache.GetFolderSize(m_strRoot.c_str(), Totals, pToken);
+	EXPECT_EQ(E_ABORT, hr);
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+
+	pToken->Release();
+}
+
+TEST_F(FolderSizeCacheTest, MaxAge)
+{
+	m_Cache.SetMaxAge(0);
+
+	FolderSizeTotals_t Totals;
+	HRESULT hr = m_Cache.GetFolderSize(m_strRoot.c_str(), Totals, NULL);
+	EXPECT_EQ(S_OK, hr);
+	EXPECT_EQ(18432ULL, Totals.ulSize);
+	EXPECT_EQ(FALSE, IsCached(m_strRoot));
+
+	m_Cache.SetMaxAge(INFINITE);
+	CalculateAll();
+	EXPECT_EQ(TRUE, IsCached(m_strRoot));
+}
+
+/* Requests made at the same time should
+all be given the same result. */
+TEST_F(FolderSizeCacheTest, ConcurrentRequests)
+{
+	const int NUM_REQUESTS = 8;
+
+	std::vector<CacheRequest_t> Requests(NUM_REQUESTS);
+	std::vector<HANDLE> Threads;
+
+	for(int i = 0; i < NUM_REQUESTS; i++)
+	{
+		Requests[i].pCache = &m_Cache;
+		Requests[i].szPath = m_strRoot.c_str();
+		Requests[i].hr = E_FAIL;
+
+		HANDLE hThread = CreateThread(NULL, 0, CacheRequestThread, &Requests[i], 0, NULL);
+		ASSERT_NE(static_cast<HANDLE>(NULL), hThread);
+		Threads.push_back(hThread);
+	}
+
+	WaitForMultipleObjects(static_cast<DWORD>(Threads.size()), &Threads[0], TRUE, INFINITE);
+
+	for(int i = 0; i < NUM_REQUESTS; i++)
+	{
+		CloseHandle(Threads[i]);
+
+		EXPECT_EQ(S_OK, Requests[i].hr);
+		EXPECT_EQ(6, Requests[i].Totals.nFiles);
+		EXPECT_EQ(18432ULL, Requests[i].Totals.ulSize);
+	}
+}
+
+TEST(FolderSizeCachePathTest, GetCanonicalPath)
+{
+	EXPECT_EQ(L"c:\\folder", CFolderSizeCache::GetCanonicalPath(L"C:\\Folder\\"));
+	EXPECT_EQ(L"c:\\folder", CFolderSizeCache::GetCanonicalPath(L"\\\\?\\C:\\Folder"));
+	EXPECT_EQ(L"c:\\folder\\sub", CFolderSizeCache::GetCanonicalPath(L"C:/Folder/Sub"));
+	EXPECT_EQ(L"c:", CFolderSizeCache::GetCanonicalPath(L"C:\\"));
+	EXPECT_EQ(L"\\\\server\\share", CFolderSizeCache::GetCanonicalPath(L"\\\\?\\UNC\\Server\\Share\\"));
+}
@@ -0,0 +1,328 @@
+#include "stdafx.h"
+#include <algorithm>
+#include <vector>
+#include <string>
+#include "../Helper/LocalityOrder.h"
+#include "../Helper/ThreadPool.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	std::vector<int> PopAll(CLocalityQueue<int> &Queue)
+	{
+		std::vector<int> Items;
+		int iItem;
+
+		while(Queue.Pop(iItem))
+		{
+			Items.push_back(iItem);
+		}
+
+		return Items;
+	}
+}
+
+TEST(LocalityQueueTest, Empty)
+{
+	CLocalityQueue<int> Queue;
+	EXPECT_EQ(TRUE, Queue.IsEmpty());
+
+	int iItem;
+	EXPECT_EQ(FALSE, Queue.Pop(iItem));
+
+	std::vector<int *> Upcoming;
+	Queue.GetUpcoming(4, Upcoming);
+	EXPECT_TRUE(Upcoming.empty());
+}
+
+TEST(LocalityQueueTest, Sweep)
+{
+	CLocalityQueue<int> Queue;
+	Queue.Push(50, 50);
+	Queue.Push(10, 10);
+	Queue.Push(30, 30);
+	EXPECT_EQ(3, Queue.GetSize());
+
+	int iItem;
+	ASSERT_EQ(TRUE, Queue.Pop(iItem));
+	EXPECT_EQ(10, iItem);
+
+	/* Items behind the sweep wait until it
+	wraps around; items ahead of it are taken
+	on the way. */
+	Queue.Push(5, 5);
+	Queue.Push(20, 20);
+	Queue.Push(60, 60);
+
+	std::vector<int> Expected;
+	Expected.push_back(20);
+	Expected.push_back(30);
+	Expected.push_back(50);
+	Expected.push_back(60);
+	Expected.push_back(5);
+	EXPECT_EQ(Expected, PopAll(Queue));
+	EXPECT_EQ(TRUE, Queue.IsEmpty());
+}
+
+TEST(LocalityQueueTest, SameLocation)
+{
+	CLocalityQueue<int> Queue;
+
+	for(int i = 0; i < 5; i++)
+	{
+		Queue.Push(100, i);
+	}
+
+	Queue.Push(0, 5);
+
+	std::vector<int> Expected;
+
+	for(int i = 0; i < 6; i++)
+	{
+		Expected.push_back(i);
+	}
+
+	/* The first item is taken from the start of the
+	disk, so everything else is ahead of it. */
+	int iItem;
+	ASSERT_EQ(TRUE, Queue.Pop(iItem));
+	EXPECT_EQ(5, iItem);
+
+	Expected.pop_back();
+	EXPECT_EQ(Expected, PopAll(Queue));
+}
+
+TEST(LocalityQueueTest, Upcoming)
+{
+	CLocalityQueue<int> Queue;
+	Queue.Push(10, 10);
+	Queue.Push(20, 20);
+	Queue.Push(30, 30);
+
+	int iItem;
+	ASSERT_EQ(TRUE, Queue.Pop(iItem));
+	ASSERT_EQ(TRUE, Queue.Pop(iItem));
+	EXPECT_EQ(20, iItem);
+
+	Queue.Push(5, 5);
+	Queue.Push(40, 40);
+
+	std::vector<int *> Upcoming;
+	Queue.GetUpcoming(2, Upcoming);
+	ASSERT_EQ(2, Upcoming.size());
+	EXPECT_EQ(30, *Upcoming[0]);
+	EXPECT_EQ(40, *Upcoming[1]);
+
+	/* The upcoming items wrap around, in the
+	same way as the items that are popped. */
+	Queue.GetUpcoming(10, Upcoming);
+	ASSERT_EQ(3, Upcoming.size());
+	EXPECT_EQ(5, *Upcoming[2]);
+
+	*Upcoming[2] = 6;
+
+	std::vector<int> Expected;
+	Expected.push_back(30);
+	Expected.push_back(40);
+	Expected.push_back(6);
+	EXPECT_EQ(Expected, PopAll(Queue));
+}
+
+TEST(LocalityOrderTest, DiskLocation)
+{
+	/* The sequence number is dropped. */
+	EXPECT_EQ(0x123456789ABCULL, GetDiskLocation(0x0005123456789ABCULL));
+	EXPECT_EQ(42, GetDiskLocation(42));
+}
+
+TEST(LocalityOrderTest, ShouldUseLocalityOrder)
+{
+	TCHAR szTempPath[MAX_PATH];
+	GetTestTempDirectory(szTempPath, SIZEOF_ARRAY(szTempPath));
+
+	EXPECT_EQ(FALSE, ShouldUseLocalityOrder(TRAVERSAL_ORDER_DEFAULT, szTempPath));
+	EXPECT_EQ(TRUE, ShouldUseLocalityOrder(TRAVERSAL_ORDER_LOCALITY, szTempPath));
+	EXPECT_EQ(FALSE, ShouldUseLocalityOrder(TRAVERSAL_ORDER_AUTOMATIC, NULL));
+
+	/* Devices that can't be identified are reported
+	as such, and given the limits of a rotational disk. */
+	DeviceClass_t DeviceClass;
+	EXPECT_EQ(FALSE, CThreadPool::GetInstance().LookupDeviceClass(L"", DeviceClass));
+	EXPECT_EQ(DEVICE_CLASS_ROTATIONAL, DeviceClass);
+
+	EXPECT_GE(GetLocalityOrderThreadLimit(szTempPath), 1);
+}
+
+class DirectoryReaderTest : public ::testing::Test
+{
+protected:
+
+	static const int NUM_FILES = 20;
+	static const int NUM_FOLDERS = 5;
+
+	void SetUp()
+	{
+		TCHAR szDirectory[MAX_PATH];
+		GetTestTempFilePath(L"DirectoryReader", szDirectory, SIZEOF_ARRAY(szDirectory));
+		m_strDirectory = szDirectory;
+
+		RemoveTree();
+
+		BOOL bRet = CreateDirectory(m_strDirectory.c_str(), NULL);
+		ASSERT_EQ(TRUE, bRet);
+
+		for(int i = 0; i < NUM_FILES; i++)
+		{
+			std::wstring strName = L"File" + std::to_wstring(static_cast<long long>(i));
+			CreateTestFile(m_strDirectory + L"\\" + strName);
+			m_Names.push_back(strName);
+		}
+
+		for(int i = 0; i < NUM_FOLDERS; i++)
+		{
+			std::wstring strName = L"Folder" + std::to_wstring(static_cast<long long>(i));
+			bRet = CreateDirectory((m_strDirectory + L"\\" + strName).c_str(), NULL);
+			ASSERT_EQ(TRUE, bRet);
+			m_Names.push_back(strName);
+		}
+
+		std::sort(m_Names.begin(), m_Names.end());
+	}
+
+	void TearDown()
+	{
+		RemoveTree();
+	}
+
+	void RemoveTree()
+	{
+		for(int i = 0; i < NUM_FILES; i++)
+		{
+			DeleteFile((m_strDirectory + L"\\File" + std::to_wstring(static_cast<long long>(i))).c_str());
+		}
+
+		for(int i = 0; i < NUM_FOLDERS; i++)
+		{
+			RemoveDirectory((m_strDirectory + L"\\Folder" + std::to_wstring(static_cast<long long>(i))).c_str());
+		}
+
+		RemoveDirectory(m_strDirectory.c_str());
+	}
+
+	std::wstring m_strDirectory;
+	std::vector<std::wstring> m_Names;
+};
+
+TEST_F(DirectoryReaderTest, Read)
+{
+	CDirectoryReader DirectoryReader;
+	ASSERT_EQ(TRUE, DirectoryReader.Open(m_strDirectory));
+
+	std::vector<std::wstring> Names;
+	std::vector<ULONGLONG> FolderLocations;
+	WIN32_FIND_DATA wfd;
+	ULONGLONG ulLocation;
+
+	while(DirectoryReader.Read(wfd, ulLocation))
+	{
+		Names.push_back(wfd.cFileName);
+
+		if((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == FILE_ATTRIBUTE_DIRECTORY)
+		{
+			/* Every sub folder is located, however
+			the folder is listed. */
+			ULONGLONG ulExpectedLocation;
+			BOOL bRet = GetFileLocation(m_strDirectory + L"\\" + wfd.cFileName, ulExpectedLocation);
+			ASSERT_EQ(TRUE, bRet);
+			EXPECT_EQ(ulExpectedLocation, ulLocation);
+
+			FolderLocations.push_back(ulLocation);
+		}
+	}
+
+	/* Reading past the end has no effect. */
+	EXPECT_EQ(FALSE, DirectoryReader.Read(wfd, ulLocation));
+
+	std::sort(Names.begin(), Names.end());
+	EXPECT_EQ(m_Names, Names);
+
+	std::sort(FolderLocations.begin(), FolderLocations.end());
+	EXPECT_EQ(FolderLocations.end(), std::unique(FolderLocations.begin(), FolderLocations.end()));
+
+	/* The reader can be reused. */
+	ASSERT_EQ(TRUE, DirectoryReader.Open(m_strDirectory));
+
+	int nItems = 0;
+
+	while(DirectoryReader.Read(wfd, ulLocation))
+	{
+		nItems++;
+	}
+
+	EXPECT_EQ(NUM_FILES + NUM_FOLDERS, nItems);
+}
+
+TEST_F(DirectoryReaderTest, Missing)
+{
+	CDirectoryReader DirectoryReader;
+	EXPECT_EQ(FALSE, DirectoryReader.Open(m_strDirectory + L"\\Missing"));
+
+	WIN32_FIND_DATA wfd;
+	ULONGLONG ulLocation;
+	EXPECT_EQ(FALSE, DirectoryReader.Read(wfd, ulLocation));
+
+	EXPECT_EQ(FALSE, GetFileLocation(m_strDirectory + L"\\Missing", ulLocation));
+}
+
+TEST_F(DirectoryReaderTest, Prefetch)
+{
+	CDirectoryPrefetcher DirectoryPrefetcher(NUM_FOLDERS + 1);
+	DirectoryPrefetcher.Prefetch(m_strDirectory);
+
+	for(int i = 0; i < NUM_FOLDERS; i++)
+	{
+		DirectoryPrefetcher.Prefetch(m_strDirectory + L"\\Folder" + std::to_wstring(static_cast<long long>(i)));
+	}
+
+	/* Nothing has been dropped, so every
+	folder should eventually be read. */
+	for(int i = 0; i < 500 && DirectoryPrefetcher.GetPrefetchCount() < NUM_FOLDERS + 1; i++)
+	{
+		Sleep(10);
+	}
+
+	EXPECT_EQ(NUM_FOLDERS + 1, DirectoryPrefetcher.GetPrefetchCount());
+}
+
+TEST_F(DirectoryReaderTest, PrefetchDropped)
+{
+	/* Only the most recent request is kept, so some
+	of these are likely to be dropped. */
+	CDirectoryPrefetcher *pDirectoryPrefetcher = new CDirectoryPrefetcher(1);
+
+	for(int i = 0; i < 100; i++)
+	{
+		pDirectoryPrefetcher->Prefetch(m_strDirectory);
+	}
+
+	for(int i = 0; i < 500 && pDirectoryPrefetcher->GetPrefetchCount() < 1; i++)
+	{
+		Sleep(10);
+	}
+
+	Sleep(50);
+
+	LONG lPrefetched = pDirectoryPrefetcher->GetPrefetchCount();
+	EXPECT_GE(lPrefetched, 1);
+	EXPECT_LE(lPrefetched, 100);
+
+	/* Destroying the prefetcher with requests
+	outstanding drops them. */
+	for(int i = 0; i < 100; i++)
+	{
+		pDirectoryPrefetcher->Prefetch(m_strDirectory);
+	}
+
+	delete pDirectoryPrefetcher;
+}
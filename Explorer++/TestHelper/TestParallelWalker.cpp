@@ -0,0 +1,180 @@
+#include "stdafx.h"
+#include <algorithm>
+#include <vector>
+#include "../Helper/ParallelWalker.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	/* Item i has children 2i + 1 and 2i + 2, up to
+	NUM_ITEMS, so the items form a binary tree. */
+	const int NUM_ITEMS = 5000;
+
+	struct WalkInfo_t
+	{
+		CParallelWalker<int> *pWalker;
+		BOOL bTryFirst;
+		volatile LONG lVisits[NUM_ITEMS];
+	};
+
+	void WalkWorker(int iWorker, LPVOID pData)
+	{
+		WalkInfo_t *pWalkInfo = reinterpret_cast<WalkInfo_t *>(pData);
+		int iItem;
+
+		while(TRUE)
+		{
+			if(!pWalkInfo->bTryFirst || !pWalkInfo->pWalker->TryPop(iWorker, iItem))
+			{
+				if(!pWalkInfo->pWalker->Pop(iWorker, iItem))
+				{
+					break;
+				}
+			}
+
+			InterlockedIncrement(&pWalkInfo->lVisits[iItem]);
+
+			std::vector<int> Children;
+
+			for(int i = 2 * iItem + 1; i <= 2 * iItem + 2 && i < NUM_ITEMS; i++)
+			{
+				Children.push_back(i);
+			}
+
+			pWalkInfo->pWalker->Push(iWorker, Children);
+			pWalkInfo->pWalker->Finish();
+		}
+	}
+
+	void CheckWalk(int nWorkers, BOOL bTryFirst)
+	{
+		CParallelWalker<int> Walker(nWorkers);
+		EXPECT_EQ(nWorkers, Walker.GetWorkerCount());
+
+		WalkInfo_t WalkInfo;
+		WalkInfo.pWalker = &Walker;
+		WalkInfo.bTryFirst = bTryFirst;
+
+		for(int i = 0; i < NUM_ITEMS; i++)
+		{
+			WalkInfo.lVisits[i] = 0;
+		}
+
+		std::vector<int> Roots(1, 0);
+		Walker.Push(0, Roots);
+		Walker.Run(WalkWorker, &WalkInfo);
+
+		for(int i = 0; i < NUM_ITEMS; i++)
+		{
+			EXPECT_EQ(1, WalkInfo.lVisits[i]);
+		}
+	}
+
+	ULONGLONG GetItemLocation(const int &iItem)
+	{
+		return static_cast<ULONGLONG>(iItem);
+	}
+
+	void PrefetchItem(int &iItem, LPVOID pData)
+	{
+		std::vector<int> *pPrefetched = reinterpret_cast<std::vector<int> *>(pData);
+		pPrefetched->push_back(iItem);
+	}
+
+	struct OrderInfo_t
+	{
+		CParallelWalker<int> *pWalker;
+		std::vector<int> Order;
+	};
+
+	void OrderWorker(int iWorker, LPVOID pData)
+	{
+		OrderInfo_t *pOrderInfo = reinterpret_cast<OrderInfo_t *>(pData);
+		int iItem;
+
+		while(pOrderInfo->pWalker->Pop(iWorker, iItem))
+		{
+			pOrderInfo->Order.push_back(iItem);
+			pOrderInfo->pWalker->Finish();
+		}
+	}
+}
+
+TEST(ParallelWalkerTest, SingleWorker)
+{
+	CheckWalk(1, FALSE);
+}
+
+/* Repeated, as a lost wakeup would only
+show up some of the time (as a hang). */
+TEST(ParallelWalkerTest, ManyWorkers)
+{
+	for(int i = 0; i < 20; i++)
+	{
+		CheckWalk(8, FALSE);
+		CheckWalk(3, TRUE);
+	}
+}
+
+TEST(ParallelWalkerTest, Empty)
+{
+	CParallelWalker<int> Walker(4);
+
+	WalkInfo_t WalkInfo;
+	WalkInfo.pWalker = &Walker;
+	WalkInfo.bTryFirst = FALSE;
+
+	/* Returns straight away, as there's nothing to walk. */
+	Walker.Run(WalkWorker, &WalkInfo);
+
+	int iItem;
+	EXPECT_EQ(FALSE, Walker.TryPop(0, iItem));
+}
+
+/* A single worker takes its own items from the
+back, so they're visited in the order pushed. */
+TEST(ParallelWalkerTest, DefaultOrder)
+{
+	CParallelWalker<int> Walker(1);
+
+	std::vector<int> Items;
+	Items.push_back(30);
+	Items.push_back(10);
+	Items.push_back(20);
+	Walker.Push(0, Items);
+
+	OrderInfo_t OrderInfo;
+	OrderInfo.pWalker = &Walker;
+	Walker.Run(OrderWorker, &OrderInfo);
+
+	EXPECT_EQ(Items, OrderInfo.Order);
+}
+
+TEST(ParallelWalkerTest, LocalityOrder)
+{
+	std::vector<int> Prefetched;
+
+	CParallelWalker<int> Walker(1);
+	Walker.SetLocalityOrder(GetItemLocation, PrefetchItem, &Prefetched, 2);
+
+	std::vector<int> Items;
+	Items.push_back(30);
+	Items.push_back(10);
+	Items.push_back(20);
+	Walker.Push(0, Items);
+
+	OrderInfo_t OrderInfo;
+	OrderInfo.pWalker = &Walker;
+	Walker.Run(OrderWorker, &OrderInfo);
+
+	std::vector<int> Expected(Items);
+	std::sort(Expected.begin(), Expected.end());
+	EXPECT_EQ(Expected, OrderInfo.Order);
+
+	/* The two items after 10, then the one after 20. */
+	std::vector<int> ExpectedPrefetched;
+	ExpectedPrefetched.push_back(20);
+	ExpectedPrefetched.push_back(30);
+	ExpectedPrefetched.push_back(30);
+	EXPECT_EQ(ExpectedPrefetched, Prefetched);
+}
@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include <regex>
+#include "../Helper/RegexMatcher.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	/* Generates every string of length 0 to uMaxLength
+	made up of characters from szAlphabet. */
+	void GenerateStrings(const TCHAR *szAlphabet, size_t uMaxLength, std::vector<std::wstring> &Strings)
+	{
+		std::vector<std::wstring> Current(1, std::wstring());
+
+		for(size_t i = 0; i <= uMaxLength; i++)
+		{
+			Strings.insert(Strings.end(), Current.begin(), Current.end());
+
+			std::vector<std::wstring> Next;
+
+			for(auto itr = Current.begin(); itr != Current.end(); itr++)
+			{
+				for(const TCHAR *p = szAlphabet; *p != '\0'; p++)
+				{
+					Next.push_back(*itr + *p);
+				}
+			}
+
+			Current.swap(Next);
+		}
+	}
+
+	void CheckAgainstStandardRegex(const TCHAR *szPattern, const std::vector<std::wstring> &Strings, BOOL bCaseInsensitive)
+	{
+		CRegexMatcher RegexMatcher;
+		ASSERT_TRUE(RegexMatcher.Compile(szPattern, bCaseInsensitive)) << szPattern;
+
+		std::wregex rxPattern;
+
+		if(bCaseInsensitive)
+		{
+			rxPattern.assign(szPattern, std::regex_constants::icase);
+		}
+		else
+		{
+			rxPattern.assign(szPattern);
+		}
+
+		for(auto itr = Strings.begin(); itr != Strings.end(); itr++)
+		{
+			BOOL bExpected = std::regex_match(*itr, rxPattern);
+			EXPECT_EQ(bExpected, RegexMatcher.Match(itr->c_str()))
+				<< "Pattern: " << szPattern << " String: " << *itr << " Case insensitive: " << bCaseInsensitive;
+		}
+	}
+
+	const TCHAR *SUPPORTED_PATTERNS[] = {
+		_T(""), _T("a"), _T("ab"), _T("a*"), _T("a+b"), _T("a?b?"), _T("(ab)*"),
+		_T("(?:a|b)+"), _T("a|b|"), _T("[ab]+"), _T("[^a]*"), _T("[a-c]*1"), _T(".*"),
+		_T(".+\\..*"), _T("a.b"), _T("\\d+"), _T("\\w*"), _T("\\W"), _T("\\S+"), _T("[\\d.]+"),
+		_T("[\\D]"), _T("a{2}"), _T("a{1,3}"), _T("a{2,}b"), _T("a{0}"), _T("a{0,0}b"),
+		_T("(a|ab)(c|bcd)?"), _T("^ab$"), _T("^a*"), _T("(a*)*"), _T("(a|)+b"), _T("a*?b"),
+		_T("a+?"), _T("[.]"), _T("\\."), _T("\\x41"), _T("\\u0061+"), _T("[A-Z]+"),
+		_T("b[a-zA-Z]*"), _T("(?:ab|a)(?:b|)"), _T(".*a.*"), _T("a.*b.*1"), _T("[-a]+"),
+		_T("[a-]+"), _T("((a))"), _T("x*"), _T("(ab)+a"), _T("a(ba)+"), _T("[^\\d]+")
+	};
+
+	const TCHAR *FALLBACK_PATTERNS[] = {
+		_T("(a)\\1"), _T("(?=a)a"), _T("(?!b)."), _T("\\ba"), _T("a\\B."),
+		_T("[[:alpha:]]+"), _T("a^"), _T("a$b")
+	};
+}
+
+TEST(RegexMatcher, MatchesStandardRegex)
+{
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("aAb1. "), 5, Strings);
+
+	for(size_t i = 0; i < SIZEOF_ARRAY(SUPPORTED_PATTERNS); i++)
+	{
+		CheckAgainstStandardRegex(SUPPORTED_PATTERNS[i], Strings, FALSE);
+		CheckAgainstStandardRegex(SUPPORTED_PATTERNS[i], Strings, TRUE);
+	}
+}
+
+TEST(RegexMatcher, FallbackMatchesStandardRegex)
+{
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("aAb1. "), 4, Strings);
+
+	for(size_t i = 0; i < SIZEOF_ARRAY(FALLBACK_PATTERNS); i++)
+	{
+		CheckAgainstStandardRegex(FALLBACK_PATTERNS[i], Strings, FALSE);
+		CheckAgainstStandardRegex(FALLBACK_PATTERNS[i], Strings, TRUE);
+	}
+}
+
+TEST(RegexMatcher, Fallback)
+{
+	CRegexMatcher RegexMatcher;
+
+	for(size_t i = 0; i < SIZEOF_ARRAY(SUPPORTED_PATTERNS); i++)
+	{
+		ASSERT_TRUE(RegexMatcher.Compile(SUPPORTED_PATTERNS[i], FALSE));
+		EXPECT_FALSE(RegexMatcher.IsUsingFallback()) << SUPPORTED_PATTERNS[i];
+	}
+
+	for(size_t i = 0; i < SIZEOF_ARRAY(FALLBACK_PATTERNS); i++)
+	{
+		ASSERT_TRUE(RegexMatcher.Compile(FALLBACK_PATTERNS[i], FALSE));
+		EXPECT_TRUE(RegexMatcher.IsUsingFallback()) << FALLBACK_PATTERNS[i];
+	}
+}
+
+TEST(RegexMatcher, RequiredLiteral)
+{
+	CRegexMatcher RegexMatcher;
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("abc"), FALSE));
+	EXPECT_EQ(std::wstring(_T("abc")), RegexMatcher.GetRequiredLiteral());
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T(".*\\.txt"), FALSE));
+	EXPECT_EQ(std::wstring(_T(".txt")), RegexMatcher.GetRequiredLiteral());
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("x(ab)+c"), FALSE));
+	EXPECT_EQ(std::wstring(_T("xab")), RegexMatcher.GetRequiredLiteral());
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("ab?cde"), FALSE));
+	EXPECT_EQ(std::wstring(_T("cde")), RegexMatcher.GetRequiredLiteral());
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("abc|abd"), FALSE));
+	EXPECT_EQ(std::wstring(_T("")), RegexMatcher.GetRequiredLiteral());
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("ReadMe\\.TXT"), TRUE));
+	EXPECT_EQ(std::wstring(_T("readme.txt")), RegexMatcher.GetRequiredLiteral());
+}
+
+TEST(RegexMatcher, FileNames)
+{
+	CRegexMatcher RegexMatcher;
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T(".*\\.(cpp|h)"), FALSE));
+	EXPECT_TRUE(RegexMatcher.Match(_T("RegexMatcher.cpp")));
+	EXPECT_TRUE(RegexMatcher.Match(_T("RegexMatcher.h")));
+	EXPECT_FALSE(RegexMatcher.Match(_T("RegexMatcher.CPP")));
+	EXPECT_FALSE(RegexMatcher.Match(_T("RegexMatcher.cpp.bak")));
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T(".*\\.(cpp|h)"), TRUE));
+	EXPECT_TRUE(RegexMatcher.Match(_T("RegexMatcher.CPP")));
+
+	ASSERT_TRUE(RegexMatcher.Compile(_T("IMG_\\d{4}\\.jpe?g"), TRUE));
+	EXPECT_TRUE(RegexMatcher.Match(_T("img_1234.JPG")));
+	EXPECT_TRUE(RegexMatcher.Match(_T("IMG_0001.jpeg")));
+	EXPECT_FALSE(RegexMatcher.Match(_T("IMG_123.jpg")));
+}
+
+TEST(RegexMatcher, InvalidPatterns)
+{
+	CRegexMatcher RegexMatcher;
+
+	EXPECT_FALSE(RegexMatcher.Compile(_T("("), FALSE));
+	EXPECT_FALSE(RegexMatcher.Compile(_T("[b-a]"), FALSE));
+	EXPECT_FALSE(RegexMatcher.Compile(_T("a{2,1}"), FALSE));
+	EXPECT_FALSE(RegexMatcher.Compile(_T("*a"), FALSE));
+
+	/* Nothing matches if the pattern couldn't
+	be compiled. */
+	EXPECT_FALSE(RegexMatcher.Match(_T("a")));
+}
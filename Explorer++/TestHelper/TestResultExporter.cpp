@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "../Helper/ResultExporter.h"
+#include "../Helper/TimeHelper.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+class ResultExporterTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		GetTestTempFilePath(L"TestResultExporter.txt", m_szFileName, SIZEOF_ARRAY(m_szFileName));
+
+		/* 2015-06-15 13:45:30, local time. */
+		SYSTEMTIME st = {0};
+		st.wYear = 2015;
+		st.wMonth = 6;
+		st.wDay = 15;
+		st.wHour = 13;
+		st.wMinute = 45;
+		st.wSecond = 30;
+
+		FILETIME ft;
+		BOOL bRet = LocalSystemTimeToFileTime(&st, &ft);
+		ASSERT_EQ(TRUE, bRet);
+
+		WIN32_FIND_DATA wfdFile = {0};
+		StringCchCopy(wfdFile.cFileName, SIZEOF_ARRAY(wfdFile.cFileName), L"report, \"final\".txt");
+		wfdFile.dwFileAttributes = FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_READONLY;
+		wfdFile.nFileSizeLow = 1;
+		wfdFile.nFileSizeHigh = 1;
+		wfdFile.ftCreationTime = ft;
+		wfdFile.ftLastWriteTime = ft;
+		m_wfdFile = wfdFile;
+
+		WIN32_FIND_DATA wfdFolder = {0};
+		StringCchCopy(wfdFolder.cFileName, SIZEOF_ARRAY(wfdFolder.cFileName), L"caf\u00e9");
+		wfdFolder.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+		wfdFolder.ftLastWriteTime = ft;
+		m_wfdFolder = wfdFolder;
+	}
+
+	void TearDown()
+	{
+		DeleteFile(m_szFileName);
+	}
+
+	std::string Export(CResultExporter::Format_t Format)
+	{
+		CResultExporter ResultExporter(Format);
+		EXPECT_EQ(TRUE, ResultExporter.Open(m_szFileName));
+		EXPECT_EQ(TRUE, ResultExporter.AddResult(L"C:\\docs\\report, \"final\".txt", &m_wfdFile));
+		EXPECT_EQ(TRUE, ResultExporter.AddResult(L"C:\\caf\u00e9", &m_wfdFolder));
+		EXPECT_EQ(TRUE, ResultExporter.Close());
+
+		return ReadTestFile();
+	}
+
+	std::string ReadTestFile()
+	{
+		HANDLE hFile = CreateFile(m_szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		EXPECT_NE(INVALID_HANDLE_VALUE, hFile);
+
+		std::string strContents;
+		char Buffer[4096];
+		DWORD nBytesRead;
+
+		while(ReadFile(hFile, Buffer, sizeof(Buffer), &nBytesRead, NULL) && nBytesRead > 0)
+		{
+			strContents.append(Buffer, nBytesRead);
+		}
+
+		CloseHandle(hFile);
+
+		return strContents;
+	}
+
+	TCHAR m_szFileName[MAX_PATH];
+	WIN32_FIND_DATA m_wfdFile;
+	WIN32_FIND_DATA m_wfdFolder;
+};
+
+TEST_F(ResultExporterTest, Csv)
+{
+	std::string strExpected =
+		"\xEF\xBB\xBFPath,Size,Created,Modified,Accessed,Attributes\r\n"
+		"\"C:\\docs\\report, \"\"final\"\".txt\",4294967297,2015-06-15 13:45:30,2015-06-15 13:45:30,,RA\r\n"
+		"C:\\caf\xC3\xA9,,,2015-06-15 13:45:30,,D\r\n";
+
+	EXPECT_EQ(strExpected, Export(CResultExporter::FORMAT_CSV));
+}
+
+TEST_F(ResultExporterTest, Tsv)
+{
+	std::string strExpected =
+		"\xEF\xBB\xBFPath\tSize\tCreated\tModified\tAccessed\tAttributes\r\n"
+		"C:\\docs\\report, \"final\".txt\t4294967297\t2015-06-15 13:45:30\t2015-06-15 13:45:30\t\tRA\r\n"
+		"C:\\caf\xC3\xA9\t\t\t2015-06-15 13:45:30\t\tD\r\n";
+
+	EXPECT_EQ(strExpected, Export(CResultExporter::FORMAT_TSV));
+}
+
+TEST_F(ResultExporterTest, JsonLines)
+{
+	std::string strExpected =
+		"{\"path\":\"C:\\\\docs\\\\report, \\\"final\\\".txt\",\"size\":4294967297,"
+		"\"created\":\"2015-06-15 13:45:30\",\"modified\":\"2015-06-15 13:45:30\",\"accessed\":null,\"attributes\":\"RA\"}\n"
+		"{\"path\":\"C:\\\\caf\xC3\xA9\",\"size\":null,"
+		"\"created\":null,\"modified\":\"2015-06-15 13:45:30\",\"accessed\":null,\"attributes\":\"D\"}\n";
+
+	EXPECT_EQ(strExpected, Export(CResultExporter::FORMAT_JSON_LINES));
+}
+
+/* Enough results to fill the buffer several times over. */
+TEST_F(ResultExporterTest, ManyResults)
+{
+	const int NUM_RESULTS = 20000;
+
+	CResultExporter ResultExporter(CResultExporter::FORMAT_TSV);
+	ASSERT_EQ(TRUE, ResultExporter.Open(m_szFileName));
+
+	WIN32_FIND_DATA wfd = {0};
+
+	for(int i = 0; i < NUM_RESULTS; i++)
+	{
+		TCHAR szFullFileName[MAX_PATH];
+		StringCchPrintf(szFullFileName, SIZEOF_ARRAY(szFullFileName), L"C:\\folder\\file%d", i);
+
+		wfd.nFileSizeLow = i;
+		EXPECT_EQ(TRUE, ResultExporter.AddResult(szFullFileName, &wfd));
+	}
+
+	EXPECT_EQ(TRUE, ResultExporter.Close());
+
+	std::string strContents = ReadTestFile();
+
+	size_t nLines = 0;
+	size_t nPosition = 0;
+
+	while((nPosition = strContents.find("\r\n", nPosition)) != std::string::npos)
+	{
+		nLines++;
+		nPosition += 2;
+	}
+
+	/* The header, plus one line per result. */
+	EXPECT_EQ(NUM_RESULTS + 1, nLines);
+	EXPECT_NE(std::string::npos, strContents.find("C:\\folder\\file19999\t19999\t"));
+}
@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include "../Helper/ResultTable.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	CResultTable::ItemInfo_t BuildItemInfo(ULONGLONG ulSize, DWORD dwAttributes)
+	{
+		CResultTable::ItemInfo_t Info = {0};
+		Info.ulSize = ulSize;
+		Info.dwAttributes = dwAttributes;
+
+		return Info;
+	}
+
+	void Refine(CResultTable &ResultTable, const TCHAR *szQuery, int nThreads)
+	{
+		CSearchQuery SearchQuery;
+		BOOL bRet = SearchQuery.Parse(szQuery);
+		ASSERT_EQ(TRUE, bRet) << szQuery;
+
+		ResultTable.Refine(SearchQuery, nThreads);
+	}
+
+	std::vector<std::wstring> GetCurrentFileNames(const CResultTable &ResultTable)
+	{
+		std::vector<std::wstring> FileNames;
+
+		for(int i = 0; i < ResultTable.GetCurrentRowCount(); i++)
+		{
+			FileNames.push_back(ResultTable.GetFileName(ResultTable.GetCurrentRow(i)));
+		}
+
+		return FileNames;
+	}
+}
+
+class ResultTableTest : public ::testing::Test
+{
+protected:
+
+	void SetUp()
+	{
+		m_ResultTable.SetBaseDirectory(L"C:\\base");
+		m_ResultTable.AddRow(L"C:\\base\\readme.txt", BuildItemInfo(100, FILE_ATTRIBUTE_ARCHIVE));
+		m_ResultTable.AddRow(L"C:\\base\\src", BuildItemInfo(0, FILE_ATTRIBUTE_DIRECTORY));
+		m_ResultTable.AddRow(L"C:\\base\\src\\main.cpp", BuildItemInfo(5000, FILE_ATTRIBUTE_ARCHIVE));
+		m_ResultTable.AddRow(L"C:\\base\\src\\notes.txt", BuildItemInfo(20, FILE_ATTRIBUTE_READONLY));
+		m_ResultTable.AddRow(L"C:\\base\\docs\\guide.txt", BuildItemInfo(3000, FILE_ATTRIBUTE_ARCHIVE));
+	}
+
+	CResultTable m_ResultTable;
+};
+
+TEST_F(ResultTableTest, NoRefinement)
+{
+	EXPECT_EQ(5, m_ResultTable.GetRowCount());
+	EXPECT_EQ(5, m_ResultTable.GetCurrentRowCount());
+	EXPECT_EQ(0, m_ResultTable.GetRefinementCount());
+	EXPECT_STREQ(L"C:\\base\\src\\main.cpp", m_ResultTable.GetFullFileName(2));
+	EXPECT_STREQ(L"main.cpp", m_ResultTable.GetFileName(2));
+	EXPECT_EQ(FALSE, m_ResultTable.Undo());
+}
+
+TEST_F(ResultTableTest, Refine)
+{
+	Refine(m_ResultTable, L"*.txt", 1);
+
+	std::vector<std::wstring> Expected;
+	Expected.push_back(L"readme.txt");
+	Expected.push_back(L"notes.txt");
+	Expected.push_back(L"guide.txt");
+	EXPECT_EQ(Expected, GetCurrentFileNames(m_ResultTable));
+
+	/* Each refinement filters the rows
+	left by the previous one. */
+	Refine(m_ResultTable, L"size:>50", 1);
+
+	Expected.clear();
+	Expected.push_back(L"readme.txt");
+	Expected.push_back(L"guide.txt");
+	EXPECT_EQ(Expected, GetCurrentFileNames(m_ResultTable));
+	EXPECT_EQ(2, m_ResultTable.GetRefinementCount());
+}
+
+TEST_F(ResultTableTest, DirectoryTerms)
+{
+	Refine(m_ResultTable, L"in:src", 1);
+
+	std::vector<std::wstring> Expected;
+	Expected.push_back(L"main.cpp");
+	Expected.push_back(L"notes.txt");
+	EXPECT_EQ(Expected, GetCurrentFileNames(m_ResultTable));
+
+	m_ResultTable.Undo();
+	Refine(m_ResultTable, L"depth:1", 1);
+
+	Expected.clear();
+	Expected.push_back(L"readme.txt");
+	Expected.push_back(L"src");
+	EXPECT_EQ(Expected, GetCurrentFileNames(m_ResultTable));
+}
+
+TEST_F(ResultTableTest, Undo)
+{
+	Refine(m_ResultTable, L"type:file", 1);
+	Refine(m_ResultTable, L"attrib:R", 1);
+	EXPECT_EQ(1, m_ResultTable.GetCurrentRowCount());
+
+	EXPECT_EQ(TRUE, m_ResultTable.Undo());
+	EXPECT_EQ(4, m_ResultTable.GetCurrentRowCount());
+
+	EXPECT_EQ(TRUE, m_ResultTable.Undo());
+	EXPECT_EQ(5, m_ResultTable.GetCurrentRowCount());
+
+	EXPECT_EQ(FALSE, m_ResultTable.Undo());
+}
+
+/* Large enough to be split between threads. The result
+should be the same as a single-threaded refinement. */
+TEST(ResultTableLargeTest, Parallel)
+{
+	const int NUM_ROWS = 100000;
+
+	CResultTable ResultTable;
+	ResultTable.SetBaseDirectory(L"C:\\base");
+
+	for(int i = 0; i < NUM_ROWS; i++)
+	{
+		TCHAR szFullFileName[MAX_PATH];
+		StringCchPrintf(szFullFileName, SIZEOF_ARRAY(szFullFileName), L"C:\\base\\folder%d\\file%d.dat", i / 100, i);
+
+		ResultTable.AddRow(szFullFileName, BuildItemInfo(i, FILE_ATTRIBUTE_ARCHIVE));
+	}
+
+	Refine(ResultTable, L"size:<50000 in:folder1*", 1);
+
+	std::vector<int> Expected;
+
+	for(int i = 0; i < ResultTable.GetCurrentRowCount(); i++)
+	{
+		Expected.push_back(ResultTable.GetCurrentRow(i));
+	}
+
+	ResultTable.Undo();
+	Refine(ResultTable, L"size:<50000 in:folder1*", 8);
+
+	std::vector<int> Actual;
+
+	for(int i = 0; i < ResultTable.GetCurrentRowCount(); i++)
+	{
+		Actual.push_back(ResultTable.GetCurrentRow(i));
+	}
+
+	/* folder1 and folder10-199, less anything
+	at or above 50000 (folder500 onwards). */
+	EXPECT_EQ(11100, Expected.size());
+	EXPECT_EQ(Expected, Actual);
+}
@@ -0,0 +1,258 @@
+#include "stdafx.h"
+#include "../Helper/SearchQuery.h"
+#include "../Helper/TimeHelper.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	WIN32_FIND_DATA BuildFindData(const TCHAR *szName, ULONGLONG ulSize, DWORD dwAttributes)
+	{
+		WIN32_FIND_DATA wfd = {0};
+		StringCchCopy(wfd.cFileName, SIZEOF_ARRAY(wfd.cFileName), szName);
+		wfd.dwFileAttributes = dwAttributes;
+
+		ULARGE_INTEGER uliSize;
+		uliSize.QuadPart = ulSize;
+		wfd.nFileSizeLow = uliSize.LowPart;
+		wfd.nFileSizeHigh = uliSize.HighPart;
+
+		return wfd;
+	}
+
+	void SetModifiedDate(WIN32_FIND_DATA &wfd, WORD wYear, WORD wMonth, WORD wDay, WORD wHour)
+	{
+		SYSTEMTIME st = {0};
+		st.wYear = wYear;
+		st.wMonth = wMonth;
+		st.wDay = wDay;
+		st.wHour = wHour;
+
+		BOOL bRet = LocalSystemTimeToFileTime(&st, &wfd.ftLastWriteTime);
+		ASSERT_EQ(TRUE, bRet);
+	}
+
+	BOOL Evaluate(const TCHAR *szQuery, const WIN32_FIND_DATA &wfd)
+	{
+		CSearchQuery SearchQuery;
+		BOOL bRet = SearchQuery.Parse(szQuery);
+		EXPECT_EQ(TRUE, bRet) << szQuery;
+
+		CSearchQuery::DirectoryContext_t Context;
+		SearchQuery.GetBaseContext(Context);
+
+		return SearchQuery.Evaluate(&wfd, Context);
+	}
+}
+
+TEST(SearchQueryTest, Parse)
+{
+	const TCHAR *VALID_QUERIES[] = {L"", L"readme", L"name:*.txt", L"size:>10MB", L"size:1KB..2KB",
+		L"size:..100", L"modified:2015-06-01", L"modified:>=2015-01-01", L"attrib:RH", L"type:folder",
+		L"in:src", L"depth:<=2", L"a OR b", L"NOT a", L"(a OR b) c", L"name:\"file name\"", L"\"or\""};
+
+	const TCHAR *INVALID_QUERIES[] = {L"(a", L"a)", L"a OR", L"NOT", L"AND a", L"size:", L"size:10XB",
+		L"size:big", L"size:5..1", L"size:..", L"size:<0", L"modified:2015-13-01", L"modified:2015-02-30",
+		L"modified:15-01-01", L"attrib:Q", L"type:link", L"colour:red", L"depth:-1", L"\"unterminated"};
+
+	CSearchQuery SearchQuery;
+
+	for(int i = 0; i < SIZEOF_ARRAY(VALID_QUERIES); i++)
+	{
+		EXPECT_EQ(TRUE, SearchQuery.Parse(VALID_QUERIES[i])) << VALID_QUERIES[i];
+	}
+
+	for(int i = 0; i < SIZEOF_ARRAY(INVALID_QUERIES); i++)
+	{
+		EXPECT_EQ(FALSE, SearchQuery.Parse(INVALID_QUERIES[i])) << INVALID_QUERIES[i];
+	}
+
+	EXPECT_EQ(TRUE, SearchQuery.Parse(L"  "));
+	EXPECT_EQ(TRUE, SearchQuery.IsEmpty());
+}
+
+TEST(SearchQueryTest, Name)
+{
+	WIN32_FIND_DATA wfd = BuildFindData(L"Readme.txt", 0, FILE_ATTRIBUTE_ARCHIVE);
+
+	EXPECT_EQ(TRUE, Evaluate(L"readme", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"name:*.TXT", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"name:*.h:*.txt", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"name:*.doc", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"name:read", wfd));
+}
+
+TEST(SearchQueryTest, Size)
+{
+	WIN32_FIND_DATA wfd = BuildFindData(L"file", 2048, FILE_ATTRIBUTE_ARCHIVE);
+
+	EXPECT_EQ(TRUE, Evaluate(L"size:2KB", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"size:>=2048", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"size:>2KB", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"size:<3KB", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"size:<2KB", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"size:1KB..2KB", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"size:3KB..", wfd));
+
+	/* Sizes above 4GB are split across two fields. */
+	WIN32_FIND_DATA wfdLarge = BuildFindData(L"large", 5ULL * 1024 * 1024 * 1024, FILE_ATTRIBUTE_ARCHIVE);
+	EXPECT_EQ(TRUE, Evaluate(L"size:>4GB", wfdLarge));
+	EXPECT_EQ(FALSE, Evaluate(L"size:<1GB", wfdLarge));
+
+	WIN32_FIND_DATA wfdFolder = BuildFindData(L"folder", 0, FILE_ATTRIBUTE_DIRECTORY);
+	EXPECT_EQ(FALSE, Evaluate(L"size:<1KB", wfdFolder));
+}
+
+TEST(SearchQueryTest, Modified)
+{
+	WIN32_FIND_DATA wfd = BuildFindData(L"file", 0, FILE_ATTRIBUTE_ARCHIVE);
+	SetModifiedDate(wfd, 2015, 6, 15, 13);
+
+	/* A single date covers the whole day. */
+	EXPECT_EQ(TRUE, Evaluate(L"modified:2015-06-15", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"modified:2015-06-14", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"modified:<=2015-06-15", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"modified:<2015-06-15", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"modified:>2015-06-15", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"modified:2015-01-01..2015-12-31", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"modified:2016-01-01..", wfd));
+}
+
+TEST(SearchQueryTest, Attributes)
+{
+	WIN32_FIND_DATA wfd = BuildFindData(L"file", 0, FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_READONLY);
+
+	EXPECT_EQ(TRUE, Evaluate(L"attrib:H", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"attrib:rh", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"attrib:HS", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"type:file", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"type:folder", wfd));
+}
+
+TEST(SearchQueryTest, Operators)
+{
+	WIN32_FIND_DATA wfd = BuildFindData(L"notes.txt", 100, FILE_ATTRIBUTE_ARCHIVE);
+
+	EXPECT_EQ(TRUE, Evaluate(L"notes size:100", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"notes AND size:100", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"notes size:200", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"size:200 OR notes", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"NOT notes", wfd));
+	EXPECT_EQ(TRUE, Evaluate(L"not not notes", wfd));
+
+	/* AND binds tighter than OR. */
+	EXPECT_EQ(TRUE, Evaluate(L"notes OR other AND size:200", wfd));
+	EXPECT_EQ(FALSE, Evaluate(L"(notes OR other) AND size:200", wfd));
+
+	/* Quoted keywords are names. */
+	EXPECT_EQ(FALSE, Evaluate(L"notes \"or\" size:100", wfd));
+}
+
+TEST(SearchQueryTest, DirectoryTerms)
+{
+	CSearchQuery SearchQuery;
+	BOOL bRet = SearchQuery.Parse(L"in:src depth:<=3 NOT in:obj");
+	ASSERT_EQ(TRUE, bRet);
+
+	WIN32_FIND_DATA wfd = BuildFindData(L"main.cpp", 100, FILE_ATTRIBUTE_ARCHIVE);
+
+	/* Base directory (depth 1). */
+	CSearchQuery::DirectoryContext_t Base;
+	SearchQuery.GetBaseContext(Base);
+	EXPECT_EQ(FALSE, SearchQuery.Evaluate(&wfd, Base));
+	EXPECT_EQ(TRUE, SearchQuery.CanMatchWithin(Base));
+
+	/* base\src (depth 2). */
+	CSearchQuery::DirectoryContext_t Src;
+	SearchQuery.GetChildContext(Base, L"src", Src);
+	EXPECT_EQ(TRUE, SearchQuery.Evaluate(&wfd, Src));
+	EXPECT_EQ(TRUE, SearchQuery.CanMatchWithin(Src));
+
+	/* base\src\obj (depth 3). Nothing below here can
+	match, since every item is within obj. */
+	CSearchQuery::DirectoryContext_t Obj;
+	SearchQuery.GetChildContext(Src, L"obj", Obj);
+	EXPECT_EQ(FALSE, SearchQuery.Evaluate(&wfd, Obj));
+	EXPECT_EQ(FALSE, SearchQuery.CanMatchWithin(Obj));
+
+	/* base\src\lib (depth 3), then base\src\lib\inner
+	(depth 4), which is too deep. */
+	CSearchQuery::DirectoryContext_t Lib;
+	SearchQuery.GetChildContext(Src, L"lib", Lib);
+	EXPECT_EQ(TRUE, SearchQuery.Evaluate(&wfd, Lib));
+	EXPECT_EQ(TRUE, SearchQuery.CanMatchWithin(Lib));
+
+	CSearchQuery::DirectoryContext_t Inner;
+	SearchQuery.GetChildContext(Lib, L"inner", Inner);
+	EXPECT_EQ(FALSE, SearchQuery.Evaluate(&wfd, Inner));
+	EXPECT_EQ(FALSE, SearchQuery.CanMatchWithin(Inner));
+}
+
+/* Checks that a directory is only ever skipped when
+nothing within it could match. */
+TEST(SearchQueryTest, CanMatchWithinIsConservative)
+{
+	const TCHAR *QUERIES[] = {L"in:a", L"NOT in:a", L"depth:2", L"depth:>=3", L"NOT depth:<=2",
+		L"in:a OR depth:1", L"NOT (in:a AND depth:>2)", L"in:b NOT in:a", L"x.txt depth:..2"};
+	const TCHAR *FOLDER_NAMES[] = {L"a", L"b", L"c"};
+	const TCHAR *FILE_NAMES[] = {L"x.txt", L"y.txt"};
+
+	for(int i = 0; i < SIZEOF_ARRAY(QUERIES); i++)
+	{
+		CSearchQuery SearchQuery;
+		BOOL bRet = SearchQuery.Parse(QUERIES[i]);
+		ASSERT_EQ(TRUE, bRet);
+
+		/* Every path of up to four folders. */
+		std::vector<CSearchQuery::DirectoryContext_t> Contexts(1);
+		SearchQuery.GetBaseContext(Contexts[0]);
+
+		for(size_t j = 0; j < Contexts.size(); j++)
+		{
+			if(Contexts[j].iDepth < 5)
+			{
+				for(int k = 0; k < SIZEOF_ARRAY(FOLDER_NAMES); k++)
+				{
+					CSearchQuery::DirectoryContext_t Child;
+					SearchQuery.GetChildContext(Contexts[j], FOLDER_NAMES[k], Child);
+					Contexts.push_back(Child);
+				}
+			}
+		}
+
+		/* Contexts[j]'s children were added in order, so every
+		descendant of a context comes after it. For each context
+		that is skipped, nothing in it or below it may match. */
+		for(size_t j = 0; j < Contexts.size(); j++)
+		{
+			if(SearchQuery.CanMatchWithin(Contexts[j]))
+			{
+				continue;
+			}
+
+			std::vector<size_t> Pending(1, j);
+
+			while(!Pending.empty())
+			{
+				size_t nCurrent = Pending.back();
+				Pending.pop_back();
+
+				for(int k = 0; k < SIZEOF_ARRAY(FILE_NAMES); k++)
+				{
+					WIN32_FIND_DATA wfd = BuildFindData(FILE_NAMES[k], 0, FILE_ATTRIBUTE_ARCHIVE);
+					EXPECT_EQ(FALSE, SearchQuery.Evaluate(&wfd, Contexts[nCurrent])) << QUERIES[i];
+				}
+
+				/* Children of context n are at 1 + 3n ... 3 + 3n. */
+				for(size_t k = 1; k <= SIZEOF_ARRAY(FOLDER_NAMES); k++)
+				{
+					size_t nChild = nCurrent * SIZEOF_ARRAY(FOLDER_NAMES) + k;
+
+					if(nChild < Contexts.size())
+					{
+						Pending.push_back(nChild);
+					}
+				}
+			}
+		}
+	}
+}
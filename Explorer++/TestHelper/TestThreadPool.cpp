@@ -0,0 +1,661 @@
+#include "stdafx.h"
+#include <string>
+#include "../Helper/ThreadPool.h"
+#include "../Helper/Macros.h"
+#include "Helper.h"
+
+namespace
+{
+	void EmptyJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pParam);
+		UNREFERENCED_PARAMETER(pToken);
+	}
+
+	CThreadPoolQueue::Job_t MakeJob(ThreadPoolPriority_t Priority, const TCHAR *szDevice, LPVOID pParam)
+	{
+		CThreadPoolQueue::Job_t Job;
+		Job.pfnJob = EmptyJob;
+		Job.pParam = pParam;
+		Job.Priority = Priority;
+		Job.pToken = new CCancellationToken();
+		Job.strDevice = szDevice;
+		Job.DeviceClass = DEVICE_CLASS_ROTATIONAL;
+		Job.dwQueuedTime = 0;
+		Job.bCounted = FALSE;
+
+		return Job;
+	}
+
+	/* Pops a job, and returns the parameter
+	it was queued with (or -1). */
+	INT_PTR PopJob(CThreadPoolQueue &Queue, CThreadPoolQueue::Job_t &Job)
+	{
+		if(!Queue.Pop(Job, 0))
+		{
+			return -1;
+		}
+
+		Job.pToken->Release();
+
+		return reinterpret_cast<INT_PTR>(Job.pParam);
+	}
+
+	struct BurstJobs_t
+	{
+		CRITICAL_SECTION cs;
+		HANDLE hFinishedEvent;
+		int nJobs;
+		int nRunning;
+		int nMaxRunning;
+		int nFinished;
+	};
+
+	void BurstJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		BurstJobs_t *pBurstJobs = reinterpret_cast<BurstJobs_t *>(pParam);
+
+		EnterCriticalSection(&pBurstJobs->cs);
+		pBurstJobs->nRunning++;
+		pBurstJobs->nMaxRunning = max(pBurstJobs->nMaxRunning, pBurstJobs->nRunning);
+		LeaveCriticalSection(&pBurstJobs->cs);
+
+		Sleep(1);
+
+		EnterCriticalSection(&pBurstJobs->cs);
+		pBurstJobs->nRunning--;
+
+		if(++pBurstJobs->nFinished == pBurstJobs->nJobs)
+		{
+			SetEvent(pBurstJobs->hFinishedEvent);
+		}
+
+		LeaveCriticalSection(&pBurstJobs->cs);
+	}
+
+	void SetAllDeviceClassLimits(CThreadPool &ThreadPool, int nMaxJobsPerDevice,
+		ULONGLONG ulMaxBytesPerSecond)
+	{
+		for(int i = 0; i < NUM_DEVICE_CLASSES; i++)
+		{
+			ThreadPool.SetDeviceClassLimits(static_cast<DeviceClass_t>(i),
+				nMaxJobsPerDevice, ulMaxBytesPerSecond);
+		}
+	}
+
+	BOOL FindDeviceStats(const CThreadPool &ThreadPool, const std::wstring &strDevice,
+		DeviceStats_t &DeviceStats)
+	{
+		std::vector<DeviceStats_t> AllDeviceStats;
+		ThreadPool.GetDeviceStats(AllDeviceStats);
+
+		for(auto itr = AllDeviceStats.begin(); itr != AllDeviceStats.end(); itr++)
+		{
+			if(itr->strDevice == strDevice)
+			{
+				DeviceStats = *itr;
+				return TRUE;
+			}
+		}
+
+		return FALSE;
+	}
+
+	struct PreemptedJobs_t
+	{
+		HANDLE hBackgroundStartedEvent;
+		HANDLE hInteractiveQueuedEvent;
+		volatile LONG lInteractiveFinished;
+		BOOL bInteractiveFinishedFirst;
+		BOOL bThrottleSucceeded;
+	};
+
+	void BackgroundJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		PreemptedJobs_t *pPreemptedJobs = reinterpret_cast<PreemptedJobs_t *>(pParam);
+
+		SetEvent(pPreemptedJobs->hBackgroundStartedEvent);
+		WaitForSingleObject(pPreemptedJobs->hInteractiveQueuedEvent, INFINITE);
+
+		/* The interactive job needs this job's slot,
+		so it can only run if this job gives it up. */
+		pPreemptedJobs->bThrottleSucceeded = CThreadPool::ThrottleIo(1);
+		pPreemptedJobs->bInteractiveFinishedFirst = (pPreemptedJobs->lInteractiveFinished != 0);
+	}
+
+	void InteractiveJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		PreemptedJobs_t *pPreemptedJobs = reinterpret_cast<PreemptedJobs_t *>(pParam);
+		InterlockedExchange(&pPreemptedJobs->lInteractiveFinished, 1);
+	}
+
+	struct ThrottledJob_t
+	{
+		int nBlocks;
+		ULONGLONG ulBlockSize;
+		DWORD dwElapsed;
+	};
+
+	void ThrottledJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		ThrottledJob_t *pThrottledJob = reinterpret_cast<ThrottledJob_t *>(pParam);
+
+		DWORD dwStart = GetTickCount();
+
+		for(int i = 0; i < pThrottledJob->nBlocks; i++)
+		{
+			CThreadPool::ThrottleIo(pThrottledJob->ulBlockSize);
+		}
+
+		pThrottledJob->dwElapsed = GetTickCount() - dwStart;
+	}
+
+	struct RecordedJob_t
+	{
+		HANDLE hStartedEvent;
+		HANDLE hStartEvent;
+		BOOL bCalled;
+		BOOL bCancelled;
+	};
+
+	void RecordJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		RecordedJob_t *pRecordedJob = reinterpret_cast<RecordedJob_t *>(pParam);
+
+		if(pRecordedJob->hStartedEvent != NULL)
+		{
+			SetEvent(pRecordedJob->hStartedEvent);
+		}
+
+		if(pRecordedJob->hStartEvent != NULL)
+		{
+			WaitForSingleObject(pRecordedJob->hStartEvent, INFINITE);
+		}
+
+		pRecordedJob->bCalled = TRUE;
+		pRecordedJob->bCancelled = pToken->IsCancelled();
+	}
+
+	struct DeviceLimitJob_t
+	{
+		HANDLE hFinishedEvent;
+		int nLimit;
+	};
+
+	void DeviceLimitJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		DeviceLimitJob_t *pDeviceLimitJob = reinterpret_cast<DeviceLimitJob_t *>(pParam);
+
+		pDeviceLimitJob->nLimit = CThreadPool::GetJobDeviceLimit();
+		SetEvent(pDeviceLimitJob->hFinishedEvent);
+	}
+
+	struct HelperThread_t
+	{
+		LPVOID pJobContext;
+		ULONGLONG ulBytes;
+	};
+
+	DWORD WINAPI HelperThreadProc(LPVOID pParam)
+	{
+		HelperThread_t *pHelperThread = reinterpret_cast<HelperThread_t *>(pParam);
+
+		CThreadPool::SetJobContext(pHelperThread->pJobContext);
+		CThreadPool::ThrottleIo(pHelperThread->ulBytes);
+		CThreadPool::SetJobContext(NULL);
+
+		return 0;
+	}
+
+	/* Reports I/O both from the job's own
+	thread, and from a thread it creates. */
+	void HelperThreadJob(LPVOID pParam, const CCancellationToken *pToken)
+	{
+		UNREFERENCED_PARAMETER(pToken);
+
+		HelperThread_t *pHelperThread = reinterpret_cast<HelperThread_t *>(pParam);
+		pHelperThread->pJobContext = CThreadPool::GetJobContext();
+
+		HANDLE hThread = CreateThread(NULL, 0, HelperThreadProc, pParam, 0, NULL);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+
+		CThreadPool::ThrottleIo(pHelperThread->ulBytes);
+	}
+
+	void CountItem(LPVOID pParam, int iItem)
+	{
+		volatile LONG *pCounts = reinterpret_cast<volatile LONG *>(pParam);
+		InterlockedIncrement(&pCounts[iItem]);
+	}
+}
+
+TEST(ThreadPoolQueueTest, Priority)
+{
+	CThreadPoolQueue Queue(2);
+	CThreadPoolQueue::Job_t Job;
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_LOW, _T(""), reinterpret_cast<LPVOID>(1)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T(""), reinterpret_cast<LPVOID>(2)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_HIGH, _T(""), reinterpret_cast<LPVOID>(3)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T(""), reinterpret_cast<LPVOID>(4)));
+
+	EXPECT_EQ(3, PopJob(Queue, Job));
+	EXPECT_EQ(2, PopJob(Queue, Job));
+	EXPECT_EQ(4, PopJob(Queue, Job));
+	EXPECT_EQ(1, PopJob(Queue, Job));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+}
+
+TEST(ThreadPoolQueueTest, DeviceLimit)
+{
+	CThreadPoolQueue Queue(2);
+	CThreadPoolQueue::Job_t Job;
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(1)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(2)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(3)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("d:\\"), reinterpret_cast<LPVOID>(4)));
+
+	EXPECT_EQ(1, PopJob(Queue, Job));
+	EXPECT_EQ(2, PopJob(Queue, Job));
+
+	CThreadPoolQueue::Job_t FinishedJob = Job;
+
+	/* c:\ is now at its limit, so the
+	job for d:\ is run ahead of it. */
+	EXPECT_EQ(4, PopJob(Queue, Job));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+	EXPECT_EQ(2, Queue.GetRunningCount(_T("c:\\")));
+
+	Queue.JobFinished(FinishedJob);
+	EXPECT_EQ(1, Queue.GetRunningCount(_T("c:\\")));
+
+	EXPECT_EQ(3, PopJob(Queue, Job));
+	EXPECT_EQ(0u, Queue.GetQueuedCount());
+}
+
+TEST(ThreadPoolQueueTest, DeviceClassLimits)
+{
+	CThreadPoolQueue Queue(1);
+	Queue.SetMaxJobsPerDevice(DEVICE_CLASS_SOLID_STATE, 2);
+
+	CThreadPoolQueue::Job_t Job;
+
+	for(int i = 0; i < 2; i++)
+	{
+		Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(1)));
+
+		CThreadPoolQueue::Job_t SolidStateJob = MakeJob(THREAD_POOL_PRIORITY_NORMAL,
+			_T("d:\\"), reinterpret_cast<LPVOID>(2));
+		SolidStateJob.DeviceClass = DEVICE_CLASS_SOLID_STATE;
+		Queue.Push(SolidStateJob);
+	}
+
+	EXPECT_EQ(1, PopJob(Queue, Job));
+	EXPECT_EQ(2, PopJob(Queue, Job));
+	EXPECT_EQ(2, PopJob(Queue, Job));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+}
+
+TEST(ThreadPoolQueueTest, QueueWait)
+{
+	CThreadPoolQueue Queue(2);
+	CThreadPoolQueue::Job_t Job;
+
+	CThreadPoolQueue::Job_t QueuedJob = MakeJob(THREAD_POOL_PRIORITY_NORMAL,
+		_T("c:\\"), NULL);
+	QueuedJob.dwQueuedTime = 100;
+	Queue.Push(QueuedJob);
+
+	QueuedJob = MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), NULL);
+	QueuedJob.dwQueuedTime = 120;
+	Queue.Push(QueuedJob);
+
+	ASSERT_EQ(TRUE, Queue.Pop(Job, 150));
+	Job.pToken->Release();
+	ASSERT_EQ(TRUE, Queue.Pop(Job, 200));
+	Job.pToken->Release();
+
+	std::vector<DeviceStats_t> DeviceStats;
+	Queue.GetDeviceStats(DeviceStats);
+
+	ASSERT_EQ(1u, DeviceStats.size());
+	EXPECT_EQ(std::wstring(_T("c:\\")), DeviceStats[0].strDevice);
+	EXPECT_EQ(2u, DeviceStats[0].nJobsStarted);
+	EXPECT_EQ(130u, DeviceStats[0].ulTotalQueueWait);
+	EXPECT_EQ(80u, DeviceStats[0].dwMaxQueueWait);
+	EXPECT_EQ(2, DeviceStats[0].nRunning);
+}
+
+TEST(ThreadPoolQueueTest, SuspendAndResume)
+{
+	CThreadPoolQueue Queue(1);
+	CThreadPoolQueue::Job_t BackgroundJob;
+	CThreadPoolQueue::Job_t Job;
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_LOW, _T("c:\\"), reinterpret_cast<LPVOID>(1)));
+	EXPECT_EQ(1, PopJob(Queue, BackgroundJob));
+	EXPECT_EQ(FALSE, Queue.HasInteractiveWork(_T("c:\\")));
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(2)));
+	EXPECT_EQ(TRUE, Queue.HasInteractiveWork(_T("c:\\")));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+
+	/* Once the background job gives up its
+	slot, the interactive job can run. */
+	Queue.SuspendJob(BackgroundJob);
+	EXPECT_EQ(0, Queue.GetRunningCount(_T("c:\\")));
+	EXPECT_EQ(2, PopJob(Queue, Job));
+	EXPECT_EQ(FALSE, Queue.ResumeJob(BackgroundJob));
+
+	Queue.JobFinished(Job);
+	EXPECT_EQ(FALSE, Queue.HasInteractiveWork(_T("c:\\")));
+	EXPECT_EQ(TRUE, Queue.ResumeJob(BackgroundJob));
+	EXPECT_EQ(1, Queue.GetRunningCount(_T("c:\\")));
+}
+
+TEST(ThreadPoolQueueTest, LowPriorityLeavesSlot)
+{
+	CThreadPoolQueue Queue(2);
+	CThreadPoolQueue::Job_t Job;
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_LOW, _T("c:\\"), reinterpret_cast<LPVOID>(1)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_LOW, _T("c:\\"), reinterpret_cast<LPVOID>(2)));
+
+	EXPECT_EQ(1, PopJob(Queue, Job));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(3)));
+	EXPECT_EQ(3, PopJob(Queue, Job));
+}
+
+TEST(ThreadPoolQueueTest, Cancelled)
+{
+	CThreadPoolQueue Queue(1);
+	CThreadPoolQueue::Job_t Job;
+
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(1)));
+	Queue.Push(MakeJob(THREAD_POOL_PRIORITY_NORMAL, _T("c:\\"), reinterpret_cast<LPVOID>(2)));
+
+	EXPECT_EQ(1, PopJob(Queue, Job));
+	EXPECT_EQ(-1, PopJob(Queue, Job));
+
+	/* Cancelled jobs don't have to wait
+	for the device. */
+	Queue.CancelAll();
+	EXPECT_EQ(2, PopJob(Queue, Job));
+	EXPECT_EQ(FALSE, Job.bCounted);
+	EXPECT_EQ(1, Queue.GetRunningCount(_T("c:\\")));
+}
+
+/* Queues a burst of jobs against the same
+device. Every job should run, without the
+device's limit ever being exceeded. */
+TEST(ThreadPoolTest, Burst)
+{
+	const int NUM_JOBS = 500;
+
+	TCHAR szResourceDirectory[MAX_PATH];
+	GetTestResourceDirectory(szResourceDirectory, SIZEOF_ARRAY(szResourceDirectory));
+
+	BurstJobs_t BurstJobs;
+	InitializeCriticalSection(&BurstJobs.cs);
+	BurstJobs.hFinishedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	BurstJobs.nJobs = NUM_JOBS;
+	BurstJobs.nRunning = 0;
+	BurstJobs.nMaxRunning = 0;
+	BurstJobs.nFinished = 0;
+
+	{
+		CThreadPool ThreadPool(8);
+		SetAllDeviceClassLimits(ThreadPool, 2, 0);
+
+		for(int i = 0; i < NUM_JOBS; i++)
+		{
+			EXPECT_EQ(TRUE, ThreadPool.QueueJob(BurstJob, &BurstJobs,
+				THREAD_POOL_PRIORITY_NORMAL, szResourceDirectory));
+		}
+
+		EXPECT_EQ(WAIT_OBJECT_0, WaitForSingleObject(BurstJobs.hFinishedEvent, 30000));
+
+		DeviceStats_t DeviceStats;
+		ASSERT_EQ(TRUE, FindDeviceStats(ThreadPool,
+			CThreadPool::GetDeviceName(szResourceDirectory), DeviceStats));
+		EXPECT_EQ(static_cast<ULONGLONG>(NUM_JOBS), DeviceStats.nJobsStarted);
+		EXPECT_EQ(0, DeviceStats.nQueued);
+	}
+
+	EXPECT_EQ(NUM_JOBS, BurstJobs.nFinished);
+	EXPECT_GE(2, BurstJobs.nMaxRunning);
+
+	CloseHandle(BurstJobs.hFinishedEvent);
+	DeleteCriticalSection(&BurstJobs.cs);
+}
+
+/* A background job that reports I/O while an
+interactive job is waiting for its device should
+pause until the interactive job has finished. */
+TEST(ThreadPoolTest, Preempt)
+{
+	TCHAR szResourceDirectory[MAX_PATH];
+	GetTestResourceDirectory(szResourceDirectory, SIZEOF_ARRAY(szResourceDirectory));
+
+	PreemptedJobs_t PreemptedJobs;
+	PreemptedJobs.hBackgroundStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	PreemptedJobs.hInteractiveQueuedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	PreemptedJobs.lInteractiveFinished = 0;
+	PreemptedJobs.bInteractiveFinishedFirst = FALSE;
+	PreemptedJobs.bThrottleSucceeded = FALSE;
+
+	{
+		CThreadPool ThreadPool(1);
+		SetAllDeviceClassLimits(ThreadPool, 1, 0);
+
+		EXPECT_EQ(TRUE, ThreadPool.QueueJob(BackgroundJob, &PreemptedJobs,
+			THREAD_POOL_PRIORITY_LOW, szResourceDirectory));
+		WaitForSingleObject(PreemptedJobs.hBackgroundStartedEvent, INFINITE);
+
+		EXPECT_EQ(TRUE, ThreadPool.QueueJob(InteractiveJob, &PreemptedJobs,
+			THREAD_POOL_PRIORITY_NORMAL, szResourceDirectory));
+		SetEvent(PreemptedJobs.hInteractiveQueuedEvent);
+	}
+
+	EXPECT_EQ(TRUE, PreemptedJobs.bThrottleSucceeded);
+	EXPECT_EQ(TRUE, PreemptedJobs.bInteractiveFinishedFirst);
+
+	CloseHandle(PreemptedJobs.hInteractiveQueuedEvent);
+	CloseHandle(PreemptedJobs.hBackgroundStartedEvent);
+}
+
+TEST(ThreadPoolTest, Bandwidth)
+{
+	const ULONGLONG BYTES_PER_SECOND = 10000;
+
+	TCHAR szResourceDirectory[MAX_PATH];
+	GetTestResourceDirectory(szResourceDirectory, SIZEOF_ARRAY(szResourceDirectory));
+
+	/* A second's worth of data is available straight
+	away, so the other second's worth has to wait. */
+	ThrottledJob_t Throttled;
+	Throttled.nBlocks = 20;
+	Throttled.ulBlockSize = BYTES_PER_SECOND / 10;
+	Throttled.dwElapsed = 0;
+
+	CThreadPool ThreadPool(1);
+	SetAllDeviceClassLimits(ThreadPool, 2, BYTES_PER_SECOND);
+
+	HANDLE hFinishedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	RecordedJob_t FinishedJob = {NULL, NULL, FALSE, FALSE};
+
+	EXPECT_EQ(TRUE, ThreadPool.QueueJob(ThrottledJob, &Throttled,
+		THREAD_POOL_PRIORITY_LOW, szResourceDirectory));
+
+	/* Jobs are run in order, so once this one has started,
+	the throttled job will have finished. */
+	FinishedJob.hStartedEvent = hFinishedEvent;
+	EXPECT_EQ(TRUE, ThreadPool.QueueJob(RecordJob, &FinishedJob,
+		THREAD_POOL_PRIORITY_LOW, NULL));
+	EXPECT_EQ(WAIT_OBJECT_0, WaitForSingleObject(hFinishedEvent, 30000));
+
+	EXPECT_LE(800u, Throttled.dwElapsed);
+
+	DeviceStats_t DeviceStats;
+	ASSERT_EQ(TRUE, FindDeviceStats(ThreadPool,
+		CThreadPool::GetDeviceName(szResourceDirectory), DeviceStats));
+	EXPECT_EQ(2 * BYTES_PER_SECOND, DeviceStats.ulBytes);
+	EXPECT_LT(0u, DeviceStats.ulThrottledTime);
+
+	CloseHandle(hFinishedEvent);
+}
+
+TEST(ThreadPoolTest, Cancel)
+{
+	RecordedJob_t BlockingJob = {CreateEvent(NULL, TRUE, FALSE, NULL),
+		CreateEvent(NULL, TRUE, FALSE, NULL), FALSE, FALSE};
+	RecordedJob_t CancelledJob = {NULL, NULL, FALSE, FALSE};
+
+	{
+		CThreadPool ThreadPool(1);
+
+		EXPECT_EQ(TRUE, ThreadPool.QueueJob(RecordJob, &BlockingJob,
+			THREAD_POOL_PRIORITY_NORMAL, NULL));
+		WaitForSingleObject(BlockingJob.hStartedEvent, INFINITE);
+
+		CCancellationToken *pToken = new CCancellationToken();
+		EXPECT_EQ(TRUE, ThreadPool.QueueJob(RecordJob, &CancelledJob,
+			THREAD_POOL_PRIORITY_NORMAL, NULL, pToken));
+		pToken->Cancel();
+		pToken->Release();
+
+		SetEvent(BlockingJob.hStartEvent);
+	}
+
+	EXPECT_EQ(TRUE, BlockingJob.bCalled);
+	EXPECT_EQ(FALSE, BlockingJob.bCancelled);
+
+	/* The job is still called, so that
+	it can clean up. */
+	EXPECT_EQ(TRUE, CancelledJob.bCalled);
+	EXPECT_EQ(TRUE, CancelledJob.bCancelled);
+
+	CloseHandle(BlockingJob.hStartedEvent);
+	CloseHandle(BlockingJob.hStartEvent);
+}
+
+/* Jobs that haven't started when the pool is
+destroyed are cancelled, but still called. */
+TEST(ThreadPoolTest, Shutdown)
+{
+	const int NUM_JOBS = 10;
+
+	RecordedJob_t RecordedJobs[NUM_JOBS];
+
+	for(int i = 0; i < NUM_JOBS; i++)
+	{
+		RecordedJobs[i].hStartedEvent = NULL;
+		RecordedJobs[i].hStartEvent = NULL;
+		RecordedJobs[i].bCalled = FALSE;
+		RecordedJobs[i].bCancelled = FALSE;
+	}
+
+	{
+		CThreadPool ThreadPool(1);
+
+		for(int i = 0; i < NUM_JOBS; i++)
+		{
+			ThreadPool.QueueJob(RecordJob, &RecordedJobs[i],
+				THREAD_POOL_PRIORITY_LOW, NULL);
+		}
+	}
+
+	for(int i = 0; i < NUM_JOBS; i++)
+	{
+		EXPECT_EQ(TRUE, RecordedJobs[i].bCalled);
+	}
+}
+
+TEST(ThreadPoolTest, JobDeviceLimit)
+{
+	TCHAR szResourceDirectory[MAX_PATH];
+	GetTestResourceDirectory(szResourceDirectory, SIZEOF_ARRAY(szResourceDirectory));
+
+	DeviceLimitJob_t LimitJob;
+	LimitJob.hFinishedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	LimitJob.nLimit = -1;
+
+	{
+		CThreadPool ThreadPool(1);
+		SetAllDeviceClassLimits(ThreadPool, 3, 0);
+
+		EXPECT_EQ(TRUE, ThreadPool.QueueJob(DeviceLimitJob, &LimitJob,
+			THREAD_POOL_PRIORITY_NORMAL, szResourceDirectory));
+		EXPECT_EQ(WAIT_OBJECT_0, WaitForSingleObject(LimitJob.hFinishedEvent, 30000));
+	}
+
+	EXPECT_EQ(3, LimitJob.nLimit);
+
+	/* Outside of a job, there's no limit. */
+	EXPECT_EQ(0, CThreadPool::GetJobDeviceLimit());
+
+	CloseHandle(LimitJob.hFinishedEvent);
+}
+
+/* Every item should be done exactly once,
+whether by the caller or by the pool. */
+TEST(ThreadPoolTest, RunInParallel)
+{
+	const int NUM_ITEMS = 1000;
+
+	volatile LONG Counts[NUM_ITEMS];
+
+	for(int i = 0; i < NUM_ITEMS; i++)
+	{
+		Counts[i] = 0;
+	}
+
+	RunInParallel(CountItem, const_cast<LONG *>(Counts), NUM_ITEMS, 4, THREAD_POOL_PRIORITY_HIGH);
+
+	for(int i = 0; i < NUM_ITEMS; i++)
+	{
+		EXPECT_EQ(1, Counts[i]);
+	}
+}
+
+TEST(ThreadPoolTest, JobContext)
+{
+	TCHAR szResourceDirectory[MAX_PATH];
+	GetTestResourceDirectory(szResourceDirectory, SIZEOF_ARRAY(szResourceDirectory));
+
+	HelperThread_t HelperThread;
+	HelperThread.pJobContext = NULL;
+	HelperThread.ulBytes = 1000;
+
+	CThreadPool ThreadPool(1);
+
+	HANDLE hFinishedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	RecordedJob_t FinishedJob = {hFinishedEvent, NULL, FALSE, FALSE};
+
+	EXPECT_EQ(TRUE, ThreadPool.QueueJob(HelperThreadJob, &HelperThread,
+		THREAD_POOL_PRIORITY_NORMAL, szResourceDirectory));
+	EXPECT_EQ(TRUE, ThreadPool.QueueJob(RecordJob, &FinishedJob,
+		THREAD_POOL_PRIORITY_NORMAL, NULL));
+	EXPECT_EQ(WAIT_OBJECT_0, WaitForSingleObject(hFinishedEvent, 30000));
+
+	DeviceStats_t DeviceStats;
+	ASSERT_EQ(TRUE, FindDeviceStats(ThreadPool,
+		CThreadPool::GetDeviceName(szResourceDirectory), DeviceStats));
+	EXPECT_EQ(2 * HelperThread.ulBytes, DeviceStats.ulBytes);
+
+	CloseHandle(hFinishedEvent);
+}
\ No newline at end of file
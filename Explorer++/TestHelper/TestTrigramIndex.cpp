@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "../Helper/TrigramIndex.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	std::vector<int> GetCandidates(const CTrigramIndex &TrigramIndex, const TCHAR *szSubstring)
+	{
+		std::vector<int> Items;
+		EXPECT_TRUE(TrigramIndex.GetCandidates(szSubstring, Items));
+		return Items;
+	}
+}
+
+TEST(TrigramIndexTest, Candidates)
+{
+	CTrigramIndex TrigramIndex;
+	TrigramIndex.AddName(0, L"readme.txt");
+	TrigramIndex.AddName(1, L"thread.cpp");
+	TrigramIndex.AddName(2, L"main.cpp");
+
+	EXPECT_EQ(std::vector<int>({0, 1}), GetCandidates(TrigramIndex, L"read"));
+	EXPECT_EQ(std::vector<int>({1, 2}), GetCandidates(TrigramIndex, L".cpp"));
+	EXPECT_EQ(std::vector<int>({2}), GetCandidates(TrigramIndex, L"main"));
+	EXPECT_TRUE(GetCandidates(TrigramIndex, L"missing").empty());
+}
+
+TEST(TrigramIndexTest, CaseIgnored)
+{
+	CTrigramIndex TrigramIndex;
+	TrigramIndex.AddName(0, L"ReadMe.TXT");
+
+	EXPECT_EQ(std::vector<int>({0}), GetCandidates(TrigramIndex, L"readme"));
+	EXPECT_EQ(std::vector<int>({0}), GetCandidates(TrigramIndex, L"ME.txt"));
+}
+
+TEST(TrigramIndexTest, ShortSubstring)
+{
+	CTrigramIndex TrigramIndex;
+	TrigramIndex.AddName(0, L"ab");
+	TrigramIndex.AddName(1, L"abc");
+
+	std::vector<int> Items;
+	EXPECT_FALSE(TrigramIndex.GetCandidates(L"ab", Items));
+	EXPECT_EQ(1, TrigramIndex.GetTrigramCount());
+}
+
+TEST(TrigramIndexTest, Remove)
+{
+	CTrigramIndex TrigramIndex;
+	TrigramIndex.AddName(0, L"file1.txt");
+	TrigramIndex.AddName(1, L"file2.txt");
+
+	TrigramIndex.RemoveName(0, L"file1.txt");
+	EXPECT_EQ(std::vector<int>({1}), GetCandidates(TrigramIndex, L"file"));
+	EXPECT_TRUE(GetCandidates(TrigramIndex, L"file1").empty());
+
+	/* Adding an item back after it's been removed. */
+	TrigramIndex.AddName(0, L"file1.txt");
+	EXPECT_EQ(std::vector<int>({0, 1}), GetCandidates(TrigramIndex, L"file"));
+
+	TrigramIndex.RemoveName(0, L"file1.txt");
+	TrigramIndex.RemoveName(1, L"file2.txt");
+	EXPECT_EQ(0, TrigramIndex.GetTrigramCount());
+}
+
+TEST(TrigramIndexTest, AddedOutOfOrder)
+{
+	CTrigramIndex TrigramIndex;
+
+	/* Large gaps between items need more than
+	one byte to encode. */
+	for(int i = 0; i < 100; i++)
+	{
+		TrigramIndex.AddName(i * 1000, L"name");
+	}
+
+	for(int i = 0; i < 100; i++)
+	{
+		TrigramIndex.AddName(i * 1000 + 1, L"name");
+	}
+
+	std::vector<int> Expected;
+
+	for(int i = 0; i < 100; i++)
+	{
+		Expected.push_back(i * 1000);
+		Expected.push_back(i * 1000 + 1);
+	}
+
+	EXPECT_EQ(Expected, GetCandidates(TrigramIndex, L"name"));
+}
+
+TEST(TrigramIndexTest, RemapItems)
+{
+	CTrigramIndex TrigramIndex;
+	TrigramIndex.AddName(0, L"alpha");
+	TrigramIndex.AddName(1, L"beta");
+	TrigramIndex.AddName(2, L"alphabet");
+
+	std::vector<int> NewItems;
+	NewItems.push_back(-1);
+	NewItems.push_back(0);
+	NewItems.push_back(1);
+	TrigramIndex.RemapItems(NewItems);
+
+	EXPECT_EQ(std::vector<int>({1}), GetCandidates(TrigramIndex, L"alpha"));
+	EXPECT_EQ(std::vector<int>({0, 1}), GetCandidates(TrigramIndex, L"bet"));
+}
+
+/* Compares the candidates against a plain
+substring search over the same names. */
+TEST(TrigramIndexTest, MatchesSubstringSearch)
+{
+	const TCHAR *NAMES[] = {L"abc", L"abcd", L"bcda", L"cdab", L"dabc", L"aaaa", L"abab"};
+	const TCHAR *SUBSTRINGS[] = {L"abc", L"bcd", L"aaa", L"bab", L"dab", L"abcd"};
+
+	CTrigramIndex TrigramIndex;
+	std::vector<std::wstring> Names;
+
+	/* Items are added, removed and renamed in a fixed
+	but scattered order, so that the pending changes
+	to each list are exercised. */
+	for(int i = 0; i < 500; i++)
+	{
+		int iItem = (i * 37) % 250;
+		std::wstring strName = NAMES[(i * 7) % SIZEOF_ARRAY(NAMES)];
+
+		if(static_cast<size_t>(iItem) >= Names.size())
+		{
+			Names.resize(iItem + 1);
+		}
+
+		if(!Names[iItem].empty())
+		{
+			TrigramIndex.RemoveName(iItem, Names[iItem].c_str());
+		}
+
+		if(i % 5 == 0)
+		{
+			Names[iItem].clear();
+		}
+		else
+		{
+			TrigramIndex.AddName(iItem, strName.c_str());
+			Names[iItem] = strName;
+		}
+	}
+
+	for(size_t i = 0; i < SIZEOF_ARRAY(SUBSTRINGS); i++)
+	{
+		std::vector<int> Expected;
+
+		for(size_t j = 0; j < Names.size(); j++)
+		{
+			if(!Names[j].empty() && Names[j].find(SUBSTRINGS[i]) != std::wstring::npos)
+			{
+				Expected.push_back(static_cast<int>(j));
+			}
+		}
+
+		EXPECT_EQ(Expected, GetCandidates(TrigramIndex, SUBSTRINGS[i])) << SUBSTRINGS[i];
+	}
+}
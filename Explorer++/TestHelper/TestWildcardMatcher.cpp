@@ -0,0 +1,174 @@
+﻿#include "stdafx.h"
+#include "../Helper/WildcardMatcher.h"
+#include "../Helper/StringHelper.h"
+#include "../Helper/Macros.h"
+
+namespace
+{
+	/* Generates every string of length 0 to uMaxLength
+	made up of characters from szAlphabet. */
+	void GenerateStrings(const TCHAR *szAlphabet, size_t uMaxLength, std::vector<std::wstring> &Strings)
+	{
+		std::vector<std::wstring> Current(1, std::wstring());
+
+		for(size_t i = 0; i <= uMaxLength; i++)
+		{
+			Strings.insert(Strings.end(), Current.begin(), Current.end());
+
+			std::vector<std::wstring> Next;
+
+			for(auto itr = Current.begin(); itr != Current.end(); itr++)
+			{
+				for(const TCHAR *p = szAlphabet; *p != '\0'; p++)
+				{
+					Next.push_back(*itr + *p);
+				}
+			}
+
+			Current.swap(Next);
+		}
+	}
+
+	void TestEquivalence(const std::wstring &strPattern, const std::vector<std::wstring> &Strings, BOOL bCaseSensitive)
+	{
+		CWildcardMatcher WildcardMatcher(strPattern.c_str(), bCaseSensitive);
+
+		for(auto itr = Strings.begin(); itr != Strings.end(); itr++)
+		{
+			EXPECT_EQ(CheckWildcardMatch(strPattern.c_str(), itr->c_str(), bCaseSensitive),
+				WildcardMatcher.Match(itr->c_str())) << L"Pattern: \"" << strPattern << L"\", string: \"" << *itr << L"\"";
+		}
+	}
+}
+
+TEST(CWildcardMatcher, SimpleMatches)
+{
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("*.txt"), TRUE).Match(_T("Test.txt")));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("?.txt"), TRUE).Match(_T("1.txt")));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("?ab*cd.tx?"), TRUE).Match(_T("1abefghcd.txt")));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("Test?1*txt"), TRUE).Match(_T("Test11test.txt")));
+	EXPECT_EQ(FALSE, CWildcardMatcher(_T("*.txt"), TRUE).Match(_T("Test.txt.bak")));
+}
+
+TEST(CWildcardMatcher, MultiplePatterns)
+{
+	CWildcardMatcher WildcardMatcher(_T("*.h: *.cpp :Makefile: Read*"), FALSE);
+
+	EXPECT_EQ(TRUE, WildcardMatcher.Match(_T("Main.CPP")));
+	EXPECT_EQ(TRUE, WildcardMatcher.Match(_T("stdafx.h")));
+	EXPECT_EQ(TRUE, WildcardMatcher.Match(_T("makefile")));
+	EXPECT_EQ(TRUE, WildcardMatcher.Match(_T("Readme.txt")));
+	EXPECT_EQ(FALSE, WildcardMatcher.Match(_T("Main.c")));
+	EXPECT_EQ(FALSE, WildcardMatcher.Match(_T("Makefile.am")));
+}
+
+TEST(CWildcardMatcher, UnicodeMatches)
+{
+	#pragma warning(push)
+	#pragma warning(disable:4566)
+
+	EXPECT_EQ(TRUE, CWildcardMatcher(L"привет", FALSE).Match(L"Привет"));
+	EXPECT_EQ(TRUE, CWildcardMatcher(L"*.тест", FALSE).Match(L"Файл.ТЕСТ"));
+	EXPECT_EQ(FALSE, CWildcardMatcher(L"тестовую строку 2", TRUE).Match(L"ТЕСТОВУЮ СТРОКУ 2"));
+	EXPECT_EQ(TRUE, CWildcardMatcher(L"Тест?1*txt", TRUE).Match(L"Тест11Тест.txt"));
+
+	#pragma warning(pop)
+}
+
+/* The following tests check that CWildcardMatcher gives
+exactly the same results as CheckWildcardMatch, for every
+pattern and string that can be built from a small alphabet. */
+TEST(CWildcardMatcher, EquivalenceCaseSensitive)
+{
+	std::vector<std::wstring> Patterns;
+	GenerateStrings(_T("ab.*?"), 4, Patterns);
+
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("ab."), 5, Strings);
+
+	for(auto itr = Patterns.begin(); itr != Patterns.end(); itr++)
+	{
+		TestEquivalence(*itr, Strings, TRUE);
+	}
+}
+
+TEST(CWildcardMatcher, EquivalenceCaseInsensitive)
+{
+	std::vector<std::wstring> Patterns;
+	GenerateStrings(_T("aB.*?"), 4, Patterns);
+
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("Ab."), 4, Strings);
+
+	for(auto itr = Patterns.begin(); itr != Patterns.end(); itr++)
+	{
+		TestEquivalence(*itr, Strings, FALSE);
+	}
+}
+
+TEST(CWildcardMatcher, EquivalenceMultiplePatterns)
+{
+	/* Includes empty patterns, patterns that are empty
+	once trimmed and patterns with surrounding whitespace. */
+	std::vector<std::wstring> Patterns;
+	GenerateStrings(_T("a.*: "), 4, Patterns);
+
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("ab. "), 4, Strings);
+
+	for(auto itr = Patterns.begin(); itr != Patterns.end(); itr++)
+	{
+		TestEquivalence(*itr, Strings, TRUE);
+	}
+}
+
+TEST(CWildcardMatcher, IsSubsetOf)
+{
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("*abc*"), TRUE).IsSubsetOf(CWildcardMatcher(_T("*ab*"), TRUE)));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("abc*"), TRUE).IsSubsetOf(CWildcardMatcher(_T("ab*"), TRUE)));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("*.txt"), TRUE).IsSubsetOf(CWildcardMatcher(_T("*.txt:*.h"), TRUE)));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("A*"), TRUE).IsSubsetOf(CWildcardMatcher(_T("a*"), FALSE)));
+	EXPECT_EQ(TRUE, CWildcardMatcher(_T("a?c"), TRUE).IsSubsetOf(CWildcardMatcher(_T("a*"), TRUE)));
+
+	/* Appending to a pattern that doesn't end in a
+	wildcard doesn't narrow it. */
+	EXPECT_EQ(FALSE, CWildcardMatcher(_T("*.tx"), TRUE).IsSubsetOf(CWildcardMatcher(_T("*.t"), TRUE)));
+	EXPECT_EQ(FALSE, CWildcardMatcher(_T("a*"), FALSE).IsSubsetOf(CWildcardMatcher(_T("a*"), TRUE)));
+	EXPECT_EQ(FALSE, CWildcardMatcher(_T("a*c"), TRUE).IsSubsetOf(CWildcardMatcher(_T("a?c"), TRUE)));
+}
+
+/* Whenever one matcher is reported to be a subset of another,
+checks that every string accepted by the first is also accepted
+by the second. */
+TEST(CWildcardMatcher, IsSubsetOfSound)
+{
+	std::vector<std::wstring> Patterns;
+	GenerateStrings(_T("ab*?"), 3, Patterns);
+
+	std::vector<std::wstring> Strings;
+	GenerateStrings(_T("ab"), 5, Strings);
+
+	for(auto itr = Patterns.begin(); itr != Patterns.end(); itr++)
+	{
+		CWildcardMatcher WildcardMatcher(itr->c_str(), TRUE);
+
+		for(auto itrOther = Patterns.begin(); itrOther != Patterns.end(); itrOther++)
+		{
+			CWildcardMatcher OtherWildcardMatcher(itrOther->c_str(), TRUE);
+
+			if(!WildcardMatcher.IsSubsetOf(OtherWildcardMatcher))
+			{
+				continue;
+			}
+
+			for(auto itrString = Strings.begin(); itrString != Strings.end(); itrString++)
+			{
+				if(WildcardMatcher.Match(itrString->c_str()))
+				{
+					EXPECT_EQ(TRUE, OtherWildcardMatcher.Match(itrString->c_str())) << L"Pattern: \"" << *itr
+						<< L"\", other pattern: \"" << *itrOther << L"\", string: \"" << *itrString << L"\"";
+				}
+			}
+		}
+	}
+}